@@ -0,0 +1,55 @@
+#ifndef BOUNDS_H
+#define BOUNDS_H
+
+#include <glm/glm.hpp>
+
+#include <cfloat>
+
+// axis aligned bounding box, empty while min > max
+struct AABB {
+    glm::vec3 min = glm::vec3(FLT_MAX);
+    glm::vec3 max = glm::vec3(-FLT_MAX);
+
+    bool empty() const { return min.x > max.x; }
+    glm::vec3 center() const { return (min + max) * 0.5f; }
+    glm::vec3 extent() const { return (max - min) * 0.5f; }
+
+    void grow(const glm::vec3 &point)
+    {
+        min = glm::min(min, point);
+        max = glm::max(max, point);
+    }
+
+    void grow(const AABB &other)
+    {
+        if (other.empty())
+            return;
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    float area() const
+    {
+        if (empty())
+            return 0.0f;
+        glm::vec3 d = max - min;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    // box that encloses this box after the transformation, using the absolute matrix trick (Arvo)
+    AABB transformed(const glm::mat4 &m) const
+    {
+        AABB result;
+        if (empty())
+            return result;
+        glm::vec3 c = glm::vec3(m * glm::vec4(center(), 1.0f));
+        glm::vec3 e = extent();
+        glm::vec3 r;
+        for (int i = 0; i < 3; i++)
+            r[i] = glm::abs(m[0][i]) * e.x + glm::abs(m[1][i]) * e.y + glm::abs(m[2][i]) * e.z;
+        result.min = c - r;
+        result.max = c + r;
+        return result;
+    }
+};
+#endif
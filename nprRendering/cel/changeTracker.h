@@ -0,0 +1,82 @@
+#ifndef CHANGETRACKER_H
+#define CHANGETRACKER_H
+
+#include <cstring>
+#include <vector>
+
+// Finds out which passes of a frame have to run again. Every watched value (a config field, the camera position, a
+// light) keeps a copy of its bytes and the passes that read it, poll compares them all and returns the passes of the
+// values that changed together with the invalidated ones, the caller adds the passes that read their outputs. A change
+// keeps its passes dirty for settleFrames more polls, for results that lag behind their inputs (occlusion culling
+// against an old depth, the gui reacting to a click).
+//
+// usage:
+//   tracker.watch(config.strokeSize, PASS_EDGE);                // once, the value must outlive the tracker
+//   tracker.invalidate(PASS_SCREEN);                            // for changes that aren't watched, a resize or an event
+//   unsigned int dirty = tracker.poll();                        // once per loop iteration, 0 means nothing to draw
+class ChangeTracker {
+public:
+    int settleFrames = 1; // raised by the caller while a result lags more frames
+
+    // statistics
+    int drawnFrames = 0;   // polls that returned some pass
+    int skippedFrames = 0; // polls that returned none
+
+    template <typename T>
+    void watch(const T& value, unsigned int passes)
+    {
+        Watch entry;
+        entry.value = reinterpret_cast<const unsigned char*>(&value);
+        entry.size = sizeof(T);
+        entry.passes = passes;
+        entry.copy.assign(entry.value, entry.value + entry.size);
+        watches.push_back(entry);
+        // nothing was drawn with it yet
+        invalidate(passes);
+    }
+
+    // dirties the passes for the next frames polls
+    void invalidate(unsigned int passes, int frames = 1)
+    {
+        for (int i = 0; i < frames; i++) {
+            if (i == (int) pending.size())
+                pending.push_back(0);
+            pending[i] |= passes;
+        }
+    }
+
+    unsigned int poll()
+    {
+        unsigned int changed = 0;
+        for (Watch& entry : watches) {
+            if (std::memcmp(entry.value, &entry.copy[0], entry.size) != 0) {
+                std::memcpy(&entry.copy[0], entry.value, entry.size);
+                changed |= entry.passes;
+            }
+        }
+        invalidate(changed, 1 + settleFrames);
+
+        unsigned int dirty = 0;
+        if (!pending.empty()) {
+            dirty = pending.front();
+            pending.erase(pending.begin());
+        }
+        if (dirty != 0)
+            drawnFrames++;
+        else
+            skippedFrames++;
+        return dirty;
+    }
+
+private:
+    struct Watch {
+        const unsigned char* value;
+        size_t size;
+        unsigned int passes;
+        std::vector<unsigned char> copy;
+    };
+
+    std::vector<Watch> watches;
+    std::vector<unsigned int> pending; // invalidated passes of the next polls, the current one first
+};
+#endif
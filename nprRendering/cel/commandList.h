@@ -0,0 +1,246 @@
+#ifndef COMMANDLIST_H
+#define COMMANDLIST_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <shader.h>
+#include <model.h>
+#include <materialAtlas.h>
+#include <streamRing.h>
+#include <weightedOIT.h>
+
+#include <vector>
+#include <map>
+#include <memory>
+#include <cstddef>
+#include <new>
+#include <algorithm>
+
+// Bump allocator over fixed blocks, reset once per frame. Every worker owns one so recording never locks.
+class LinearAllocator {
+public:
+    explicit LinearAllocator(size_t blockSize = 64 * 1024) : blockSize(blockSize) {}
+
+    void *allocate(size_t size, size_t alignment = 16)
+    {
+        size_t start = (offset + alignment - 1) & ~(alignment - 1);
+        if (blocks.empty() || start + size > blockSize) {
+            // next block, the old ones are kept and reused after reset()
+            current = blocks.empty() ? 0 : current + 1;
+            if (current == blocks.size())
+                blocks.push_back(std::unique_ptr<char[]>(new char[std::max(size, blockSize)]));
+            start = 0;
+        }
+        offset = start + size;
+        used += size;
+        return blocks[current].get() + start;
+    }
+
+    void reset()
+    {
+        current = 0;
+        offset = 0;
+        used = 0;
+    }
+
+    size_t bytesUsed() const { return used; }
+
+private:
+    std::vector<std::unique_ptr<char[]> > blocks;
+    size_t blockSize;
+    size_t current = 0, offset = 0, used = 0;
+};
+
+// fixed function state that commands can toggle, mapped to GL by the replay
+enum RenderState {
+    STATE_BLEND = 0,
+    STATE_DEPTH_TEST,
+    STATE_DEPTH_WRITE,
+    STATE_OIT // draws into the weighted blended transparency targets instead of blending
+};
+
+enum CommandType {
+    CMD_USE_SHADER = 0,
+    CMD_SET_INT,
+    CMD_SET_FLOAT,
+    CMD_SET_VEC2,
+    CMD_SET_VEC3,
+    CMD_SET_MAT4,
+    CMD_SET_STATE,
+    CMD_DRAW_MESH
+};
+
+// every command starts with this header, the commands of a list are chained through next
+struct CommandHeader {
+    CommandType type;
+    CommandHeader *next;
+};
+
+struct CmdUseShader { CommandHeader header; Shader *shader; };
+struct CmdSetInt { CommandHeader header; const char *name; int value; };
+struct CmdSetFloat { CommandHeader header; const char *name; float value; };
+struct CmdSetVec2 { CommandHeader header; const char *name; glm::vec2 value; };
+struct CmdSetVec3 { CommandHeader header; const char *name; glm::vec3 value; };
+struct CmdSetMat4 { CommandHeader header; const char *name; glm::mat4 value; };
+struct CmdSetState { CommandHeader header; RenderState state; bool enabled; };
+// draws one mesh of a model with its DrawData block, useAtlas selects the texture array materials
+struct CmdDrawMesh {
+    CommandHeader header;
+    Model *model;
+    unsigned int mesh;
+    bool useAtlas;
+    glm::mat4 world;
+    glm::mat4 worldInvT;
+};
+
+// Backend neutral list of render commands. Recording only writes into the allocator, so lists can be filled on
+// worker threads, the GL calls happen when the list is replayed on the GL thread.
+// Uniform names must outlive the list, string literals are the intended use.
+class CommandList {
+public:
+    // starts a new recording, the previous commands are dropped (their memory is owned by the old allocator)
+    void begin(LinearAllocator *allocator)
+    {
+        this->allocator = allocator;
+        first = last = nullptr;
+        count = 0;
+    }
+
+    void useShader(Shader *shader) { push<CmdUseShader>(CMD_USE_SHADER)->shader = shader; }
+    void setBool(const char *name, bool value) { setInt(name, (int) value); }
+    void setInt(const char *name, int value) { CmdSetInt *cmd = push<CmdSetInt>(CMD_SET_INT); cmd->name = name; cmd->value = value; }
+    void setFloat(const char *name, float value) { CmdSetFloat *cmd = push<CmdSetFloat>(CMD_SET_FLOAT); cmd->name = name; cmd->value = value; }
+    void setVec2(const char *name, const glm::vec2 &value) { CmdSetVec2 *cmd = push<CmdSetVec2>(CMD_SET_VEC2); cmd->name = name; cmd->value = value; }
+    void setVec3(const char *name, const glm::vec3 &value) { CmdSetVec3 *cmd = push<CmdSetVec3>(CMD_SET_VEC3); cmd->name = name; cmd->value = value; }
+    void setMat4(const char *name, const glm::mat4 &value) { CmdSetMat4 *cmd = push<CmdSetMat4>(CMD_SET_MAT4); cmd->name = name; cmd->value = value; }
+    void setState(RenderState state, bool enabled) { CmdSetState *cmd = push<CmdSetState>(CMD_SET_STATE); cmd->state = state; cmd->enabled = enabled; }
+
+    void drawMesh(Model *model, unsigned int mesh, const glm::mat4 &world, const glm::mat4 &worldInvT, bool useAtlas)
+    {
+        CmdDrawMesh *cmd = push<CmdDrawMesh>(CMD_DRAW_MESH);
+        cmd->model = model;
+        cmd->mesh = mesh;
+        cmd->useAtlas = useAtlas;
+        cmd->world = world;
+        cmd->worldInvT = worldInvT;
+    }
+
+    const CommandHeader *commands() const { return first; }
+    int size() const { return count; }
+
+private:
+    LinearAllocator *allocator = nullptr;
+    CommandHeader *first = nullptr, *last = nullptr;
+    int count = 0;
+
+    template<class T>
+    T *push(CommandType type)
+    {
+        T *cmd = new (allocator->allocate(sizeof(T), alignof(T))) T();
+        cmd->header.type = type;
+        cmd->header.next = nullptr;
+        if (last)
+            last->next = &cmd->header;
+        else
+            first = &cmd->header;
+        last = &cmd->header;
+        count++;
+        return cmd;
+    }
+};
+
+// Executes command lists with OpenGL on the thread that owns the context.
+// Uniform locations are cached per program and name, names are expected to be string literals.
+class CommandReplay {
+public:
+    MaterialAtlas *atlas = nullptr; // needed by the draws that use the texture arrays
+    StreamRing *ring = nullptr;     // streams the transforms of the draws
+    WeightedOIT *oit = nullptr;     // needed by STATE_OIT
+    glm::mat4 viewProjection = glm::mat4(1.0f); // of the frame being replayed, for the per draw matrices
+
+    // statistics since the last resetStats()
+    int replayedCommands = 0;
+
+    void resetStats() { replayedCommands = 0; }
+
+    void replay(const CommandList &list)
+    {
+        for (const CommandHeader *cmd = list.commands(); cmd != nullptr; cmd = cmd->next) {
+            switch (cmd->type) {
+                case CMD_USE_SHADER:
+                    shader = ((const CmdUseShader *) cmd)->shader;
+                    shader->use();
+                    break;
+                case CMD_SET_INT: {
+                    const CmdSetInt *c = (const CmdSetInt *) cmd;
+                    glUniform1i(location(c->name), c->value);
+                    break;
+                }
+                case CMD_SET_FLOAT: {
+                    const CmdSetFloat *c = (const CmdSetFloat *) cmd;
+                    glUniform1f(location(c->name), c->value);
+                    break;
+                }
+                case CMD_SET_VEC2: {
+                    const CmdSetVec2 *c = (const CmdSetVec2 *) cmd;
+                    glUniform2fv(location(c->name), 1, &c->value[0]);
+                    break;
+                }
+                case CMD_SET_VEC3: {
+                    const CmdSetVec3 *c = (const CmdSetVec3 *) cmd;
+                    glUniform3fv(location(c->name), 1, &c->value[0]);
+                    break;
+                }
+                case CMD_SET_MAT4: {
+                    const CmdSetMat4 *c = (const CmdSetMat4 *) cmd;
+                    glUniformMatrix4fv(location(c->name), 1, GL_FALSE, &c->value[0][0]);
+                    break;
+                }
+                case CMD_SET_STATE: {
+                    const CmdSetState *c = (const CmdSetState *) cmd;
+                    if (c->state == STATE_DEPTH_WRITE)
+                        glDepthMask(c->enabled ? GL_TRUE : GL_FALSE);
+                    else if (c->state == STATE_OIT) {
+                        if (c->enabled)
+                            oit->begin();
+                        else
+                            oit->end();
+                    }
+                    else if (c->enabled)
+                        glEnable(c->state == STATE_BLEND ? GL_BLEND : GL_DEPTH_TEST);
+                    else
+                        glDisable(c->state == STATE_BLEND ? GL_BLEND : GL_DEPTH_TEST);
+                    break;
+                }
+                case CMD_DRAW_MESH: {
+                    const CmdDrawMesh *c = (const CmdDrawMesh *) cmd;
+                    DrawData data = {c->world, c->worldInvT, viewProjection * c->world};
+                    ring->bindUniform(STREAM_DRAW_BINDING, &data, sizeof(data));
+                    if (c->useAtlas && atlas != nullptr)
+                        c->model->DrawMesh(c->mesh, *shader, *atlas);
+                    else
+                        c->model->DrawMesh(c->mesh, *shader);
+                    break;
+                }
+            }
+            replayedCommands++;
+        }
+    }
+
+private:
+    Shader *shader = nullptr;
+    std::map<std::pair<unsigned int, const char *>, GLint> locations;
+
+    GLint location(const char *name)
+    {
+        std::pair<unsigned int, const char *> key(shader->ID, name);
+        auto it = locations.find(key);
+        if (it != locations.end())
+            return it->second;
+        GLint result = glGetUniformLocation(shader->ID, name);
+        locations[key] = result;
+        return result;
+    }
+};
+#endif
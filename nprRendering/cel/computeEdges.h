@@ -0,0 +1,89 @@
+#ifndef COMPUTEEDGES_H
+#define COMPUTEEDGES_H
+
+#include <glad/glad.h>
+
+#include <computeShader.h>
+
+#include <algorithm>
+#include <iostream>
+#include <map>
+#include <string>
+
+// The edge stage of the post chain as a compute pass. The fragment version reads 9 taps per pixel from the texture,
+// further apart the larger the stroke size, so neighbouring pixels share few cache lines. Here a work group loads its
+// 16x16 tile and an apron of 6 texels into shared memory once and all taps read the shared copy. The output is
+// composited like the edge stage (the cel image minus the edges, or only the edges), the passes after it read it
+// as their input. Laplace or Sobel, on the colors or on the luminance only, every combination is a variant compiled
+// the first time it is used. Needs GL 4.3.
+//
+// usage:
+//   edges.sobel = true;
+//   edges.dispatch(celTexture, edgeTexture, width, height, strokeSize);  // edgeTexture is rgba8, the same size
+class ComputeEdges {
+public:
+    static const int TILE = 16;
+    // the apron of edgeDetect.comp covers taps this far away
+    static const int MAX_STROKE_SIZE = 5;
+
+    bool supported = false;
+    bool sobel = false;
+    bool luminance = false;
+    bool edgeOnly = false;
+
+    ComputeEdges()
+    {
+#ifdef GL_VERSION_4_3
+        supported = GLAD_GL_VERSION_4_3 != 0;
+#endif
+        if (!supported)
+            std::cout << "ERROR::COMPUTE EDGES:: needs an OpenGL 4.3 context, using the fragment edge pass" << std::endl;
+    }
+
+    ~ComputeEdges()
+    {
+#ifdef GL_VERSION_4_3
+        for (auto& variant : variants) {
+            glDeleteProgram(variant.second->ID);
+            delete variant.second;
+        }
+#endif
+    }
+
+    void dispatch(unsigned int source, unsigned int target, int width, int height, float strokeSize)
+    {
+#ifdef GL_VERSION_4_3
+        if (!supported)
+            return;
+        ComputeShader* shader = variant();
+        shader->use();
+        shader->setFloat("strokeSize", std::max(0.0f, std::min(strokeSize, (float) MAX_STROKE_SIZE)));
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, source);
+        glBindImageTexture(0, target, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+        glDispatchCompute((width + TILE - 1) / TILE, (height + TILE - 1) / TILE, 1);
+        // the next pass samples the edges
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+#endif
+    }
+
+private:
+#ifdef GL_VERSION_4_3
+    std::map<std::string, ComputeShader*> variants;
+
+    ComputeShader* variant()
+    {
+        // preprocessor ints, the shader picks the type of its shared cache with #if
+        std::string defines = std::string("#define EDGE_SOBEL ") + (sobel ? "1" : "0") + "\n"
+                            + "#define EDGE_LUMINANCE " + (luminance ? "1" : "0") + "\n"
+                            + "#define DO_EDGE_ONLY " + (edgeOnly ? "1" : "0") + "\n";
+        auto it = variants.find(defines);
+        if (it != variants.end())
+            return it->second;
+        ComputeShader* shader = new ComputeShader("shaders/edgeDetect.comp", defines);
+        variants[defines] = shader;
+        return shader;
+    }
+#endif
+};
+#endif
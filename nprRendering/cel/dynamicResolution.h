@@ -0,0 +1,58 @@
+#ifndef DYNAMICRESOLUTION_H
+#define DYNAMICRESOLUTION_H
+
+#include <algorithm>
+#include <cmath>
+
+// Scales the size the frame is rendered at so the gpu time of a frame stays within a budget. The time is averaged
+// over a few frames against the noise of single ones. Over the budget the scale drops at once by the square root of
+// the overshoot (the time follows the pixel count, the square of the scale), under budget * headroom it grows back
+// one step at a time, so it doesn't oscillate around the budget. The scale moves in steps to keep the sizes the
+// render graph pools few, and settleFrames frames are measured at a scale before it changes again, the gpu times
+// come in a few frames late.
+//
+// usage:
+//   if (resolution.update(framePacer->gpuTime))  // once per drawn frame
+//       renderScale = resolution.scale;
+//   int width = DynamicResolution::scaled(windowWidth, renderScale);
+class DynamicResolution {
+public:
+    float budget = 16.0f; // gpu ms per frame
+    float headroom = 0.85f;
+    float minScale = 0.5f, maxScale = 1.0f;
+    float step = 0.05f;
+    int settleFrames = 8;
+
+    float scale = 1.0f;
+    float averageTime = 0.0f; // ms, of the frames since the last change
+
+    // returns true when the scale changed
+    bool update(float gpuTime)
+    {
+        if (gpuTime <= 0.0f)
+            return false;
+        averageTime = frames == 0 ? gpuTime : averageTime * 0.8f + gpuTime * 0.2f;
+        if (++frames < settleFrames)
+            return false;
+        float next = scale;
+        if (averageTime > budget)
+            next = std::floor(scale * std::sqrt(budget / averageTime) / step) * step;
+        else if (averageTime < budget * headroom)
+            next = scale + step;
+        next = std::max(minScale, std::min(maxScale, next));
+        if (std::fabs(next - scale) < step * 0.5f)
+            return false;
+        scale = next;
+        frames = 0;
+        return true;
+    }
+
+    static int scaled(int size, float scale)
+    {
+        return std::max(1, (int) (size * scale + 0.5f));
+    }
+
+private:
+    int frames = 0;
+};
+#endif
@@ -0,0 +1,141 @@
+#ifndef FRAMEPACER_H
+#define FRAMEPACER_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <streamRing.h>
+
+#include <deque>
+#include <vector>
+
+// the cpu never runs further ahead than the stream ring has regions for, so the ring itself never has to wait
+const int FRAME_PACER_MAX_FRAMES = STREAM_RING_FRAMES;
+
+// Limits how many frames the gpu may be behind the cpu. Every frame ends with a fence, beginFrame waits on the oldest
+// ones until fewer than framesInFlight are pending, so whatever runs before it (input, culling, recording the
+// command lists) overlaps the gpu working on the previous frames.
+// The time blocked in the fence wait and in the swap is measured, together with the gpu time of every frame from a
+// timer query that is read once its fence passed, so reading it never stalls.
+//
+// usage:
+//   pacer.beginCpuWork();   // counts the cpu only work of the frame to cpuTime
+//   ... cpu only work of the next frame ...
+//   pacer.beginFrame();     // before the first GL call that writes per frame data
+//   ... draw ...
+//   pacer.endFrame(tag);    // tag, bits of the caller that come back as gpuTag with the gpu time of the frame
+//   pacer.swap(window);
+class FramePacer {
+public:
+    int framesInFlight = 2; // 1 to FRAME_PACER_MAX_FRAMES
+
+    // statistics, ms
+    float frameTime = 0.0f;     // begin to begin
+    float cpuTime = 0.0f;       // beginCpuWork to the end of the frame, without the waits
+    float gpuTime = 0.0f;       // of the last frame the gpu finished
+    unsigned int gpuTag = 0;    // the tag of that frame
+    int retiredFrames = 0;      // frames whose gpu time was read, a new gpuTime when it changes
+    float fenceWaitTime = 0.0f; // beginFrame blocked on the fence of an old frame
+    float swapTime = 0.0f;      // glfwSwapBuffers blocked
+
+    FramePacer()
+    {
+        glGenQueries(FRAME_PACER_MAX_FRAMES, queries);
+        for (int i = 0; i < FRAME_PACER_MAX_FRAMES; i++)
+            freeQueries.push_back(queries[i]);
+    }
+
+    ~FramePacer()
+    {
+        while (!pending.empty()) {
+            glDeleteSync(pending.front().fence);
+            pending.pop_front();
+        }
+        glDeleteQueries(FRAME_PACER_MAX_FRAMES, queries);
+    }
+
+    void beginFrame()
+    {
+        double start = glfwGetTime();
+        if (frameStart > 0.0)
+            frameTime = (float) (start - frameStart) * 1000.0f;
+        frameStart = start;
+        framesInFlight = framesInFlight < 1 ? 1 : (framesInFlight > FRAME_PACER_MAX_FRAMES ? FRAME_PACER_MAX_FRAMES : framesInFlight);
+        // the finished frames are retired for free, the ones over the limit are waited for
+        while (!pending.empty() && ((int) pending.size() >= framesInFlight || signaled(pending.front().fence)))
+            retire();
+        double waited = glfwGetTime();
+        fenceWaitTime = (float) (waited - start) * 1000.0f;
+        cpuStart = waited;
+        workTime = workStart > 0.0 ? start - workStart : 0.0;
+        workStart = 0.0;
+
+        query = freeQueries.back();
+        freeQueries.pop_back();
+        glBeginQuery(GL_TIME_ELAPSED, query);
+    }
+
+    // after the last draw of the frame, before the swap
+    void endFrame(unsigned int tag = 0)
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        PendingFrame frame = {glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), query, tag};
+        pending.push_back(frame);
+        cpuTime = (float) (glfwGetTime() - cpuStart + workTime) * 1000.0f;
+    }
+
+    // before the cpu work that runs ahead of beginFrame, culling and recording are part of the cpu time of the frame
+    void beginCpuWork() { workStart = glfwGetTime(); }
+
+    void swap(GLFWwindow *window)
+    {
+        double start = glfwGetTime();
+        glfwSwapBuffers(window);
+        swapTime = (float) (glfwGetTime() - start) * 1000.0f;
+    }
+
+    int pendingFrames() const { return (int) pending.size(); }
+
+    // the gpu took longer than the cpu, the cpu spends the difference blocked in the fence wait or the swap
+    bool gpuBound() const { return gpuTime > cpuTime; }
+
+private:
+    struct PendingFrame {
+        GLsync fence;
+        unsigned int query;
+        unsigned int tag;
+    };
+
+    unsigned int queries[FRAME_PACER_MAX_FRAMES];
+    std::vector<unsigned int> freeQueries;
+    std::deque<PendingFrame> pending;
+    unsigned int query = 0;
+    double frameStart = 0.0, cpuStart = 0.0;
+    double workStart = 0.0, workTime = 0.0;
+
+    static bool signaled(GLsync fence)
+    {
+        GLint status = GL_UNSIGNALED;
+        glGetSynciv(fence, GL_SYNC_STATUS, 1, NULL, &status);
+        return status == GL_SIGNALED;
+    }
+
+    // waits for the oldest frame and reads its gpu time
+    void retire()
+    {
+        PendingFrame frame = pending.front();
+        pending.pop_front();
+        GLenum result;
+        do
+            result = glClientWaitSync(frame.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+        while (result == GL_TIMEOUT_EXPIRED);
+        glDeleteSync(frame.fence);
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(frame.query, GL_QUERY_RESULT, &elapsed);
+        gpuTime = (float) elapsed / 1000000.0f;
+        gpuTag = frame.tag;
+        retiredFrames++;
+        freeQueries.push_back(frame.query);
+    }
+};
+#endif
@@ -0,0 +1,93 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <glm/glm.hpp>
+
+#include <bounds.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_SIMD 1
+#include <xmmintrin.h>
+#endif
+
+// result of a box test, INTERSECT means the children of a bvh node still need testing
+enum FrustumTest {
+    FRUSTUM_OUTSIDE = 0,
+    FRUSTUM_INTERSECT,
+    FRUSTUM_INSIDE
+};
+
+// the six clip planes of a view projection matrix, stored as structure of arrays so that four planes
+// are tested against a box with a handful of SSE instructions
+class Frustum {
+public:
+    // plane i is (nx[i], ny[i], nz[i], d[i]), the last two are padding planes that never reject anything
+    alignas(16) float nx[8], ny[8], nz[8], d[8];
+    // absolute values of the normals, used for the box projection radius
+    alignas(16) float ax[8], ay[8], az[8];
+
+    Frustum()
+    {
+        setPlanes(glm::mat4(1.0f));
+    }
+
+    explicit Frustum(const glm::mat4 &viewProjection)
+    {
+        setPlanes(viewProjection);
+    }
+
+    // Gribb-Hartmann plane extraction: left, right, bottom, top, near, far
+    void setPlanes(const glm::mat4 &m)
+    {
+        glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+        glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+        glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+        glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+        glm::vec4 planes[6] = {row3 + row0, row3 - row0, row3 + row1, row3 - row1, row3 + row2, row3 - row2};
+        for (int i = 0; i < 8; i++) {
+            glm::vec4 p = i < 6 ? planes[i] : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+            float length = glm::length(glm::vec3(p));
+            if (length > 0.0f)
+                p /= length;
+            nx[i] = p.x; ny[i] = p.y; nz[i] = p.z; d[i] = p.w;
+            ax[i] = glm::abs(p.x); ay[i] = glm::abs(p.y); az[i] = glm::abs(p.z);
+        }
+    }
+
+    // classifies a box against all planes using its center and half extent:
+    // outside if center distance + radius < 0 for any plane, inside if center distance - radius >= 0 for all
+    FrustumTest test(const AABB &box) const
+    {
+        glm::vec3 c = box.center();
+        glm::vec3 e = box.extent();
+#ifdef FRUSTUM_SIMD
+        __m128 cx = _mm_set1_ps(c.x), cy = _mm_set1_ps(c.y), cz = _mm_set1_ps(c.z);
+        __m128 ex = _mm_set1_ps(e.x), ey = _mm_set1_ps(e.y), ez = _mm_set1_ps(e.z);
+        __m128 zero = _mm_setzero_ps();
+        int outside = 0, intersect = 0;
+        for (int i = 0; i < 8; i += 4) {
+            __m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(nx + i), cx), _mm_mul_ps(_mm_load_ps(ny + i), cy)),
+                                     _mm_add_ps(_mm_mul_ps(_mm_load_ps(nz + i), cz), _mm_load_ps(d + i)));
+            __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_load_ps(ax + i), ex), _mm_mul_ps(_mm_load_ps(ay + i), ey)),
+                                       _mm_mul_ps(_mm_load_ps(az + i), ez));
+            outside |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(dist, radius), zero));
+            intersect |= _mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(dist, radius), zero));
+        }
+        if (outside)
+            return FRUSTUM_OUTSIDE;
+        return intersect ? FRUSTUM_INTERSECT : FRUSTUM_INSIDE;
+#else
+        bool intersect = false;
+        for (int i = 0; i < 6; i++) {
+            float dist = nx[i] * c.x + ny[i] * c.y + nz[i] * c.z + d[i];
+            float radius = ax[i] * e.x + ay[i] * e.y + az[i] * e.z;
+            if (dist + radius < 0.0f)
+                return FRUSTUM_OUTSIDE;
+            if (dist - radius < 0.0f)
+                intersect = true;
+        }
+        return intersect ? FRUSTUM_INTERSECT : FRUSTUM_INSIDE;
+#endif
+    }
+};
+#endif
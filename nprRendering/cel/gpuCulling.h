@@ -0,0 +1,415 @@
+#ifndef GPUCULLING_H
+#define GPUCULLING_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <shader.h>
+#include <computeShader.h>
+#include <model.h>
+#include <materialAtlas.h>
+#include <sceneGraph.h>
+#include <frustum.h>
+#include <hiZ.h>
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <algorithm>
+
+// target of the draw count buffer, core since 4.6 and the same value in ARB_indirect_parameters
+#if defined(GL_PARAMETER_BUFFER)
+#define CULL_PARAMETER_BUFFER GL_PARAMETER_BUFFER
+#elif defined(GL_PARAMETER_BUFFER_ARB)
+#define CULL_PARAMETER_BUFFER GL_PARAMETER_BUFFER_ARB
+#endif
+
+// layout of the records read by glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// std430 mirrors of the structs in cull.comp and celShaderIndirect.vert
+struct GpuInstance {
+    glm::mat4 model;
+    glm::mat4 modelInvT;
+    glm::vec4 boundsMin;
+    glm::vec4 boundsMax;
+    unsigned int mesh;      // pool mesh of lod 0
+    unsigned int lodCount;
+    unsigned int lodStride;
+    unsigned int bucket;
+    int material;
+    unsigned int pad[3];
+};
+
+struct GpuMesh {
+    unsigned int count;
+    unsigned int firstIndex;
+    int baseVertex;
+    unsigned int pad;
+};
+
+// buffer bindings shared with the shaders
+const unsigned int CULL_INSTANCES_BINDING = 1;
+const unsigned int CULL_MESHES_BINDING = 2;
+const unsigned int CULL_COMMANDS_BINDING = 3;
+const unsigned int CULL_COUNTS_BINDING = 4;
+const unsigned int CULL_BUCKETS_BINDING = 5;
+// vertex attribute with the instance id, the baseInstance of every command points it at its instance
+const unsigned int CULL_INSTANCE_ID_LOCATION = 5;
+
+// The geometry of every model in one vertex and index buffer, so any mesh can be drawn by an indirect command.
+// Coarser lods of a model must have the same meshes, lod l of mesh i is at first + l * meshCount + i.
+class MeshPool {
+public:
+    unsigned int VAO = 0;
+    std::vector<GpuMesh> meshes;
+    std::vector<int> materials;
+    std::map<const Model *, unsigned int> first;    // first pool mesh of a registered model
+    std::map<const Model *, unsigned int> lodCount;
+
+    ~MeshPool()
+    {
+        release();
+    }
+
+    bool contains(const Model *model) const { return first.count(model) > 0; }
+
+    void add(Model *model, const std::vector<Model *> &lods = std::vector<Model *>())
+    {
+        first[model] = (unsigned int) meshes.size();
+        lodCount[model] = 1 + (unsigned int) lods.size();
+        append(model);
+        for (unsigned int l = 0; l < lods.size(); l++) {
+            if (lods[l]->meshes.size() != model->meshes.size())
+                std::cout << "ERROR::MESH POOL:: lod " << l + 1 << " of " << model->directory << " has different meshes" << std::endl;
+            append(lods[l]);
+        }
+        dirty = true;
+    }
+
+    // uploads the geometry added since the last build, instanceIds is attached as the per instance id attribute
+    void build(unsigned int instanceIds)
+    {
+        if (!dirty)
+            return;
+        release();
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+
+        // same attributes as Mesh::setupMesh
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+        glEnableVertexAttribArray(4);
+        glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceIds);
+        glEnableVertexAttribArray(CULL_INSTANCE_ID_LOCATION);
+        glVertexAttribIPointer(CULL_INSTANCE_ID_LOCATION, 1, GL_UNSIGNED_INT, sizeof(unsigned int), (void*)0);
+        glVertexAttribDivisor(CULL_INSTANCE_ID_LOCATION, 1);
+        glBindVertexArray(0);
+        dirty = false;
+    }
+
+private:
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    unsigned int VBO = 0, EBO = 0;
+    bool dirty = false;
+
+    void append(Model *model)
+    {
+        for (unsigned int i = 0; i < model->meshes.size(); i++) {
+            const Mesh &mesh = model->meshes[i];
+            GpuMesh gpuMesh;
+            gpuMesh.count = (unsigned int) mesh.indices.size();
+            gpuMesh.firstIndex = (unsigned int) indices.size();
+            gpuMesh.baseVertex = (int) vertices.size();
+            gpuMesh.pad = 0;
+            meshes.push_back(gpuMesh);
+            materials.push_back(mesh.materialIndex);
+            vertices.insert(vertices.end(), mesh.vertices.begin(), mesh.vertices.end());
+            indices.insert(indices.end(), mesh.indices.begin(), mesh.indices.end());
+        }
+    }
+
+    void release()
+    {
+        if (!VAO)
+            return;
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        VAO = 0;
+    }
+};
+
+// GPU driven culling: the scene instances live in a storage buffer, a compute pass tests them against the frustum,
+// a max distance and the hi-z pyramid, and appends the visible ones as indirect commands with atomic counters.
+// The commands are grouped in buckets of instances whose materials share the atlas pages, one multi draw per bucket.
+// With GL 4.6 or ARB_indirect_parameters the commands are compacted and the draw count is read from the counters,
+// otherwise every instance keeps its command slot and the culled ones are issued with zero instances.
+//
+// usage:
+//   GpuCulling culling;
+//   if (culling.supported) {
+//       culling.upload(scene, atlas);                        // when the scene changed
+//       culling.cull(viewProjection, camera.Position, hiZ);  // per frame
+//       culling.draw(shader, atlas, false);                  // opaque, then transparent with true
+//   }
+class GpuCulling {
+public:
+    struct Bucket {
+        unsigned int first = 0; // first command, also the first instance of the bucket
+        unsigned int size = 0;
+        int material = -1;      // any material of the bucket, binds its pages
+        bool transparent = false;
+    };
+
+    MeshPool pool;
+    std::vector<Bucket> buckets;
+    unsigned int instanceCount = 0;
+    bool supported = false;     // compute shaders and multi draw indirect
+    bool compact = false;       // indirect count available
+    float maxDistance = 100.0f;
+    float lodDistance = 30.0f;
+
+    GpuCulling()
+    {
+#ifdef GL_VERSION_4_3
+        supported = GLAD_GL_VERSION_4_3 != 0;
+#endif
+#ifdef GL_VERSION_4_6
+        compact = compact || GLAD_GL_VERSION_4_6 != 0;
+#endif
+#ifdef GL_ARB_indirect_parameters
+        compact = compact || GLAD_GL_ARB_indirect_parameters != 0;
+#endif
+#ifndef CULL_PARAMETER_BUFFER
+        compact = false;
+#endif
+        compact = compact && supported;
+        if (!supported) {
+            std::cout << "ERROR::GPU CULLING:: needs an OpenGL 4.3 context, using the cpu culling" << std::endl;
+            return;
+        }
+#ifdef GL_VERSION_4_3
+        cullShader = new ComputeShader("shaders/cull.comp");
+        cullShader->use();
+        cullShader->setInt("hiZTexture", 0);
+        unsigned int *buffers[] = {&instanceBuffer, &meshBuffer, &commandBuffer, &countBuffer, &bucketBuffer, &instanceIds};
+        for (unsigned int *buffer : buffers)
+            glGenBuffers(1, buffer);
+#endif
+    }
+
+    ~GpuCulling()
+    {
+#ifdef GL_VERSION_4_3
+        if (!supported)
+            return;
+        unsigned int buffers[] = {instanceBuffer, meshBuffer, commandBuffer, countBuffer, bucketBuffer, instanceIds};
+        glDeleteBuffers(6, buffers);
+        delete cullShader;
+#endif
+    }
+
+    // copies the instances of the scene to the gpu, sorted by bucket, after scene.update()
+    void upload(const SceneGraph &scene, MaterialAtlas &atlas)
+    {
+#ifdef GL_VERSION_4_3
+        if (!supported)
+            return;
+        for (const SceneInstance &instance : scene.instances)
+            if (!pool.contains(instance.model))
+                pool.add(instance.model);
+
+        // buckets by (transparency, atlas pages), opaque ones first
+        std::map<std::pair<bool, long long>, std::vector<int> > groups;
+        for (unsigned int i = 0; i < scene.instances.size(); i++) {
+            const SceneInstance &instance = scene.instances[i];
+            int material = instance.model->meshes[instance.mesh].materialIndex;
+            groups[std::make_pair(instance.transparent, atlas.pageKey(material))].push_back(i);
+        }
+
+        std::vector<GpuInstance> gpuInstances;
+        std::vector<unsigned int> bucketFirst;
+        buckets.clear();
+        for (auto it = groups.begin(); it != groups.end(); ++it) {
+            Bucket bucket;
+            bucket.first = (unsigned int) gpuInstances.size();
+            bucket.size = (unsigned int) it->second.size();
+            bucket.transparent = it->first.first;
+            for (int i : it->second) {
+                const SceneInstance &instance = scene.instances[i];
+                const glm::mat4 &world = scene.nodes[instance.node].world;
+                GpuInstance gpuInstance;
+                gpuInstance.model = world;
+                gpuInstance.modelInvT = glm::inverse(glm::transpose(world));
+                gpuInstance.boundsMin = glm::vec4(instance.bounds.min, 1.0f);
+                gpuInstance.boundsMax = glm::vec4(instance.bounds.max, 1.0f);
+                gpuInstance.mesh = pool.first[instance.model] + instance.mesh;
+                gpuInstance.lodCount = pool.lodCount[instance.model];
+                gpuInstance.lodStride = (unsigned int) instance.model->meshes.size();
+                gpuInstance.bucket = (unsigned int) buckets.size();
+                gpuInstance.material = instance.model->meshes[instance.mesh].materialIndex;
+                gpuInstance.pad[0] = gpuInstance.pad[1] = gpuInstance.pad[2] = 0;
+                bucket.material = gpuInstance.material;
+                gpuInstances.push_back(gpuInstance);
+            }
+            bucketFirst.push_back(bucket.first);
+            buckets.push_back(bucket);
+        }
+        instanceCount = (unsigned int) gpuInstances.size();
+        if (instanceCount == 0)
+            return;
+
+        std::vector<unsigned int> ids(instanceCount);
+        for (unsigned int i = 0; i < instanceCount; i++)
+            ids[i] = i;
+        glBindBuffer(GL_ARRAY_BUFFER, instanceIds);
+        glBufferData(GL_ARRAY_BUFFER, ids.size() * sizeof(unsigned int), &ids[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        pool.build(instanceIds);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, instanceBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, gpuInstances.size() * sizeof(GpuInstance), &gpuInstances[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, meshBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, pool.meshes.size() * sizeof(GpuMesh), &pool.meshes[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, bucketBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, bucketFirst.size() * sizeof(unsigned int), &bucketFirst[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, buckets.size() * sizeof(unsigned int), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, commandBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, instanceCount * sizeof(DrawElementsIndirectCommand), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+#endif
+    }
+
+    // writes the indirect commands of the visible instances, hiZ may be null to skip the occlusion test, otherwise
+    // hiZ->reproject(viewProjection) runs first
+    void cull(const glm::mat4 &viewProjection, const glm::vec3 &cameraPosition, const HiZBuffer *hiZ)
+    {
+#ifdef GL_VERSION_4_3
+        if (!supported || instanceCount == 0)
+            return;
+        std::vector<unsigned int> zeros(buckets.size(), 0);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, zeros.size() * sizeof(unsigned int), &zeros[0]);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+        cullShader->use();
+        Frustum frustum(viewProjection);
+        for (int i = 0; i < 6; i++)
+            cullShader->setVec4("planes[" + std::to_string(i) + "]", glm::vec4(frustum.nx[i], frustum.ny[i], frustum.nz[i], frustum.d[i]));
+        glUniform1ui(glGetUniformLocation(cullShader->ID, "instanceCount"), instanceCount);
+        cullShader->setVec3("cameraPosition", cameraPosition);
+        cullShader->setFloat("maxDistance", maxDistance);
+        cullShader->setFloat("lodDistance", lodDistance);
+        cullShader->setBool("compact", compact);
+        bool useHiZ = hiZ != nullptr && hiZ->built;
+        cullShader->setBool("useHiZ", useHiZ);
+        if (useHiZ) {
+            cullShader->setMat4("hiZViewProjection", hiZ->reprojectedViewProjection);
+            cullShader->setVec2("hiZSize", glm::vec2((float) hiZ->reprojectedWidth, (float) hiZ->reprojectedHeight));
+            cullShader->setInt("hiZLevels", hiZ->reprojectedLevels);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, hiZ->reprojectedTexture);
+        }
+
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_INSTANCES_BINDING, instanceBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_MESHES_BINDING, meshBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_COMMANDS_BINDING, commandBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_COUNTS_BINDING, countBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_BUCKETS_BINDING, bucketBuffer);
+        glDispatchCompute((instanceCount + 63) / 64, 1, 1);
+        // the commands and counts are read by the draws, the instances by the vertex shader
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+#endif
+    }
+
+    // issues one multi draw per bucket of the requested transparency, shader is celShaderIndirect
+    void draw(Shader &shader, MaterialAtlas &atlas, bool transparent)
+    {
+#ifdef GL_VERSION_4_3
+        if (!supported || instanceCount == 0)
+            return;
+        glBindVertexArray(pool.VAO);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CULL_INSTANCES_BINDING, instanceBuffer);
+        for (unsigned int b = 0; b < buckets.size(); b++) {
+            const Bucket &bucket = buckets[b];
+            if (bucket.transparent != transparent)
+                continue;
+            atlas.use(shader, bucket.material);
+            const void *offset = (const void *) (bucket.first * sizeof(DrawElementsIndirectCommand));
+            if (compact)
+                multiDrawCount(offset, (GLintptr) (b * sizeof(unsigned int)), bucket.size);
+            else
+                glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, offset, bucket.size, 0);
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glBindVertexArray(0);
+#endif
+    }
+
+    // sum of the bucket counters, waits for the culling to finish so only used for statistics and benchmarks
+    int readVisibleCount()
+    {
+        int visible = 0;
+#ifdef GL_VERSION_4_3
+        if (!supported || buckets.empty())
+            return 0;
+        std::vector<unsigned int> counts(buckets.size());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, countBuffer);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, counts.size() * sizeof(unsigned int), &counts[0]);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        for (unsigned int count : counts)
+            visible += (int) count;
+#endif
+        return visible;
+    }
+
+private:
+#ifdef GL_VERSION_4_3
+    ComputeShader *cullShader = nullptr;
+#endif
+    unsigned int instanceBuffer = 0, meshBuffer = 0, commandBuffer = 0, countBuffer = 0, bucketBuffer = 0, instanceIds = 0;
+
+    void multiDrawCount(const void *offset, GLintptr countOffset, unsigned int maxCount)
+    {
+#ifdef CULL_PARAMETER_BUFFER
+        glBindBuffer(CULL_PARAMETER_BUFFER, countBuffer);
+#ifdef GL_VERSION_4_6
+        if (GLAD_GL_VERSION_4_6) {
+            glMultiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_INT, offset, countOffset, maxCount, 0);
+            glBindBuffer(CULL_PARAMETER_BUFFER, 0);
+            return;
+        }
+#endif
+#ifdef GL_ARB_indirect_parameters
+        glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, GL_UNSIGNED_INT, offset, countOffset, maxCount, 0);
+#endif
+        glBindBuffer(CULL_PARAMETER_BUFFER, 0);
+#endif
+    }
+};
+#endif
@@ -0,0 +1,481 @@
+#ifndef HIZ_H
+#define HIZ_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <shader.h>
+#include <bounds.h>
+#include <sceneGraph.h>
+#include <workerPool.h>
+
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+// Hierarchical-Z occlusion culling. After the scene pass the depth buffer is reduced into a max depth pyramid on
+// the GPU, a coarse level of it is read back asynchronously, and the bounding boxes of the next frames are tested
+// against it. That depth is some frames old, so before the test it is reprojected into the current view: every
+// texel is moved to where its depth lands now, and the texels nothing landed on (disoccluded, or outside the old
+// view) read as far, together with their neighbours, so a box that just came out from behind something is drawn.
+// The cpu path reprojects the read back level, the gpu path the same level of the pyramid texture.
+//
+// usage:
+//   HiZBuffer hiZ(SCR_WIDTH, SCR_HEIGHT, quadVAO, workers); // hiZ.resize when the depth buffer changes size
+//   hiZ.filter(scene.instances, visible, occluded, viewProjection); // before drawing, removes the occluded ones
+//   hiZ.reproject(viewProjection);                   // or this, before the gpu culling reads reprojectedTexture
+//   ... draw the scene into a framebuffer with a depth texture ...
+//   hiZ.build(depthTexture, viewProjection);         // after drawing, hiZ.reset() instead when culling is off
+class HiZBuffer {
+public:
+    // max of the depth pyramid size, the level 0 is the largest power of two that fits in the screen
+    static const int MAX_SIZE = 512;
+    // the gpu level read back is the first one not wider than this
+    static const int READBACK_SIZE = 128;
+    // boxes per worker, below twice this amount the tests run on the calling thread
+    static const int PARALLEL_THRESHOLD = 256;
+    // pack buffers in the ring, a read is collected this many frames minus one after it started. One more than the
+    // frames the frame pacer lets the gpu be behind, so the mapped one is always finished
+    static const int READBACK_BUFFERS = 4;
+
+    unsigned int texture = 0; // R32F, max depth, one mip per pyramid level
+    int width = 0, height = 0, levels = 0;
+    int readbackLevel = 0;
+
+    // the view projection the gpu pyramid was rendered with
+    glm::mat4 textureViewProjection = glm::mat4(1.0f);
+    bool built = false;
+    // the gpu pyramid reprojected by reproject(), starts at the read back level, for the tests done on the gpu
+    unsigned int reprojectedTexture = 0; // R32F, max depth, one mip per level
+    int reprojectedWidth = 0, reprojectedHeight = 0, reprojectedLevels = 0;
+    glm::mat4 reprojectedViewProjection = glm::mat4(1.0f);
+
+    // statistics of the last filter()
+    int testedCount = 0;
+    int occludedCount = 0;
+
+    HiZBuffer(int screenWidth, int screenHeight, unsigned int quadVAO, WorkerPool &workers)
+        : quadVAO(quadVAO), workers(workers)
+    {
+        reduceShader = new Shader("shaders/screenShader.vert", "shaders/hiZ.frag");
+        reduceShader->use();
+        reduceShader->setInt("source", 0);
+        splatShader = new Shader("shaders/hiZReproject.vert", "shaders/hiZReproject.frag");
+        splatShader->use();
+        splatShader->setInt("source", 0);
+        holesShader = new Shader("shaders/screenShader.vert", "shaders/hiZHoles.frag");
+        holesShader->use();
+        holesShader->setInt("source", 0);
+        // the points take their texel from gl_VertexID, no attributes
+        glGenVertexArrays(1, &pointsVAO);
+        glGenFramebuffers(1, &framebuffer);
+        allocate(screenWidth, screenHeight);
+    }
+
+    // the depth buffer changed size. Within the same pyramid size only the reduction ratio changes, otherwise the
+    // pyramid is allocated again and the tests keep everything visible until its first read back
+    void resize(int screenWidth, int screenHeight)
+    {
+        if (screenWidth == this->screenWidth && screenHeight == this->screenHeight)
+            return;
+        if (pyramidSize(screenWidth) == width && pyramidSize(screenHeight) == height) {
+            this->screenWidth = screenWidth;
+            this->screenHeight = screenHeight;
+            return;
+        }
+        release();
+        reset();
+        allocate(screenWidth, screenHeight);
+    }
+
+    // forgets the pyramids, for when nothing builds them anymore. The tests keep everything visible until the first
+    // read back after the next build
+    void reset()
+    {
+        readback.clear();
+        cpuLevels.clear();
+        results.clear();
+        built = false;
+        frame = 0;
+    }
+
+    ~HiZBuffer()
+    {
+        release();
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteVertexArrays(1, &pointsVAO);
+        delete reduceShader;
+        delete splatShader;
+        delete holesShader;
+    }
+
+    int levelWidth(int level) const { return std::max(width >> level, 1); }
+    int levelHeight(int level) const { return std::max(height >> level, 1); }
+
+    // reduces the depth texture into the pyramid and starts reading back its coarse levels
+    void build(unsigned int depthTexture, const glm::mat4 &viewProjection)
+    {
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glDisable(GL_DEPTH_TEST);
+        glDisable(GL_BLEND);
+        glActiveTexture(GL_TEXTURE0);
+        glBindVertexArray(quadVAO);
+        reduceShader->use();
+
+        for (int level = 0; level < levels; level++) {
+            if (level == 0) {
+                // the screen is not a power of two, every texel takes the max of all depth texels it covers
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+                glViewport(0, 0, width, height);
+                glBindTexture(GL_TEXTURE_2D, depthTexture);
+                reduceShader->setVec2("ratio", (float) screenWidth / width, (float) screenHeight / height);
+                reduceShader->setVec2("sourceSize", (float) screenWidth, (float) screenHeight);
+                glDrawArrays(GL_TRIANGLES, 0, 6);
+            } else {
+                reduceLevel(texture, level, levelWidth(level - 1), levelHeight(level - 1));
+            }
+
+            if (level == readbackLevel) {
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[frame % READBACK_BUFFERS]);
+                glReadPixels(0, 0, levelWidth(level), levelHeight(level), GL_RED, GL_FLOAT, 0);
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+                pendingViewProjection[frame % READBACK_BUFFERS] = viewProjection;
+            }
+        }
+        textureViewProjection = viewProjection;
+        built = true;
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+        // the oldest read is done by now, so mapping it doesn't stall
+        frame++;
+        if (frame >= READBACK_BUFFERS)
+            collect(pbo[frame % READBACK_BUFFERS], pendingViewProjection[frame % READBACK_BUFFERS]);
+    }
+
+    // true once a read back pyramid is available
+    bool ready() const { return !readback.empty(); }
+
+    // reprojects the gpu pyramid into the view of viewProjection, does nothing until the first build
+    void reproject(const glm::mat4 &viewProjection)
+    {
+        if (!built)
+            return;
+        GLint viewport[4], previousFramebuffer;
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+        GLfloat clearColor[4];
+        glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+        GLboolean blend = glIsEnabled(GL_BLEND);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glActiveTexture(GL_TEXTURE0);
+
+        // one point per texel of the read back level, max blending keeps the farthest where several share a texel
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, splatTexture, 0);
+        glViewport(0, 0, reprojectedWidth, reprojectedHeight);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glEnable(GL_BLEND);
+        glBlendEquation(GL_MAX);
+        splatShader->use();
+        splatShader->setInt("sourceLevel", readbackLevel);
+        splatShader->setMat4("toCurrent", viewProjection * glm::inverse(textureViewProjection));
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glBindVertexArray(pointsVAO);
+        glDrawArrays(GL_POINTS, 0, reprojectedWidth * reprojectedHeight);
+        glBlendEquation(GL_FUNC_ADD);
+        glDisable(GL_BLEND);
+
+        // the holes and their neighbours read as far, then the coarser levels take the max as in build()
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, reprojectedTexture, 0);
+        holesShader->use();
+        glBindTexture(GL_TEXTURE_2D, splatTexture);
+        glBindVertexArray(quadVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+        reduceShader->use();
+        for (int level = 1; level < reprojectedLevels; level++)
+            reduceLevel(reprojectedTexture, level, levelWidth(readbackLevel + level - 1),
+                        levelHeight(readbackLevel + level - 1));
+        glBindTexture(GL_TEXTURE_2D, reprojectedTexture);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, reprojectedLevels - 1);
+        reprojectedViewProjection = viewProjection;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+        if (blend)
+            glEnable(GL_BLEND);
+    }
+
+    // moves the occluded instances from visible into occluded, keeps the order of both. The read back depth is
+    // reprojected into the view of viewProjection first
+    void filter(const std::vector<SceneInstance> &instances, std::vector<int> &visible, std::vector<int> &occluded,
+                const glm::mat4 &viewProjection)
+    {
+        occluded.clear();
+        testedCount = (int) visible.size();
+        occludedCount = 0;
+        if (!ready() || visible.empty())
+            return;
+        reprojectReadback(viewProjection);
+
+        results.assign(visible.size(), 0);
+        auto testRange = [&](int begin, int end) {
+            for (int i = begin; i < end; i++)
+                results[i] = isOccluded(instances[visible[i]].bounds) ? 1 : 0;
+        };
+        int count = (int) visible.size();
+        int chunks = std::min(workers.size(), count / PARALLEL_THRESHOLD);
+        if (chunks > 1) {
+            // every job tests a contiguous range, the pyramid is only read
+            int chunk = (count + chunks - 1) / chunks;
+            workers.run(chunks, [&](int index, int) {
+                testRange(index * chunk, std::min((index + 1) * chunk, count));
+            });
+        } else {
+            testRange(0, count);
+        }
+
+        int kept = 0;
+        for (int i = 0; i < count; i++) {
+            if (results[i])
+                occluded.push_back(visible[i]);
+            else
+                visible[kept++] = visible[i];
+        }
+        visible.resize(kept);
+        occludedCount = (int) occluded.size();
+    }
+
+    // test of a world space box against the reprojected read back pyramid, call filter() first
+    bool isOccluded(const AABB &box) const
+    {
+        if (box.empty())
+            return false;
+        glm::vec2 ndcMin(FLT_MAX), ndcMax(-FLT_MAX);
+        float nearestDepth = FLT_MAX;
+        for (int i = 0; i < 8; i++) {
+            glm::vec3 corner((i & 1) ? box.max.x : box.min.x, (i & 2) ? box.max.y : box.min.y, (i & 4) ? box.max.z : box.min.z);
+            glm::vec4 clip = cpuViewProjection * glm::vec4(corner, 1.0f);
+            // crosses the near plane, nothing to compare with
+            if (clip.w <= 1e-5f)
+                return false;
+            glm::vec3 ndc = glm::vec3(clip) / clip.w;
+            ndcMin = glm::min(ndcMin, glm::vec2(ndc));
+            ndcMax = glm::max(ndcMax, glm::vec2(ndc));
+            nearestDepth = std::min(nearestDepth, ndc.z * 0.5f + 0.5f);
+        }
+        // partly outside of the view, the depth there is unknown
+        if (ndcMin.x < -1.0f || ndcMin.y < -1.0f || ndcMax.x > 1.0f || ndcMax.y > 1.0f)
+            return false;
+
+        // pick the level where the box covers at most 2x2 texels
+        int base = readbackLevel;
+        glm::vec2 size0((float) levelWidth(base), (float) levelHeight(base));
+        glm::vec2 rectMin = (ndcMin * 0.5f + 0.5f) * size0;
+        glm::vec2 rectMax = (ndcMax * 0.5f + 0.5f) * size0;
+        float extent = std::max(rectMax.x - rectMin.x, rectMax.y - rectMin.y);
+        int level = 0;
+        while (extent > 1.0f && level + 1 < (int) cpuLevels.size()) {
+            extent *= 0.5f;
+            level++;
+        }
+
+        const std::vector<float> &depth = cpuLevels[level];
+        int w = levelWidth(base + level), h = levelHeight(base + level);
+        float scale = 1.0f / (float) (1 << level);
+        int x0 = glm::clamp((int) (rectMin.x * scale), 0, w - 1), x1 = glm::clamp((int) (rectMax.x * scale), 0, w - 1);
+        int y0 = glm::clamp((int) (rectMin.y * scale), 0, h - 1), y1 = glm::clamp((int) (rectMax.y * scale), 0, h - 1);
+        float farthest = 0.0f;
+        for (int y = y0; y <= y1; y++)
+            for (int x = x0; x <= x1; x++)
+                farthest = std::max(farthest, depth[y * w + x]);
+        return nearestDepth > farthest;
+    }
+
+private:
+    Shader *reduceShader;
+    Shader *splatShader, *holesShader;
+    unsigned int framebuffer = 0;
+    unsigned int quadVAO, pointsVAO = 0;
+    unsigned int splatTexture = 0;
+    WorkerPool &workers;
+    int screenWidth = 0, screenHeight = 0;
+
+    unsigned int pbo[READBACK_BUFFERS];
+    glm::mat4 pendingViewProjection[READBACK_BUFFERS];
+    unsigned int frame = 0;
+
+    // the read back gpu level and the view projection it was rendered with
+    std::vector<float> readback;
+    glm::mat4 readbackViewProjection = glm::mat4(1.0f);
+    // cpuLevels[0] is the read back level reprojected into the view of cpuViewProjection, the coarser ones are
+    // reduced on the cpu
+    std::vector<std::vector<float> > cpuLevels;
+    std::vector<float> splat;
+    glm::mat4 cpuViewProjection = glm::mat4(1.0f);
+    std::vector<char> results;
+
+    static int pyramidSize(int screenSize)
+    {
+        int size = 1;
+        while (size * 2 <= std::min(screenSize, MAX_SIZE)) size *= 2;
+        return size;
+    }
+
+    void allocate(int screenWidth, int screenHeight)
+    {
+        this->screenWidth = screenWidth;
+        this->screenHeight = screenHeight;
+        width = pyramidSize(screenWidth);
+        height = pyramidSize(screenHeight);
+        levels = 1;
+        while ((width >> levels) > 0 || (height >> levels) > 0) levels++;
+        readbackLevel = 0;
+        while ((width >> readbackLevel) > READBACK_SIZE) readbackLevel++;
+
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        for (int level = 0; level < levels; level++)
+            glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, levelWidth(level), levelHeight(level), 0, GL_RED, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+        // a ring of pack buffers, the gpu writes into the newest while the oldest is read
+        int bytes = levelWidth(readbackLevel) * levelHeight(readbackLevel) * sizeof(float);
+        glGenBuffers(READBACK_BUFFERS, pbo);
+        for (int i = 0; i < READBACK_BUFFERS; i++) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        // the reprojection at the read back level and its coarser levels
+        reprojectedWidth = levelWidth(readbackLevel);
+        reprojectedHeight = levelHeight(readbackLevel);
+        reprojectedLevels = levels - readbackLevel;
+        glGenTextures(1, &splatTexture);
+        glBindTexture(GL_TEXTURE_2D, splatTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, reprojectedWidth, reprojectedHeight, 0, GL_RED, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        glGenTextures(1, &reprojectedTexture);
+        glBindTexture(GL_TEXTURE_2D, reprojectedTexture);
+        for (int level = 0; level < reprojectedLevels; level++)
+            glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, levelWidth(readbackLevel + level),
+                         levelHeight(readbackLevel + level), 0, GL_RED, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, reprojectedLevels - 1);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    void release()
+    {
+        glDeleteTextures(1, &texture);
+        glDeleteTextures(1, &splatTexture);
+        glDeleteTextures(1, &reprojectedTexture);
+        glDeleteBuffers(READBACK_BUFFERS, pbo);
+    }
+
+    // max reduction of level - 1 of target into level, with reduceShader bound. Only the previous level is sampled
+    // (as level 0) so the one being written doesn't form a feedback loop
+    void reduceLevel(unsigned int target, int level, int sourceWidth, int sourceHeight)
+    {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, target, level);
+        glViewport(0, 0, std::max(sourceWidth / 2, 1), std::max(sourceHeight / 2, 1));
+        glBindTexture(GL_TEXTURE_2D, target);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+        reduceShader->setVec2("ratio", 2.0f, 2.0f);
+        reduceShader->setVec2("sourceSize", (float) sourceWidth, (float) sourceHeight);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+    }
+
+    void collect(unsigned int buffer, const glm::mat4 &viewProjection)
+    {
+        int w = levelWidth(readbackLevel), h = levelHeight(readbackLevel);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+        float *data = (float *) glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, w * h * sizeof(float), GL_MAP_READ_BIT);
+        if (data) {
+            readback.resize(w * h);
+            memcpy(readback.data(), data, w * h * sizeof(float));
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            readbackViewProjection = viewProjection;
+        } else {
+            std::cout << "ERROR::HIZ::READBACK:: failed to map the pack buffer" << std::endl;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+    // the cpu side of reproject(): moves every read back texel into the view of viewProjection, keeps the farthest
+    // depth where several land in the same texel and makes the holes and their neighbours far
+    void reprojectReadback(const glm::mat4 &viewProjection)
+    {
+        int w = levelWidth(readbackLevel), h = levelHeight(readbackLevel);
+        glm::mat4 toCurrent = viewProjection * glm::inverse(readbackViewProjection);
+        splat.assign(w * h, 0.0f);
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                glm::vec4 clip = toCurrent * glm::vec4((x + 0.5f) / w * 2.0f - 1.0f, (y + 0.5f) / h * 2.0f - 1.0f,
+                                                       readback[y * w + x] * 2.0f - 1.0f, 1.0f);
+                // behind the camera now
+                if (clip.w <= 1e-5f)
+                    continue;
+                glm::vec3 ndc = glm::vec3(clip) / clip.w;
+                int tx = (int) std::floor((ndc.x * 0.5f + 0.5f) * w);
+                int ty = (int) std::floor((ndc.y * 0.5f + 0.5f) * h);
+                if (tx < 0 || ty < 0 || tx >= w || ty >= h)
+                    continue;
+                float &target = splat[ty * w + tx];
+                target = std::max(target, std::min(ndc.z * 0.5f + 0.5f, 1.0f));
+            }
+        }
+
+        cpuLevels.resize(levels - readbackLevel);
+        std::vector<float> &level0 = cpuLevels[0];
+        level0.resize(w * h);
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                float depth = splat[y * w + x];
+                for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, h - 1); ny++)
+                    for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, w - 1); nx++)
+                        if (splat[ny * w + nx] <= 0.0f)
+                            depth = 1.0f;
+                level0[y * w + x] = depth;
+            }
+        }
+        cpuViewProjection = viewProjection;
+
+        for (unsigned int level = 1; level < cpuLevels.size(); level++) {
+            int sw = levelWidth(readbackLevel + level - 1), sh = levelHeight(readbackLevel + level - 1);
+            int dw = levelWidth(readbackLevel + level), dh = levelHeight(readbackLevel + level);
+            const std::vector<float> &source = cpuLevels[level - 1];
+            std::vector<float> &target = cpuLevels[level];
+            target.resize(dw * dh);
+            for (int y = 0; y < dh; y++) {
+                for (int x = 0; x < dw; x++) {
+                    int sx = std::min(x * 2 + 1, sw - 1), sy = std::min(y * 2 + 1, sh - 1);
+                    target[y * dw + x] = std::max(std::max(source[y * 2 * sw + x * 2], source[y * 2 * sw + sx]),
+                                                  std::max(source[sy * sw + x * 2], source[sy * sw + sx]));
+                }
+            }
+        }
+    }
+};
+#endif
@@ -0,0 +1,135 @@
+#ifndef LUTBAKER_H
+#define LUTBAKER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <stb_image.h>
+
+#include <workerPool.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// A lookup texture of a pure function of the shading inputs, evaluated on the cpu and sampled with one fetch instead
+// of evaluating the function for every fragment. The function gets u and v in [0, 1], texel i of n is evaluated at
+// i / (n - 1) so the ends of the range are exact, the shaders map their inputs with lutCoord:
+//   float lutCoord(float x, float size) { return (clamp(x, 0.0, 1.0) * (size - 1.0) + 0.5) / size; }
+// bake does nothing while the key (the config values the function depends on) stays the same. Large tables are
+// split over the worker pool, the function must not write shared state. load takes an image instead (an artist
+// authored ramp), its first row for a one row table.
+//
+// usage:
+//   Lut ramp(1024, 1, GL_NEAREST, workers);
+//   ramp.bake("cel " + std::to_string(celAmount), [&](float u, float v) { return glm::vec3(quantize(u)); });
+//   ramp.bind(unit);
+class Lut {
+public:
+    // texels per job, below twice this amount the table is filled on the calling thread
+    static const int PARALLEL_THRESHOLD = 16384;
+
+    unsigned int texture = 0;
+    int width, height;
+    std::string key;     // of the current contents, empty before the first bake
+    float bakeTime = 0.0f; // ms of the last bake or load
+    int bakes = 0;
+
+    Lut(int width, int height, GLint filter, WorkerPool& workers) : width(width), height(height), workers(workers)
+    {
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    ~Lut()
+    {
+        glDeleteTextures(1, &texture);
+    }
+
+    // returns true when the table was baked again
+    bool bake(const std::string& key, const std::function<glm::vec3(float, float)>& function)
+    {
+        if (key == this->key)
+            return false;
+        auto start = std::chrono::high_resolution_clock::now();
+        int count = width * height;
+        std::vector<glm::vec3> texels(count);
+        auto bakeTexels = [&](int first, int last) {
+            for (int i = first; i < last; i++) {
+                int x = i % width, y = i / width;
+                float u = width > 1 ? (float) x / (width - 1) : 0.0f;
+                texels[i] = function(u, height > 1 ? (float) y / (height - 1) : 0.0f);
+            }
+        };
+        // contiguous ranges of texels, so one row tables split too
+        int chunks = std::min(workers.size(), count / PARALLEL_THRESHOLD);
+        if (chunks > 1) {
+            int chunk = (count + chunks - 1) / chunks;
+            workers.run(chunks, [&](int index, int) {
+                bakeTexels(index * chunk, std::min((index + 1) * chunk, count));
+            });
+        } else {
+            bakeTexels(0, count);
+        }
+        upload(texels);
+        this->key = key;
+        bakeTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        bakes++;
+        return true;
+    }
+
+    // the image resampled to the table size, false if it can't be read and the table is unchanged
+    bool load(const std::string& path)
+    {
+        if ("image " + path == key)
+            return true;
+        auto start = std::chrono::high_resolution_clock::now();
+        int imageWidth, imageHeight, components;
+        unsigned char* data = stbi_load(path.c_str(), &imageWidth, &imageHeight, &components, 3);
+        if (data == NULL) {
+            std::cout << "ERROR::LUT:: failed to load the lookup image " << path << std::endl;
+            return false;
+        }
+        std::vector<glm::vec3> texels(width * height);
+        for (int y = 0; y < height; y++) {
+            int sy = height > 1 ? y * (imageHeight - 1) / (height - 1) : 0;
+            for (int x = 0; x < width; x++) {
+                int sx = width > 1 ? x * (imageWidth - 1) / (width - 1) : 0;
+                const unsigned char* texel = data + (sy * imageWidth + sx) * 3;
+                texels[y * width + x] = glm::vec3(texel[0], texel[1], texel[2]) / 255.0f;
+            }
+        }
+        stbi_image_free(data);
+        upload(texels);
+        key = "image " + path;
+        bakeTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        bakes++;
+        return true;
+    }
+
+    void bind(int unit) const
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+private:
+    WorkerPool& workers;
+
+    void upload(const std::vector<glm::vec3>& texels)
+    {
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGB, GL_FLOAT, &texels[0]);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+};
+#endif
@@ -3,10 +3,31 @@
 #include <iostream>
 #include <vector>
 #include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <string>
+#include <iomanip>
 
 #include "shader.h"
 #include "camera.h"
 #include "model.h"
+#include "sceneGraph.h"
+#include "hiZ.h"
+#include "gpuCulling.h"
+#include "commandList.h"
+#include "workerPool.h"
+#include "streamRing.h"
+#include "framePacer.h"
+#include "weightedOIT.h"
+#include "changeTracker.h"
+#include "shaderPermutations.h"
+#include "renderGraph.h"
+#include "postChain.h"
+#include "dynamicResolution.h"
+#include "computeEdges.h"
+#include "lutBaker.h"
+#include "noiseBaker.h"
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
 #include "imgui_impl_opengl3.h"
@@ -14,15 +35,32 @@
 // function declarations //
 // --------------------- //
 void setCommonUniforms();
-void setCelFramebuffer();
-void setEdgeFramebuffer();
+void recordCommonUniforms(CommandList& list);
+void recordSceneChunk(CommandList& list, Shader* shader, int first, int last, bool useAtlas, bool useOIT);
+void recordTransparency(CommandList& list, bool transparent, bool useOIT);
+unsigned int buildFrameGraph(unsigned int dirty, bool sceneOnly);
+void updateRenderSize();
 unsigned int createVAO();
-unsigned int createTexture(char const * path);
-void drawCar();
+void buildScene(int stressObjects);
+int addCar(int parent, const glm::mat4& local);
+void prepareScene();
+void drawScene();
+void runCullingBenchmark();
+void selectPermutations();
+void bakeLuts();
+void runPermutationBenchmark();
+void runPostBenchmark();
+void runEdgeBenchmark();
+bool useComputeEdges();
 void drawCrate();
 void drawRobot();
-void drawFloor();
+void drawModel(Model* model);
+void drawMesh(const SceneInstance& instance);
+void setFrameTransforms(const glm::mat4& projection, const glm::mat4& view);
+void setDrawTransform(const glm::mat4& model);
 void drawGui();
+void drawStats();
+void watchChanges();
 
 // glfw and input functions //
 // ------------------------ //
@@ -31,12 +69,15 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void key_input_callback(GLFWwindow* window, int button, int other, int action, int mods);
 void cursor_input_callback(GLFWwindow* window, double posX, double posY);
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
+void window_refresh_callback(GLFWwindow* window);
 
 // screen settings //
 // --------------- //
 const unsigned int SCR_WIDTH = 1280;
 const unsigned int SCR_HEIGHT = 720;
-const glm::vec2 texelSize = {1.0f / SCR_WIDTH, 1.0f /SCR_HEIGHT};
+// the framebuffer of the window, and the size the scene and the post passes render at, smaller with a render scale
+int windowWidth = SCR_WIDTH, windowHeight = SCR_HEIGHT;
+int renderWidth = SCR_WIDTH, renderHeight = SCR_HEIGHT;
 //vertex attributes for a quad that fills the entire screen in Normalized Device Coordinates.
 const float quadVertices[] = {
         // positions   // texCoords
@@ -50,9 +91,28 @@ const float quadVertices[] = {
 };
 // global variables used for rendering //
 // ----------------------------------- //
+// the variants of the current config, picked from the permutations by selectPermutations every frame
 Shader* celShader;
-Shader* edgeShader;
-Shader* screenShader;
+Shader* celArrayShader;
+Shader* sceneShader; // cel shader variant used by the draw functions this frame
+ShaderPermutations* celPermutations;
+ShaderPermutations* celArrayPermutations;
+ShaderPermutations* celIndirectPermutations; // null without GL 4.3
+// the edges and the line tremor after the scene, as stages of a post chain
+PostChain* postChain;
+int edgeStage, tremorStage;
+std::vector<PostChain::Pass>* postPasses; // of the current config, fused or one per stage
+ComputeEdges* computeEdges; // the edge stage as a compute pass, GL 4.3
+// the cel quantization and the specular curve of the cel shaders, baked when their config values change
+Lut* celRamp;
+Lut* specularCurve;
+const int LUT_UNIT_CEL_RAMP = 6; // after the material textures
+const int LUT_UNIT_SPECULAR = 7;
+std::string toonRampPath; // --toon-ramp, an image used as the cel ramp instead of the baked one
+// the tremor offsets and the blue noise replacing the per pixel hash, generated once and read from the disk afterwards
+NoiseBaker* noiseBaker;
+unsigned int hashTexture;
+const int HASH_NOISE_SIZE = 64;
 Model* carPaint;
 Model* carBody;
 Model* carInterior;
@@ -62,6 +122,37 @@ Model* carWheel;
 Model* floorModel;
 Model* crate;
 Model* robot;
+MaterialAtlas* materialAtlas;
+SceneGraph scene;
+std::vector<int> visibleInstances; // filled by the culling every frame
+std::vector<int> occludedInstances;
+HiZBuffer* hiZ;
+GpuCulling* gpuCulling;
+Shader* celIndirectShader; // draws the commands written by the gpu culling, null without GL 4.3
+unsigned int gpuSceneVersion = 0; // scene version last uploaded to the gpu culling
+Shader* hiZDebugShader;
+Shader* upscaleShader; // the render size to the window size, keeps the edge lines sharp
+DynamicResolution dynamicResolution;
+glm::mat4 viewProjection; // of the current frame, the hi-z pyramid is built with it
+// frame preparation is recorded into command lists, the scene chunks on the workers, and replayed on the GL thread
+const int RECORD_CHUNK_SIZE = 128; // visible instances per scene command list
+WorkerPool* workers;
+std::vector<LinearAllocator> workerAllocators; // one per worker, reset every frame
+LinearAllocator frameAllocator;                // lists recorded on the GL thread
+CommandList commonUniforms, scenePass;
+std::vector<CommandList> sceneChunks;
+int sceneChunkCount = 0; // recorded this frame
+CommandReplay commandReplay;
+float recordTime, replayTime; // ms of the last prepareScene and drawScene
+StreamRing* streamRing; // per frame and per draw uniform blocks
+FramePacer* framePacer; // bounds the frames queued for the gpu
+WeightedOIT* weightedOIT; // transparent instances in one pass without sorting
+bool gpuScenePass = false; // the frame is culled and drawn by the compute pass, set by prepareScene
+// passes of a frame, the main loop runs the dirty ones and the ones reading their output
+const unsigned int PASS_SCREEN = 1; // the post pass with the line distortion to the screen, and the gui
+const unsigned int PASS_EDGE = 2;   // the post pass with the edges of the cel texture
+const unsigned int PASS_SCENE = 4;  // culling and the scene into the cel texture
+ChangeTracker changes;
 Camera camera(glm::vec3(0.0f, 1.2f, 5.0f));
 
 // global variables used for control //
@@ -72,9 +163,10 @@ float deltaTime;
 bool isPaused = false;
 // gl object ids //
 // ------------- //
-unsigned int celFramebuffer, celTexture, celRbo;
-unsigned int edgeFramebuffer, edgeTexture, edgeRbo;
 unsigned int edgeVAO, screenVAO;
+unsigned int quadVAO, noiseTexture;
+// the cel and depth targets, the post targets and the passes between them, declared again every frame by buildFrameGraph
+RenderGraph frameGraph;
 
 // Helper structs //
 // -------------- //
@@ -101,21 +193,71 @@ struct Config {
     bool useBPSR = false;
     float lineDistortion = 0.1; // noiseAmp
     int celAmount = 4;
+    // the cel ramp from the --toon-ramp image
+    bool useToonRamp = false;
     bool justLines = false;
     float strokeSize = 2;
+    // Sobel instead of Laplace, and the edges of the luminance instead of every color channel
+    bool edgeSobel = false;
+    bool edgeLuminance = false;
+    // the edges in a compute pass reading the texels from shared memory, see the edge benchmark for which is faster
+    bool computeEdges = false;
     bool normalizeDistortion = false;
     bool randomize = false;
+    // the random coordinates of the tremor from a blue noise texture instead of a sin hash per pixel
+    bool hashTexture = true;
+
+    // sample material textures from the atlas pages instead of binding them per mesh
+    bool useTextureArrays = true;
+
+    // skip the instances outside of the view frustum
+    bool doFrustumCulling = true;
+    // skip the instances hidden behind the depth of the previous frames
+    bool doOcclusionCulling = true;
+    // debug views, draw the occluded instances as wireframe and show a level of the hi-z pyramid (-1 is off)
+    bool showOccluded = false;
+    int hiZDebugLevel = -1;
+    // cull and build the draw commands in a compute shader, needs GL 4.3
+    bool doGpuCulling = false;
+    float maxDrawDistance = 100.0f;
+    // 0 is the car on the floor, otherwise a parking lot with this many cars, wheels and crates
+    int stressObjects = 0;
+    bool showStats = false;
+    // record the scene command lists on all cores instead of only the GL thread
+    bool recordOnWorkers = true;
+    // frames the gpu may be behind the cpu, more overlap against more latency
+    int framesInFlight = 2;
+    // weighted blended transparency instead of blending the transparent instances in draw order
+    bool useOIT = true;
+    // only run the passes whose inputs changed and sleep until the next event when none did
+    bool redrawOnChange = true;
+    // the targets are this part of the window size, set by the dynamic resolution while it is on
+    float renderScale = 1.0f;
+    bool dynamicResolution = false;
+    float frameBudget = 16.0f; // gpu ms
+    float minRenderScale = 0.5f;
+    float upscaleSharpness = 20.0f;
+    // compile the NPR switches into the shaders instead of branching on uniforms
+    bool usePermutations = true;
+    // fuse the adjacent post stages into one full screen pass instead of a pass and a target per stage
+    bool fusePostPasses = true;
 
 } config;
 
 
-int main()
+int main(int argc, char** argv)
 {
+    // --benchmark renders the stress scenes with the cpu and the gpu culling, prints the timings and exits
+    bool benchmark = argc > 1 && strcmp(argv[1], "--benchmark") == 0;
+    // --toon-ramp <image> shades with an authored ramp, dark to light from left to right
+    for (int i = 1; i + 1 < argc; i++)
+        if (strcmp(argv[i], "--toon-ramp") == 0)
+            toonRampPath = argv[i + 1];
+    config.useToonRamp = !toonRampPath.empty();
+
     // glfw: initialize and configure //
     // ------------------------------ //
     glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
 #ifdef __APPLE__
@@ -124,7 +266,14 @@ int main()
 
     // glfw window creation //
     // -------------------- //
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "NPR rendering", NULL, NULL);
+    // the newest context first, the gpu culling needs 4.3 and compacts the draws with 4.6, everything else runs on 3.3
+    const int contextVersions[][2] = {{4, 6}, {4, 3}, {3, 3}};
+    GLFWwindow* window = NULL;
+    for (int i = 0; i < 3 && window == NULL; i++) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, contextVersions[i][0]);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, contextVersions[i][1]);
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "NPR rendering", NULL, NULL);
+    }
     if (window == NULL)
     {
         std::cout << "Failed to create GLFW window" << std::endl;
@@ -132,10 +281,13 @@ int main()
         return -1;
     }
     glfwMakeContextCurrent(window);
+    // larger than the window on high dpi screens
+    glfwGetFramebufferSize(window, &windowWidth, &windowHeight);
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
     glfwSetCursorPosCallback(window, cursor_input_callback);
     glfwSetKeyCallback(window, key_input_callback);
 	glfwSetScrollCallback(window, scroll_callback);
+    glfwSetWindowRefreshCallback(window, window_refresh_callback);
 
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED); 
 
@@ -151,22 +303,44 @@ int main()
 
     // Initialize scene objects (models and gl) //
     // ---------------------------------------- //
-    celShader = new Shader("shaders/celShader.vert", "shaders/celShader.frag");
-    carPaint = new Model("car/Paint_LOD0.obj");
-	carBody = new Model("car/Body_LOD0.obj");
-	carLight = new Model("car/Light_LOD0.obj");
-	carInterior = new Model("car/Interior_LOD0.obj");
-	carWindow = new Model("car/Windows_LOD0.obj");
-	carWheel = new Model("car/Wheel_LOD0.obj");
-	floorModel = new Model("floor/floor.obj");
-	crate = new Model("box/crate.obj");
-	//robot  = new Model("robot/RIGING_MODEL_04.obj");
-
-    setCelFramebuffer();
-    setEdgeFramebuffer();
+    materialAtlas = new MaterialAtlas();
+    carPaint = new Model("car/Paint_LOD0.obj", false, materialAtlas);
+	carBody = new Model("car/Body_LOD0.obj", false, materialAtlas);
+	carLight = new Model("car/Light_LOD0.obj", false, materialAtlas);
+	carInterior = new Model("car/Interior_LOD0.obj", false, materialAtlas);
+	carWindow = new Model("car/Windows_LOD0.obj", false, materialAtlas);
+	carWheel = new Model("car/Wheel_LOD0.obj", false, materialAtlas);
+	floorModel = new Model("floor/floor.obj", false, materialAtlas);
+	crate = new Model("box/crate.obj", false, materialAtlas);
+	//robot  = new Model("robot/RIGING_MODEL_04.obj", false, materialAtlas);
+    // all materials are known now, pack them into texture array pages
+    materialAtlas->build();
+    // the new variants get their samplers and block bindings when they are built
+    celPermutations = new ShaderPermutations("shaders/celShader.vert", "shaders/celShader.frag", [](Shader& shader) {
+        StreamRing::attach(shader);
+    });
+    celArrayPermutations = new ShaderPermutations("shaders/celShader.vert", "shaders/celShaderArray.frag", [](Shader& shader) {
+        materialAtlas->attach(shader);
+        StreamRing::attach(shader);
+    });
+    gpuCulling = new GpuCulling();
+    celIndirectPermutations = NULL;
+    if (gpuCulling->supported) {
+        celIndirectPermutations = new ShaderPermutations("shaders/celShaderIndirect.vert", "shaders/celShaderArray.frag", [](Shader& shader) {
+            materialAtlas->attach(shader);
+            StreamRing::attach(shader);
+        });
+    }
+    buildScene(config.stressObjects);
+    workers = new WorkerPool();
+    workerAllocators.resize(workers->size());
+    commandReplay.atlas = materialAtlas;
+    streamRing = new StreamRing();
+    commandReplay.ring = streamRing;
+    framePacer = new FramePacer();
 
     // screen quad VAO
-    unsigned int quadVAO, quadVBO;
+    unsigned int quadVBO;
     glGenVertexArrays(1, &quadVAO);
     glGenBuffers(1, &quadVBO);
     glBindVertexArray(quadVAO);
@@ -177,18 +351,51 @@ int main()
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
 
-    edgeShader = new Shader("shaders/edgeShader.vert", "shaders/edgeShader.frag");
-    edgeShader->use();
-    edgeShader->setInt("celTexture", 0);
+    // the edge filter reads 9 texels, the tremor moves the coordinate of one read so it fuses after it
+    postChain = new PostChain("shaders/screenShader.vert");
+    edgeStage = postChain->addStage({"edge", "shaders/post/edge.glsl", 9, nullptr, nullptr});
+    tremorStage = postChain->addStage({"tremor", "shaders/post/tremor.glsl", 1, []() {
+        glActiveTexture(GL_TEXTURE0 + 1);
+        glBindTexture(GL_TEXTURE_2D, noiseTexture);
+        glActiveTexture(GL_TEXTURE0 + 2);
+        glBindTexture(GL_TEXTURE_2D, hashTexture);
+    }, [](Shader& shader) {
+        shader.setInt("noiseTexture", 1);
+        shader.setInt("hashNoise", 2);
+    }});
 //    edgeVAO = createVAO();
-
-    screenShader = new Shader("shaders/screenShader.vert", "shaders/screenShader.frag");
-    screenShader->use();
-    screenShader->setInt("edgeTexture", 0);
-    unsigned int noiseTexture;
-    noiseTexture = createTexture("perlinNoise.png");
-    screenShader->setInt("noiseTexture", 1);
+    // tileable perlin in two channels instead of the fixed perlinNoise.png
+    noiseBaker = new NoiseBaker(*workers);
+    noiseTexture = noiseBaker->texture({NOISE_PERLIN, 256, false, 8, 4, 2});
+    hashTexture = noiseBaker->texture({NOISE_BLUE, HASH_NOISE_SIZE});
+    computeEdges = new ComputeEdges();
+    // the ramp steps are sharp, the specular curve is interpolated
+    celRamp = new Lut(1024, 1, GL_NEAREST, *workers);
+    specularCurve = new Lut(1024, 1, GL_LINEAR, *workers);
+    bakeLuts();
 //    screenVAO = createVAO();
+    selectPermutations();
+
+    hiZ = new HiZBuffer(SCR_WIDTH, SCR_HEIGHT, quadVAO, *workers);
+    // the scene pass hands it the framebuffer and depth the render graph gave it
+    weightedOIT = new WeightedOIT(SCR_WIDTH, SCR_HEIGHT, 0, 0, quadVAO, "shaders/screenShader.vert");
+    commandReplay.oit = weightedOIT;
+    hiZDebugShader = new Shader("shaders/screenShader.vert", "shaders/hiZDebug.frag");
+    hiZDebugShader->use();
+    hiZDebugShader->setInt("hiZTexture", 0);
+    upscaleShader = new Shader("shaders/screenShader.vert", "shaders/upscale.frag");
+    upscaleShader->use();
+    upscaleShader->setInt("lowResTexture", 0);
+    updateRenderSize();
+
+    if (benchmark) {
+        runCullingBenchmark();
+        runPermutationBenchmark();
+        runPostBenchmark();
+        runEdgeBenchmark();
+        glfwTerminate();
+        return 0;
+    }
 
     // IMGUI init
     IMGUI_CHECKVERSION();
@@ -206,6 +413,7 @@ int main()
 
     // RENDER LOOP //
     // ----------- //
+    watchChanges();
     while (!glfwWindowShouldClose(window))
     {
         static float lastFrame = 0.0f;
@@ -215,47 +423,57 @@ int main()
 
         processInput(window);
 
+        if (!config.redrawOnChange)
+            changes.invalidate(PASS_SCENE);
+        // the occlusion test of a frame reads the depth of READBACK_BUFFERS frames before, a change is drawn until the
+        // pyramid of its own depth culls, otherwise what the stale depth hid stays missing until the next input
+        changes.settleFrames = config.doOcclusionCulling ? HiZBuffer::READBACK_BUFFERS : 1;
+        unsigned int dirty = changes.poll();
+        if (dirty == 0) {
+            // the last frame is still on the screen, nothing is drawn or swapped until an event comes in
+            glfwWaitEvents();
+            // the gui reacts to the mouse without changing any watched value
+            if (isPaused || config.showStats)
+                changes.invalidate(PASS_SCREEN);
+            // the time spent waiting isn't camera movement time
+            lastFrame = (float)glfwGetTime();
+            continue;
+        }
+        if (dirty & PASS_SCENE)
+            dirty |= PASS_EDGE;
+        dirty |= PASS_SCREEN;
+        framePacer->beginCpuWork();
+        selectPermutations();
+        bakeLuts();
+        updateRenderSize();
+        // the graph culls the passes the screen doesn't need and may add the writers of targets it had to replace
+        dirty = buildFrameGraph(dirty, false);
+
+        // culling and recording only touch cpu memory, they run while the gpu works on the frames in flight
+        if (dirty & PASS_SCENE)
+            prepareScene();
+        framePacer->framesInFlight = config.framesInFlight;
+        framePacer->beginFrame();
+        streamRing->beginFrame();
         setCommonUniforms();
-        /// first pass, normal render with cel framebuffer
-//        glBindFramebuffer(GL_FRAMEBUFFER, celFramebuffer);
-        glBindFramebuffer(GL_FRAMEBUFFER, celFramebuffer);// if active TODO change back
-        glDepthRange(-1,1); // make the NDC a right handed coordinate system, with the camera pointing towards -z
-        glEnable(GL_DEPTH_TEST); // turn on z-buffer depth test
-        glDepthFunc(GL_LESS); // draws fragments that are closer to the screen in NDC
-        glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        celShader->use();
-        drawFloor();
-        drawCar();
-        //drawCrate();
-        //drawRobot();
-        /// second pass, render to texture with edge framebuffer
-        glBindFramebuffer(GL_FRAMEBUFFER, edgeFramebuffer);
-//        glBindFramebuffer(GL_FRAMEBUFFER, 0);// if active TODO change back
-        glDisable(GL_DEPTH_TEST);
-        glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
-        edgeShader->use();
-        glBindVertexArray(quadVAO);
-        glBindTexture(GL_TEXTURE_2D, celTexture);	// use the color attachment texture as the texture of the quad plane
-        glDrawArrays(GL_TRIANGLES, 0, 6);
-        /// third pass, render to quad with default framebuffer
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
-        glDisable(GL_DEPTH_TEST);
-        glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
-        screenShader->use();
-        glBindVertexArray(quadVAO);
-        glBindTexture(GL_TEXTURE_2D, edgeTexture); // also bind noise
-        glActiveTexture(GL_TEXTURE0 + 1);
-        glBindTexture(GL_TEXTURE_2D, noiseTexture); // also bind noise
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        frameGraph.execute();
 
-		if (isPaused) {
+		if (isPaused || config.showStats) {
 			drawGui();
 		}
 
-        glfwSwapBuffers(window);
+        streamRing->endFrame();
+        framePacer->endFrame(dirty);
+        // a new scale is a watched change, the next frame is drawn at the new size. Only the frames that drew the scene
+        // are measured, the gui only ones cost a fraction of it and would pull the scale back up
+        static int sampledFrames = 0;
+        dynamicResolution.budget = config.frameBudget;
+        dynamicResolution.minScale = config.minRenderScale;
+        if (config.dynamicResolution && framePacer->retiredFrames != sampledFrames && (framePacer->gpuTag & PASS_SCENE)
+            && dynamicResolution.update(framePacer->gpuTime))
+            config.renderScale = dynamicResolution.scale;
+        sampledFrames = framePacer->retiredFrames;
+        framePacer->swap(window);
         glfwPollEvents();
     }
 
@@ -275,7 +493,23 @@ int main()
     delete carWheel;
     delete crate;
     delete robot;
-    delete celShader;
+    delete materialAtlas;
+    delete hiZ;
+    delete gpuCulling;
+    delete workers;
+    delete streamRing;
+    delete framePacer;
+    delete weightedOIT;
+    delete hiZDebugShader;
+    delete upscaleShader;
+    delete celPermutations;
+    delete celArrayPermutations;
+    delete celIndirectPermutations;
+    delete postChain;
+    delete computeEdges;
+    delete celRamp;
+    delete specularCurve;
+    delete noiseBaker;
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
@@ -287,125 +521,196 @@ int main()
 //    SETUP FUNCTIONS    //
 ///////////////////////////
 void setCommonUniforms() {
-    celShader->use();
-    celShader->setVec3("viewPosition", camera.Position);
-    // light uniforms
-    celShader->setVec3("ambientLightColor", config.ambientLightColor * config.ambientLightIntensity);
-    celShader->setVec3("lightDirection", config.lightDirection);
-    celShader->setVec3("lightColor", config.lightColor * config.lightIntensity);
-
-    // material uniforms
-    celShader->setFloat("ambientOcclusionMix", config.ambientOcclusionMix);
-    celShader->setFloat("normalMappingMix", config.normalMappingMix);
-    celShader->setFloat("specularExponent", config.specularExponent);
-
-    // NPR
-    celShader->setBool("doCelShading", config.doCelShading);
-    celShader->setInt("celAmount", config.celAmount);
-    celShader->setBool("useBPSR", config.useBPSR);
-
-    edgeShader->use();
-    edgeShader->setBool("doEdgeDetection", config.doEdgeDetection);
-    edgeShader->setBool("doEdgeOnly", config.justLines);
-    edgeShader->setVec2("texelSize", texelSize);
-    edgeShader->setFloat("strokeSize", config.strokeSize);
-
-    screenShader->use();
-    screenShader->setBool("doLineTremor", config.doLineTremor);
-    screenShader->setBool("normalizeDistortion", config.normalizeDistortion);
-    screenShader->setBool("randomize", config.randomize);
-    screenShader->setFloat("lineDistortion", config.lineDistortion/100);
-}
-
-void setCelFramebuffer() {
-    glGenFramebuffers(1, &celFramebuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, celFramebuffer);
-
-    // generate texture to attach
-    glGenTextures(1, &celTexture);
-    glBindTexture(GL_TEXTURE_2D, celTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-//    glBindTexture(GL_TEXTURE_2D, 0); // needed?
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, celTexture, 0);
-
-    // generate renderbuffer for depth and stencil testing
-    glGenRenderbuffers(1, &celRbo);
-    glBindRenderbuffer(GL_RENDERBUFFER, celRbo);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, SCR_WIDTH, SCR_HEIGHT);
-//    glBindRenderbuffer(GL_RENDERBUFFER, 0);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, celRbo);
-
-    // check that framebuffer is complete
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        std::cout << "ERROR::CEL FRAMEBUFFER:: Framebuffer is not complete" << std::endl;
-    // unbind, and bind back to default
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    // recorded like the scene so any thread could pack them, but they are only a handful of calls
+    frameAllocator.reset();
+    commonUniforms.begin(&frameAllocator);
+    recordCommonUniforms(commonUniforms);
+    commandReplay.replay(commonUniforms);
 }
 
-void setEdgeFramebuffer() {
-    glGenFramebuffers(1, &edgeFramebuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, edgeFramebuffer);
+void recordCommonUniforms(CommandList& list) {
+    // both cel variants share the same uniforms, only the texture sampling differs
+    Shader* celShaders[] = {celShader, celArrayShader, celIndirectShader};
+    for (Shader* shader : celShaders) {
+        if (shader == NULL)
+            continue;
+        list.useShader(shader);
+        list.setVec3("viewPosition", camera.Position);
+        // light uniforms
+        list.setVec3("ambientLightColor", config.ambientLightColor * config.ambientLightIntensity);
+        list.setVec3("lightDirection", config.lightDirection);
+        list.setVec3("lightColor", config.lightColor * config.lightIntensity);
+
+        // material uniforms
+        list.setFloat("ambientOcclusionMix", config.ambientOcclusionMix);
+        list.setFloat("normalMappingMix", config.normalMappingMix);
+        list.setFloat("specularExponent", config.specularExponent);
+
+        // NPR
+        list.setBool("doCelShading", config.doCelShading);
+        list.setInt("celRamp", LUT_UNIT_CEL_RAMP);
+        list.setInt("specularCurve", LUT_UNIT_SPECULAR);
+        list.setBool("useBPSR", config.useBPSR);
+        list.setBool("oitPass", false);
+    }
 
-    // generate texture to attach
-    glGenTextures(1, &edgeTexture);
-    glBindTexture(GL_TEXTURE_2D, edgeTexture);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glBindTexture(GL_TEXTURE_2D, 0); // needed?
-
-    // generate renderbuffer for depth and stencil testing
-    glGenRenderbuffers(1, &edgeRbo);
-    glBindRenderbuffer(GL_RENDERBUFFER, edgeRbo);
-    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, SCR_WIDTH, SCR_HEIGHT);
-    glBindRenderbuffer(GL_RENDERBUFFER, 0);
-
-    // attach texture and rbo to current bound framebuffer obj
-    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, edgeTexture, 0);
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, edgeRbo);
-
-    // check that framebuffer is complete
-    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-        std::cout << "ERROR::EDGE FRAMEBUFFER:: Framebuffer is not complete" << std::endl;
-    // unbind, and bind back to default
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    // a fused pass has the uniforms of all its stages
+    for (const PostChain::Pass& pass : *postPasses) {
+        list.useShader(pass.shader);
+        list.setBool("doEdgeOnly", config.justLines);
+        list.setBool("edgeSobel", config.edgeSobel);
+        list.setBool("edgeLuminance", config.edgeLuminance);
+        list.setVec2("texelSize", glm::vec2(1.0f / renderWidth, 1.0f / renderHeight));
+        // the stroke size is in window pixels, the lines keep their width on the screen at any render size
+        list.setFloat("strokeSize", config.strokeSize * renderWidth / windowWidth);
+        list.setBool("doLineTremor", config.doLineTremor);
+        list.setBool("normalizeDistortion", config.normalizeDistortion);
+        list.setBool("randomize", config.randomize);
+        list.setBool("hashTexture", config.hashTexture);
+        // a hash texel per pixel
+        list.setVec2("hashScale", glm::vec2(renderWidth, renderHeight) / (float) HASH_NOISE_SIZE);
+        list.setFloat("lineDistortion", config.lineDistortion/100);
+    }
 }
 
-unsigned int createTexture(char const * path) {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
+unsigned int buildFrameGraph(unsigned int dirty, bool sceneOnly){
+    // declares the passes of this frame, the dirty ones run. sceneOnly keeps the cel image as the output (the culling
+    // benchmark), otherwise the screen is. Returns the passes that will run
+    frameGraph.reset();
+    // the targets a skipped pass leaves to the next frames keep their textures while the passes can be skipped
+    bool retained = config.redrawOnChange;
+    // a new size is a new desc, the graph allocates new textures and lets the old ones expire
+    int celColor = frameGraph.createTarget("cel color", {renderWidth, renderHeight, GL_RGB8}, retained);
+    int celDepth = frameGraph.createTarget("cel depth", {renderWidth, renderHeight, GL_DEPTH24_STENCIL8});
+    int hiZPyramid = frameGraph.importTexture("hi-z", hiZ->texture);
+    int backbuffer = frameGraph.importBackbuffer();
+
+    /// first pass, normal render into the cel targets
+    int scenePass = frameGraph.addPass("scene", [celDepth](RenderGraph& graph) {
+        glViewport(0, 0, renderWidth, renderHeight);
+        glDepthRange(-1,1); // make the NDC a right handed coordinate system, with the camera pointing towards -z
+        glEnable(GL_DEPTH_TEST); // turn on z-buffer depth test
+        glDepthFunc(GL_LESS); // draws fragments that are closer to the screen in NDC
+        glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        weightedOIT->setTargets(graph.boundFramebuffer(), graph.texture(celDepth));
+        materialAtlas->beginPass();
+        celRamp->bind(LUT_UNIT_CEL_RAMP);
+        specularCurve->bind(LUT_UNIT_SPECULAR);
+        sceneShader->use();
+        drawScene();
+        //drawCrate();
+        //drawRobot();
+        if (config.doOcclusionCulling || config.hiZDebugLevel >= 0)
+            hiZ->build(graph.texture(celDepth), viewProjection);
+        else
+            hiZ->reset(); // a pyramid kept from before would cull with old depth once the culling is on again
+    }, (dirty & PASS_SCENE) != 0);
+    frameGraph.write(scenePass, celColor);
+    frameGraph.write(scenePass, celDepth);
+    frameGraph.write(scenePass, hiZPyramid);
+
+    /// then the post passes from the cel image to the screen, a level of the depth pyramid instead in the debug view
+    bool showHiZ = config.hiZDebugLevel >= 0;
+    if (showHiZ) {
+        int debugPass = frameGraph.addPass("hi-z debug", [hiZPyramid](RenderGraph& graph) {
+            glViewport(0, 0, windowWidth, windowHeight);
+            glDisable(GL_DEPTH_TEST);
+            glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            glBindVertexArray(quadVAO);
+            glActiveTexture(GL_TEXTURE0);
+            hiZDebugShader->use();
+            hiZDebugShader->setInt("level", config.hiZDebugLevel);
+            hiZDebugShader->setFloat("near", 0.1f);
+            hiZDebugShader->setFloat("far", 100.0f);
+            glBindTexture(GL_TEXTURE_2D, graph.texture(hiZPyramid));
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+        }, (dirty & PASS_SCREEN) != 0);
+        frameGraph.read(debugPass, hiZPyramid);
+        frameGraph.write(debugPass, backbuffer);
     }
-    else
-    {
-        std::cout << "ERROR::LOAD TEXTURE DATA:: failed to load texture data at path: " << path << std::endl;
-        stbi_image_free(data);
+    // below the window size the last post pass writes a target the upscale pass reads
+    bool upscale = renderWidth != windowWidth || renderHeight != windowHeight;
+    std::vector<int> postPassIds;
+    int postInput = celColor;
+    // the compute edges replace the edge stage of the chain, the post passes read their output
+    int edgePass = -1;
+    if (useComputeEdges() && !showHiZ) {
+        int edgeColor = frameGraph.createTarget("edge color", {renderWidth, renderHeight, GL_RGBA8}, retained);
+        edgePass = frameGraph.addPass("edge (compute)", [postInput, edgeColor](RenderGraph& graph) {
+            computeEdges->sobel = config.edgeSobel;
+            computeEdges->luminance = config.edgeLuminance;
+            computeEdges->edgeOnly = config.justLines;
+            computeEdges->dispatch(graph.texture(postInput), graph.texture(edgeColor), renderWidth, renderHeight,
+                                   config.strokeSize * renderWidth / windowWidth);
+        }, (dirty & PASS_EDGE) != 0);
+        frameGraph.read(edgePass, postInput);
+        frameGraph.write(edgePass, edgeColor);
+        postInput = edgeColor;
+    }
+    for (size_t i = 0; i < postPasses->size() && !showHiZ; i++) {
+        PostChain::Pass* pass = &(*postPasses)[i];
+        unsigned int inputs = 0;
+        for (int stage : pass->stages)
+            inputs |= stage == edgeStage ? PASS_EDGE : PASS_SCREEN;
+        // without fusion every pass but the last writes a target the next one reads
+        bool toScreen = i + 1 == postPasses->size() && !upscale;
+        int output = toScreen ? backbuffer : frameGraph.createTarget("post " + pass->name, {renderWidth, renderHeight, GL_RGB8}, retained);
+        int postPass = frameGraph.addPass(pass->name, [pass, postInput, toScreen](RenderGraph& graph) {
+            if (toScreen)
+                glViewport(0, 0, windowWidth, windowHeight);
+            else
+                glViewport(0, 0, renderWidth, renderHeight);
+            glDisable(GL_DEPTH_TEST);
+            glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            postChain->draw(*pass, graph.texture(postInput), quadVAO);
+            // the scene pass of the next frame may run without another post pass in between
+            glActiveTexture(GL_TEXTURE0);
+        }, (dirty & inputs) != 0);
+        frameGraph.read(postPass, postInput);
+        frameGraph.write(postPass, output);
+        postPassIds.push_back(postPass);
+        postInput = output;
     }
-    return textureID;
+    if (upscale && !showHiZ) {
+        int upscalePass = frameGraph.addPass("upscale", [postInput](RenderGraph& graph) {
+            glViewport(0, 0, windowWidth, windowHeight);
+            glDisable(GL_DEPTH_TEST);
+            upscaleShader->use();
+            upscaleShader->setFloat("edgeSharpness", config.upscaleSharpness);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, graph.texture(postInput));
+            glBindVertexArray(quadVAO);
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+        }, (dirty & PASS_SCREEN) != 0);
+        frameGraph.read(upscalePass, postInput);
+        frameGraph.write(upscalePass, backbuffer);
+    }
+
+    frameGraph.markOutput(sceneOnly ? celColor : backbuffer);
+    frameGraph.compile();
+    unsigned int running = 0;
+    if (frameGraph.runs(scenePass))
+        running |= PASS_SCENE;
+    if (edgePass >= 0 && frameGraph.runs(edgePass))
+        running |= PASS_EDGE;
+    for (size_t i = 0; i < postPassIds.size(); i++)
+        if (frameGraph.runs(postPassIds[i]))
+            for (int stage : (*postPasses)[i].stages)
+                running |= stage == edgeStage ? PASS_EDGE : PASS_SCREEN;
+    // the gui is drawn on top of the screen every frame
+    running |= PASS_SCREEN;
+    return running;
+}
+
+void updateRenderSize(){
+    // the targets of the graph follow on their own, the hi-z pyramid and the oit targets are sized here
+    renderWidth = DynamicResolution::scaled(windowWidth, config.renderScale);
+    renderHeight = DynamicResolution::scaled(windowHeight, config.renderScale);
+    hiZ->resize(renderWidth, renderHeight);
+    weightedOIT->resize(renderWidth, renderHeight);
 }
 
 ///////////////////////////
@@ -417,7 +722,10 @@ void drawGui(){
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
 
-    {
+    if (config.showStats)
+        drawStats();
+
+    if (isPaused) {
         ImGui::Begin("Settings");
 
         ImGui::Text("Ambient light: ");
@@ -442,15 +750,70 @@ void drawGui(){
         ImGui::Checkbox("Do cel shading", &config.doCelShading);
         ImGui::Checkbox("Use blinn-phong specular", &config.useBPSR);
         ImGui::SliderInt("Cel shading divisions", &config.celAmount, 3, 20);
+        if (!toonRampPath.empty())
+            ImGui::Checkbox("Toon ramp image", &config.useToonRamp);
+        ImGui::Text("LUTs: cel ramp %d bakes, last %.2f ms, specular %d bakes, last %.2f ms", celRamp->bakes,
+                    celRamp->bakeTime, specularCurve->bakes, specularCurve->bakeTime);
         ImGui::Separator();
         ImGui::Checkbox("Do edge detection", &config.doEdgeDetection);
         ImGui::Checkbox("Show only edges", &config.justLines);
-        ImGui::SliderFloat("Stroke size", &config.strokeSize, 0.0f, 5.0f);
+        ImGui::SliderFloat("Stroke size", &config.strokeSize, 0.0f, (float) ComputeEdges::MAX_STROKE_SIZE);
+        ImGui::Checkbox("Sobel edges", &config.edgeSobel);
+        ImGui::Checkbox("Luminance edges", &config.edgeLuminance);
+        if (computeEdges->supported)
+            ImGui::Checkbox("Compute edge pass", &config.computeEdges);
+        else
+            ImGui::Text("Compute edge pass needs OpenGL 4.3");
         ImGui::Separator();
         ImGui::Checkbox("Do line distortion", &config.doLineTremor);
         ImGui::Checkbox("Normalize distortion", &config.normalizeDistortion);
         ImGui::Checkbox("Randomize", &config.randomize);
+        ImGui::Checkbox("Blue noise hash", &config.hashTexture);
         ImGui::SliderFloat("Line distortion", &config.lineDistortion, 0.0f, 2.0f);
+        ImGui::Text("Noise: %d generated, %d from the cache, last %.2f ms", noiseBaker->generated,
+                    noiseBaker->cacheHits, noiseBaker->bakeTime);
+        ImGui::Separator();
+        ImGui::Checkbox("Use texture arrays", &config.useTextureArrays);
+        ImGui::Checkbox("Frustum culling", &config.doFrustumCulling);
+        ImGui::Checkbox("Occlusion culling", &config.doOcclusionCulling);
+        ImGui::Checkbox("Show occluded", &config.showOccluded);
+        ImGui::SliderInt("Hi-Z debug level", &config.hiZDebugLevel, -1, hiZ->levels - 1);
+        if (celIndirectShader != NULL)
+            ImGui::Checkbox("GPU culling", &config.doGpuCulling);
+        else
+            ImGui::Text("GPU culling needs OpenGL 4.3");
+        ImGui::SliderFloat("GPU max draw distance", &config.maxDrawDistance, 5.0f, 100.0f);
+        ImGui::SliderInt("Stress objects", &config.stressObjects, 0, 20000);
+        if (ImGui::Button("Rebuild scene"))
+            buildScene(config.stressObjects);
+        ImGui::Checkbox("Show stats", &config.showStats);
+        ImGui::Checkbox("Record on worker threads", &config.recordOnWorkers);
+        ImGui::SliderInt("Frames in flight", &config.framesInFlight, 1, FRAME_PACER_MAX_FRAMES);
+        ImGui::Checkbox("Order independent transparency", &config.useOIT);
+        ImGui::Checkbox("Redraw on change", &config.redrawOnChange);
+        ImGui::Checkbox("Shader permutations", &config.usePermutations);
+        ShaderPermutations* permutations[] = {celPermutations, celArrayPermutations, celIndirectPermutations};
+        const char* permutationNames[] = {"cel", "cel array", "cel indirect"};
+        for (int i = 0; i < 3; i++)
+            if (permutations[i] != NULL)
+                ImGui::Text("  %s: %d variants, %d from disk, %.1f ms building", permutationNames[i],
+                            (int) permutations[i]->variants.size(), permutations[i]->loadedFromDisk(),
+                            permutations[i]->totalBuildTime());
+        for (const PostChain::Pass& pass : *postPasses)
+            ImGui::Text("  post %s: %d taps, %d variants, %d from disk, %.1f ms building", pass.name.c_str(), pass.taps,
+                        (int) pass.permutations->variants.size(), pass.permutations->loadedFromDisk(),
+                        pass.permutations->totalBuildTime());
+        ImGui::Checkbox("Fuse post passes", &config.fusePostPasses);
+        ImGui::Checkbox("Dynamic resolution", &config.dynamicResolution);
+        ImGui::SliderFloat("Frame budget (gpu ms)", &config.frameBudget, 4.0f, 50.0f);
+        ImGui::SliderFloat("Min render scale", &config.minRenderScale, 0.25f, 1.0f);
+        if (config.dynamicResolution)
+            ImGui::Text("Render scale %.2f", config.renderScale);
+        else
+            ImGui::SliderFloat("Render scale", &config.renderScale, 0.25f, 1.0f);
+        ImGui::SliderFloat("Upscale edge sharpness", &config.upscaleSharpness, 0.0f, 100.0f);
+        ImGui::Text("Atlas: %d pages, %d resampled, %d texture binds/frame", (int) materialAtlas->pages.size(),
+                    materialAtlas->resampledImages, materialAtlas->textureBinds);
         ImGui::Separator();
 
         ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
@@ -461,114 +824,656 @@ void drawGui(){
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
 
-void drawFloor(){edgeShader->use();
-    edgeShader->setBool("doEdgeDetection", false);
-    celShader->use();
-    // camera parameters
-    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-    glm::mat4 view = camera.GetViewMatrix();
-    glm::mat4 viewProjection = projection * view;
+void drawStats(){
+    ImGui::Begin("Stats", NULL, ImGuiWindowFlags_AlwaysAutoResize);
+    ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+    ImGui::Text("Instances: %d visible, %d culled", scene.visibleCount, scene.culledCount);
+    if (config.doGpuCulling && celIndirectShader != NULL)
+        ImGui::Text("GPU culling: %d instances, %d draw buckets%s", (int) gpuCulling->instanceCount,
+                    (int) gpuCulling->buckets.size(), gpuCulling->compact ? ", compacted" : "");
+    else
+        ImGui::Text("Occluded: %d of %d tested", hiZ->occludedCount, hiZ->testedCount);
+    ImGui::Text("BVH nodes visited: %d of %d", scene.nodesVisited, (int) scene.bvh.nodes.size());
+    ImGui::Text("World matrices updated: %d", scene.worldUpdates);
+    ImGui::Text("Record: %.3f ms on %d threads, replay: %.3f ms, %d commands", recordTime,
+                config.recordOnWorkers ? workers->size() : 1, replayTime, commandReplay.replayedCommands);
+    ImGui::Text("Stream ring: %.1f KB in %d ranges (%s), %d stalls %.2f ms, last %.2f ms, %d grows",
+                streamRing->frameBytes / 1024.0f, streamRing->frameAllocations,
+                streamRing->persistent ? "persistent" : "orphaning", streamRing->stalls, streamRing->stallTime,
+                streamRing->lastStallTime, streamRing->grows);
+    ImGui::Text("Frame: %.2f ms, cpu %.2f ms, gpu %.2f ms, %d of %d frames in flight, %s bound", framePacer->frameTime,
+                framePacer->cpuTime, framePacer->gpuTime, framePacer->pendingFrames(), framePacer->framesInFlight,
+                framePacer->gpuBound() ? "gpu" : "cpu");
+    ImGui::Text("Blocked: %.2f ms on the fence, %.2f ms in the swap", framePacer->fenceWaitTime, framePacer->swapTime);
+    ImGui::Text("Redraw: %d frames drawn, %d waits for events", changes.drawnFrames, changes.skippedFrames);
+    ImGui::Text("Resolution: %dx%d of %dx%d (%.0f%%), gpu %.2f ms averaged%s", renderWidth, renderHeight,
+                windowWidth, windowHeight, config.renderScale * 100.0f, dynamicResolution.averageTime,
+                config.dynamicResolution ? ", dynamic" : "");
+    ImGui::Text("Render graph: %d passes run, %d culled, targets %.1f MB at the peak of %.1f MB declared, %.1f MB pooled",
+                frameGraph.executedPasses, frameGraph.culledPasses, frameGraph.peakBytes / 1048576.0f,
+                frameGraph.declaredBytes / 1048576.0f, frameGraph.pooledBytes / 1048576.0f);
+    ImGui::End();
+}
+
+void watchChanges(){
+    // everything the passes read that can change between frames, with the first pass reading it
+    changes.watch(camera.Position, PASS_SCENE);
+    changes.watch(camera.Front, PASS_SCENE);
+    changes.watch(camera.Up, PASS_SCENE);
+    changes.watch(camera.Zoom, PASS_SCENE);
+    changes.watch(scene.version, PASS_SCENE);
+    changes.watch(config.ambientLightColor, PASS_SCENE);
+    changes.watch(config.ambientLightIntensity, PASS_SCENE);
+    changes.watch(config.lightDirection, PASS_SCENE);
+    changes.watch(config.lightColor, PASS_SCENE);
+    changes.watch(config.lightIntensity, PASS_SCENE);
+    changes.watch(config.specularExponent, PASS_SCENE);
+    changes.watch(config.ambientOcclusionMix, PASS_SCENE);
+    changes.watch(config.normalMappingMix, PASS_SCENE);
+    changes.watch(config.reflectionMix, PASS_SCENE);
+    changes.watch(config.doCelShading, PASS_SCENE);
+    changes.watch(config.useBPSR, PASS_SCENE);
+    changes.watch(config.celAmount, PASS_SCENE);
+    changes.watch(config.useToonRamp, PASS_SCENE);
+    changes.watch(config.useTextureArrays, PASS_SCENE);
+    changes.watch(config.doFrustumCulling, PASS_SCENE);
+    changes.watch(config.doOcclusionCulling, PASS_SCENE);
+    changes.watch(config.showOccluded, PASS_SCENE);
+    changes.watch(config.hiZDebugLevel, PASS_SCENE);
+    changes.watch(config.doGpuCulling, PASS_SCENE);
+    changes.watch(config.maxDrawDistance, PASS_SCENE);
+    changes.watch(config.useOIT, PASS_SCENE);
+    changes.watch(config.usePermutations, PASS_SCENE);
+    changes.watch(config.renderScale, PASS_SCENE);
+    changes.watch(config.upscaleSharpness, PASS_SCREEN);
+    // the post process passes reuse the cel texture
+    changes.watch(config.doEdgeDetection, PASS_EDGE);
+    changes.watch(config.fusePostPasses, PASS_EDGE);
+    changes.watch(config.justLines, PASS_EDGE);
+    changes.watch(config.strokeSize, PASS_EDGE);
+    changes.watch(config.edgeSobel, PASS_EDGE);
+    changes.watch(config.edgeLuminance, PASS_EDGE);
+    changes.watch(config.computeEdges, PASS_EDGE);
+    changes.watch(config.doLineTremor, PASS_SCREEN);
+    changes.watch(config.normalizeDistortion, PASS_SCREEN);
+    changes.watch(config.randomize, PASS_SCREEN);
+    changes.watch(config.hashTexture, PASS_SCREEN);
+    changes.watch(config.lineDistortion, PASS_SCREEN);
+    changes.watch(config.showStats, PASS_SCREEN);
+    changes.watch(isPaused, PASS_SCREEN);
+}
 
-    // set projection matrix uniform
-    celShader->setMat4("projection", projection);
-    celShader->setMat4("view", view);
+void buildScene(int stressObjects){
+    scene.clear();
+    if (stressObjects <= 0) {
+        // floor
+        scene.addModel(floorModel, -1, glm::scale(glm::mat4(1.0), glm::vec3(5.f, 5.f, 5.f)));
+        addCar(-1, glm::mat4(1.0f));
+        return;
+    }
+
+    // parking lot, a square grid of cars, loose wheels and crates with random headings
+    int side = (int) ceil(sqrt((float) stressObjects));
+    float spacing = 6.0f;
+    float size = side * spacing * 0.5f;
+    scene.addModel(floorModel, -1, glm::scale(glm::mat4(1.0), glm::vec3(size, 1.f, size)));
+    srand(1);
+    for (int i = 0; i < stressObjects; i++) {
+        glm::vec3 position((i % side) * spacing - size, 0.0f, -(i / side) * spacing + spacing);
+        float heading = glm::two_pi<float>() * (float) rand() / RAND_MAX;
+        glm::mat4 local = glm::rotate(glm::translate(glm::mat4(1.0f), position), heading, glm::vec3(0.0f, 1.0f, 0.0f));
+        switch (i % 3) {
+            case 0: addCar(-1, local); break;
+            case 1: scene.addModel(carWheel, -1, glm::translate(local, glm::vec3(0.0f, .328f, 0.0f))); break;
+            default: scene.addModel(crate, -1, glm::translate(local, glm::vec3(0.0f, .5f, 0.0f))); break;
+        }
+    }
+}
 
-    // draw floor,
-    // notice that we overwrite the value of one of the uniform variables to set a different floor color
-    celShader->setVec3("reflectionColor", .2, .5, .2);
-    glm::mat4 model = glm::scale(glm::mat4(1.0), glm::vec3(5.f, 5.f, 5.f));
-    celShader->setMat4("model", model);
-    celShader->setMat4("modelInvT", glm::inverse(glm::transpose(model)));
-    floorModel->Draw(*celShader);
+int addCar(int parent, const glm::mat4& local){
+    // every part hangs from the car node so moving it only dirties this subtree
+    int car = scene.addNode("car", parent, local);
+    glm::mat4 flip = glm::rotate(glm::mat4(1.0f), glm::pi<float>(), glm::vec3(0.0, 1.0, 0.0));
+    scene.addModel(carWheel, car, glm::translate(glm::mat4(1.0f), glm::vec3(-.7432, .328, 1.39)));
+    scene.addModel(carWheel, car, glm::translate(glm::mat4(1.0f), glm::vec3(-.7432, .328, -1.296)));
+    scene.addModel(carWheel, car, glm::translate(flip, glm::vec3(-.7432, .328, 1.296)));
+    scene.addModel(carWheel, car, glm::translate(flip, glm::vec3(-.7432, .328, -1.39)));
+    scene.addModel(carBody, car);
+    scene.addModel(carInterior, car);
+    scene.addModel(carPaint, car);
+    scene.addModel(carLight, car);
+    scene.addModel(carWindow, car, glm::mat4(1.0f), true);
+    return car;
 }
 
-void drawCar(){edgeShader->use();
-    edgeShader->setBool("doEdgeDetection", config.doEdgeDetection);
-    celShader->use();
+void prepareScene(){
+    // no GL calls in here, it runs before the frame pacer waits for the gpu
+    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)windowWidth / (float)windowHeight, 0.1f, 100.0f);
+    viewProjection = projection * camera.GetViewMatrix();
+    scene.update();
+    gpuScenePass = config.doGpuCulling && celIndirectShader != NULL;
+    if (gpuScenePass)
+        return;
+
+    scene.cull(viewProjection, visibleInstances, config.doFrustumCulling);
+    if (config.doOcclusionCulling)
+        hiZ->filter(scene.instances, visibleInstances, occludedInstances, viewProjection);
+    else
+        occludedInstances.clear();
+
+    // record the visible instances in chunks, in parallel when enabled, every worker writes into its own allocator
+    double recordStart = glfwGetTime();
+    int visibleCount = (int) visibleInstances.size();
+    sceneChunkCount = (visibleCount + RECORD_CHUNK_SIZE - 1) / RECORD_CHUNK_SIZE;
+    if ((int) sceneChunks.size() < sceneChunkCount)
+        sceneChunks.resize(sceneChunkCount);
+    for (LinearAllocator& allocator : workerAllocators)
+        allocator.reset();
+    bool useAtlas = config.useTextureArrays;
+    bool useOIT = config.useOIT;
+    Shader* shader = sceneShader;
+    auto recordChunk = [&](int chunk, int worker) {
+        sceneChunks[chunk].begin(&workerAllocators[worker]);
+        recordSceneChunk(sceneChunks[chunk], shader, chunk * RECORD_CHUNK_SIZE, std::min((chunk + 1) * RECORD_CHUNK_SIZE, visibleCount),
+                         useAtlas, useOIT);
+    };
+    if (config.recordOnWorkers)
+        workers->run(sceneChunkCount, recordChunk);
+    else
+        for (int chunk = 0; chunk < sceneChunkCount; chunk++)
+            recordChunk(chunk, 0);
+    recordTime = (float) (glfwGetTime() - recordStart) * 1000.0f;
+}
+
+void drawScene(){
+    sceneShader->use();
     // camera parameters
-    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)windowWidth / (float)windowHeight, 0.1f, 100.0f);
     glm::mat4 view = camera.GetViewMatrix();
-    glm::mat4 viewInv = glm::inverse(view);
-    glm::mat4 viewProjection = projection * view;
-    // set projection matrix uniform
-    celShader->setMat4("projection", projection);
-    celShader->setMat4("view", view);
-
-    // draw wheel
-    glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(-.7432, .328, 1.39));
-    celShader->setMat4("model", model);
-    celShader->setMat4("modelInvT", glm::inverse(glm::transpose(model)));
-    carWheel->Draw(*celShader);
-
-    // draw wheel
-    model = glm::translate(glm::mat4(1.0f), glm::vec3(-.7432, .328, -1.296));
-    celShader->setMat4("model", model);
-    celShader->setMat4("modelInvT", glm::inverse(glm::transpose(model)));
-    carWheel->Draw(*celShader);
-
-    // draw wheel
-    model = glm::rotate(glm::mat4(1.0f), glm::pi<float>(), glm::vec3(0.0, 1.0, 0.0));
-    model = glm::translate(model, glm::vec3(-.7432, .328, 1.296));
-    celShader->setMat4("model", model);
-    celShader->setMat4("modelInvT", glm::inverse(glm::transpose(model)));
-    carWheel->Draw(*celShader);
-
-    // draw wheel
-    model = glm::rotate(glm::mat4(1.0f), glm::pi<float>(), glm::vec3(0.0, 1.0, 0.0));
-    model = glm::translate(model, glm::vec3(-.7432, .328, -1.39));
-    celShader->setMat4("model", model);
-    celShader->setMat4("modelInvT", glm::inverse(glm::transpose(model)));
-    carWheel->Draw(*celShader);
-
-    // draw the rest of the car
-    model = glm::mat4(1.0f);
-    celShader->setMat4("model", model);
-    celShader->setMat4("modelInvT", glm::inverse(glm::transpose(model)));
-    carBody->Draw(*celShader);
-    carInterior->Draw(*celShader);
-    carPaint->Draw(*celShader);
-    carLight->Draw(*celShader);
-    glEnable(GL_BLEND);
-    carWindow->Draw(*celShader);
-    glDisable(GL_BLEND);
+    // the camera block is shared by the cel shader variants
+    setFrameTransforms(projection, view);
+
+    if (gpuScenePass) {
+        // the compute pass replaces the bvh and the cpu hi-z test, the instances stay on the gpu until the scene changes
+        if (gpuSceneVersion != scene.version) {
+            gpuCulling->upload(scene, *materialAtlas);
+            gpuSceneVersion = scene.version;
+        }
+        gpuCulling->maxDistance = config.maxDrawDistance;
+        if (config.doOcclusionCulling)
+            hiZ->reproject(viewProjection);
+        gpuCulling->cull(viewProjection, camera.Position, config.doOcclusionCulling ? hiZ : NULL);
+
+        sceneShader = celIndirectShader;
+        sceneShader->use();
+        gpuCulling->draw(*sceneShader, *materialAtlas, false);
+        glDepthMask(GL_FALSE);
+        if (config.useOIT) {
+            weightedOIT->begin();
+            sceneShader->setBool("oitPass", true);
+            gpuCulling->draw(*sceneShader, *materialAtlas, true);
+            sceneShader->setBool("oitPass", false);
+            weightedOIT->composite();
+        } else {
+            glEnable(GL_BLEND);
+            gpuCulling->draw(*sceneShader, *materialAtlas, true);
+            glDisable(GL_BLEND);
+        }
+        glDepthMask(GL_TRUE);
+        return;
+    }
+
+    // the scene chunks were recorded by prepareScene
+    scenePass.begin(&frameAllocator);
+    scenePass.setState(STATE_BLEND, false);
+    scenePass.setState(STATE_DEPTH_WRITE, true);
+    if (config.useOIT) {
+        scenePass.setState(STATE_OIT, false);
+        scenePass.setBool("oitPass", false);
+    }
+    double replayStart = glfwGetTime();
+
+    // the lists are replayed in order, so the transparent instances still come last
+    commandReplay.resetStats();
+    for (int chunk = 0; chunk < sceneChunkCount; chunk++)
+        commandReplay.replay(sceneChunks[chunk]);
+    commandReplay.replay(scenePass);
+    replayTime = (float) (glfwGetTime() - replayStart) * 1000.0f;
+
+    if (config.showOccluded) {
+        // culled set on top of everything as wireframe, without touching the depth
+        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+        glDisable(GL_DEPTH_TEST);
+        for (int i : occludedInstances) {
+            const SceneInstance& instance = scene.instances[i];
+            setDrawTransform(scene.nodes[instance.node].world);
+            drawMesh(instance);
+        }
+        glEnable(GL_DEPTH_TEST);
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+    }
+    // resolves the transparent instances over the cel image before the post passes read it
+    weightedOIT->composite();
+}
+
+void recordSceneChunk(CommandList& list, Shader* shader, int first, int last, bool useAtlas, bool useOIT){
+    // each chunk sets the shader and the blend state it starts with, it can't know where the previous one ended
+    list.useShader(shader);
+    bool blending = scene.instances[visibleInstances[first]].transparent;
+    recordTransparency(list, blending, useOIT);
+    for (int i = first; i < last; i++) {
+        const SceneInstance& instance = scene.instances[visibleInstances[i]];
+        // transparent instances come last, they are drawn with blending and don't write depth so they never occlude
+        if (instance.transparent != blending) {
+            blending = instance.transparent;
+            recordTransparency(list, blending, useOIT);
+        }
+        const glm::mat4& model = scene.nodes[instance.node].world;
+        list.drawMesh(instance.model, instance.mesh, model, glm::inverse(glm::transpose(model)), useAtlas);
+    }
+}
+
+void recordTransparency(CommandList& list, bool transparent, bool useOIT){
+    // with the weighted blended targets the order of the transparent instances doesn't matter
+    list.setState(useOIT ? STATE_OIT : STATE_BLEND, transparent);
+    if (useOIT)
+        list.setBool("oitPass", transparent);
+    list.setState(STATE_DEPTH_WRITE, !transparent);
+}
+
+void runCullingBenchmark(){
+    // renders the cel pass of growing stress scenes with the cpu culling (bvh + hi-z read back) and the compute culling,
+    // the gpu time comes from a timer query so every measured frame waits for the gpu
+    const int objectCounts[] = {250, 1000, 2500, 5000, 10000, 20000};
+    const int warmupFrames = 10;
+    const int measuredFrames = 60;
+    unsigned int query;
+    glGenQueries(1, &query);
+    setCommonUniforms();
+
+    std::cout << "objects  instances  culling  visible  cpu ms/frame  gpu ms/frame" << std::endl;
+    for (int objects : objectCounts) {
+        buildScene(objects);
+        for (int gpu = 0; gpu < 2; gpu++) {
+            if (gpu && celIndirectShader == NULL) {
+                std::cout << "ERROR::BENCHMARK:: no OpenGL 4.3 context, skipping the gpu culling" << std::endl;
+                continue;
+            }
+            config.doGpuCulling = gpu == 1;
+            double cpuTime = 0.0;
+            GLuint64 gpuTime = 0;
+            for (int frame = 0; frame < warmupFrames + measuredFrames; frame++) {
+                bool measured = frame >= warmupFrames;
+                streamRing->beginFrame();
+                // only the scene pass, the graph culls the post passes
+                sceneShader = celArrayShader;
+                buildFrameGraph(PASS_SCENE | PASS_EDGE | PASS_SCREEN, true);
+                if (measured)
+                    glBeginQuery(GL_TIME_ELAPSED, query);
+                double start = glfwGetTime();
+                prepareScene();
+                frameGraph.execute();
+                streamRing->endFrame();
+                double end = glfwGetTime();
+                if (measured) {
+                    glEndQuery(GL_TIME_ELAPSED);
+                    GLuint64 elapsed = 0;
+                    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+                    gpuTime += elapsed;
+                    cpuTime += end - start;
+                }
+            }
+            int visible = config.doGpuCulling ? gpuCulling->readVisibleCount() : (int) visibleInstances.size();
+            std::cout << std::setw(7) << objects << std::setw(11) << scene.instances.size()
+                      << std::setw(9) << (config.doGpuCulling ? "gpu" : "cpu") << std::setw(9) << visible
+                      << std::fixed << std::setprecision(3)
+                      << std::setw(14) << cpuTime * 1000.0 / measuredFrames
+                      << std::setw(14) << gpuTime / 1.0e6 / measuredFrames << std::endl;
+        }
+    }
+    glDeleteQueries(1, &query);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void selectPermutations(){
+    // the switches of the config as constants, the uber shaders (empty defines) branch on the uniforms instead.
+    // oitPass changes within the scene pass and the light stays a uniform, it's a single directional one
+    std::string celDefines, postDefines;
+    if (config.usePermutations) {
+        // the amount of cel steps is in the ramp
+        celDefines = ShaderPermutations::define("DO_CEL_SHADING", config.doCelShading)
+                   + ShaderPermutations::define("USE_BPSR", config.useBPSR);
+        // the switches of all post stages, a pass only reads the ones of its stages
+        postDefines = ShaderPermutations::define("DO_EDGE_ONLY", config.justLines)
+                    + ShaderPermutations::define("EDGE_SOBEL", config.edgeSobel)
+                    + ShaderPermutations::define("EDGE_LUMINANCE", config.edgeLuminance)
+                    + ShaderPermutations::define("DO_LINE_TREMOR", config.doLineTremor)
+                    + ShaderPermutations::define("NORMALIZE_DISTORTION", config.normalizeDistortion)
+                    + ShaderPermutations::define("RANDOMIZE", config.randomize)
+                    + ShaderPermutations::define("HASH_TEXTURE", config.hashTexture);
+    }
+    celShader = celPermutations->get(celDefines);
+    celArrayShader = celArrayPermutations->get(celDefines);
+    celIndirectShader = celIndirectPermutations != NULL ? celIndirectPermutations->get(celDefines) : NULL;
+    // without edge detection the edge stage would only copy, the tremor reads the cel image. The compute edges run
+    // before the chain
+    std::vector<int> postStages;
+    if (config.doEdgeDetection && !useComputeEdges())
+        postStages.push_back(edgeStage);
+    postStages.push_back(tremorStage);
+    postPasses = &postChain->passes(postStages, config.fusePostPasses);
+    for (PostChain::Pass& pass : *postPasses)
+        pass.shader = pass.permutations->get(postDefines);
+    sceneShader = config.useTextureArrays ? celArrayShader : celShader;
+}
+
+void bakeLuts(){
+    // the keys hold the values the functions read, a lut is only baked again when one of them changed
+    if (config.useToonRamp && !celRamp->load(toonRampPath))
+        config.useToonRamp = false;
+    if (!config.useToonRamp) {
+        int celAmount = config.celAmount;
+        celRamp->bake("cel " + std::to_string(celAmount), [celAmount](float shading, float) {
+            // the quantization loop the cel shader ran for every fragment. The i == 0 fix-up can send it back up,
+            // the iteration cap keeps it from looping forever when it lands on 0 again
+            float celShading = 1.0f;
+            float step = 1.0f / celAmount;
+            int iterations = 0;
+            for (float i = 1 - (step * 2); i >= 0 && iterations <= celAmount; i = i - step, iterations++) {
+                if (i == 0) i = 0.1f;
+                if (shading < i) celShading = i + step;
+            }
+            return glm::vec3(celShading);
+        });
+    }
+    float exponent = config.specularExponent;
+    specularCurve->bake("specular " + std::to_string(exponent), [exponent](float nDotH, float) {
+        return glm::vec3(std::pow(nDotH, exponent));
+    });
+}
+
+void runPermutationBenchmark(){
+    // renders the three passes of a few configs with the uber shaders and with their variants, the gpu time comes
+    // from a timer query. The build time is the first get of the variant, from the disk cache after the first run
+    struct BenchmarkConfig { bool celShading, bpsr; int celAmount; bool edges, tremor; };
+    const BenchmarkConfig configs[] = {
+        {false, false, 4, false, false},
+        {true, false, 4, false, false},
+        {true, true, 4, true, false},
+        {true, true, 12, true, true},
+    };
+    const int warmupFrames = 10;
+    const int measuredFrames = 60;
+    unsigned int query;
+    glGenQueries(1, &query);
+    buildScene(1000);
+    config.doGpuCulling = false;
+    config.useTextureArrays = true;
+
+    std::cout << std::endl << "cel  bpsr  steps  edges  tremor  uber ms/frame  variant ms/frame  variant build ms" << std::endl;
+    for (const BenchmarkConfig& benchmarkConfig : configs) {
+        config.doCelShading = benchmarkConfig.celShading;
+        config.useBPSR = benchmarkConfig.bpsr;
+        config.celAmount = benchmarkConfig.celAmount;
+        config.doEdgeDetection = benchmarkConfig.edges;
+        config.doLineTremor = benchmarkConfig.tremor;
+        double gpuTimes[2];
+        float buildTime = 0.0f;
+        for (int specialized = 0; specialized < 2; specialized++) {
+            config.usePermutations = specialized == 1;
+            float buildStart = (float) glfwGetTime();
+            selectPermutations();
+            bakeLuts();
+            if (specialized)
+                buildTime = ((float) glfwGetTime() - buildStart) * 1000.0f;
+            setCommonUniforms();
+            GLuint64 gpuTime = 0;
+            for (int frame = 0; frame < warmupFrames + measuredFrames; frame++) {
+                bool measured = frame >= warmupFrames;
+                streamRing->beginFrame();
+                buildFrameGraph(PASS_SCENE | PASS_EDGE | PASS_SCREEN, false);
+                if (measured)
+                    glBeginQuery(GL_TIME_ELAPSED, query);
+                prepareScene();
+                frameGraph.execute();
+                streamRing->endFrame();
+                if (measured) {
+                    glEndQuery(GL_TIME_ELAPSED);
+                    GLuint64 elapsed = 0;
+                    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+                    gpuTime += elapsed;
+                }
+            }
+            gpuTimes[specialized] = gpuTime / 1.0e6 / measuredFrames;
+        }
+        std::cout << std::setw(3) << benchmarkConfig.celShading << std::setw(6) << benchmarkConfig.bpsr
+                  << std::setw(7) << benchmarkConfig.celAmount << std::setw(7) << benchmarkConfig.edges
+                  << std::setw(8) << benchmarkConfig.tremor << std::fixed << std::setprecision(3)
+                  << std::setw(15) << gpuTimes[0] << std::setw(18) << gpuTimes[1]
+                  << std::setw(18) << buildTime << std::endl;
+    }
+    glDeleteQueries(1, &query);
+}
 
+bool useComputeEdges(){
+    return config.doEdgeDetection && config.computeEdges && computeEdges->supported;
+}
+
+void runPostBenchmark(){
+    // the post passes alone at 4K with the edges and the tremor on, one pass per stage against the fused pass. The
+    // input is the last frame on the screen scaled up, the passes run in a render graph of their own. The traffic is
+    // an estimate, every pass reads its input once (the filter taps hit the texture cache) and writes its target once
+    const int width = 3840, height = 2160;
+    const int warmupFrames = 10;
+    const int measuredFrames = 60;
+    unsigned int query;
+    glGenQueries(1, &query);
+    unsigned int input, inputFramebuffer;
+    glGenTextures(1, &input);
+    glBindTexture(GL_TEXTURE_2D, input);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glGenFramebuffers(1, &inputFramebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, inputFramebuffer);
+    glFramebufferTexture2D(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, input, 0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, windowWidth, windowHeight, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    config.doEdgeDetection = true;
+    config.doLineTremor = true;
+    config.usePermutations = true;
+    glViewport(0, 0, width, height);
+    RenderGraph postGraph;
+    std::cout << std::endl << "post passes at " << width << "x" << height << std::endl;
+    std::cout << "fused  passes  targets MB  traffic MB/frame  gpu ms/frame  GB/s" << std::endl;
+    for (int fused = 0; fused < 2; fused++) {
+        config.fusePostPasses = fused == 1;
+        selectPermutations();
+        setCommonUniforms();
+        for (const PostChain::Pass& pass : *postPasses) {
+            pass.shader->use();
+            pass.shader->setVec2("texelSize", glm::vec2(1.0f / width, 1.0f / height));
+        }
+        GLuint64 gpuTime = 0;
+        for (int frame = 0; frame < warmupFrames + measuredFrames; frame++) {
+            bool measured = frame >= warmupFrames;
+            postGraph.reset();
+            int postInput = postGraph.importTexture("input", input);
+            for (size_t i = 0; i < postPasses->size(); i++) {
+                PostChain::Pass* pass = &(*postPasses)[i];
+                int output = postGraph.createTarget("post " + pass->name, {width, height, GL_RGB8});
+                int postPass = postGraph.addPass(pass->name, [pass, postInput](RenderGraph& graph) {
+                    glDisable(GL_DEPTH_TEST);
+                    postChain->draw(*pass, graph.texture(postInput), quadVAO);
+                    glActiveTexture(GL_TEXTURE0);
+                });
+                postGraph.read(postPass, postInput);
+                postGraph.write(postPass, output);
+                postInput = output;
+            }
+            postGraph.markOutput(postInput);
+            postGraph.compile();
+            if (measured)
+                glBeginQuery(GL_TIME_ELAPSED, query);
+            postGraph.execute();
+            if (measured) {
+                glEndQuery(GL_TIME_ELAPSED);
+                GLuint64 elapsed = 0;
+                glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+                gpuTime += elapsed;
+            }
+        }
+        double ms = gpuTime / 1.0e6 / measuredFrames;
+        double trafficMB = postPasses->size() * 2.0 * width * height * 3 / 1048576.0;
+        std::cout << std::setw(5) << fused << std::setw(8) << postPasses->size() << std::fixed << std::setprecision(1)
+                  << std::setw(12) << postGraph.declaredBytes / 1048576.0 << std::setw(18) << trafficMB
+                  << std::setprecision(3) << std::setw(14) << ms
+                  << std::setprecision(1) << std::setw(6) << trafficMB / 1024.0 / (ms / 1000.0) << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(0, 0, windowWidth, windowHeight);
+    glDeleteFramebuffers(1, &inputFramebuffer);
+    glDeleteTextures(1, &input);
+    glDeleteQueries(1, &query);
+}
+
+void runEdgeBenchmark(){
+    // the edge stage alone as a fragment pass and as the compute pass, over a few resolutions and stroke sizes. The
+    // input is the last frame on the screen scaled up. With LIBGL_ALWAYS_SOFTWARE=1 mesa runs it on llvmpipe
+    const int sizes[][2] = {{1280, 720}, {1920, 1080}, {3840, 2160}};
+    const float strokeSizes[] = {1.0f, 2.0f, 3.0f, 5.0f};
+    const int warmupFrames = 5;
+    const int measuredFrames = 30;
+    if (!computeEdges->supported) {
+        std::cout << "ERROR::BENCHMARK:: no OpenGL 4.3 context, skipping the compute edges" << std::endl;
+        return;
+    }
+    unsigned int query;
+    glGenQueries(1, &query);
+    config.doEdgeDetection = true;
+    config.usePermutations = true;
+    config.edgeSobel = false;
+    config.edgeLuminance = false;
+    PostChain::Pass& fragmentPass = postChain->passes({edgeStage}, false)[0];
+    selectPermutations();
+    fragmentPass.shader = fragmentPass.permutations->get(ShaderPermutations::define("DO_EDGE_ONLY", false)
+                                                         + ShaderPermutations::define("EDGE_SOBEL", false)
+                                                         + ShaderPermutations::define("EDGE_LUMINANCE", false));
+    computeEdges->sobel = false;
+    computeEdges->luminance = false;
+    computeEdges->edgeOnly = false;
+    glDisable(GL_DEPTH_TEST);
+
+    std::cout << std::endl << "edges on " << (const char*) glGetString(GL_RENDERER) << std::endl;
+    std::cout << "resolution  stroke  fragment ms  compute ms" << std::endl;
+    for (const auto& size : sizes) {
+        int width = size[0], height = size[1];
+        unsigned int textures[2], framebuffers[2];
+        glGenTextures(2, textures);
+        glGenFramebuffers(2, framebuffers);
+        for (int i = 0; i < 2; i++) {
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[i]);
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, textures[i], 0);
+        }
+        // textures[0] is the input, textures[1] the edges
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffers[0]);
+        glBlitFramebuffer(0, 0, windowWidth, windowHeight, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        glViewport(0, 0, width, height);
+
+        for (float strokeSize : strokeSizes) {
+            fragmentPass.shader->use();
+            fragmentPass.shader->setVec2("texelSize", glm::vec2(1.0f / width, 1.0f / height));
+            fragmentPass.shader->setFloat("strokeSize", strokeSize);
+            double times[2];
+            for (int compute = 0; compute < 2; compute++) {
+                GLuint64 gpuTime = 0;
+                for (int frame = 0; frame < warmupFrames + measuredFrames; frame++) {
+                    bool measured = frame >= warmupFrames;
+                    if (measured)
+                        glBeginQuery(GL_TIME_ELAPSED, query);
+                    if (compute) {
+                        computeEdges->dispatch(textures[0], textures[1], width, height, strokeSize);
+                    } else {
+                        glBindFramebuffer(GL_FRAMEBUFFER, framebuffers[1]);
+                        postChain->draw(fragmentPass, textures[0], quadVAO);
+                    }
+                    if (measured) {
+                        glEndQuery(GL_TIME_ELAPSED);
+                        GLuint64 elapsed = 0;
+                        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+                        gpuTime += elapsed;
+                    }
+                }
+                times[compute] = gpuTime / 1.0e6 / measuredFrames;
+            }
+            std::cout << std::setw(5) << width << "x" << std::setw(4) << height << std::setw(8) << std::setprecision(1)
+                      << std::fixed << strokeSize << std::setprecision(3) << std::setw(13) << times[0]
+                      << std::setw(12) << times[1] << std::endl;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(2, framebuffers);
+        glDeleteTextures(2, textures);
+    }
+    glViewport(0, 0, windowWidth, windowHeight);
+    glDeleteQueries(1, &query);
 }
 
 void drawCrate() {
-    edgeShader->use();
-    edgeShader->setBool("doEdgeDetection", config.doEdgeDetection);
-    celShader->use();
+    sceneShader->use();
     // camera parameters
-    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)windowWidth / (float)windowHeight, 0.1f, 100.0f);
     glm::mat4 view = camera.GetViewMatrix();
-    glm::mat4 viewProjection = projection * view;
-    // set projection matrix uniform
-    celShader->setMat4("projection", projection);
-    celShader->setMat4("view", view);
+    setFrameTransforms(projection, view);
 
     glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(3, 1, 1.39));
-    celShader->setMat4("model", model);
-    celShader->setMat4("modelInvT", glm::inverse(glm::transpose(model)));
-    crate->Draw(*celShader);
+    setDrawTransform(model);
+    drawModel(crate);
 }
 
 void drawRobot() {
-    edgeShader->use();
-    edgeShader->setBool("doEdgeDetection", config.doEdgeDetection);
-    celShader->use();
+    sceneShader->use();
     // camera parameters
-    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)windowWidth / (float)windowHeight, 0.1f, 100.0f);
     glm::mat4 view = camera.GetViewMatrix();
-    glm::mat4 viewProjection = projection * view;
-    // set projection matrix uniform
-    celShader->setMat4("projection", projection);
-    celShader->setMat4("view", view);
+    setFrameTransforms(projection, view);
 
 
     glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(-2, 0.28, 1.39));
-    celShader->setMat4("model", model);
-    celShader->setMat4("modelInvT", glm::inverse(glm::transpose(model)));
-    robot->Draw(*celShader);
+    setDrawTransform(model);
+    drawModel(robot);
+}
+
+void setFrameTransforms(const glm::mat4& projection, const glm::mat4& view) {
+    FrameData data = {projection, view, projection * view};
+    streamRing->bindUniform(STREAM_FRAME_BINDING, &data, sizeof(data));
+    // the draws of the frame combine their model matrix with it
+    commandReplay.viewProjection = data.viewProjection;
+}
+
+void setDrawTransform(const glm::mat4& model) {
+    DrawData data = {model, glm::inverse(glm::transpose(model)), commandReplay.viewProjection * model};
+    streamRing->bindUniform(STREAM_DRAW_BINDING, &data, sizeof(data));
+}
+
+void drawModel(Model* model) {
+    if (config.useTextureArrays)
+        model->Draw(*sceneShader, *materialAtlas);
+    else
+        model->Draw(*sceneShader);
+}
+
+void drawMesh(const SceneInstance& instance) {
+    if (config.useTextureArrays)
+        instance.model->DrawMesh(instance.mesh, *sceneShader, *materialAtlas);
+    else
+        instance.model->DrawMesh(instance.mesh, *sceneShader);
 }
 
 // ---------------
@@ -635,10 +1540,22 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 }
 
 
+// glfw: the window contents were damaged (uncovered, restored), the last frame has to be presented again
+void window_refresh_callback(GLFWwindow* window)
+{
+    changes.invalidate(PASS_SCREEN);
+}
+
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
     // make sure the viewport matches the new window dimensions; note that width and
     // height will be significantly larger than specified on retina displays.
     glViewport(0, 0, width, height);
+    // minimized, the targets keep their size until the window comes back
+    if (width == 0 || height == 0)
+        return;
+    windowWidth = width;
+    windowHeight = height;
+    changes.invalidate(PASS_SCENE);
 }
\ No newline at end of file
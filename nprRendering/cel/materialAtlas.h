@@ -0,0 +1,361 @@
+#ifndef MATERIALATLAS_H
+#define MATERIALATLAS_H
+
+#include <glad/glad.h>
+
+#include <stb_image.h>
+
+#include <shader.h>
+
+#include <string>
+#include <iostream>
+#include <map>
+#include <vector>
+#include <cmath>
+
+// material texture kinds, each one is sampled from its own sampler2DArray in the shaders
+enum AtlasSlot {
+    ATLAS_DIFFUSE = 0,
+    ATLAS_NORMAL,
+    ATLAS_AMBIENT,
+    ATLAS_SPECULAR,
+    ATLAS_SLOT_COUNT
+};
+
+// must match MAX_MATERIALS in the *Array.frag shaders
+const int ATLAS_MAX_MATERIALS = 256;
+// uniform block binding point used for the material table
+const unsigned int ATLAS_MATERIALS_BINDING = 0;
+// texture unit of the first slot, slots use consecutive units
+const unsigned int ATLAS_FIRST_UNIT = 0;
+
+// Groups the material textures of every loaded model into GL_TEXTURE_2D_ARRAY pages, so meshes that share
+// a page only differ by the layer index they read from the material table and don't need any texture binds.
+//
+// usage:
+//   MaterialAtlas atlas;
+//   Model model("car/Body_LOD0.obj", false, &atlas); // registers the materials while loading
+//   atlas.build();                                   // groups, resamples and uploads the pages
+//   atlas.attach(shader);                            // once per shader with the array samplers
+//   atlas.beginPass(); model.Draw(shader, atlas);    // per frame
+class MaterialAtlas {
+public:
+    struct Image {
+        std::string path;
+        int width = 0, height = 0, components = 0;
+        std::vector<unsigned char> pixels;
+        // filled by build()
+        int page = -1, layer = -1;
+    };
+
+    struct Page {
+        unsigned int id = 0; // GL_TEXTURE_2D_ARRAY object
+        int slot = 0;
+        int width = 0, height = 0, components = 0;
+        std::vector<int> images; // indices into images, in layer order
+    };
+
+    struct Material {
+        int image[ATLAS_SLOT_COUNT] = {-1, -1, -1, -1};
+    };
+
+    std::vector<Image> images;
+    std::vector<Page> pages;
+    std::vector<Material> materials;
+    // number of images that were resampled to fit into an existing page
+    int resampledImages = 0;
+    // a (size, format) group smaller than this gets merged into the nearest bigger page
+    int minPageLayers = 2;
+
+    ~MaterialAtlas()
+    {
+        for (unsigned int i = 0; i < pages.size(); i++)
+            glDeleteTextures(1, &pages[i].id);
+        if (materialsUBO)
+            glDeleteBuffers(1, &materialsUBO);
+    }
+
+    // registers a material and returns its index in the material table, paths may be empty for missing textures
+    int addMaterial(const std::string paths[ATLAS_SLOT_COUNT])
+    {
+        Material material;
+        for (int slot = 0; slot < ATLAS_SLOT_COUNT; slot++)
+            if (!paths[slot].empty())
+                material.image[slot] = loadImage(slot, paths[slot]);
+
+        // materials with identical textures share the same entry
+        for (unsigned int i = 0; i < materials.size(); i++) {
+            bool same = true;
+            for (int slot = 0; slot < ATLAS_SLOT_COUNT; slot++)
+                same = same && materials[i].image[slot] == material.image[slot];
+            if (same)
+                return (int) i;
+        }
+        if (materials.size() >= ATLAS_MAX_MATERIALS) {
+            std::cout << "ERROR::MATERIAL ATLAS:: more than " << ATLAS_MAX_MATERIALS << " materials" << std::endl;
+            return -1;
+        }
+        materials.push_back(material);
+        return (int) materials.size() - 1;
+    }
+
+    // groups the registered images into pages, uploads them and the material table, and frees the cpu copies
+    void build()
+    {
+        int maxLayers = 256;
+        glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+
+        for (int slot = 0; slot < ATLAS_SLOT_COUNT; slot++) {
+            // 1. group by size and format
+            std::map<long long, std::vector<int> > groups;
+            for (unsigned int i = 0; i < images.size(); i++)
+                if (imageSlot[i] == slot)
+                    groups[groupKey(images[i].width, images[i].height, images[i].components)].push_back(i);
+
+            // 2. small groups of odd sizes are resampled into the nearest well populated group
+            std::vector<long long> keys;
+            for (auto it = groups.begin(); it != groups.end(); ++it)
+                keys.push_back(it->first);
+            for (unsigned int k = 0; k < keys.size(); k++) {
+                std::vector<int> &group = groups[keys[k]];
+                if (group.empty() || (int) group.size() >= minPageLayers)
+                    continue;
+                long long nearest = nearestGroup(groups, keys[k]);
+                if (nearest == keys[k])
+                    continue;
+                Image &target = images[groups[nearest][0]];
+                for (unsigned int g = 0; g < group.size(); g++) {
+                    resample(images[group[g]], target.width, target.height, target.components);
+                    groups[nearest].push_back(group[g]);
+                    resampledImages++;
+                }
+                group.clear();
+            }
+
+            // 3. one array page per group, split when it has more images than layers allowed
+            for (auto it = groups.begin(); it != groups.end(); ++it) {
+                const std::vector<int> &group = it->second;
+                for (unsigned int first = 0; first < group.size(); first += maxLayers) {
+                    Page page;
+                    page.slot = slot;
+                    page.width = images[group[first]].width;
+                    page.height = images[group[first]].height;
+                    page.components = images[group[first]].components;
+                    for (unsigned int g = first; g < group.size() && g < first + maxLayers; g++) {
+                        images[group[g]].page = (int) pages.size();
+                        images[group[g]].layer = (int) page.images.size();
+                        page.images.push_back(group[g]);
+                    }
+                    uploadPage(page);
+                    pages.push_back(page);
+                }
+            }
+        }
+
+        uploadMaterials();
+
+        // pixel data lives on the gpu now
+        for (unsigned int i = 0; i < images.size(); i++)
+            std::vector<unsigned char>().swap(images[i].pixels);
+
+        std::cout << "MATERIAL ATLAS:: " << images.size() << " textures in " << pages.size() << " pages, "
+                  << resampledImages << " resampled, " << materials.size() << " materials" << std::endl;
+    }
+
+    // sets the sampler units and the material table binding of a shader that uses the *Array.frag variants
+    void attach(Shader &shader) const
+    {
+        shader.use();
+        shader.setInt("atlas_diffuse", ATLAS_FIRST_UNIT + ATLAS_DIFFUSE);
+        shader.setInt("atlas_normal", ATLAS_FIRST_UNIT + ATLAS_NORMAL);
+        shader.setInt("atlas_ambient", ATLAS_FIRST_UNIT + ATLAS_AMBIENT);
+        shader.setInt("atlas_specular", ATLAS_FIRST_UNIT + ATLAS_SPECULAR);
+        unsigned int blockIndex = glGetUniformBlockIndex(shader.ID, "Materials");
+        if (blockIndex != GL_INVALID_INDEX)
+            glUniformBlockBinding(shader.ID, blockIndex, ATLAS_MATERIALS_BINDING);
+    }
+
+    // forget which pages are bound, call it whenever other code may have touched the atlas texture units
+    void beginPass()
+    {
+        for (int slot = 0; slot < ATLAS_SLOT_COUNT; slot++)
+            boundPage[slot] = -1;
+        glBindBufferBase(GL_UNIFORM_BUFFER, ATLAS_MATERIALS_BINDING, materialsUBO);
+        textureBinds = 0;
+    }
+
+    // selects a material for the next draw, only binds the pages that differ from the ones already bound
+    void use(Shader &shader, int material)
+    {
+        shader.setInt("materialIndex", material);
+        if (material < 0)
+            return;
+        for (int slot = 0; slot < ATLAS_SLOT_COUNT; slot++) {
+            int image = materials[material].image[slot];
+            if (image < 0 || images[image].page == boundPage[slot])
+                continue;
+            boundPage[slot] = images[image].page;
+            glActiveTexture(GL_TEXTURE0 + ATLAS_FIRST_UNIT + slot);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, pages[boundPage[slot]].id);
+            textureBinds++;
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // identifies the pages a material reads from, materials with the same key can be drawn without rebinding
+    long long pageKey(int material) const
+    {
+        long long key = 0;
+        if (material < 0)
+            return key;
+        for (int slot = 0; slot < ATLAS_SLOT_COUNT; slot++) {
+            int image = materials[material].image[slot];
+            key = key * 4096 + (image < 0 ? 0 : images[image].page + 1);
+        }
+        return key;
+    }
+
+    // texture binds issued since the last beginPass()
+    int textureBinds = 0;
+
+private:
+    std::vector<int> imageSlot;
+    std::map<std::string, int> imageByPath;
+    int boundPage[ATLAS_SLOT_COUNT] = {-1, -1, -1, -1};
+    unsigned int materialsUBO = 0;
+
+    static long long groupKey(int width, int height, int components)
+    {
+        return ((long long) width << 32) | ((long long) height << 8) | components;
+    }
+
+    int loadImage(int slot, const std::string &path)
+    {
+        // the same file used as two different kinds of map gets two entries, they can end up in different pages
+        std::string key = std::to_string(slot) + ":" + path;
+        auto found = imageByPath.find(key);
+        if (found != imageByPath.end())
+            return found->second;
+
+        Image image;
+        image.path = path;
+        unsigned char *data = stbi_load(path.c_str(), &image.width, &image.height, &image.components, 0);
+        if (!data)
+        {
+            std::cout << "ERROR::MATERIAL ATLAS:: failed to load texture data at path: " << path << std::endl;
+            imageByPath[key] = -1;
+            return -1;
+        }
+        image.pixels.assign(data, data + image.width * image.height * image.components);
+        stbi_image_free(data);
+
+        images.push_back(image);
+        imageSlot.push_back(slot);
+        imageByPath[key] = (int) images.size() - 1;
+        return (int) images.size() - 1;
+    }
+
+    // the populated group of the same slot with the closest size (in log2 area), preferring the same format
+    long long nearestGroup(std::map<long long, std::vector<int> > &groups, long long key) const
+    {
+        int width = (int) (key >> 32), height = (int) ((key >> 8) & 0xffffff), components = (int) (key & 0xff);
+        long long best = key;
+        float bestDistance = 1e30f;
+        for (auto it = groups.begin(); it != groups.end(); ++it) {
+            if (it->first == key || it->second.empty())
+                continue;
+            int w = (int) (it->first >> 32), h = (int) ((it->first >> 8) & 0xffffff), c = (int) (it->first & 0xff);
+            float distance = std::fabs(std::log2((float) (w * h) / (float) (width * height)))
+                             + (c == components ? 0.0f : 0.5f)
+                             + ((int) it->second.size() >= minPageLayers ? 0.0f : 4.0f);
+            if (distance < bestDistance) {
+                bestDistance = distance;
+                best = it->first;
+            }
+        }
+        return best;
+    }
+
+    // bilinear resample to the page size, also converts the number of components
+    static void resample(Image &image, int width, int height, int components)
+    {
+        std::vector<unsigned char> out(width * height * components);
+        for (int y = 0; y < height; y++) {
+            float v = ((float) y + 0.5f) / (float) height * (float) image.height - 0.5f;
+            int y0 = v < 0 ? 0 : (int) v;
+            int y1 = y0 + 1 < image.height ? y0 + 1 : image.height - 1;
+            float fy = v < 0 ? 0.0f : v - (float) y0;
+            for (int x = 0; x < width; x++) {
+                float u = ((float) x + 0.5f) / (float) width * (float) image.width - 0.5f;
+                int x0 = u < 0 ? 0 : (int) u;
+                int x1 = x0 + 1 < image.width ? x0 + 1 : image.width - 1;
+                float fx = u < 0 ? 0.0f : u - (float) x0;
+                for (int c = 0; c < components; c++) {
+                    // grayscale sources are replicated, missing alpha is opaque
+                    int src = c < image.components ? c : (c == 3 ? -1 : 0);
+                    float value = 255.0f;
+                    if (src >= 0) {
+                        float a = image.pixels[(y0 * image.width + x0) * image.components + src];
+                        float b = image.pixels[(y0 * image.width + x1) * image.components + src];
+                        float d = image.pixels[(y1 * image.width + x0) * image.components + src];
+                        float e = image.pixels[(y1 * image.width + x1) * image.components + src];
+                        value = (a + (b - a) * fx) * (1.0f - fy) + (d + (e - d) * fx) * fy;
+                    }
+                    out[(y * width + x) * components + c] = (unsigned char) (value + 0.5f);
+                }
+            }
+        }
+        image.width = width;
+        image.height = height;
+        image.components = components;
+        image.pixels.swap(out);
+    }
+
+    static void formats(int components, GLenum &internalFormat, GLenum &format)
+    {
+        if (components == 1) { internalFormat = GL_R8; format = GL_RED; }
+        else if (components == 2) { internalFormat = GL_RG8; format = GL_RG; }
+        else if (components == 3) { internalFormat = GL_RGB8; format = GL_RGB; }
+        else { internalFormat = GL_RGBA8; format = GL_RGBA; }
+    }
+
+    void uploadPage(Page &page)
+    {
+        GLenum internalFormat, format;
+        formats(page.components, internalFormat, format);
+
+        glGenTextures(1, &page.id);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, page.id);
+        // rows of 1 and 3 component images are not 4 byte aligned
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, internalFormat, page.width, page.height, (GLsizei) page.images.size(),
+                     0, format, GL_UNSIGNED_BYTE, NULL);
+        for (unsigned int layer = 0; layer < page.images.size(); layer++)
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, page.width, page.height, 1, format, GL_UNSIGNED_BYTE,
+                            &images[page.images[layer]].pixels[0]);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    }
+
+    // std140 table of ivec4 (diffuse, normal, ambient, specular) layers, -1 for a missing texture
+    void uploadMaterials()
+    {
+        std::vector<int> table(ATLAS_MAX_MATERIALS * 4, -1);
+        for (unsigned int i = 0; i < materials.size(); i++)
+            for (int slot = 0; slot < ATLAS_SLOT_COUNT; slot++) {
+                int image = materials[i].image[slot];
+                table[i * 4 + slot] = image < 0 ? -1 : images[image].layer;
+            }
+        glGenBuffers(1, &materialsUBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, materialsUBO);
+        glBufferData(GL_UNIFORM_BUFFER, table.size() * sizeof(int), &table[0], GL_STATIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+};
+#endif
@@ -7,6 +7,7 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <shader.h>
+#include <bounds.h>
 
 #include <string>
 #include <fstream>
@@ -41,6 +42,10 @@ public:
     vector<unsigned int> indices;
     vector<Texture> textures;
     unsigned int VAO;
+    // entry of the mesh material in the MaterialAtlas table, -1 if the model was loaded without an atlas
+    int materialIndex = -1;
+    // object space bounds, computed once at import
+    AABB bounds;
 
     /*  Functions  */
     // constructor
@@ -50,6 +55,9 @@ public:
         this->indices = indices;
         this->textures = textures;
 
+        for(unsigned int i = 0; i < vertices.size(); i++)
+            bounds.grow(vertices[i].Position);
+
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
         setupMesh();
     }
@@ -83,13 +91,19 @@ public:
             glBindTexture(GL_TEXTURE_2D, textures[i].id);
         }
 
+        // always good practice to set everything back to defaults once configured.
+        glActiveTexture(GL_TEXTURE0);
+
         // draw mesh
+        DrawGeometry();
+    }
+
+    // draw the mesh without touching any texture state (the material atlas path binds its own pages)
+    void DrawGeometry()
+    {
         glBindVertexArray(VAO);
         glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
         glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
     }
 
 private:
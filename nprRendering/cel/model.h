@@ -13,6 +13,7 @@
 
 #include <mesh.h>
 #include <shader.h>
+#include <materialAtlas.h>
 
 #include <string>
 #include <fstream>
@@ -24,18 +25,33 @@ using namespace std;
 
 unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
 
+// a node of the imported hierarchy, parents are always stored before their children
+struct ModelNode {
+    string name;
+    int parent;
+    glm::mat4 transform; // relative to the parent node
+    vector<unsigned int> meshes; // indices into Model::meshes
+};
+
 class Model
 {
 public:
     /*  Model Data */
     vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
     vector<Mesh> meshes;
+    vector<ModelNode> nodes;
     string directory;
     bool gammaCorrection;
+    // if set, mesh materials are also registered in the atlas while loading
+    MaterialAtlas *atlas;
+    // with an atlas the per mesh textures are only uploaded by the first draw without it, the pages hold the same
+    // images and most runs never leave them
+    bool meshTexturesLoaded;
 
     /*  Functions   */
     // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    Model(string const &path, bool gamma = false, MaterialAtlas *atlas = nullptr)
+        : gammaCorrection(gamma), atlas(atlas), meshTexturesLoaded(atlas == nullptr)
     {
         loadModel(path);
     }
@@ -43,10 +59,46 @@ public:
     // draws the model, and thus all its meshes
     void Draw(Shader shader)
     {
+        LoadMeshTextures();
         for(unsigned int i = 0; i < meshes.size(); i++)
             meshes[i].Draw(shader);
     }
 
+    // draws the model reading the textures from the atlas pages, the shader must use the *Array.frag variant
+    void Draw(Shader &shader, MaterialAtlas &materialAtlas)
+    {
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            DrawMesh(i, shader, materialAtlas);
+    }
+
+    // draws a single mesh, used by the scene graph that culls meshes individually
+    void DrawMesh(unsigned int i, Shader shader)
+    {
+        LoadMeshTextures();
+        meshes[i].Draw(shader);
+    }
+
+    void DrawMesh(unsigned int i, Shader &shader, MaterialAtlas &materialAtlas)
+    {
+        materialAtlas.use(shader, meshes[i].materialIndex);
+        meshes[i].DrawGeometry();
+    }
+
+    // uploads the per mesh textures the loading left to the atlas, once
+    void LoadMeshTextures()
+    {
+        if(meshTexturesLoaded)
+            return;
+        for(unsigned int j = 0; j < textures_loaded.size(); j++)
+            textures_loaded[j].id = TextureFromFile(textures_loaded[j].path.c_str(), this->directory);
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            for(unsigned int t = 0; t < meshes[i].textures.size(); t++)
+                for(unsigned int j = 0; j < textures_loaded.size(); j++)
+                    if(meshes[i].textures[t].path == textures_loaded[j].path)
+                        meshes[i].textures[t].id = textures_loaded[j].id;
+        meshTexturesLoaded = true;
+    }
+
 private:
     /*  Functions   */
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
@@ -65,28 +117,45 @@ private:
         directory = path.substr(0, path.find_last_of('/'));
 
         // process ASSIMP's root node recursively
-        processNode(scene->mRootNode, scene);
+        processNode(scene->mRootNode, scene, -1);
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
-    void processNode(aiNode *node, const aiScene *scene)
+    // the hierarchy and the node transformations are kept in nodes so the scene graph can place the meshes.
+    void processNode(aiNode *node, const aiScene *scene, int parent)
     {
+        ModelNode modelNode;
+        modelNode.name = node->mName.C_Str();
+        modelNode.parent = parent;
+        modelNode.transform = toGlm(node->mTransformation);
         // process each mesh located at the current node
         for(unsigned int i = 0; i < node->mNumMeshes; i++)
         {
             // the node object only contains indices to index the actual objects in the scene.
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
+            modelNode.meshes.push_back(meshes.size());
             meshes.push_back(processMesh(mesh, scene));
         }
+        nodes.push_back(modelNode);
+        int index = (int) nodes.size() - 1;
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
         {
-            processNode(node->mChildren[i], scene);
+            processNode(node->mChildren[i], scene, index);
         }
 
     }
 
+    // assimp matrices are row major
+    static glm::mat4 toGlm(const aiMatrix4x4 &m)
+    {
+        return glm::mat4(glm::vec4(m.a1, m.b1, m.c1, m.d1),
+                         glm::vec4(m.a2, m.b2, m.c2, m.d2),
+                         glm::vec4(m.a3, m.b3, m.c3, m.d3),
+                         glm::vec4(m.a4, m.b4, m.c4, m.d4));
+    }
+
     Mesh processMesh(aiMesh *mesh, const aiScene *scene)
     {
         // data to fill
@@ -165,7 +234,26 @@ private:
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
         // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        Mesh result(vertices, indices, textures);
+        if(atlas)
+            result.materialIndex = registerMaterial(material);
+        return result;
+    }
+
+    // adds the first texture of every kind to the material atlas, the slot order matches AtlasSlot
+    int registerMaterial(aiMaterial *mat)
+    {
+        const aiTextureType types[ATLAS_SLOT_COUNT] = {aiTextureType_DIFFUSE, aiTextureType_HEIGHT, aiTextureType_AMBIENT, aiTextureType_SPECULAR};
+        string paths[ATLAS_SLOT_COUNT];
+        for(int slot = 0; slot < ATLAS_SLOT_COUNT; slot++)
+        {
+            if(mat->GetTextureCount(types[slot]) == 0)
+                continue;
+            aiString str;
+            mat->GetTexture(types[slot], 0, &str);
+            paths[slot] = directory + '/' + string(str.C_Str());
+        }
+        return atlas->addMaterial(paths);
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
@@ -193,7 +281,7 @@ private:
                 Texture texture;
 //                std::cout << "PATH FOUND: " << str.C_Str() << std::endl;
 //                std::cout << "type FOUND: " << typeName << std::endl;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
+                texture.id = atlas ? 0 : TextureFromFile(str.C_Str(), this->directory);
                 texture.type = typeName;
                 texture.path = str.C_Str();
                 textures.push_back(texture);
@@ -0,0 +1,536 @@
+#ifndef NOISEBAKER_H
+#define NOISEBAKER_H
+
+#include <glad/glad.h>
+
+#include <workerPool.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+enum NoiseType { NOISE_PERLIN, NOISE_SIMPLEX, NOISE_WORLEY, NOISE_BLUE };
+
+// what a noise texture is made of, also the name of its cache file
+struct NoiseDesc {
+    NoiseType type;
+    int size;              // texels along every axis, a power of two
+    bool volume = false;   // size^3 texels in a 3D texture instead of size^2 in a 2D one
+    int period = 4;        // lattice cells (perlin, simplex) or feature points (worley) along an axis at the first octave
+    int octaves = 1;       // each at twice the frequency and half the amplitude of the one before
+    int channels = 1;      // 1 to 4, every channel from a seed of its own
+    unsigned int seed = 0;
+};
+
+// Generates tileable noise textures: the lattice of every octave wraps around at the texture size, so they repeat
+// without seams. Perlin and worley fill a row cell by cell, the gradients or feature points of a cell are looked up
+// once and the loop over its texels is plain float math the compiler vectorizes. Simplex tiles as a torus in 4D, blue
+// noise is void and cluster on a torus (its texels are ranks, sample it with texelFetch or GL_NEAREST). Simplex and
+// blue noise volumes aren't tileable along z, they are made of perlin noise and of independent blue noise slices.
+// The rows are spread over the worker pool. The texels are 16 bit unorm, stored to noise_<hash>.bin the first time
+// and read from there afterwards, and uploaded with a mip chain and GL_REPEAT.
+//
+// usage:
+//   NoiseBaker baker(workers);
+//   unsigned int perlin = baker.texture({NOISE_PERLIN, 256, false, 8, 4, 2});  // 2 channels, 4 octaves
+//   unsigned int blue = baker.texture({NOISE_BLUE, 64});
+class NoiseBaker {
+public:
+    // part of the cache file names, a change of the generators needs a new one
+    static const int VERSION = 1;
+
+    bool diskCache = true;
+    float bakeTime = 0.0f; // ms of the last generated or loaded texture
+    int generated = 0;
+    int cacheHits = 0;
+
+    explicit NoiseBaker(WorkerPool& workers) : workers(workers)
+    {
+    }
+
+    ~NoiseBaker()
+    {
+        for (auto& texture : textures)
+            glDeleteTextures(1, &texture.second);
+    }
+
+    // the same texture for the same desc, 0 if the desc is invalid
+    unsigned int texture(const NoiseDesc& desc)
+    {
+        std::string key = describe(desc);
+        auto it = textures.find(key);
+        if (it != textures.end())
+            return it->second;
+        if (desc.size < 4 || (desc.size & (desc.size - 1)) != 0 || desc.channels < 1 || desc.channels > 4
+            || desc.period < 1 || desc.octaves < 1) {
+            std::cout << "ERROR::NOISE BAKER:: invalid noise " << key << std::endl;
+            return 0;
+        }
+        auto start = std::chrono::high_resolution_clock::now();
+        std::string path = cacheFile(key);
+        std::vector<unsigned short> texels;
+        if (diskCache && load(path, key, texelCount(desc), texels)) {
+            cacheHits++;
+        } else {
+            texels = generate(desc);
+            generated++;
+            if (diskCache)
+                store(path, key, texels);
+        }
+        unsigned int texture = upload(desc, texels);
+        bakeTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        return textures[key] = texture;
+    }
+
+    // the texels without a texture, channels interleaved, x fastest then y then z
+    std::vector<unsigned short> generate(const NoiseDesc& desc)
+    {
+        int size = desc.size;
+        int slices = desc.volume ? size : 1;
+        std::vector<unsigned short> texels(texelCount(desc));
+        for (int channel = 0; channel < desc.channels; channel++) {
+            unsigned int seed = hash(channel, 0, 0, 0, desc.seed);
+            if (desc.type == NOISE_BLUE) {
+                for (int z = 0; z < slices; z++) {
+                    std::vector<float> ranks = blueNoise(size, hash(z, 0, 0, 0, seed));
+                    for (int i = 0; i < size * size; i++)
+                        texels[((size_t) z * size * size + i) * desc.channels + channel] = quantize(ranks[i]);
+                }
+                continue;
+            }
+            NoiseType type = desc.type == NOISE_SIMPLEX && desc.volume ? NOISE_PERLIN : desc.type;
+            // a job per row, they don't share anything
+            workers.run(size * slices, [&](int job, int) {
+                int y = job % size, z = job / size;
+                std::vector<float> row(size, 0.0f);
+                float amplitude = 1.0f, total = 0.0f;
+                for (int octave = 0; octave < desc.octaves; octave++) {
+                    int frequency = desc.period << octave;
+                    // cells smaller than two texels would only alias
+                    if (octave > 0 && frequency > size / 2)
+                        break;
+                    if (type == NOISE_PERLIN)
+                        perlinRow(&row[0], size, frequency, y, z, desc.volume, hash(octave, 0, 0, 0, seed), amplitude);
+                    else if (type == NOISE_SIMPLEX)
+                        simplexRow(&row[0], size, frequency, y, hash(octave, 0, 0, 0, seed), amplitude);
+                    else
+                        worleyRow(&row[0], size, frequency, y, z, desc.volume, hash(octave, 0, 0, 0, seed), amplitude);
+                    total += amplitude;
+                    amplitude *= 0.5f;
+                }
+                size_t first = ((size_t) z * size + y) * size;
+                for (int x = 0; x < size; x++) {
+                    // the gradient noises are around 0, the worley distances start at 0
+                    float value = type == NOISE_WORLEY ? row[x] / total : 0.5f + 0.5f * row[x] / total;
+                    texels[(first + x) * desc.channels + channel] = quantize(value);
+                }
+            });
+        }
+        return texels;
+    }
+
+private:
+    WorkerPool& workers;
+    std::map<std::string, unsigned int> textures;
+
+    static std::string describe(const NoiseDesc& desc)
+    {
+        static const char* names[] = {"perlin", "simplex", "worley", "blue"};
+        char key[160];
+        std::snprintf(key, sizeof(key), "noise v%d %s size %d%s period %d octaves %d channels %d seed %u", VERSION,
+                      names[desc.type], desc.size, desc.volume ? " volume" : "", desc.period, desc.octaves,
+                      desc.channels, desc.seed);
+        return key;
+    }
+
+    // FNV-1a, only tells the cache files apart
+    static std::string cacheFile(const std::string& key)
+    {
+        unsigned long long value = 14695981039346656037ULL;
+        for (unsigned char c : key) {
+            value ^= c;
+            value *= 1099511628211ULL;
+        }
+        char name[64];
+        std::snprintf(name, sizeof(name), "noise_%016llx.bin", value);
+        return name;
+    }
+
+    // 16 bit values of the texture, size^2 or size^3 texels of every channel
+    static size_t texelCount(const NoiseDesc& desc)
+    {
+        size_t slices = desc.volume ? desc.size : 1;
+        return (size_t) desc.size * desc.size * slices * desc.channels;
+    }
+
+    // the key on the first line, the texels after it. A file of any other length is left alone, a cut off or a
+    // foreign one would upload garbage or read past the end
+    static bool load(const std::string& path, const std::string& key, size_t count, std::vector<unsigned short>& texels)
+    {
+        std::ifstream file(path, std::ios::binary);
+        std::string header;
+        if (!file || !std::getline(file, header) || header != key)
+            return false;
+        std::vector<unsigned short> data;
+        file.seekg(0, std::ios::end);
+        std::streamoff bytes = (std::streamoff) file.tellg() - (std::streamoff) (header.size() + 1);
+        if (bytes != (std::streamoff) (count * sizeof(unsigned short))) {
+            std::cout << "ERROR::NOISE BAKER:: wrong size of the noise cache " << path << ", generating it again"
+                      << std::endl;
+            return false;
+        }
+        data.resize(count);
+        file.seekg(header.size() + 1);
+        file.read((char*) &data[0], bytes);
+        if (!file)
+            return false;
+        texels.swap(data);
+        return true;
+    }
+
+    // written to a temporary file that replaces the cache file once complete, so a crash or a second instance never
+    // leaves a partial one behind
+    static void store(const std::string& path, const std::string& key, const std::vector<unsigned short>& texels)
+    {
+        std::string temporary = path + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary);
+            if (file) {
+                file << key << '\n';
+                file.write((const char*) &texels[0], texels.size() * sizeof(unsigned short));
+            }
+            if (!file) {
+                std::cout << "ERROR::NOISE BAKER:: can't write the noise cache " << temporary << std::endl;
+                file.close();
+                std::remove(temporary.c_str());
+                return;
+            }
+        }
+        // rename doesn't replace an existing file everywhere
+        if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+            std::remove(path.c_str());
+            if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+                std::cout << "ERROR::NOISE BAKER:: can't replace the noise cache " << path << std::endl;
+                std::remove(temporary.c_str());
+            }
+        }
+    }
+
+    static unsigned int upload(const NoiseDesc& desc, const std::vector<unsigned short>& texels)
+    {
+        static const GLenum formats[] = {GL_RED, GL_RG, GL_RGB, GL_RGBA};
+        static const GLint internalFormats[] = {GL_R16, GL_RG16, GL_RGB16, GL_RGBA16};
+        GLenum target = desc.volume ? GL_TEXTURE_3D : GL_TEXTURE_2D;
+        // the rows are an even amount of 16 bit texels, 4 byte aligned like the unpack alignment wants
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(target, texture);
+        if (desc.volume)
+            glTexImage3D(target, 0, internalFormats[desc.channels - 1], desc.size, desc.size, desc.size, 0,
+                         formats[desc.channels - 1], GL_UNSIGNED_SHORT, &texels[0]);
+        else
+            glTexImage2D(target, 0, internalFormats[desc.channels - 1], desc.size, desc.size, 0,
+                         formats[desc.channels - 1], GL_UNSIGNED_SHORT, &texels[0]);
+        glGenerateMipmap(target);
+        glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_REPEAT);
+        // interpolated ranks aren't ranks
+        bool nearest = desc.type == NOISE_BLUE;
+        glTexParameteri(target, GL_TEXTURE_MIN_FILTER, nearest ? GL_NEAREST_MIPMAP_NEAREST : GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, nearest ? GL_NEAREST : GL_LINEAR);
+        glBindTexture(target, 0);
+        return texture;
+    }
+
+    static unsigned short quantize(float value)
+    {
+        return (unsigned short) (std::max(0.0f, std::min(value, 1.0f)) * 65535.0f + 0.5f);
+    }
+
+    static unsigned int mix(unsigned int value)
+    {
+        value ^= value >> 16;
+        value *= 0x7feb352dU;
+        value ^= value >> 15;
+        value *= 0x846ca68bU;
+        value ^= value >> 16;
+        return value;
+    }
+
+    // of the lattice points, the coordinates are already wrapped at the period
+    static unsigned int hash(int x, int y, int z, int w, unsigned int seed)
+    {
+        unsigned int value = mix(seed + 0x9e3779b9U);
+        value = mix(value ^ (unsigned int) x);
+        value = mix(value ^ (unsigned int) y);
+        value = mix(value ^ (unsigned int) z);
+        return mix(value ^ (unsigned int) w);
+    }
+
+    static float unit(unsigned int value)
+    {
+        return (value >> 8) * (1.0f / 16777216.0f);
+    }
+
+    static float fade(float t)
+    {
+        return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+    }
+
+    // one octave of perlin noise, about [-1, 1] times the amplitude, added to the row
+    static void perlinRow(float* row, int size, int frequency, int y, int z, bool volume, unsigned int seed,
+                          float amplitude)
+    {
+        static const float gradients2D[8][2] = {{1.0f, 0.0f}, {0.7071068f, 0.7071068f}, {0.0f, 1.0f},
+            {-0.7071068f, 0.7071068f}, {-1.0f, 0.0f}, {-0.7071068f, -0.7071068f}, {0.0f, -1.0f},
+            {0.7071068f, -0.7071068f}};
+        static const float gradients3D[12][3] = {{1, 1, 0}, {-1, 1, 0}, {1, -1, 0}, {-1, -1, 0}, {1, 0, 1},
+            {-1, 0, 1}, {1, 0, -1}, {-1, 0, -1}, {0, 1, 1}, {0, -1, 1}, {0, 1, -1}, {0, -1, -1}};
+        // the 2D gradients reach about 0.7
+        float scale = (float) frequency / size;
+        amplitude *= volume ? 1.0f : 1.4142136f;
+        float fy = y * scale, fz = volume ? z * scale : 0.0f;
+        int cy = (int) fy, cz = (int) fz;
+        float ty = fy - cy, tz = fz - cz;
+        float v = fade(ty), w = fade(tz);
+        for (int cx = 0; cx < frequency; cx++) {
+            int first = (cx * size + frequency - 1) / frequency;
+            int last = ((cx + 1) * size + frequency - 1) / frequency;
+            if (first == last)
+                continue;
+            // corner k is at (k & 1, k >> 1 & 1, k >> 2). Its dot product is gx * tx + c, only tx changes in the cell.
+            // A 2D row has the z = 1 corners equal to the z = 0 ones and w = 0
+            float gx[8], c[8];
+            for (int k = 0; k < 8; k++) {
+                int ox = k & 1, oy = k >> 1 & 1, oz = volume ? k >> 2 : 0;
+                int ix = (cx + ox) % frequency, iy = (cy + oy) % frequency, iz = (cz + oz) % frequency;
+                unsigned int h = hash(ix, iy, volume ? iz : 0, 0, seed);
+                if (volume) {
+                    const float* g = gradients3D[h % 12];
+                    gx[k] = g[0];
+                    c[k] = g[1] * (ty - oy) + g[2] * (tz - oz) - g[0] * ox;
+                } else {
+                    const float* g = gradients2D[h & 7];
+                    gx[k] = g[0];
+                    c[k] = g[1] * (ty - oy) - g[0] * ox;
+                }
+            }
+            for (int x = first; x < last; x++) {
+                float tx = x * scale - cx;
+                float u = fade(tx);
+                float d0 = gx[0] * tx + c[0], d1 = gx[1] * tx + c[1], d2 = gx[2] * tx + c[2], d3 = gx[3] * tx + c[3];
+                float d4 = gx[4] * tx + c[4], d5 = gx[5] * tx + c[5], d6 = gx[6] * tx + c[6], d7 = gx[7] * tx + c[7];
+                float x0 = d0 + (d1 - d0) * u, x1 = d2 + (d3 - d2) * u;
+                float x2 = d4 + (d5 - d4) * u, x3 = d6 + (d7 - d6) * u;
+                float y0 = x0 + (x1 - x0) * v, y1 = x2 + (x3 - x2) * v;
+                row[x] += amplitude * (y0 + (y1 - y0) * w);
+            }
+        }
+    }
+
+    // one octave of worley noise, the distance to the nearest feature point in cells (clamped to 1) times the
+    // amplitude, added to the row
+    static void worleyRow(float* row, int size, int frequency, int y, int z, bool volume, unsigned int seed,
+                          float amplitude)
+    {
+        float scale = (float) frequency / size;
+        float fy = y * scale, fz = volume ? z * scale : 0.0f;
+        int cy = (int) fy, cz = (int) fz;
+        float ty = fy - cy, tz = fz - cz;
+        for (int cx = 0; cx < frequency; cx++) {
+            int first = (cx * size + frequency - 1) / frequency;
+            int last = ((cx + 1) * size + frequency - 1) / frequency;
+            if (first == last)
+                continue;
+            // the points of the neighbouring cells relative to this one, with their distance in y and z to the row
+            float px[27], distanceYZ[27];
+            int points = 0;
+            for (int dz = volume ? -1 : 0; dz <= (volume ? 1 : 0); dz++) {
+                for (int dy = -1; dy <= 1; dy++) {
+                    for (int dx = -1; dx <= 1; dx++) {
+                        int ix = (cx + dx + frequency) % frequency, iy = (cy + dy + frequency) % frequency;
+                        int iz = (cz + dz + frequency) % frequency;
+                        unsigned int h = hash(ix, iy, volume ? iz : 0, 1, seed);
+                        float pointY = dy + unit(mix(h ^ 1U)) - ty;
+                        float pointZ = volume ? dz + unit(mix(h ^ 2U)) - tz : 0.0f;
+                        px[points] = dx + unit(h);
+                        distanceYZ[points] = pointY * pointY + pointZ * pointZ;
+                        points++;
+                    }
+                }
+            }
+            for (int x = first; x < last; x++) {
+                float tx = x * scale - cx;
+                float nearest = 1.0f;
+                for (int k = 0; k < points; k++) {
+                    float dx = px[k] - tx;
+                    nearest = std::min(nearest, dx * dx + distanceYZ[k]);
+                }
+                row[x] += amplitude * std::sqrt(nearest);
+            }
+        }
+    }
+
+    // one octave of simplex noise, the texture wraps around two circles in 4D whose circumference is the frequency
+    static void simplexRow(float* row, int size, int frequency, int y, unsigned int seed, float amplitude)
+    {
+        const float twoPi = 6.2831853f;
+        float radius = frequency / twoPi;
+        float angleY = twoPi * y / size;
+        float z = radius * std::cos(angleY), w = radius * std::sin(angleY);
+        for (int x = 0; x < size; x++) {
+            float angleX = twoPi * x / size;
+            row[x] += amplitude * simplex4(radius * std::cos(angleX), radius * std::sin(angleX), z, w, seed);
+        }
+    }
+
+    // Gustavson's 4D simplex noise, the corners ranked to find the simplex, about [-1, 1]
+    static float simplex4(float x, float y, float z, float w, unsigned int seed)
+    {
+        const float F4 = 0.309016994f; // (sqrt(5) - 1) / 4
+        const float G4 = 0.138196601f; // (5 - sqrt(5)) / 20
+        float s = (x + y + z + w) * F4;
+        int i = (int) std::floor(x + s), j = (int) std::floor(y + s);
+        int k = (int) std::floor(z + s), l = (int) std::floor(w + s);
+        float t = (i + j + k + l) * G4;
+        float corner[5][4];
+        corner[0][0] = x - (i - t);
+        corner[0][1] = y - (j - t);
+        corner[0][2] = z - (k - t);
+        corner[0][3] = w - (l - t);
+        // the rank of an axis is how many of the others it exceeds, the simplex steps along the highest first
+        int rank[4] = {0, 0, 0, 0};
+        for (int a = 0; a < 4; a++)
+            for (int b = a + 1; b < 4; b++)
+                rank[corner[0][a] > corner[0][b] ? a : b]++;
+        int offsets[5][4];
+        for (int a = 0; a < 4; a++) {
+            offsets[0][a] = 0;
+            offsets[1][a] = rank[a] >= 3;
+            offsets[2][a] = rank[a] >= 2;
+            offsets[3][a] = rank[a] >= 1;
+            offsets[4][a] = 1;
+        }
+        float sum = 0.0f;
+        for (int c = 0; c < 5; c++) {
+            for (int a = 0; a < 4; a++)
+                corner[c][a] = corner[0][a] - offsets[c][a] + c * G4;
+            float falloff = 0.6f - corner[c][0] * corner[c][0] - corner[c][1] * corner[c][1]
+                          - corner[c][2] * corner[c][2] - corner[c][3] * corner[c][3];
+            if (falloff <= 0.0f)
+                continue;
+            // one of the 32 gradients with a 0 in one axis and +-1 in the others
+            unsigned int h = hash(i + offsets[c][0], j + offsets[c][1], k + offsets[c][2], l + offsets[c][3], seed);
+            int zeroAxis = h & 3;
+            float gradient = 0.0f;
+            for (int a = 0, bit = 4; a < 4; a++) {
+                if (a == zeroAxis)
+                    continue;
+                gradient += (h & bit ? -1.0f : 1.0f) * corner[c][a];
+                bit <<= 1;
+            }
+            falloff *= falloff;
+            sum += falloff * falloff * gradient;
+        }
+        return 27.0f * sum;
+    }
+
+    // void and cluster: ranks in (0, 1) of a size x size torus, every threshold of them is an even point pattern
+    std::vector<float> blueNoise(int size, unsigned int seed)
+    {
+        const float sigma = 1.5f;
+        const int radius = std::min(6, size / 2);
+        int count = size * size, mask = size - 1, span = 2 * radius + 1;
+        std::vector<float> kernel(span * span);
+        for (int dy = -radius; dy <= radius; dy++)
+            for (int dx = -radius; dx <= radius; dx++)
+                kernel[(dy + radius) * span + dx + radius] = std::exp(-(dx * dx + dy * dy) / (2.0f * sigma * sigma));
+        std::vector<char> pattern(count, 0);
+        std::vector<float> energy(count, 0.0f);
+        auto splat = [&](int index, float sign) {
+            int px = index & mask, py = index / size;
+            for (int dy = -radius; dy <= radius; dy++)
+                for (int dx = -radius; dx <= radius; dx++)
+                    energy[((py + dy) & mask) * size + ((px + dx) & mask)] += sign * kernel[(dy + radius) * span + dx + radius];
+        };
+        // the texel of the pattern value with the highest (the tightest cluster) or the lowest energy (the largest
+        // void). The rows are split over the workers, ties go to the lowest index whatever the amount of workers
+        int chunks = size >= 64 ? std::min(workers.size() * 4, size) : 1;
+        std::vector<int> chunkBest(chunks);
+        auto find = [&](char value, bool highest) {
+            workers.run(chunks, [&](int chunk, int) {
+                int best = -1;
+                for (int i = chunk * size / chunks * size; i < (chunk + 1) * size / chunks * size; i++) {
+                    if (pattern[i] != value)
+                        continue;
+                    if (best < 0 || (highest ? energy[i] > energy[best] : energy[i] < energy[best]))
+                        best = i;
+                }
+                chunkBest[chunk] = best;
+            });
+            int best = -1;
+            for (int candidate : chunkBest) {
+                if (candidate < 0)
+                    continue;
+                if (best < 0 || (highest ? energy[candidate] > energy[best] : energy[candidate] < energy[best]))
+                    best = candidate;
+            }
+            return best;
+        };
+
+        // a tenth of the texels at random
+        std::mt19937 random(seed);
+        int ones = std::max(1, count / 10);
+        for (int placed = 0; placed < ones;) {
+            int index = (int) (random() % count);
+            if (pattern[index])
+                continue;
+            pattern[index] = 1;
+            splat(index, 1.0f);
+            placed++;
+        }
+        // even them out, the tightest cluster moves to the largest void until it is the largest void itself
+        for (int iteration = 0; iteration < count; iteration++) {
+            int cluster = find(1, true);
+            pattern[cluster] = 0;
+            splat(cluster, -1.0f);
+            int largestVoid = find(0, false);
+            pattern[largestVoid] = 1;
+            splat(largestVoid, 1.0f);
+            if (largestVoid == cluster)
+                break;
+        }
+        std::vector<int> ranks(count);
+        std::vector<char> initialPattern = pattern;
+        std::vector<float> initialEnergy = energy;
+        // the points of the pattern get the low ranks, the tightest clusters the highest of them
+        for (int rank = ones - 1; rank >= 0; rank--) {
+            int cluster = find(1, true);
+            pattern[cluster] = 0;
+            splat(cluster, -1.0f);
+            ranks[cluster] = rank;
+        }
+        pattern = initialPattern;
+        energy = initialEnergy;
+        // the rest in the order they fill the largest voids
+        for (int rank = ones; rank < count; rank++) {
+            int largestVoid = find(0, false);
+            pattern[largestVoid] = 1;
+            splat(largestVoid, 1.0f);
+            ranks[largestVoid] = rank;
+        }
+        std::vector<float> values(count);
+        for (int i = 0; i < count; i++)
+            values[i] = (ranks[i] + 0.5f) / count;
+        return values;
+    }
+};
+#endif
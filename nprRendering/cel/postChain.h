@@ -0,0 +1,160 @@
+#ifndef POSTCHAIN_H
+#define POSTCHAIN_H
+
+#include <glad/glad.h>
+
+#include <shader.h>
+#include <shaderPermutations.h>
+
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// A stage of the post chain, a GLSL function in a file of shaders/post/ without a #version line:
+//   vec4 STAGE(vec2 uv) { ... STAGE_INPUT(uv + offset) ... }
+// STAGE is the name the chain gives the function, STAGE_INPUT the color of the previous stage at a coordinate (the
+// input texture, or the previous stage's function when they are fused). Uniforms and switches are declared in the
+// file, helpers need a name of their own.
+struct PostStage {
+    std::string name;
+    std::string path;
+    // reads of STAGE_INPUT per pixel, 1 for point-wise stages and the ones that only move the coordinate
+    int taps;
+    // binds what the stage samples besides its input (the noise texture), before a pass with it draws
+    std::function<void()> bind;
+    // samplers of the stage on a new program
+    std::function<void(Shader&)> setup;
+};
+
+// Builds the full screen passes for a list of stages. Unfused, every stage is a pass writing a full screen target the
+// next one reads. Fused, a stage goes into the pass before it as long as the input reads of the pass stay at most
+// maxFusedTaps: a fused stage calls the previous stage's function for every tap, so the pass reads its input taps
+// times the taps of everything fused after it, but no target sits between them. The fragment shader of a pass is
+// composed in memory and compiled through ShaderPermutations, so the switches of the stages work like in the other
+// shaders.
+//
+// usage:
+//   chain.addStage({"edge", "shaders/post/edge.glsl", 9, NULL, NULL});
+//   std::vector<PostChain::Pass>& passes = chain.passes({0, 1}, true);  // composed and compiled the first time
+//   pass.shader = pass.permutations->get(defines);
+//   chain.draw(pass, inputTexture, quadVAO);                           // into the bound framebuffer
+class PostChain {
+public:
+    struct Pass {
+        std::string name;          // the stage names joined by '+'
+        std::vector<int> stages;
+        int taps;                  // input reads per pixel
+        ShaderPermutations* permutations;
+        Shader* shader = NULL;     // the variant picked by the caller
+    };
+
+    int maxFusedTaps = 16;
+    std::vector<PostStage> stages;
+
+    PostChain(const char* vertexPath) : vertexPath(vertexPath)
+    {
+    }
+
+    ~PostChain()
+    {
+        for (auto& built : passLists)
+            for (Pass& pass : built.second)
+                delete pass.permutations;
+    }
+
+    int addStage(const PostStage& stage)
+    {
+        stages.push_back(stage);
+        return (int) stages.size() - 1;
+    }
+
+    std::vector<Pass>& passes(const std::vector<int>& enabled, bool fuse)
+    {
+        std::string key = fuse ? "fused" : "separate";
+        for (int stage : enabled)
+            key += " " + stages[stage].name;
+        auto it = passLists.find(key);
+        if (it != passLists.end())
+            return it->second;
+
+        std::vector<Pass> built;
+        for (int stage : enabled) {
+            if (fuse && !built.empty() && built.back().taps * stages[stage].taps <= maxFusedTaps) {
+                built.back().stages.push_back(stage);
+                built.back().taps *= stages[stage].taps;
+                built.back().name += "+" + stages[stage].name;
+                continue;
+            }
+            Pass pass;
+            pass.name = stages[stage].name;
+            pass.stages.push_back(stage);
+            pass.taps = stages[stage].taps;
+            pass.permutations = NULL;
+            built.push_back(pass);
+        }
+        for (Pass& pass : built)
+            pass.permutations = compose(pass);
+        return passLists[key] = built;
+    }
+
+    void draw(const Pass& pass, unsigned int inputTexture, unsigned int quadVAO)
+    {
+        for (int stage : pass.stages)
+            if (stages[stage].bind)
+                stages[stage].bind();
+        pass.shader->use();
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, inputTexture);
+        glBindVertexArray(quadVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+    }
+
+private:
+    std::string vertexPath;
+    std::map<std::string, std::vector<Pass>> passLists;
+
+    ShaderPermutations* compose(const Pass& pass)
+    {
+        std::stringstream source;
+        source << "#version 330 core\n"
+               << "// composed by PostChain (postChain.h) from the stages " << pass.name << "\n"
+               << "out vec4 FragColor;\n"
+               << "in vec2 TexCoords;\n"
+               << "uniform sampler2D postInput;\n";
+        std::string input = "texture(postInput, uv)";
+        std::string function;
+        for (int stage : pass.stages) {
+            std::ifstream file(stages[stage].path);
+            if (!file)
+                std::cout << "ERROR::POST CHAIN:: can't read the stage " << stages[stage].path << std::endl;
+            std::stringstream code;
+            code << file.rdbuf();
+            function = "post_" + stages[stage].name;
+            source << "\n#define STAGE " << function << "\n"
+                   << "#define STAGE_INPUT(uv) " << input << "\n"
+                   << code.str() << "\n"
+                   << "#undef STAGE\n"
+                   << "#undef STAGE_INPUT\n";
+            input = function + "(uv)";
+        }
+        source << "\nvoid main() {\n"
+               << "    FragColor = " << function << "(TexCoords);\n"
+               << "}\n";
+
+        std::vector<std::function<void(Shader&)>> setups;
+        for (int stage : pass.stages)
+            if (stages[stage].setup)
+                setups.push_back(stages[stage].setup);
+        return ShaderPermutations::fromSource(vertexPath.c_str(), source.str(), [setups](Shader& shader) {
+            shader.use();
+            shader.setInt("postInput", 0);
+            for (const auto& setup : setups)
+                setup(shader);
+        });
+    }
+};
+#endif
@@ -0,0 +1,467 @@
+#ifndef RENDERGRAPH_H
+#define RENDERGRAPH_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+struct RenderTargetDesc {
+    int width, height;
+    GLenum internalFormat;
+
+    bool operator==(const RenderTargetDesc& other) const
+    {
+        return width == other.width && height == other.height && internalFormat == other.internalFormat;
+    }
+};
+
+// A frame graph for the passes of a frame. Every frame the passes are declared in execution order together with the
+// targets they read and write, compile culls the passes nothing visible depends on and gives the targets textures:
+//   transient  lives from its first to its last use in the frame, comes from a pool and shares its texture with the
+//              transient targets of the same size and format whose lifetimes don't overlap (GL can't alias memory
+//              between formats, so reusing the texture is the aliasing there is)
+//   retained   keeps its texture and contents across frames, for the targets a later frame reads without writing
+//              them again (the passes skipped by the ChangeTracker)
+//   imported   a texture owned by someone else (the hi-z pyramid), or the default framebuffer
+// A skipped pass (run = false) is still declared so its targets keep their textures. A pass that runs and reads a
+// transient target, or a retained one that just got a new texture, makes the writers of the target run as well.
+//
+// usage:
+//   graph.reset();
+//   int color = graph.createTarget("color", {width, height, GL_RGB8}, retained);
+//   int screen = graph.importBackbuffer();
+//   int pass = graph.addPass("scene", [](RenderGraph& graph) { ... }, dirty & PASS_SCENE);
+//   graph.write(pass, color);
+//   ... more passes, reading color ...
+//   graph.markOutput(screen);          // what the frame is for, the passes it doesn't depend on are culled
+//   graph.compile();                   // allocates the textures and the framebuffers
+//   graph.execute();                   // binds the framebuffer of each pass and runs it
+class RenderGraph {
+public:
+    // compiles a pooled or retained texture survives without being declared
+    int poolFrames = 60;
+
+    // statistics of the last compile
+    int culledPasses = 0, executedPasses = 0;
+    size_t peakBytes = 0;    // textures in use at the busiest pass, the retained ones included
+    size_t declaredBytes = 0; // the targets of the passes that weren't culled, if each had its own texture
+    size_t pooledBytes = 0;   // all textures the graph owns
+
+    ~RenderGraph()
+    {
+        for (PooledTexture& pooled : pool)
+            glDeleteTextures(1, &pooled.texture);
+        for (auto& retained : retainedTextures)
+            glDeleteTextures(1, &retained.second.texture);
+        for (auto& framebuffer : framebuffers)
+            glDeleteFramebuffers(1, &framebuffer.second);
+    }
+
+    void reset()
+    {
+        passes.clear();
+        resources.clear();
+    }
+
+    int createTarget(const std::string& name, const RenderTargetDesc& desc, bool retained = false)
+    {
+        Resource resource;
+        resource.name = name;
+        resource.desc = desc;
+        resource.kind = retained ? RESOURCE_RETAINED : RESOURCE_TRANSIENT;
+        resources.push_back(resource);
+        return (int) resources.size() - 1;
+    }
+
+    int importTexture(const std::string& name, unsigned int texture)
+    {
+        Resource resource;
+        resource.name = name;
+        resource.kind = RESOURCE_IMPORTED;
+        resource.texture = texture;
+        resources.push_back(resource);
+        return (int) resources.size() - 1;
+    }
+
+    // a pass writing it draws into the default framebuffer
+    int importBackbuffer()
+    {
+        Resource resource;
+        resource.name = "backbuffer";
+        resource.kind = RESOURCE_BACKBUFFER;
+        resources.push_back(resource);
+        return (int) resources.size() - 1;
+    }
+
+    int addPass(const std::string& name, const std::function<void(RenderGraph&)>& execute, bool run = true)
+    {
+        Pass pass;
+        pass.name = name;
+        pass.execute = execute;
+        pass.run = run;
+        passes.push_back(pass);
+        return (int) passes.size() - 1;
+    }
+
+    void read(int pass, int resource) { passes[pass].reads.push_back(resource); }
+    void write(int pass, int resource) { passes[pass].writes.push_back(resource); }
+    void markOutput(int resource) { resources[resource].output = true; }
+
+    // valid after compile
+    unsigned int texture(int resource) const { return resources[resource].texture; }
+    bool culled(int pass) const { return !passes[pass].alive; }
+    bool runs(int pass) const { return passes[pass].alive && passes[pass].run; }
+    // framebuffer of the pass being executed
+    unsigned int boundFramebuffer() const { return current < 0 ? 0 : passes[current].framebuffer; }
+
+    void compile()
+    {
+        frame++;
+        cull();
+        allocate();
+        forceWriters();
+        buildFramebuffers();
+        releaseUnused();
+    }
+
+    void execute()
+    {
+        executedPasses = 0;
+        for (current = 0; current < (int) passes.size(); current++) {
+            Pass& pass = passes[current];
+            if (!pass.alive || !pass.run)
+                continue;
+            if (pass.bindsFramebuffer)
+                glBindFramebuffer(GL_FRAMEBUFFER, pass.framebuffer);
+            pass.execute(*this);
+            executedPasses++;
+        }
+        current = -1;
+    }
+
+private:
+    enum ResourceKind { RESOURCE_TRANSIENT, RESOURCE_RETAINED, RESOURCE_IMPORTED, RESOURCE_BACKBUFFER };
+
+    struct Resource {
+        std::string name;
+        RenderTargetDesc desc = {0, 0, GL_NONE};
+        ResourceKind kind = RESOURCE_TRANSIENT;
+        unsigned int texture = 0;
+        bool output = false;
+        bool fresh = false;         // got a new texture this compile, its contents are undefined
+        int first = -1, last = -1;  // passes using it, culled ones left out
+    };
+
+    struct Pass {
+        std::string name;
+        std::function<void(RenderGraph&)> execute;
+        bool run = true, alive = false;
+        std::vector<int> reads, writes;
+        bool bindsFramebuffer = false;
+        unsigned int framebuffer = 0;
+    };
+
+    struct PooledTexture {
+        unsigned int texture;
+        RenderTargetDesc desc;
+        int lastFrame;
+        bool busy;
+    };
+
+    std::vector<Pass> passes;
+    std::vector<Resource> resources;
+    std::vector<PooledTexture> pool;
+    std::map<std::string, PooledTexture> retainedTextures;
+    std::map<std::vector<unsigned int>, unsigned int> framebuffers; // by attachments, colors first
+    int frame = 0, current = -1;
+
+    static bool isTarget(const Resource& resource)
+    {
+        return resource.kind == RESOURCE_TRANSIENT || resource.kind == RESOURCE_RETAINED;
+    }
+
+    void cull()
+    {
+        // walks back from the outputs, a pass is kept when a later kept pass reads what it writes
+        std::vector<bool> needed(resources.size(), false);
+        for (size_t i = 0; i < resources.size(); i++)
+            needed[i] = resources[i].output;
+        culledPasses = 0;
+        for (int p = (int) passes.size() - 1; p >= 0; p--) {
+            Pass& pass = passes[p];
+            pass.alive = false;
+            for (int resource : pass.writes)
+                pass.alive = pass.alive || needed[resource];
+            if (!pass.alive) {
+                culledPasses++;
+                continue;
+            }
+            for (int resource : pass.reads)
+                needed[resource] = true;
+        }
+
+        for (Resource& resource : resources)
+            resource.first = resource.last = -1;
+        for (int p = 0; p < (int) passes.size(); p++) {
+            if (!passes[p].alive)
+                continue;
+            std::vector<int> used = passes[p].reads;
+            used.insert(used.end(), passes[p].writes.begin(), passes[p].writes.end());
+            for (int resource : used) {
+                if (resources[resource].first < 0)
+                    resources[resource].first = p;
+                resources[resource].last = p;
+            }
+        }
+    }
+
+    void allocate()
+    {
+        for (PooledTexture& pooled : pool)
+            pooled.busy = false;
+        declaredBytes = 0;
+        size_t retainedBytes = 0;
+        for (Resource& resource : resources) {
+            resource.fresh = false;
+            if (!isTarget(resource) || resource.first < 0)
+                continue;
+            declaredBytes += bytes(resource.desc);
+            if (resource.kind != RESOURCE_RETAINED)
+                continue;
+            auto it = retainedTextures.find(resource.name);
+            if (it != retainedTextures.end() && !(it->second.desc == resource.desc)) {
+                forgetFramebuffers(it->second.texture);
+                glDeleteTextures(1, &it->second.texture);
+                retainedTextures.erase(it);
+                it = retainedTextures.end();
+            }
+            if (it == retainedTextures.end()) {
+                PooledTexture created = {createTexture(resource.desc), resource.desc, frame, true};
+                it = retainedTextures.insert(std::make_pair(resource.name, created)).first;
+                resource.fresh = true;
+            }
+            it->second.lastFrame = frame;
+            resource.texture = it->second.texture;
+            retainedBytes += bytes(resource.desc);
+        }
+
+        // the transient targets take a free pooled texture at their first pass and give it back after their last
+        size_t liveBytes = 0;
+        peakBytes = retainedBytes;
+        for (int p = 0; p < (int) passes.size(); p++) {
+            for (Resource& resource : resources) {
+                if (resource.kind != RESOURCE_TRANSIENT || resource.first != p)
+                    continue;
+                PooledTexture* pooled = NULL;
+                for (PooledTexture& candidate : pool)
+                    if (!candidate.busy && candidate.desc == resource.desc) {
+                        pooled = &candidate;
+                        break;
+                    }
+                if (pooled == NULL) {
+                    PooledTexture created = {createTexture(resource.desc), resource.desc, frame, false};
+                    pool.push_back(created);
+                    pooled = &pool.back();
+                }
+                pooled->busy = true;
+                pooled->lastFrame = frame;
+                resource.texture = pooled->texture;
+                resource.fresh = true;
+                liveBytes += bytes(resource.desc);
+            }
+            peakBytes = std::max(peakBytes, retainedBytes + liveBytes);
+            for (Resource& resource : resources) {
+                if (resource.kind != RESOURCE_TRANSIENT || resource.last != p)
+                    continue;
+                for (PooledTexture& pooled : pool)
+                    if (pooled.texture == resource.texture)
+                        pooled.busy = false;
+                liveBytes -= bytes(resource.desc);
+            }
+        }
+    }
+
+    void forceWriters()
+    {
+        // a target without valid contents has to be written before a running pass reads it, back to front so the
+        // writers pulled in pull in their own inputs
+        for (int p = (int) passes.size() - 1; p >= 0; p--) {
+            if (!passes[p].alive || !passes[p].run)
+                continue;
+            for (int resource : passes[p].reads) {
+                if (!resources[resource].fresh)
+                    continue;
+                for (int writer = 0; writer < p; writer++)
+                    if (passes[writer].alive && writesTo(passes[writer], resource))
+                        passes[writer].run = true;
+            }
+        }
+    }
+
+    static bool writesTo(const Pass& pass, int resource)
+    {
+        for (int written : pass.writes)
+            if (written == resource)
+                return true;
+        return false;
+    }
+
+    void buildFramebuffers()
+    {
+        for (Pass& pass : passes) {
+            pass.bindsFramebuffer = false;
+            pass.framebuffer = 0;
+            if (!pass.alive)
+                continue;
+            std::vector<unsigned int> colors, depth;
+            std::vector<int> depthResources;
+            for (int resource : pass.writes) {
+                const Resource& written = resources[resource];
+                if (written.kind == RESOURCE_BACKBUFFER)
+                    pass.bindsFramebuffer = true;
+                if (!isTarget(written))
+                    continue;
+                pass.bindsFramebuffer = true;
+                if (isDepth(written.desc.internalFormat)) {
+                    depth.push_back(written.texture);
+                    depthResources.push_back(resource);
+                } else {
+                    colors.push_back(written.texture);
+                }
+            }
+            if (colors.empty() && depth.empty())
+                continue;
+
+            std::vector<unsigned int> key = colors;
+            key.insert(key.end(), depth.begin(), depth.end());
+            auto it = framebuffers.find(key);
+            if (it == framebuffers.end()) {
+                unsigned int framebuffer;
+                glGenFramebuffers(1, &framebuffer);
+                glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+                std::vector<GLenum> drawBuffers;
+                for (size_t i = 0; i < colors.size(); i++) {
+                    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + (GLenum) i, GL_TEXTURE_2D, colors[i], 0);
+                    drawBuffers.push_back(GL_COLOR_ATTACHMENT0 + (GLenum) i);
+                }
+                if (!depth.empty()) {
+                    GLenum attachment = hasStencil(resources[depthResources[0]].desc.internalFormat)
+                                        ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+                    glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, depth[0], 0);
+                }
+                if (drawBuffers.empty())
+                    glDrawBuffer(GL_NONE);
+                else
+                    glDrawBuffers((GLsizei) drawBuffers.size(), &drawBuffers[0]);
+                if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+                    std::cout << "ERROR::RENDER GRAPH:: framebuffer of the " << pass.name << " pass is not complete" << std::endl;
+                glBindFramebuffer(GL_FRAMEBUFFER, 0);
+                it = framebuffers.insert(std::make_pair(key, framebuffer)).first;
+            }
+            pass.framebuffer = it->second;
+        }
+    }
+
+    void releaseUnused()
+    {
+        pooledBytes = 0;
+        for (size_t i = 0; i < pool.size();) {
+            if (frame - pool[i].lastFrame > poolFrames) {
+                forgetFramebuffers(pool[i].texture);
+                glDeleteTextures(1, &pool[i].texture);
+                pool.erase(pool.begin() + i);
+            } else {
+                pooledBytes += bytes(pool[i].desc);
+                i++;
+            }
+        }
+        for (auto it = retainedTextures.begin(); it != retainedTextures.end();) {
+            if (frame - it->second.lastFrame > poolFrames) {
+                forgetFramebuffers(it->second.texture);
+                glDeleteTextures(1, &it->second.texture);
+                it = retainedTextures.erase(it);
+            } else {
+                pooledBytes += bytes(it->second.desc);
+                ++it;
+            }
+        }
+    }
+
+    void forgetFramebuffers(unsigned int texture)
+    {
+        for (auto it = framebuffers.begin(); it != framebuffers.end();) {
+            bool attached = false;
+            for (unsigned int attachment : it->first)
+                attached = attached || attachment == texture;
+            if (attached) {
+                glDeleteFramebuffers(1, &it->second);
+                it = framebuffers.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    static bool isDepth(GLenum internalFormat)
+    {
+        return internalFormat == GL_DEPTH24_STENCIL8 || internalFormat == GL_DEPTH32F_STENCIL8 ||
+               internalFormat == GL_DEPTH_COMPONENT24 || internalFormat == GL_DEPTH_COMPONENT32F;
+    }
+
+    static bool hasStencil(GLenum internalFormat)
+    {
+        return internalFormat == GL_DEPTH24_STENCIL8 || internalFormat == GL_DEPTH32F_STENCIL8;
+    }
+
+    // upload format and type of the sized formats the passes use, and their bytes per texel
+    static void formatInfo(GLenum internalFormat, GLenum& format, GLenum& type, int& texelBytes)
+    {
+        switch (internalFormat) {
+            case GL_R8:                 format = GL_RED; type = GL_UNSIGNED_BYTE; texelBytes = 1; break;
+            case GL_RG8:                format = GL_RG; type = GL_UNSIGNED_BYTE; texelBytes = 2; break;
+            case GL_RGB8:               format = GL_RGB; type = GL_UNSIGNED_BYTE; texelBytes = 3; break;
+            case GL_RGBA8:              format = GL_RGBA; type = GL_UNSIGNED_BYTE; texelBytes = 4; break;
+            case GL_R16F:               format = GL_RED; type = GL_HALF_FLOAT; texelBytes = 2; break;
+            case GL_RG16F:              format = GL_RG; type = GL_HALF_FLOAT; texelBytes = 4; break;
+            case GL_RGBA16F:            format = GL_RGBA; type = GL_HALF_FLOAT; texelBytes = 8; break;
+            case GL_R32F:               format = GL_RED; type = GL_FLOAT; texelBytes = 4; break;
+            case GL_RGBA32F:            format = GL_RGBA; type = GL_FLOAT; texelBytes = 16; break;
+            case GL_DEPTH24_STENCIL8:   format = GL_DEPTH_STENCIL; type = GL_UNSIGNED_INT_24_8; texelBytes = 4; break;
+            case GL_DEPTH32F_STENCIL8:  format = GL_DEPTH_STENCIL; type = GL_FLOAT_32_UNSIGNED_INT_24_8_REV; texelBytes = 8; break;
+            case GL_DEPTH_COMPONENT24:  format = GL_DEPTH_COMPONENT; type = GL_UNSIGNED_INT; texelBytes = 4; break;
+            case GL_DEPTH_COMPONENT32F: format = GL_DEPTH_COMPONENT; type = GL_FLOAT; texelBytes = 4; break;
+            default:                    format = GL_RGBA; type = GL_UNSIGNED_BYTE; texelBytes = 4; break;
+        }
+    }
+
+    static size_t bytes(const RenderTargetDesc& desc)
+    {
+        GLenum format, type;
+        int texelBytes;
+        formatInfo(desc.internalFormat, format, type, texelBytes);
+        return (size_t) desc.width * desc.height * texelBytes;
+    }
+
+    static unsigned int createTexture(const RenderTargetDesc& desc)
+    {
+        GLenum format, type;
+        int texelBytes;
+        formatInfo(desc.internalFormat, format, type, texelBytes);
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, desc.internalFormat, desc.width, desc.height, 0, format, type, NULL);
+        // the color targets are sampled between texels by the post passes, depth is read texel by texel
+        GLint filter = isDepth(desc.internalFormat) ? GL_NEAREST : GL_LINEAR;
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return texture;
+    }
+};
+#endif
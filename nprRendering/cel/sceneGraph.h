@@ -0,0 +1,252 @@
+#ifndef SCENEGRAPH_H
+#define SCENEGRAPH_H
+
+#include <glm/glm.hpp>
+
+#include <model.h>
+#include <bounds.h>
+#include <frustum.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// a transform in the hierarchy, parents are always stored before their children
+struct SceneNode {
+    std::string name;
+    int parent = -1;
+    glm::mat4 local = glm::mat4(1.0f);
+    glm::mat4 world = glm::mat4(1.0f);
+    bool dirty = true; // local changed since the last update
+};
+
+// a single mesh placed at a scene node, this is what gets culled and drawn
+struct SceneInstance {
+    int node;
+    Model *model;
+    unsigned int mesh;
+    bool transparent;
+    AABB bounds; // world space, refreshed when the node moves
+};
+
+// bounding volume hierarchy over the scene instances, built top down with a median split
+class Bvh {
+public:
+    struct Node {
+        AABB bounds;
+        int left = -1;       // index of the left child, the right one is left + 1, -1 for leaves
+        int first = 0;       // range in order covered by this node
+        int count = 0;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<int> order; // instance indices, every node covers a contiguous range
+    int leafSize = 2;
+
+    void build(const std::vector<SceneInstance> &instances)
+    {
+        nodes.clear();
+        order.resize(instances.size());
+        for (unsigned int i = 0; i < order.size(); i++)
+            order[i] = i;
+        if (order.empty())
+            return;
+        nodes.push_back(Node());
+        split(instances, 0, 0, (int) order.size());
+    }
+
+    // recomputes the bounds bottom up after instances moved, the topology is kept
+    void refit(const std::vector<SceneInstance> &instances)
+    {
+        for (int i = (int) nodes.size() - 1; i >= 0; i--) {
+            Node &node = nodes[i];
+            node.bounds = AABB();
+            if (node.left < 0) {
+                for (int j = node.first; j < node.first + node.count; j++)
+                    node.bounds.grow(instances[order[j]].bounds);
+            } else {
+                node.bounds.grow(nodes[node.left].bounds);
+                node.bounds.grow(nodes[node.left + 1].bounds);
+            }
+        }
+    }
+
+    // appends the visible instances, subtrees fully inside the frustum are accepted without further plane tests
+    void cull(const Frustum &frustum, std::vector<int> &visible, int &nodesVisited) const
+    {
+        if (nodes.empty())
+            return;
+        int stack[64];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const Node &node = nodes[stack[--top]];
+            nodesVisited++;
+            FrustumTest result = frustum.test(node.bounds);
+            if (result == FRUSTUM_OUTSIDE)
+                continue;
+            if (result == FRUSTUM_INSIDE || node.left < 0) {
+                for (int j = node.first; j < node.first + node.count; j++)
+                    visible.push_back(order[j]);
+                continue;
+            }
+            stack[top++] = node.left;
+            stack[top++] = node.left + 1;
+        }
+    }
+
+private:
+    void split(const std::vector<SceneInstance> &instances, int index, int first, int count)
+    {
+        AABB bounds, centers;
+        for (int j = first; j < first + count; j++) {
+            bounds.grow(instances[order[j]].bounds);
+            centers.grow(instances[order[j]].bounds.center());
+        }
+        nodes[index].bounds = bounds;
+        nodes[index].first = first;
+        nodes[index].count = count;
+        if (count <= leafSize || centers.empty())
+            return;
+
+        // median split along the longest axis of the centers
+        glm::vec3 size = centers.max - centers.min;
+        int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+        int half = count / 2;
+        std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count,
+                         [&](int a, int b) { return instances[a].bounds.center()[axis] < instances[b].bounds.center()[axis]; });
+
+        int left = (int) nodes.size();
+        nodes[index].left = left;
+        nodes.push_back(Node());
+        nodes.push_back(Node());
+        split(instances, left, first, half);
+        split(instances, left + 1, first + half, count - half);
+    }
+};
+
+// keeps the imported node hierarchy of every model with cached world matrices, only dirty subtrees are recomputed
+class SceneGraph {
+public:
+    std::vector<SceneNode> nodes;
+    std::vector<SceneInstance> instances;
+    Bvh bvh;
+
+    // changes whenever instances are added or moved, lets copies of the scene know when to refresh
+    unsigned int version = 0;
+
+    // statistics of the last update() and cull()
+    int worldUpdates = 0;
+    int visibleCount = 0;
+    int culledCount = 0;
+    int nodesVisited = 0;
+
+    int addNode(const std::string &name, int parent = -1, const glm::mat4 &local = glm::mat4(1.0f))
+    {
+        SceneNode node;
+        node.name = name;
+        node.parent = parent;
+        node.local = local;
+        nodes.push_back(node);
+        version++;
+        return (int) nodes.size() - 1;
+    }
+
+    void clear()
+    {
+        nodes.clear();
+        instances.clear();
+        bvh = Bvh();
+        bvhValid = false;
+        version++;
+    }
+
+    // instantiates the node hierarchy of a model under parent, returns the node of the model root
+    int addModel(Model *model, int parent = -1, const glm::mat4 &local = glm::mat4(1.0f), bool transparent = false)
+    {
+        int root = addNode(model->directory, parent, local);
+        std::vector<int> mapped(model->nodes.size());
+        for (unsigned int i = 0; i < model->nodes.size(); i++) {
+            const ModelNode &modelNode = model->nodes[i];
+            int nodeParent = modelNode.parent < 0 ? root : mapped[modelNode.parent];
+            mapped[i] = addNode(modelNode.name, nodeParent, modelNode.transform);
+            for (unsigned int m = 0; m < modelNode.meshes.size(); m++) {
+                SceneInstance instance;
+                instance.node = mapped[i];
+                instance.model = model;
+                instance.mesh = modelNode.meshes[m];
+                instance.transparent = transparent;
+                instances.push_back(instance);
+            }
+        }
+        bvhValid = false;
+        return root;
+    }
+
+    void setLocal(int node, const glm::mat4 &local)
+    {
+        nodes[node].local = local;
+        nodes[node].dirty = true;
+    }
+
+    // recomputes the world matrices of dirty nodes and their descendants, then the bounds of the affected instances
+    void update()
+    {
+        worldUpdates = 0;
+        changed.assign(nodes.size(), 0);
+        for (unsigned int i = 0; i < nodes.size(); i++) {
+            SceneNode &node = nodes[i];
+            bool parentChanged = node.parent >= 0 && changed[node.parent];
+            if (!node.dirty && !parentChanged)
+                continue;
+            node.world = node.parent >= 0 ? nodes[node.parent].world * node.local : node.local;
+            node.dirty = false;
+            changed[i] = 1;
+            worldUpdates++;
+        }
+
+        bool moved = false;
+        for (unsigned int i = 0; i < instances.size(); i++) {
+            SceneInstance &instance = instances[i];
+            if (!changed[instance.node] && bvhValid)
+                continue;
+            instance.bounds = instance.model->meshes[instance.mesh].bounds.transformed(nodes[instance.node].world);
+            moved = true;
+        }
+
+        if (moved)
+            version++;
+        if (!bvhValid) {
+            bvh.build(instances);
+            bvhValid = true;
+        } else if (moved) {
+            bvh.refit(instances);
+        }
+    }
+
+    // fills visible with the instances that intersect the view frustum (or all of them), opaque ones first
+    void cull(const glm::mat4 &viewProjection, std::vector<int> &visible, bool frustumCulling = true)
+    {
+        visible.clear();
+        nodesVisited = 0;
+        if (frustumCulling) {
+            bvh.cull(Frustum(viewProjection), visible, nodesVisited);
+        } else {
+            for (unsigned int i = 0; i < instances.size(); i++)
+                visible.push_back(i);
+        }
+        // keep submission order stable and put transparent instances last, they are blended
+        std::sort(visible.begin(), visible.end(), [&](int a, int b) {
+            if (instances[a].transparent != instances[b].transparent)
+                return !instances[a].transparent;
+            return a < b;
+        });
+        visibleCount = (int) visible.size();
+        culledCount = (int) instances.size() - visibleCount;
+    }
+
+private:
+    std::vector<char> changed;
+    bool bvhValid = false;
+};
+#endif
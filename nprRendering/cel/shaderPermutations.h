@@ -0,0 +1,237 @@
+#ifndef SHADERPERMUTATIONS_H
+#define SHADERPERMUTATIONS_H
+
+#include <glad/glad.h>
+
+#include <shader.h>
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Compiles the variants of one vertex/fragment pair, one per set of defines, the first time they are asked for. The
+// shaders read their switches from uniforms unless a define replaces them with a constant, so the empty set is the uber
+// shader and every other set a specialized one where the compiler folds the branches and unrolls the loops.
+// With GL 4.1 the linked programs are also kept on disk as program binaries, keyed by a hash of the sources, the
+// defines and the driver, so later runs skip the compile. setup runs on every new program (samplers, block bindings),
+// the uniform values aren't part of a binary.
+//
+// usage:
+//   ShaderPermutations cel("shaders/celShader.vert", "shaders/celShader.frag", setup);
+//   Shader* shader = cel.get(ShaderPermutations::define("DO_CEL_SHADING", true)); // compiled or loaded the first time
+class ShaderPermutations {
+public:
+    struct Variant {
+        Shader* shader;
+        float buildTime; // ms to compile and link or to load the binary
+        bool fromDisk;
+    };
+
+    // by defines, the empty string is the uber shader
+    std::map<std::string, Variant> variants;
+    // write new programs to the disk cache and look there first
+    bool diskCache = true;
+
+    ShaderPermutations(const char* vertexPath, const char* fragmentPath, std::function<void(Shader&)> setup = nullptr)
+        : ShaderPermutations(readFile(vertexPath), readFile(fragmentPath), setup)
+    {
+    }
+
+    // a fragment shader composed in memory instead of read from a file, PostChain builds its passes like this
+    static ShaderPermutations* fromSource(const char* vertexPath, const std::string& fragmentCode,
+                                          std::function<void(Shader&)> setup = nullptr)
+    {
+        return new ShaderPermutations(readFile(vertexPath), fragmentCode, setup);
+    }
+
+    ~ShaderPermutations()
+    {
+        for (auto& variant : variants) {
+            glDeleteProgram(variant.second.shader->ID);
+            delete variant.second.shader;
+        }
+    }
+
+    static std::string define(const std::string& name, int value)
+    {
+        return "#define " + name + " " + std::to_string(value) + "\n";
+    }
+    // glsl has no implicit int to bool conversion, if (1) doesn't compile
+    static std::string define(const std::string& name, bool value)
+    {
+        return "#define " + name + (value ? " true\n" : " false\n");
+    }
+
+    Shader* get(const std::string& defines)
+    {
+        auto it = variants.find(defines);
+        if (it != variants.end())
+            return it->second.shader;
+
+        auto start = std::chrono::high_resolution_clock::now();
+        std::string cachePath = cacheFile(defines);
+        Variant variant;
+        variant.shader = diskCache ? loadBinary(cachePath) : NULL;
+        variant.fromDisk = variant.shader != NULL;
+        if (variant.shader == NULL) {
+            variant.shader = Shader::fromSource(vertexCode, fragmentCode, defines);
+            if (diskCache)
+                storeBinary(*variant.shader, cachePath);
+        }
+        if (setup)
+            setup(*variant.shader);
+        variant.buildTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+        variants[defines] = variant;
+        return variant.shader;
+    }
+
+    float totalBuildTime() const
+    {
+        float total = 0.0f;
+        for (const auto& variant : variants)
+            total += variant.second.buildTime;
+        return total;
+    }
+
+    int loadedFromDisk() const
+    {
+        int count = 0;
+        for (const auto& variant : variants)
+            count += variant.second.fromDisk ? 1 : 0;
+        return count;
+    }
+
+private:
+    std::string vertexCode, fragmentCode;
+    std::function<void(Shader&)> setup;
+    unsigned long long sourceHash;
+
+    ShaderPermutations(const std::string& vertexCode, const std::string& fragmentCode,
+                       std::function<void(Shader&)> setup)
+        : vertexCode(vertexCode), fragmentCode(fragmentCode), setup(setup)
+    {
+        sourceHash = hash(vertexCode + fragmentCode, 14695981039346656037ULL);
+        const char* driver[] = {(const char*) glGetString(GL_VENDOR), (const char*) glGetString(GL_RENDERER),
+                                (const char*) glGetString(GL_VERSION)};
+        for (const char* name : driver)
+            if (name != NULL)
+                sourceHash = hash(name, sourceHash);
+    }
+
+    static std::string readFile(const std::string& path)
+    {
+        std::ifstream file(path);
+        if (!file)
+            std::cout << "ERROR::SHADER_PERMUTATIONS:: can't read " << path << std::endl;
+        std::stringstream stream;
+        stream << file.rdbuf();
+        return stream.str();
+    }
+
+    // FNV-1a, only tells the cache files apart
+    static unsigned long long hash(const std::string& text, unsigned long long value)
+    {
+        for (unsigned char c : text) {
+            value ^= c;
+            value *= 1099511628211ULL;
+        }
+        return value;
+    }
+
+    std::string cacheFile(const std::string& defines) const
+    {
+        char name[64];
+        std::snprintf(name, sizeof(name), "shaders/cache_%016llx.bin", hash(defines, sourceHash));
+        return name;
+    }
+
+    static bool binariesSupported()
+    {
+#ifdef GL_VERSION_4_1
+        if (!GLAD_GL_VERSION_4_1)
+            return false;
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+#else
+        return false;
+#endif
+    }
+
+    static Shader* loadBinary(const std::string& path)
+    {
+#ifdef GL_VERSION_4_1
+        if (!binariesSupported())
+            return NULL;
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+            return NULL;
+        GLenum format = 0;
+        file.read((char*) &format, sizeof(format));
+        if (!file)
+            return NULL;
+        std::vector<char> binary((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (binary.empty())
+            return NULL;
+        unsigned int program = glCreateProgram();
+        glProgramBinary(program, format, &binary[0], (GLsizei) binary.size());
+        GLint success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            // a new driver may reject the old binaries, the caller compiles the sources again and replaces the file
+            glDeleteProgram(program);
+            return NULL;
+        }
+        return new Shader(program);
+#else
+        return NULL;
+#endif
+    }
+
+    static void storeBinary(const Shader& shader, const std::string& path)
+    {
+#ifdef GL_VERSION_4_1
+        if (!binariesSupported())
+            return;
+        GLint length = 0;
+        glGetProgramiv(shader.ID, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        std::vector<char> binary(length);
+        GLenum format = 0;
+        glGetProgramBinary(shader.ID, length, NULL, &format, &binary[0]);
+        // written to a temporary file that replaces the cache file once complete, a crash mid write would otherwise
+        // leave a truncated binary for the next run to load
+        std::string temporary = path + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary);
+            if (file) {
+                file.write((const char*) &format, sizeof(format));
+                file.write(&binary[0], length);
+            }
+            if (!file) {
+                std::cout << "ERROR::SHADER_PERMUTATIONS:: can't write the program cache " << temporary << std::endl;
+                file.close();
+                std::remove(temporary.c_str());
+                return;
+            }
+        }
+        // rename doesn't replace an existing file everywhere
+        if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+            std::remove(path.c_str());
+            if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+                std::cout << "ERROR::SHADER_PERMUTATIONS:: can't replace the program cache " << path << std::endl;
+                std::remove(temporary.c_str());
+            }
+        }
+#endif
+    }
+};
+#endif
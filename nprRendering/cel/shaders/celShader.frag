@@ -1,5 +1,6 @@
 #version 330 core
-out vec4 FragColor;
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out vec4 OitWeight; // only bound in the transparency pass
 
 in float nDotL;
 in vec2 texCoord;
@@ -25,9 +26,26 @@ uniform sampler2D texture_diffuse1;
 uniform sampler2D texture_normal1;
 uniform sampler2D texture_ambient1;
 
-uniform int celAmount;
+// the NPR switches, constants in the variants of shaderPermutations.h and uniforms in the uber shader
+#ifndef DO_CEL_SHADING
 uniform bool doCelShading;
+#define DO_CEL_SHADING doCelShading
+#endif
+#ifndef USE_BPSR
 uniform bool useBPSR;
+#define USE_BPSR useBPSR
+#endif
+// the transparent surfaces go to the weighted blended targets, see weightedOIT.h
+uniform bool oitPass;
+// the quantization of the shading (for celAmount, or an artist's toon ramp) and the specular curve (for
+// specularExponent), baked into lookup textures by lutBaker.h
+uniform sampler2D celRamp;
+uniform sampler2D specularCurve;
+
+float lutCoord(float x, sampler2D lut) {
+    float size = float(textureSize(lut, 0).x);
+    return (clamp(x, 0.0, 1.0) * (size - 1.0) + 0.5) / size;
+}
 
 void main() {
 
@@ -52,7 +70,7 @@ void main() {
     vec3 V = normalize(CamPos_tangent - Pos_tangent); // V: surface to eye vector
     vec3 H = normalize(L + V); // H: half-vector between L and V
     float specModulation = max(dot(N, H), 0.0);
-    specModulation = pow(specModulation, specularExponent);
+    specModulation = texture(specularCurve, vec2(lutCoord(specModulation, specularCurve), 0.5)).r;
     vec3 specular = lightColor * specModulation;
 
 
@@ -63,29 +81,36 @@ void main() {
     // calculate soft shading
     //    float shading = nDotL;
     vec3 shading;
-    if (useBPSR)
+    if (USE_BPSR)
     shading = ambient + (diffuse + specular) * ambientOcclusion;
     else
     shading = vec3(nDotL);
 
-    // re-quantisize soft shading
-    //    float celShading = 1.0;
-    vec3 celShading = vec3(1.0);
-    float step = 1.0 / celAmount;
-    for (float i = 1 - (step * 2); i >= 0; i = i - step) {
-        if (i == 0) i = 0.1;
-        //        if (shading < i) celShading = i + step;
-        if (shading.r < i) celShading.r = i + step;
-        if (shading.g < i) celShading.g = i + step;
-        if (shading.b < i) celShading.b = i + step;
-    }
-
-    if (doCelShading) {
+    if (DO_CEL_SHADING) {
+        // re-quantisize soft shading
+        vec3 celShading;
+        if (USE_BPSR) {
+            celShading.r = texture(celRamp, vec2(lutCoord(shading.r, celRamp), 0.5)).r;
+            celShading.g = texture(celRamp, vec2(lutCoord(shading.g, celRamp), 0.5)).g;
+            celShading.b = texture(celRamp, vec2(lutCoord(shading.b, celRamp), 0.5)).b;
+        } else {
+            // gray, one fetch
+            celShading = texture(celRamp, vec2(lutCoord(shading.r, celRamp), 0.5)).rgb;
+        }
         FragColor = vec4(color.rgb * celShading, color.a);
     } else {
         FragColor = vec4(color.rgb * shading, color.a);
     }
 
+    if (oitPass) {
+        // the weight falls off with the view distance, so nearer layers dominate the average
+        float alpha = FragColor.a;
+        float viewDistance = 1.0 / gl_FragCoord.w;
+        float weight = alpha * clamp(10.0 / (1e-5 + pow(viewDistance / 5.0, 2.0) + pow(viewDistance / 200.0, 6.0)), 1e-2, 3e3);
+        FragColor = vec4(FragColor.rgb * alpha * weight, alpha);
+        OitWeight = vec4(alpha * weight);
+    }
+
     // create texture with above result: celTexture
 
 }
\ No newline at end of file
@@ -11,16 +11,25 @@ out vec3 Pos_tangent;
 out vec3 CamPos_tangent;
 out vec3 LightDir_tangent;
 out vec3 Norm_tangent;
+flat out int MaterialIndex;
 
 // light uniform variables
 uniform vec3 lightDirection;
 uniform vec3 viewPosition;
 
-// transformations
-uniform mat4 projection; // camera projection matrix
-uniform mat4 view;  // represents the world in the eye coord space
-uniform mat4 model; // represents model in the world coord space
-uniform mat4 modelInvT; // inverse of the transpose of  model
+// transformations, streamed through the ring buffer (streamRing.h)
+layout (std140) uniform FrameData {
+    mat4 projection; // camera projection matrix
+    mat4 view;  // represents the world in the eye coord space
+    mat4 viewProjection; // projection * view
+};
+layout (std140) uniform DrawData {
+    mat4 model; // represents model in the world coord space
+    mat4 modelInvT; // inverse of the transpose of  model
+    mat4 modelViewProjection; // projection * view * model, multiplied once per draw on the cpu
+};
+// material of the mesh, read by the texture array variant of the fragment shader
+uniform int materialIndex;
 
 void main() {
     mat3 normalModelInvT = mat3(modelInvT);
@@ -35,6 +44,7 @@ void main() {
     CamPos_tangent = TBN * viewPosition;
     Pos_tangent = vec3(0.0);
     Norm_tangent = TBN * N;
+    MaterialIndex = materialIndex;
 
-    gl_Position = projection * view * model * vec4(vertex, 1.0);
+    gl_Position = modelViewProjection * vec4(vertex, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,127 @@
+#version 330 core
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out vec4 OitWeight; // only bound in the transparency pass
+
+in float nDotL;
+in vec2 texCoord;
+in vec3 Pos_tangent;
+in vec3 CamPos_tangent;
+in vec3 LightDir_tangent;
+in vec3 Norm_tangent;
+
+// light uniform variables
+uniform vec3 ambientLightColor;
+uniform vec3 lightColor;
+
+// material properties
+uniform float ambientOcclusionMix;
+uniform float normalMappingMix;
+uniform float specularExponent;
+
+// camera position
+uniform vec3 viewPosition;
+
+// material textures, one array page per kind, the layers come from the material table
+#define MAX_MATERIALS 256
+uniform sampler2DArray atlas_diffuse;
+uniform sampler2DArray atlas_normal;
+uniform sampler2DArray atlas_ambient;
+layout (std140) uniform Materials {
+    ivec4 materialLayers[MAX_MATERIALS]; // diffuse, normal, ambient, specular, -1 if missing
+};
+flat in int MaterialIndex; // entry in the material table, -1 without material
+
+// the NPR switches, constants in the variants of shaderPermutations.h and uniforms in the uber shader
+#ifndef DO_CEL_SHADING
+uniform bool doCelShading;
+#define DO_CEL_SHADING doCelShading
+#endif
+#ifndef USE_BPSR
+uniform bool useBPSR;
+#define USE_BPSR useBPSR
+#endif
+// the transparent surfaces go to the weighted blended targets, see weightedOIT.h
+uniform bool oitPass;
+// the quantization of the shading (for celAmount, or an artist's toon ramp) and the specular curve (for
+// specularExponent), baked into lookup textures by lutBaker.h
+uniform sampler2D celRamp;
+uniform sampler2D specularCurve;
+
+float lutCoord(float x, sampler2D lut) {
+    float size = float(textureSize(lut, 0).x);
+    return (clamp(x, 0.0, 1.0) * (size - 1.0) + 0.5) / size;
+}
+
+vec4 sampleAtlas(sampler2DArray atlas, int layer, vec4 fallback) {
+    if (layer < 0) return fallback;
+    return texture(atlas, vec3(texCoord, float(layer)));
+}
+
+void main() {
+    ivec4 layers = MaterialIndex < 0 ? ivec4(-1) : materialLayers[MaterialIndex];
+
+    vec4 albedo = sampleAtlas(atlas_diffuse, layers.x, vec4(1.0));
+
+    float ambientOcclusion = sampleAtlas(atlas_ambient, layers.z, vec4(1.0)).r;
+    ambientOcclusion = mix(1.0, ambientOcclusion, ambientOcclusionMix);
+
+    vec3 N =  sampleAtlas(atlas_normal, layers.y, vec4(0.5, 0.5, 1.0, 1.0)).rgb;
+    N = normalize(N * 2.0 - 1.0);
+    N = normalize(mix(Norm_tangent, N, normalMappingMix));
+
+    // ambient light
+    vec3 ambient = ambientLightColor;// * albedo.rgb;
+
+    // parallel light
+    vec3 L = normalize(LightDir_tangent);   // L: - light direction
+    float diffuseModulation = max(dot(N, L), 0.0);
+    vec3 diffuse = lightColor * diffuseModulation;// * albedo.rgb;
+
+    // blinn-phong specular reflection
+    vec3 V = normalize(CamPos_tangent - Pos_tangent); // V: surface to eye vector
+    vec3 H = normalize(L + V); // H: half-vector between L and V
+    float specModulation = max(dot(N, H), 0.0);
+    specModulation = texture(specularCurve, vec2(lutCoord(specModulation, specularCurve), 0.5)).r;
+    vec3 specular = lightColor * specModulation;
+
+
+    //vec4 color = vec4(ambient + (diffuse + specular) * ambientOcclusion, albedo.a);
+    vec4 color = albedo;
+
+    //  Cel shading
+    // calculate soft shading
+    //    float shading = nDotL;
+    vec3 shading;
+    if (USE_BPSR)
+    shading = ambient + (diffuse + specular) * ambientOcclusion;
+    else
+    shading = vec3(nDotL);
+
+    if (DO_CEL_SHADING) {
+        // re-quantisize soft shading
+        vec3 celShading;
+        if (USE_BPSR) {
+            celShading.r = texture(celRamp, vec2(lutCoord(shading.r, celRamp), 0.5)).r;
+            celShading.g = texture(celRamp, vec2(lutCoord(shading.g, celRamp), 0.5)).g;
+            celShading.b = texture(celRamp, vec2(lutCoord(shading.b, celRamp), 0.5)).b;
+        } else {
+            // gray, one fetch
+            celShading = texture(celRamp, vec2(lutCoord(shading.r, celRamp), 0.5)).rgb;
+        }
+        FragColor = vec4(color.rgb * celShading, color.a);
+    } else {
+        FragColor = vec4(color.rgb * shading, color.a);
+    }
+
+    if (oitPass) {
+        // the weight falls off with the view distance, so nearer layers dominate the average
+        float alpha = FragColor.a;
+        float viewDistance = 1.0 / gl_FragCoord.w;
+        float weight = alpha * clamp(10.0 / (1e-5 + pow(viewDistance / 5.0, 2.0) + pow(viewDistance / 200.0, 6.0)), 1e-2, 3e3);
+        FragColor = vec4(FragColor.rgb * alpha * weight, alpha);
+        OitWeight = vec4(alpha * weight);
+    }
+
+    // create texture with above result: celTexture
+
+}
\ No newline at end of file
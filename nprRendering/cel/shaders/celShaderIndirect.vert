@@ -0,0 +1,63 @@
+#version 430 core
+layout (location = 0) in vec3 vertex; // Original vertex position V
+layout (location = 1) in vec3 normal; // Vertex normal N
+layout (location = 2) in vec2 textCoord;
+layout (location = 3) in vec3 tangent;
+layout (location = 4) in vec3 bitangent;
+layout (location = 5) in uint instanceId; // per instance, offset by the baseInstance of the indirect command
+
+out float nDotL;
+out vec2 texCoord;
+out vec3 Pos_tangent;
+out vec3 CamPos_tangent;
+out vec3 LightDir_tangent;
+out vec3 Norm_tangent;
+flat out int MaterialIndex;
+
+// must match GpuInstance in gpuCulling.h
+struct Instance {
+    mat4 model;
+    mat4 modelInvT;
+    vec4 boundsMin;
+    vec4 boundsMax;
+    uint mesh;
+    uint lodCount;
+    uint lodStride;
+    uint bucket;
+    int material;
+    uint pad0, pad1, pad2;
+};
+layout (std430, binding = 1) readonly buffer Instances {
+    Instance instances[];
+};
+
+// light uniform variables
+uniform vec3 lightDirection;
+uniform vec3 viewPosition;
+
+// transformations, model and modelInvT come from the instance buffer, the camera from the ring buffer
+layout (std140) uniform FrameData {
+    mat4 projection; // camera projection matrix
+    mat4 view;  // represents the world in the eye coord space
+    mat4 viewProjection; // projection * view
+};
+
+void main() {
+    mat4 model = instances[instanceId].model;
+    mat3 normalModelInvT = mat3(instances[instanceId].modelInvT);
+    vec3 N = normalize(normalModelInvT * normal);
+    mat3 TBN = transpose(mat3( normalize(normalModelInvT * tangent),
+    normalize(normalModelInvT * bitangent),
+    normalize(normalModelInvT * normal)));
+
+    nDotL = dot(normal, lightDirection);
+    texCoord = textCoord;
+    LightDir_tangent = TBN * lightDirection;
+    CamPos_tangent = TBN * viewPosition;
+    Pos_tangent = vec3(0.0);
+    Norm_tangent = TBN * N;
+    MaterialIndex = instances[instanceId].material;
+
+    // two matrix vector products instead of the matrix products of projection * view * model
+    gl_Position = viewProjection * (model * vec4(vertex, 1.0));
+}
@@ -0,0 +1,19 @@
+#version 330 core
+out vec4 FragColor;
+in vec2 TexCoords;
+
+uniform sampler2D source; // depth texture or the previous pyramid level
+uniform vec2 ratio;       // source texels per target texel
+uniform vec2 sourceSize;
+
+void main() {
+    // max depth of every source texel covered by this texel, so the pyramid never claims something is closer than it is
+    vec2 target = floor(gl_FragCoord.xy);
+    ivec2 first = ivec2(floor(target * ratio));
+    ivec2 last = min(ivec2(ceil((target + 1.0) * ratio)) - 1, ivec2(sourceSize) - 1);
+    float depth = 0.0;
+    for (int y = first.y; y <= last.y; y++)
+        for (int x = first.x; x <= last.x; x++)
+            depth = max(depth, texelFetch(source, ivec2(x, y), 0).r);
+    FragColor = vec4(depth);
+}
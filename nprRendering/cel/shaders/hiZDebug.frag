@@ -0,0 +1,16 @@
+#version 330 core
+out vec4 FragColor;
+in vec2 TexCoords;
+
+uniform sampler2D hiZTexture;
+uniform int level;
+uniform float near;
+uniform float far;
+
+void main() {
+    // linearize so that the depth differences are visible, near is black and far is white
+    float depth = textureLod(hiZTexture, TexCoords, float(level)).r;
+    float z = depth * 2.0 - 1.0;
+    float linear = (2.0 * near * far) / (far + near - z * (far - near));
+    FragColor = vec4(vec3(linear / far), 1.0);
+}
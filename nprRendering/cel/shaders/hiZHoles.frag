@@ -0,0 +1,17 @@
+#version 330 core
+out vec4 FragColor;
+in vec2 TexCoords;
+
+uniform sampler2D source; // the reprojected points, 0 where none landed
+
+void main() {
+    // a hole is disoccluded or was outside of the old view, its neighbours may only be partly covered, all read as far
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    ivec2 last = textureSize(source, 0) - 1;
+    float depth = texelFetch(source, texel, 0).r;
+    for (int y = -1; y <= 1; y++)
+        for (int x = -1; x <= 1; x++)
+            if (texelFetch(source, clamp(texel + ivec2(x, y), ivec2(0), last), 0).r <= 0.0)
+                depth = 1.0;
+    FragColor = vec4(depth);
+}
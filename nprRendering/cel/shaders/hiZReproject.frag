@@ -0,0 +1,8 @@
+#version 330 core
+out vec4 FragColor;
+in float depth;
+
+void main() {
+    // blended with max, the texels no point lands on keep the clear value 0 and are holes
+    FragColor = vec4(depth);
+}
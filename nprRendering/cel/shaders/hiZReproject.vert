@@ -0,0 +1,17 @@
+#version 330 core
+out float depth;
+
+uniform sampler2D source; // the hi-z pyramid
+uniform int sourceLevel;  // the level the points are taken from, the target has its size
+uniform mat4 toCurrent;   // clip space of the pyramid to the current clip space
+
+void main() {
+    // one point per texel, moved to where its depth lands in the current view
+    ivec2 size = textureSize(source, sourceLevel);
+    ivec2 texel = ivec2(gl_VertexID % size.x, gl_VertexID / size.x);
+    vec2 ndc = (vec2(texel) + 0.5) / vec2(size) * 2.0 - 1.0;
+    vec4 clip = toCurrent * vec4(ndc, texelFetch(source, texel, sourceLevel).r * 2.0 - 1.0, 1.0);
+    depth = min(clip.z / clip.w * 0.5 + 0.5, 1.0);
+    // behind the camera now, moved out of the view so it leaves a hole
+    gl_Position = clip.w > 1e-5 ? vec4(clip.xy / clip.w, 0.0, 1.0) : vec4(2.0, 2.0, 0.0, 1.0);
+}
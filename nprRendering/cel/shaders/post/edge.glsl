@@ -0,0 +1,49 @@
+// edges of the input with a Laplace or a Sobel filter, 9 taps. Composed into a pass by postChain.h, see PostStage
+uniform vec2 texelSize;
+uniform float strokeSize;
+// constants in the variants of shaderPermutations.h, uniforms in the uber shader
+#ifndef DO_EDGE_ONLY
+uniform bool doEdgeOnly;
+#define DO_EDGE_ONLY doEdgeOnly
+#endif
+#ifndef EDGE_SOBEL
+uniform bool edgeSobel;
+#define EDGE_SOBEL edgeSobel
+#endif
+#ifndef EDGE_LUMINANCE
+uniform bool edgeLuminance;
+#define EDGE_LUMINANCE edgeLuminance
+#endif
+
+vec3 edgeTap(vec4 color) {
+    return EDGE_LUMINANCE ? vec3(dot(color.rgb, vec3(0.2126, 0.7152, 0.0722))) : color.rgb;
+}
+
+vec4 STAGE(vec2 uv) {
+    vec2 size = texelSize * strokeSize;
+    // the input may be a fused stage, every tap evaluates it again
+    vec4 color = STAGE_INPUT(uv);
+    vec3 c = edgeTap(color);
+    //texture coordinate for neighboring pixels
+    vec3 tr = edgeTap(STAGE_INPUT(uv + vec2(size.x, size.y)));
+    vec3 bl = edgeTap(STAGE_INPUT(uv + vec2(-size.x, -size.y)));
+    vec3 r = edgeTap(STAGE_INPUT(uv + vec2(size.x, 0.0)));
+    vec3 l = edgeTap(STAGE_INPUT(uv + vec2(-size.x, 0.0)));
+    vec3 t = edgeTap(STAGE_INPUT(uv + vec2(0.0, size.y)));
+    vec3 b = edgeTap(STAGE_INPUT(uv + vec2(0.0, -size.y)));
+    vec3 br = edgeTap(STAGE_INPUT(uv + vec2(size.x, -size.y)));
+    vec3 tl = edgeTap(STAGE_INPUT(uv + vec2(-size.x, size.y)));
+    vec3 edge;
+    if (EDGE_SOBEL) {
+        vec3 gx = (tr + 2.0 * r + br) - (tl + 2.0 * l + bl);
+        vec3 gy = (tl + 2.0 * t + tr) - (bl + 2.0 * b + br);
+        edge = sqrt(gx * gx + gy * gy);
+    } else {
+        // Laplace
+        edge = tr + bl + r + l + t + b + br + tl - 8.0 * c;
+    }
+    // invert and output edges
+    if (DO_EDGE_ONLY)
+        return vec4(vec3(1.0) - edge, 1.0);
+    return vec4(color.rgb - edge, 1.0);
+}
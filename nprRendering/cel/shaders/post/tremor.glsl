@@ -0,0 +1,46 @@
+// line tremor, moves the coordinate of the input by the noise texture, 1 tap. Composed into a pass by postChain.h,
+// fused after the edges it offsets the coordinates of the edge filter instead of reading an edge target
+uniform sampler2D noiseTexture;
+uniform float lineDistortion; // noiseAmp
+// blue noise (noiseBaker.h), hashScale repeats a texel per pixel
+uniform sampler2D hashNoise;
+uniform vec2 hashScale;
+// constants in the variants of shaderPermutations.h, uniforms in the uber shader
+#ifndef DO_LINE_TREMOR
+uniform bool doLineTremor;
+#define DO_LINE_TREMOR doLineTremor
+#endif
+#ifndef NORMALIZE_DISTORTION
+uniform bool normalizeDistortion;
+#define NORMALIZE_DISTORTION normalizeDistortion
+#endif
+#ifndef RANDOMIZE
+uniform bool randomize;
+#define RANDOMIZE randomize
+#endif
+#ifndef HASH_TEXTURE
+uniform bool hashTexture;
+#define HASH_TEXTURE hashTexture
+#endif
+
+float tremorRand(vec2 co){
+    return fract(sin(dot(co.xy ,vec2(12.9898,78.233))) * 43758.5453);
+}
+
+vec4 STAGE(vec2 uv) {
+    if (!DO_LINE_TREMOR)
+        return STAGE_INPUT(uv);
+    // Image distortion
+    // noiseAmp determines how much the picture is distorted
+    vec2 noise;
+    vec2 rCoords;
+    if (HASH_TEXTURE) rCoords = vec2(textureLod(hashNoise, uv * hashScale, 0.0).r);
+    else rCoords = vec2(tremorRand(uv), tremorRand(uv));
+    if (RANDOMIZE) noise = texture(noiseTexture, rCoords).xy;
+    else noise = texture(noiseTexture, uv).xy;
+    if (NORMALIZE_DISTORTION)
+        noise = normalize(noise * 2.0 - vec2(1.0));
+    noise *= lineDistortion;
+    // distortion of image / texture coord
+    return STAGE_INPUT(uv + noise);
+}
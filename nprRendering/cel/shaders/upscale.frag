@@ -0,0 +1,30 @@
+#version 330 core
+out vec4 FragColor;
+in vec2 TexCoords;
+
+// the image of the dynamic resolution, smaller than the screen
+uniform sampler2D lowResTexture;
+// how fast a texel loses its weight with the color difference to the nearest texel, 0 is bilinear
+uniform float edgeSharpness;
+
+// bilinear, but the four texels are weighted by how close their color is to the nearest one, so the dark edge lines
+// don't blur into the surfaces next to them and stay as sharp as the smaller image has them
+void main() {
+    ivec2 size = textureSize(lowResTexture, 0);
+    vec2 position = TexCoords * vec2(size) - 0.5;
+    vec2 base = floor(position);
+    vec2 f = position - base;
+    ivec2 texel = ivec2(base);
+    vec3 c00 = texelFetch(lowResTexture, clamp(texel, ivec2(0), size - 1), 0).rgb;
+    vec3 c10 = texelFetch(lowResTexture, clamp(texel + ivec2(1, 0), ivec2(0), size - 1), 0).rgb;
+    vec3 c01 = texelFetch(lowResTexture, clamp(texel + ivec2(0, 1), ivec2(0), size - 1), 0).rgb;
+    vec3 c11 = texelFetch(lowResTexture, clamp(texel + ivec2(1, 1), ivec2(0), size - 1), 0).rgb;
+    vec3 nearest = f.y < 0.5 ? (f.x < 0.5 ? c00 : c10) : (f.x < 0.5 ? c01 : c11);
+
+    vec4 w = vec4((1.0 - f.x) * (1.0 - f.y), f.x * (1.0 - f.y), (1.0 - f.x) * f.y, f.x * f.y);
+    vec3 d00 = c00 - nearest, d10 = c10 - nearest, d01 = c01 - nearest, d11 = c11 - nearest;
+    w *= exp(-edgeSharpness * vec4(dot(d00, d00), dot(d10, d10), dot(d01, d01), dot(d11, d11)));
+    // the nearest texel has the full range weight, the sum never gets to 0
+    vec3 color = (c00 * w.x + c10 * w.y + c01 * w.z + c11 * w.w) / (w.x + w.y + w.z + w.w);
+    FragColor = vec4(color, 1.0);
+}
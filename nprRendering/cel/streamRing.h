@@ -0,0 +1,284 @@
+#ifndef STREAMRING_H
+#define STREAMRING_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#include <shader.h>
+
+#include <iostream>
+#include <cstring>
+#include <cstddef>
+#include <vector>
+#include <utility>
+
+// buffer_storage is core since 4.4, older contexts may still expose the extension
+#if defined(GL_VERSION_4_4) || defined(GL_ARB_buffer_storage)
+#define STREAM_RING_BUFFER_STORAGE
+#endif
+
+// uniform block bindings of the streamed data, 0 is taken by the material table of the atlas
+const unsigned int STREAM_FRAME_BINDING = 1;
+const unsigned int STREAM_DRAW_BINDING = 2;
+// frames the cpu may run ahead of the gpu, every one owns a region of the ring
+const int STREAM_RING_FRAMES = 3;
+
+// std140 layouts of the FrameData and DrawData blocks in the vertex shaders. The products are computed here once per
+// frame or draw, the vertex shaders used to multiply the matrices for every vertex
+struct FrameData {
+    glm::mat4 projection;
+    glm::mat4 view;
+    glm::mat4 viewProjection; // projection * view
+};
+struct DrawData {
+    glm::mat4 model;
+    glm::mat4 modelInvT;
+    glm::mat4 modelViewProjection; // projection * view * model
+};
+
+// Ring allocator for data that changes every frame (uniform blocks, shader storage ranges, instance data).
+// With buffer storage the buffer is mapped once, persistent and coherent, and split into one region per frame in
+// flight. A fence guards every region, it is only written again once the gpu is done with the frame that used it.
+// Without buffer storage it falls back to orphaning the buffer every frame and writing with glBufferSubData.
+//
+// usage:
+//   ring.beginFrame();                                   // waits for the region if the gpu fell behind
+//   ring.bindUniform(STREAM_DRAW_BINDING, &data, sizeof(data));
+//   ring.bindStorage(binding, &instances[0], bytes);     // per instance data of a draw, needs storageSupported
+//   size_t offset = ring.pushVertices(&instances[0], bytes); // or as instanced attributes, glVertexAttribPointer(offset)
+//   ...
+//   ring.endFrame();                                     // after the last draw that reads from the ring
+class StreamRing {
+public:
+    unsigned int buffer = 0;
+    bool persistent = false;  // buffer storage path, false for the orphaning fallback
+    bool storageSupported = false; // shader storage ranges, GL 4.3
+    size_t regionSize;
+
+    // statistics, the frame ones are of the last finished frame
+    size_t frameBytes = 0;
+    int frameAllocations = 0;
+    int stalls = 0;           // beginFrame calls that had to wait for the gpu
+    float stallTime = 0.0f;   // ms waited in total
+    float lastStallTime = 0.0f;
+    int grows = 0;            // times a frame overflowed its region
+
+    explicit StreamRing(size_t regionSize = 4 * 1024 * 1024) : regionSize(regionSize)
+    {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        uniformAlignment = (size_t) alignment;
+        storageAlignment = uniformAlignment;
+#ifdef GL_VERSION_4_3
+        storageSupported = GLAD_GL_VERSION_4_3 != 0;
+        if (storageSupported) {
+            glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+            storageAlignment = (size_t) alignment;
+        }
+#endif
+#ifdef STREAM_RING_BUFFER_STORAGE
+#ifdef GL_VERSION_4_4
+        persistent = GLAD_GL_VERSION_4_4;
+#endif
+#ifdef GL_ARB_buffer_storage
+        persistent = persistent || GLAD_GL_ARB_buffer_storage;
+#endif
+#endif
+        for (int i = 0; i < STREAM_RING_FRAMES; i++)
+            fences[i] = 0;
+        create();
+        std::cout << "STREAM RING:: " << (persistent ? "persistent mapped, " : "orphaning glBufferSubData, ")
+                  << STREAM_RING_FRAMES << " x " << regionSize / 1024 << " KB" << std::endl;
+    }
+
+    ~StreamRing()
+    {
+        release();
+    }
+
+    // selects the region of the next frame, blocks while the gpu still reads from it
+    void beginFrame()
+    {
+        frame = (frame + 1) % STREAM_RING_FRAMES;
+        offset = 0;
+        used = 0;
+        allocations = 0;
+        if (!persistent) {
+            // orphan, the driver hands out fresh storage and the draws in flight keep the old one
+            releaseRetired(true);
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            glBufferData(GL_ARRAY_BUFFER, regionSize, NULL, GL_STREAM_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            return;
+        }
+        waitRegion(frame);
+        // the fence of the frame that retired a buffer passed too
+        releaseRetired(false);
+    }
+
+    // fences the region of this frame, the next frames won't write into it before the gpu passed the fence
+    void endFrame()
+    {
+        frameBytes = used;
+        frameAllocations = allocations;
+        if (!persistent)
+            return;
+        fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // copies size bytes into the ring and returns their offset in the buffer
+    size_t push(const void *data, size_t size, size_t alignment)
+    {
+        size_t start = (offset + alignment - 1) & ~(alignment - 1);
+        if (start + size > regionSize) {
+            grow(start + size);
+            start = 0;
+        }
+        if (persistent) {
+            memcpy(mapped + frame * regionSize + start, data, size);
+            start += frame * regionSize;
+        } else {
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            glBufferSubData(GL_ARRAY_BUFFER, start, size, data);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        offset = (start % regionSize) + size;
+        used += size;
+        allocations++;
+        return start;
+    }
+
+    // streams a uniform block and binds its range, the range stays valid until the end of the frame
+    void bindUniform(unsigned int binding, const void *data, size_t size)
+    {
+        size_t start = push(data, size, uniformAlignment);
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, start, size);
+    }
+
+    // streams a shader storage block, for per instance data that outgrows the uniform block size. Only with
+    // storageSupported, the range stays valid until the end of the frame
+    void bindStorage(unsigned int binding, const void *data, size_t size)
+    {
+#ifdef GL_VERSION_4_3
+        if (!storageSupported)
+            return;
+        size_t start = push(data, size, storageAlignment);
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, binding, buffer, start, size);
+#endif
+    }
+
+    // streams per instance vertex attributes, returns the offset in buffer for glVertexAttribPointer. buffer is read
+    // after the push, a grow replaces it
+    size_t pushVertices(const void *data, size_t size)
+    {
+        return push(data, size, 16);
+    }
+
+    // connects the FrameData and DrawData blocks of a shader to the bindings of the ring
+    static void attach(Shader &shader)
+    {
+        unsigned int blockIndex = glGetUniformBlockIndex(shader.ID, "FrameData");
+        if (blockIndex != GL_INVALID_INDEX)
+            glUniformBlockBinding(shader.ID, blockIndex, STREAM_FRAME_BINDING);
+        blockIndex = glGetUniformBlockIndex(shader.ID, "DrawData");
+        if (blockIndex != GL_INVALID_INDEX)
+            glUniformBlockBinding(shader.ID, blockIndex, STREAM_DRAW_BINDING);
+    }
+
+private:
+    char *mapped = nullptr;
+    GLsync fences[STREAM_RING_FRAMES];
+    size_t uniformAlignment, storageAlignment;
+    int frame = 0;
+    size_t offset = 0, used = 0;
+    int allocations = 0;
+    // buffers replaced by grow() with the region that used them last
+    std::vector<std::pair<unsigned int, int> > retired;
+
+    void create()
+    {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+#ifdef STREAM_RING_BUFFER_STORAGE
+        if (persistent) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_ARRAY_BUFFER, regionSize * STREAM_RING_FRAMES, NULL, flags);
+            mapped = (char *) glMapBufferRange(GL_ARRAY_BUFFER, 0, regionSize * STREAM_RING_FRAMES, flags);
+            if (mapped == nullptr) {
+                std::cout << "ERROR::STREAM RING:: persistent mapping failed, using glBufferSubData" << std::endl;
+                glBindBuffer(GL_ARRAY_BUFFER, 0);
+                glDeleteBuffers(1, &buffer);
+                persistent = false;
+                create();
+                return;
+            }
+        } else
+#endif
+        glBufferData(GL_ARRAY_BUFFER, regionSize, NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void release()
+    {
+        releaseRetired(true);
+        for (int i = 0; i < STREAM_RING_FRAMES; i++) {
+            if (fences[i])
+                glDeleteSync(fences[i]);
+            fences[i] = 0;
+        }
+        if (mapped != nullptr) {
+            glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+            mapped = nullptr;
+        }
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+
+    void waitRegion(int region)
+    {
+        if (!fences[region])
+            return;
+        GLenum result = glClientWaitSync(fences[region], 0, 0);
+        if (result == GL_TIMEOUT_EXPIRED) {
+            // the gpu is more than STREAM_RING_FRAMES - 1 frames behind
+            double start = glfwGetTime();
+            do
+                result = glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+            while (result == GL_TIMEOUT_EXPIRED);
+            lastStallTime = (float) (glfwGetTime() - start) * 1000.0f;
+            stallTime += lastStallTime;
+            stalls++;
+        }
+        glDeleteSync(fences[region]);
+        fences[region] = 0;
+    }
+
+    // A frame wrote more than a region holds. The ranges bound earlier in the frame (and the frames in flight) still
+    // read from the old buffer, so it is retired instead of deleted and a larger one takes over.
+    void grow(size_t needed)
+    {
+        while (regionSize < needed)
+            regionSize *= 2;
+        grows++;
+        std::cout << "STREAM RING:: growing regions to " << regionSize / 1024 << " KB" << std::endl;
+        retired.push_back(std::make_pair(buffer, frame));
+        mapped = nullptr; // deleting the retired buffer unmaps it
+        create();
+    }
+
+    // deletes the retired buffers the gpu can't be reading from anymore
+    void releaseRetired(bool all)
+    {
+        for (size_t i = 0; i < retired.size();) {
+            if (all || !persistent || retired[i].second == frame) {
+                glDeleteBuffers(1, &retired[i].first);
+                retired.erase(retired.begin() + i);
+            } else
+                i++;
+        }
+    }
+};
+#endif
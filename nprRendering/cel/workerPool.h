@@ -0,0 +1,106 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <vector>
+#include <algorithm>
+
+// A fixed set of threads that run the jobs of one batch at a time. The calling thread takes part in the batch and
+// run() only returns when every job finished, so the jobs can freely use data owned by the caller.
+//
+// usage:
+//   WorkerPool workers;
+//   workers.run(chunks, [&](int chunk, int worker) { ... }); // worker is in [0, workers.size())
+class WorkerPool {
+public:
+    // threads besides the caller, by default one per remaining hardware thread
+    explicit WorkerPool(int threads = -1)
+    {
+        if (threads < 0)
+            threads = std::max((int) std::thread::hardware_concurrency() - 1, 0);
+        for (int i = 0; i < threads; i++)
+            this->threads.push_back(std::thread(&WorkerPool::loop, this, i + 1));
+    }
+
+    ~WorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        for (std::thread &thread : threads)
+            thread.join();
+    }
+
+    // amount of workers including the calling thread
+    int size() const { return (int) threads.size() + 1; }
+
+    // runs job(index, worker) for every index in [0, count)
+    void run(int count, const std::function<void(int, int)> &job)
+    {
+        if (count <= 0)
+            return;
+        if (threads.empty() || count == 1) {
+            for (int i = 0; i < count; i++)
+                job(i, 0);
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            this->job = &job;
+            jobCount = count;
+            nextJob = 0;
+            busyWorkers = (int) threads.size();
+            batch++;
+        }
+        wake.notify_all();
+        work(0);
+        // the workers leave the batch once no job is left, after that the job function may go out of scope
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return busyWorkers == 0; });
+        this->job = nullptr;
+    }
+
+private:
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    const std::function<void(int, int)> *job = nullptr;
+    std::atomic<int> nextJob{0};
+    int jobCount = 0;
+    int busyWorkers = 0;
+    unsigned int batch = 0;
+    bool quit = false;
+
+    void work(int worker)
+    {
+        for (int i = nextJob++; i < jobCount; i = nextJob++)
+            (*job)(i, worker);
+    }
+
+    void loop(int worker)
+    {
+        unsigned int seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&] { return quit || batch != seen; });
+                if (quit)
+                    return;
+                seen = batch;
+            }
+            work(worker);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                busyWorkers--;
+            }
+            done.notify_one();
+        }
+    }
+};
+#endif
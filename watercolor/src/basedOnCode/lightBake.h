@@ -0,0 +1,127 @@
+#ifndef LIGHTBAKE_H
+#define LIGHTBAKE_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <mesh.h>
+#include <shader.h>
+
+#include <functional>
+#include <map>
+#include <utility>
+#include <vector>
+
+// Caches the diffuse and dilute per vertex lighting of shader.vert (the three calculateLight calls) in a buffer per
+// mesh draw. A bake runs shader.vert with LIGHT_BAKE over the mesh vertices as points into a transform feedback
+// buffer with the rasterizer off, with the same math and the same (view transformed) posWorld and normalWorld as the
+// unbaked path. The watercolor shader then reads the totals from attributes 5 and 6 (useBakedLights) and only
+// evaluates the specular. A draw is baked again only when its key changes: the frame key (lights, diffuse parameters
+// and the view) followed by the model matrix of the draw, so the bakes hold while the camera stands still.
+// Meshes drawn more than once per frame (the four wheels) get one buffer per draw, in draw order.
+//
+// usage:
+//   lightBake.beginFrame(key, setUniforms);            // setUniforms sets everything but model on the bake shader
+//   lightBake.prepare(mesh, model, drawShader);        // before each mesh draw, leaves drawShader in use
+//   mesh.Draw(drawShader);
+class LightBake {
+public:
+    // baked floats per vertex, must match the varyings captured in the constructor
+    static const int BAKED_FLOATS = 6;
+    // first attribute location of the baked values in shader.vert
+    static const unsigned int BAKED_LOCATION = 5;
+
+    // draws of the last frame that ran the light math, the ones that reused a bake, and the vertices baked
+    int bakedDraws = 0, cachedDraws = 0, bakedVertices = 0;
+
+    LightBake()
+        : bakeShader("shaders/shader.vert", nullptr, nullptr, "#define LIGHT_BAKE\n",
+                     std::vector<const char*>{"lightColorTotal", "lDiluteTotal"})
+    {
+    }
+
+    ~LightBake()
+    {
+        for (auto& entry : entries)
+            glDeleteBuffers(1, &entry.second.buffer);
+    }
+
+    void beginFrame(const std::vector<float>& frameKey, const std::function<void(Shader&)>& setUniforms)
+    {
+        this->frameKey = frameKey;
+        this->setUniforms = setUniforms;
+        uniformsSet = false;
+        drawCounts.clear();
+        bakedDraws = cachedDraws = bakedVertices = 0;
+    }
+
+    // binds the baked lighting of the next draw of mesh to its VAO, bakes it first if the key changed
+    void prepare(Mesh& mesh, const glm::mat4& model, Shader& drawShader)
+    {
+        Entry& entry = entries[std::make_pair(&mesh, drawCounts[&mesh]++)];
+        std::vector<float> key = frameKey;
+        for (int i = 0; i < 4; i++)
+            for (int j = 0; j < 4; j++)
+                key.push_back(model[i][j]);
+
+        if (entry.buffer == 0) {
+            glGenBuffers(1, &entry.buffer);
+            glBindBuffer(GL_ARRAY_BUFFER, entry.buffer);
+            glBufferData(GL_ARRAY_BUFFER, mesh.vertices.size() * BAKED_FLOATS * sizeof(float), NULL, GL_DYNAMIC_COPY);
+        }
+        if (entry.key != key) {
+            bake(mesh, model, entry.buffer);
+            entry.key = key;
+            drawShader.use();
+            bakedDraws++;
+            bakedVertices += (int) mesh.vertices.size();
+        } else {
+            cachedDraws++;
+        }
+
+        // the VAO is shared by all the draws of the mesh, so the baked buffer is bound again every time
+        glBindVertexArray(mesh.VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, entry.buffer);
+        for (unsigned int i = 0; i < 2; i++) {
+            glEnableVertexAttribArray(BAKED_LOCATION + i);
+            glVertexAttribPointer(BAKED_LOCATION + i, 3, GL_FLOAT, GL_FALSE, BAKED_FLOATS * sizeof(float),
+                                  (void*)(i * 3 * sizeof(float)));
+        }
+        glBindVertexArray(0);
+    }
+
+private:
+    struct Entry {
+        unsigned int buffer = 0;
+        std::vector<float> key;
+    };
+
+    Shader bakeShader;
+    std::map<std::pair<const Mesh*, int>, Entry> entries;
+    std::map<const Mesh*, int> drawCounts;
+    std::vector<float> frameKey;
+    std::function<void(Shader&)> setUniforms;
+    bool uniformsSet = false;
+
+    void bake(Mesh& mesh, const glm::mat4& model, unsigned int buffer)
+    {
+        bakeShader.use();
+        if (!uniformsSet) {
+            setUniforms(bakeShader);
+            uniformsSet = true;
+        }
+        bakeShader.setMat4("model", model);
+        // the light math only needs positions and normals, the packed depth layout has both
+        glEnable(GL_RASTERIZER_DISCARD);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, buffer);
+        glBeginTransformFeedback(GL_POINTS);
+        glBindVertexArray(mesh.depthVAO);
+        glDrawArrays(GL_POINTS, 0, (GLsizei) mesh.vertices.size());
+        glBindVertexArray(0);
+        glEndTransformFeedback();
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+        glDisable(GL_RASTERIZER_DISCARD);
+    }
+};
+#endif
@@ -2,12 +2,18 @@
 #include <GLFW/glfw3.h>
 #include <iostream>
 
+#include <algorithm>
+#include <cstdlib>
 #include <vector>
 #include <chrono>
+#include <cstring>
+#include <iomanip>
 
 #include "shader.h"
 #include "camera.h"
 #include "model.h"
+#include "lightBake.h"
+#include "changeTracker.h"
 
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
@@ -20,6 +26,7 @@ using namespace glm;
 void loadFloorTexture();
 void drawCar();
 void drawFloor();
+void drawModel(Model* model, const glm::mat4& transform);
 void drawGui();
 
 
@@ -82,6 +89,7 @@ struct WatercolorConfig {
 struct ShadingConfig {
     // basic group
     bool useColorTexture = false;
+    bool useTextureArrays = true; // sample from the material atlas pages instead of per mesh textures
     glm::vec3 colorTint = {1,1,1};
     // normal group
     bool useNormalTexture = false;
@@ -104,6 +112,14 @@ struct GnralConfig {
     float atmRangeStart = 50.0f;
     float atmRangeEnd = 100.0f;
     vec2 texel = {1.0f / SCR_HEIGHT, 1.0f /SCR_WIDTH};
+    // lay down the depth first so the watercolor fragment shader runs once per pixel
+    bool useDepthPrePass = false;
+    // reuse the per vertex lighting while the lights, their parameters, the camera and the object don't move
+    bool useLightBake = true;
+    // only draw when something changed and sleep until the next event otherwise
+    bool redrawOnChange = true;
+    // the tremor changes every frame, with redrawOnChange it is only redrawn this many times a second
+    float tremorRate = 12.0f;
 
 }gnralConfig;
 
@@ -114,10 +130,22 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void key_input_callback(GLFWwindow* window, int button, int other, int action, int mods);
 void cursor_input_callback(GLFWwindow* window, double posX, double posY);
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
+void window_refresh_callback(GLFWwindow* window);
 
 // function declarations
 // ---------------------
 void setCommonUniforms();
+void setDisplacementUniforms();
+void setPreshaderUniforms();
+std::vector<float> lightBakeKey();
+void watchChanges();
+double nextTremorWait();
+void drawScene();
+void drawDepthPrePass();
+void drawColorPass();
+void runPrePassBenchmark();
+void runPreshaderBenchmark();
+bool runShadingCheck();
 void drawObjects();
 void drawCar();
 void drawGui();
@@ -128,7 +156,16 @@ vec2 calcVelocity(vec2 currentPos, vec2 prevPos, float zOverW);
 
 // global variables used for rendering
 // -----------------------------------
-Shader* watercolorShader;
+Shader* watercolorShader; // variant in use this frame, one of the two below
+Shader* watercolorPlainShader;
+Shader* watercolorArrayShader;
+Shader* depthShader; // depth pre-pass, repeats the vertex displacement of shader.vert
+bool depthPass = false; // the draw functions only lay down depth
+LightBake* lightBake;
+// the whole frame is one pass, there is no intermediate image to reuse
+const unsigned int PASS_SCENE = 1;
+ChangeTracker changes;
+MaterialAtlas* materialAtlas;
 Model* carPaint;
 Model* carBody;
 Model* carInterior;
@@ -149,8 +186,16 @@ bool isPaused = false; // stop camera movement when GUI is open
 /////////////////////////////////
 //      Init & Render loop     //
 /////////////////////////////////
-int main()
+int main(int argc, char** argv)
 {
+    bool benchmark = false, check = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--benchmark") == 0)
+            benchmark = true;
+        if (strcmp(argv[i], "--check") == 0)
+            check = true;
+    }
+
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
@@ -176,6 +221,7 @@ int main()
     glfwSetCursorPosCallback(window, cursor_input_callback);
     glfwSetKeyCallback(window, key_input_callback);
 	glfwSetScrollCallback(window, scroll_callback);
+    glfwSetWindowRefreshCallback(window, window_refresh_callback);
 
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED); 
 
@@ -187,14 +233,22 @@ int main()
         return -1;
     }
 
-    watercolorShader = new Shader("shaders/shader.vert", "shaders/shader.frag");
-	carPaint = new Model("car/Paint_LOD0.obj");
-	carBody = new Model("car/Body_LOD0.obj");
-	carLight = new Model("car/Light_LOD0.obj");
-	carInterior = new Model("car/Interior_LOD0.obj");
-	carWindow = new Model("car/Windows_LOD0.obj");
-	carWheel = new Model("car/Wheel_LOD0.obj");
-	floorModel = new Model("floor/floor_no_material.obj");
+    watercolorPlainShader = new Shader("shaders/shader.vert", "shaders/shader.frag");
+    watercolorArrayShader = new Shader("shaders/shader.vert", "shaders/shaderArray.frag");
+    watercolorShader = watercolorPlainShader;
+    depthShader = new Shader("shaders/depth.vert", "shaders/depth.frag");
+    lightBake = new LightBake();
+    materialAtlas = new MaterialAtlas();
+	carPaint = new Model("car/Paint_LOD0.obj", false, materialAtlas);
+	carBody = new Model("car/Body_LOD0.obj", false, materialAtlas);
+	carLight = new Model("car/Light_LOD0.obj", false, materialAtlas);
+	carInterior = new Model("car/Interior_LOD0.obj", false, materialAtlas);
+	carWindow = new Model("car/Windows_LOD0.obj", false, materialAtlas);
+	carWheel = new Model("car/Wheel_LOD0.obj", false, materialAtlas);
+	floorModel = new Model("floor/floor_no_material.obj", false, materialAtlas);
+    // all materials are known now, pack them into texture array pages
+    materialAtlas->build();
+    materialAtlas->attach(*watercolorArrayShader);
 
     // Set light 2 and 3 variables
     // ---------------------------
@@ -210,6 +264,19 @@ int main()
     glEnable(GL_DEPTH_TEST); // turn on z-buffer depth test
     glDepthFunc(GL_LESS); // draws fragments that are closer to the screen in NDC
 
+    if (check) {
+        // exits with 1 when the preshaded or the baked lighting doesn't draw what the per vertex reference draws
+        bool match = runShadingCheck();
+        glfwTerminate();
+        return match ? 0 : 1;
+    }
+    if (benchmark) {
+        runPrePassBenchmark();
+        runPreshaderBenchmark();
+        runShadingCheck();
+        glfwTerminate();
+        return 0;
+    }
 
     // IMGUI init
     IMGUI_CHECKVERSION();
@@ -226,6 +293,7 @@ int main()
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     // render loop
+    watchChanges();
     while (!glfwWindowShouldClose(window))
     {
         static float lastFrame = 0.0f;
@@ -235,13 +303,29 @@ int main()
 
         processInput(window);
 
+        // the tremor moves with the timer, it is drawn tremorRate times a second, as often as it takes the eye to see
+        // it shake
+        if (!gnralConfig.redrawOnChange)
+            changes.invalidate(PASS_SCENE);
+        double tremorWait = nextTremorWait();
+        if (changes.poll() == 0) {
+            // the last frame is still on the screen, nothing is drawn or swapped until an event or the next tremor
+            if (tremorWait > 0.0)
+                glfwWaitEventsTimeout(tremorWait);
+            else
+                glfwWaitEvents();
+            // the gui reacts to the mouse without changing any watched value
+            if (isPaused)
+                changes.invalidate(PASS_SCENE);
+            // the time spent waiting isn't camera movement time
+            lastFrame = (float)glfwGetTime();
+            continue;
+        }
+
         glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        watercolorShader->use();
-        setCommonUniforms();
-        drawFloor();
-        drawCar();
+        drawScene();
 		if (isPaused) {
 			drawGui();
 		}
@@ -263,7 +347,11 @@ int main()
 	delete carBody;
     delete carWheel;
     delete robotModel;
-    delete watercolorShader;
+    delete materialAtlas;
+    delete watercolorPlainShader;
+    delete watercolorArrayShader;
+    delete depthShader;
+    delete lightBake;
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
@@ -274,17 +362,11 @@ int main()
 void setCommonUniforms(){
     //USED ON VERTEX
     // Watercolor in vertex
-    watercolorShader->setFloat("bleedOffset", watercolorConfig.bleedOffset);
-    watercolorShader->setFloat("tremorFront", watercolorConfig.tremorFront);
-    watercolorShader->setFloat("tremorSpeed", watercolorConfig.tremorSpeed);
-    watercolorShader->setFloat("tremorFreq", watercolorConfig.tremorFrequency);
-    watercolorShader->setFloat("tremor", watercolorConfig.tremor);
+    setDisplacementUniforms();
     watercolorShader->setFloat("diffuseFactor", watercolorConfig.diffuseFactor);
     watercolorShader->setFloat("diluteArea", watercolorConfig.diluteArea);
     watercolorShader->setFloat("shaderWrap", watercolorConfig.shadeWrap);
     watercolorShader->setFloat("darkEdges", watercolorConfig.darkEdges);
-    watercolorShader->setFloat("timer", deltaTime);
-    watercolorShader->setVec2("texel", gnralConfig.texel);
     // LIGHTS
     watercolorShader->setBool("l1enabled",light1.enabled);
     watercolorShader->setInt("l1type", light1.type);
@@ -347,13 +429,92 @@ void setCommonUniforms(){
     watercolorShader->setBool("flipV", shadingConfig.flipV);
     watercolorShader->setFloat("bumpDepth", shadingConfig.bumpDepth);
     watercolorShader->setVec3("colorTint", shadingConfig.colorTint);
+}
+
+// everything that moves the vertices, shared with the depth pre-pass so both passes produce the same depth
+void setDisplacementUniforms(){
+    watercolorShader->setFloat("bleedOffset", watercolorConfig.bleedOffset);
+    watercolorShader->setFloat("tremorFront", watercolorConfig.tremorFront);
+    watercolorShader->setFloat("tremorSpeed", watercolorConfig.tremorSpeed);
+    watercolorShader->setFloat("tremorFreq", watercolorConfig.tremorFrequency);
+    watercolorShader->setFloat("tremor", watercolorConfig.tremor);
+    watercolorShader->setFloat("timer", deltaTime);
+    watercolorShader->setVec2("texel", gnralConfig.texel);
 
     // CONTROL
     watercolorShader->setVec3("inColor0", vec3{1});
     watercolorShader->setVec3("inColor1", vec3{1});
     watercolorShader->setVec3("inColor2", vec3{1});
     watercolorShader->setVec3("inColor3", vec3{1});
+    // the depth pass needs viewInv too
+    setPreshaderUniforms();
+}
 
+// the uniform only expressions of shader.vert, once per frame instead of once per vertex. Every entry is paired
+// with the per vertex version under NO_PRESHADER in the shader, keep both in sync
+void setPreshaderUniforms(){
+    glm::mat4 view = camera.GetViewMatrix();
+    watercolorShader->setMat4("viewInv", glm::inverse(view));
+    watercolorShader->setVec3("mainLightDir", glm::normalize(-light1.direction));
+    const LightConfig* lights[3] = {&light1, &light2, &light3};
+    const char* coneCosNames[3] = {"l1coneCos", "l2coneCos", "l3coneCos"};
+    for (int i = 0; i < 3; i++) {
+        // the fall off can't be inside the cone
+        float fallOff = std::max(lights[i]->fallOff, lights[i]->coneAngle);
+        watercolorShader->setVec2(coneCosNames[i], glm::cos(fallOff), glm::cos(lights[i]->coneAngle));
+    }
+    watercolorShader->setFloat("specPower", glm::pow(2.0f - shadingConfig.specularDiffusion, 10.0f));
+}
+
+// everything the baked lighting of shader.vert depends on apart from the model matrix. posWorld and normalWorld are
+// transformed by the view, the specular is not baked so its parameters are not part of it
+std::vector<float> lightBakeKey(){
+    std::vector<float> key;
+    glm::mat4 view = camera.GetViewMatrix();
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++)
+            key.push_back(view[i][j]);
+    const LightConfig* lights[3] = {&light1, &light2, &light3};
+    for (const LightConfig* light : lights) {
+        key.push_back(light->enabled);
+        key.push_back((float) light->type);
+        key.insert(key.end(), {light->position.x, light->position.y, light->position.z});
+        key.insert(key.end(), {light->color.x, light->color.y, light->color.z});
+        key.push_back(light->intensity);
+        key.insert(key.end(), {light->direction.x, light->direction.y, light->direction.z});
+        key.insert(key.end(), {light->coneAngle, light->fallOff, light->attenuationScale});
+    }
+    key.insert(key.end(), {watercolorConfig.diffuseFactor, watercolorConfig.diluteArea, watercolorConfig.shadeWrap});
+    return key;
+}
+
+// dirties the scene when the tremor is due, returns the seconds until the next tremor frame, 0 when there is none
+double nextTremorWait(){
+    static double lastTremor = 0.0;
+    if (!gnralConfig.redrawOnChange || watercolorConfig.tremor == 0.0f)
+        return 0.0;
+    double now = glfwGetTime();
+    double period = 1.0 / std::max(gnralConfig.tremorRate, 1.0f);
+    if (now - lastTremor >= period) {
+        changes.invalidate(PASS_SCENE);
+        lastTremor = now;
+    }
+    return period - (now - lastTremor);
+}
+
+void watchChanges(){
+    // everything the frame reads that can change between frames, the config structs are plain values
+    changes.watch(camera.Position, PASS_SCENE);
+    changes.watch(camera.Front, PASS_SCENE);
+    changes.watch(camera.Up, PASS_SCENE);
+    changes.watch(camera.Zoom, PASS_SCENE);
+    changes.watch(light1, PASS_SCENE);
+    changes.watch(light2, PASS_SCENE);
+    changes.watch(light3, PASS_SCENE);
+    changes.watch(watercolorConfig, PASS_SCENE);
+    changes.watch(shadingConfig, PASS_SCENE);
+    changes.watch(gnralConfig, PASS_SCENE);
+    changes.watch(isPaused, PASS_SCENE);
 }
 
 /////////////////////////////////
@@ -458,6 +619,8 @@ void drawGui(){
                 ImGui::Text("Shading");
                 ImGui::Text("Basic group");
                 ImGui::Checkbox("Use color texture", &shadingConfig.useColorTexture);
+                ImGui::Checkbox("Use texture arrays", &shadingConfig.useTextureArrays);
+                ImGui::Text("Atlas: %d pages, %d texture binds/frame", (int) materialAtlas->pages.size(), materialAtlas->textureBinds);
                 ImGui::ColorEdit3("Color tint", (float*)&shadingConfig.colorTint);
                 ImGui::Separator();
                 ImGui::Text("Normal group");
@@ -479,6 +642,14 @@ void drawGui(){
             case 3:
                 ImGui::BeginGroup();
                 ImGui::Checkbox("Use control", &gnralConfig.useControl);
+                ImGui::Checkbox("Depth pre-pass", &gnralConfig.useDepthPrePass);
+                ImGui::Checkbox("Bake lights", &gnralConfig.useLightBake);
+                ImGui::Checkbox("Redraw on change", &gnralConfig.redrawOnChange);
+                ImGui::SliderFloat("Tremor redraws per second", &gnralConfig.tremorRate, 1.0f, 60.0f);
+                ImGui::Text("  with redraw on change, a tremor above 0 redraws at this rate");
+                ImGui::Text("Redraw: %d frames drawn, %d waits for events", changes.drawnFrames, changes.skippedFrames);
+                ImGui::Text("Light bake: %d baked, %d cached draws, %d vertices", lightBake->bakedDraws,
+                            lightBake->cachedDraws, lightBake->bakedVertices);
                 ImGui::ColorEdit3("Atmosphere color", (float*)&gnralConfig.atmosphereColor);
                 ImGui::SliderFloat("Atm range start", &gnralConfig.atmRangeStart, 0.0f, 50000.0f);
                 ImGui::SliderFloat("Atm range end", &gnralConfig.atmRangeEnd, 0.0f, 50000.0f);
@@ -494,6 +665,291 @@ void drawGui(){
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 }
 
+void drawScene(){
+    if (gnralConfig.useDepthPrePass)
+        drawDepthPrePass();
+    drawColorPass();
+}
+
+void drawDepthPrePass(){
+    // depth only from the packed positions, leaves the depth test at GL_EQUAL without writes for the colour pass
+    watercolorShader = depthShader;
+    watercolorShader->use();
+    setDisplacementUniforms();
+    depthPass = true;
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    drawFloor();
+    drawCar();
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    depthPass = false;
+    glDepthFunc(GL_EQUAL);
+    glDepthMask(GL_FALSE);
+}
+
+void drawColorPass(){
+    watercolorShader = shadingConfig.useTextureArrays ? watercolorArrayShader : watercolorPlainShader;
+    materialAtlas->beginPass();
+    watercolorShader->use();
+    setCommonUniforms();
+    watercolorShader->setBool("useBakedLights", gnralConfig.useLightBake);
+    if (gnralConfig.useLightBake) {
+        lightBake->beginFrame(lightBakeKey(), [](Shader& bakeShader) {
+            Shader* drawShader = watercolorShader;
+            watercolorShader = &bakeShader;
+            setCommonUniforms();
+            watercolorShader->setMat4("projection", glm::perspective(glm::radians(camera.Zoom),
+                                      (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f));
+            watercolorShader->setMat4("view", camera.GetViewMatrix());
+            watercolorShader = drawShader;
+        });
+    }
+    drawFloor();
+    drawCar();
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+}
+
+void runPrePassBenchmark(){
+    // renders the scene offscreen at 1080p and 4K with and without the depth pre-pass. The fragment invocations of
+    // the colour pass come from a pipeline statistics query when the driver has one, otherwise from the samples
+    // that passed the depth test, the gpu time covers both passes
+    const int resolutions[2][2] = {{1920, 1080}, {3840, 2160}};
+    const int warmupFrames = 10;
+    const int measuredFrames = 60;
+    GLenum fragmentTarget = GL_SAMPLES_PASSED;
+#ifdef GL_ARB_pipeline_statistics_query
+    if (GLAD_GL_ARB_pipeline_statistics_query)
+        fragmentTarget = GL_FRAGMENT_SHADER_INVOCATIONS_ARB;
+#endif
+    unsigned int queries[2];
+    glGenQueries(2, queries);
+
+    std::cout << "fragments counted as " << (fragmentTarget == GL_SAMPLES_PASSED ? "samples passed" : "shader invocations")
+              << std::endl;
+    std::cout << "resolution  pre-pass  fragments/frame  overdraw  gpu ms/frame" << std::endl;
+    for (const int* resolution : resolutions) {
+        int width = resolution[0], height = resolution[1];
+        unsigned int framebuffer, colorTexture, depthRbo;
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glGenTextures(1, &colorTexture);
+        glBindTexture(GL_TEXTURE_2D, colorTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+        glGenRenderbuffers(1, &depthRbo);
+        glBindRenderbuffer(GL_RENDERBUFFER, depthRbo);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRbo);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER:: Benchmark framebuffer is not complete!" << std::endl;
+        glViewport(0, 0, width, height);
+
+        for (int prePass = 0; prePass < 2; prePass++) {
+            gnralConfig.useDepthPrePass = prePass == 1;
+            GLuint64 fragments = 0, gpuTime = 0;
+            for (int frame = 0; frame < warmupFrames + measuredFrames; frame++) {
+                bool measured = frame >= warmupFrames;
+                glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                if (measured)
+                    glBeginQuery(GL_TIME_ELAPSED, queries[0]);
+                if (gnralConfig.useDepthPrePass)
+                    drawDepthPrePass();
+                if (measured)
+                    glBeginQuery(fragmentTarget, queries[1]);
+                drawColorPass();
+                if (measured) {
+                    glEndQuery(fragmentTarget);
+                    glEndQuery(GL_TIME_ELAPSED);
+                    GLuint64 result = 0;
+                    glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &result);
+                    gpuTime += result;
+                    glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &result);
+                    fragments += result;
+                }
+            }
+            double fragmentsPerFrame = (double) fragments / measuredFrames;
+            std::cout << std::setw(5) << width << "x" << std::setw(4) << height
+                      << std::setw(10) << (prePass ? "on" : "off")
+                      << std::setw(17) << (long long) fragmentsPerFrame
+                      << std::fixed << std::setprecision(2)
+                      << std::setw(10) << fragmentsPerFrame / (width * height)
+                      << std::setprecision(3) << std::setw(14) << gpuTime / 1.0e6 / measuredFrames << std::endl;
+        }
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteTextures(1, &colorTexture);
+        glDeleteRenderbuffers(1, &depthRbo);
+    }
+    glDeleteQueries(2, queries);
+    glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+}
+
+void runPreshaderBenchmark(){
+    // draws the car with the baked lights, with the preshaded shader.vert and with the per vertex reference
+    // (NO_PRESHADER) at a small resolution, so the vertex shader dominates the gpu time. The camera doesn't move, so
+    // the baked row only bakes in its first warmup frame. The vertex invocations come from a pipeline statistics
+    // query when the driver has one
+    const int width = 320, height = 180;
+    const int drawsPerFrame = 10;
+    const int warmupFrames = 10;
+    const int measuredFrames = 60;
+    bool countVertices = false;
+#ifdef GL_ARB_pipeline_statistics_query
+    countVertices = GLAD_GL_ARB_pipeline_statistics_query;
+#endif
+    Shader referenceShader("shaders/shader.vert", "shaders/shader.frag", nullptr, "#define NO_PRESHADER\n");
+    Shader* preshadedShader = watercolorPlainShader;
+    bool useTextureArrays = shadingConfig.useTextureArrays;
+    bool useLightBake = gnralConfig.useLightBake;
+    shadingConfig.useTextureArrays = false;
+    unsigned int queries[2];
+    glGenQueries(2, queries);
+
+    unsigned int framebuffer, colorTexture, depthRbo;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glGenTextures(1, &colorTexture);
+    glBindTexture(GL_TEXTURE_2D, colorTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+    glGenRenderbuffers(1, &depthRbo);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthRbo);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRbo);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::FRAMEBUFFER:: Benchmark framebuffer is not complete!" << std::endl;
+    glViewport(0, 0, width, height);
+
+    std::cout << "vertex shader  vertices/frame  gpu ms/frame  ns/1000 vertices" << std::endl;
+    const char* modeNames[3] = {"baked", "preshader", "per vertex"};
+    for (int mode = 0; mode < 3; mode++) {
+        gnralConfig.useLightBake = mode == 0;
+        watercolorPlainShader = mode < 2 ? preshadedShader : &referenceShader;
+        GLuint64 vertices = 0, gpuTime = 0;
+        for (int frame = 0; frame < warmupFrames + measuredFrames; frame++) {
+            bool measured = frame >= warmupFrames;
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            if (measured) {
+                glBeginQuery(GL_TIME_ELAPSED, queries[0]);
+#ifdef GL_ARB_pipeline_statistics_query
+                if (countVertices)
+                    glBeginQuery(GL_VERTEX_SHADER_INVOCATIONS_ARB, queries[1]);
+#endif
+            }
+            for (int draw = 0; draw < drawsPerFrame; draw++)
+                drawColorPass();
+            if (measured) {
+#ifdef GL_ARB_pipeline_statistics_query
+                if (countVertices)
+                    glEndQuery(GL_VERTEX_SHADER_INVOCATIONS_ARB);
+#endif
+                glEndQuery(GL_TIME_ELAPSED);
+                GLuint64 result = 0;
+                glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &result);
+                gpuTime += result;
+                if (countVertices) {
+                    glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &result);
+                    vertices += result;
+                }
+            }
+        }
+        double gpuMs = gpuTime / 1.0e6 / measuredFrames;
+        double verticesPerFrame = (double) vertices / measuredFrames;
+        std::cout << std::setw(13) << modeNames[mode] << std::setw(16);
+        if (countVertices)
+            std::cout << (long long) verticesPerFrame;
+        else
+            std::cout << "-";
+        std::cout << std::fixed << std::setprecision(3) << std::setw(14) << gpuMs << std::setw(18);
+        if (countVertices && verticesPerFrame > 0.0)
+            std::cout << gpuMs * 1.0e6 / verticesPerFrame * 1000.0;
+        else
+            std::cout << "-";
+        std::cout << std::endl;
+    }
+
+    watercolorPlainShader = preshadedShader;
+    shadingConfig.useTextureArrays = useTextureArrays;
+    gnralConfig.useLightBake = useLightBake;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteTextures(1, &colorTexture);
+    glDeleteRenderbuffers(1, &depthRbo);
+    glDeleteQueries(2, queries);
+    glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+}
+
+bool runShadingCheck(){
+    // draws the scene with the per vertex reference (NO_PRESHADER), the preshaded shader.vert and the preshaded one
+    // with the baked lights, and compares the last two with the reference. The preshader only moves uniform math to
+    // the cpu and the bake runs the same math in another program, so they may differ by rounding and nothing else:
+    // a pixel counts when a channel is off by more than 2/255, and more than one in a thousand of them fails
+    const int width = 640, height = 360;
+    const int tolerance = 2;
+    const char* variantNames[3] = {"reference", "preshader", "light bake"};
+    Shader referenceShader("shaders/shader.vert", "shaders/shader.frag", nullptr, "#define NO_PRESHADER\n");
+    Shader* preshadedShader = watercolorPlainShader;
+    bool useTextureArrays = shadingConfig.useTextureArrays;
+    bool useLightBake = gnralConfig.useLightBake;
+    shadingConfig.useTextureArrays = false;
+
+    unsigned int framebuffer, colorTexture, depthRbo;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glGenTextures(1, &colorTexture);
+    glBindTexture(GL_TEXTURE_2D, colorTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+    glGenRenderbuffers(1, &depthRbo);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthRbo);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRbo);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::FRAMEBUFFER:: Check framebuffer is not complete!" << std::endl;
+    glViewport(0, 0, width, height);
+
+    std::vector<unsigned char> images[3];
+    for (int variant = 0; variant < 3; variant++) {
+        watercolorPlainShader = variant == 0 ? &referenceShader : preshadedShader;
+        gnralConfig.useLightBake = variant == 2;
+        glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        drawColorPass();
+        images[variant].resize(width * height * 4);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, &images[variant][0]);
+    }
+
+    bool match = true;
+    for (int variant = 1; variant < 3; variant++) {
+        int differentPixels = 0, maxDifference = 0;
+        for (int i = 0; i < width * height; i++) {
+            int difference = 0;
+            for (int c = 0; c < 4; c++)
+                difference = std::max(difference, std::abs(images[variant][i * 4 + c] - images[0][i * 4 + c]));
+            maxDifference = std::max(maxDifference, difference);
+            if (difference > tolerance)
+                differentPixels++;
+        }
+        bool variantMatch = differentPixels * 1000 <= width * height;
+        std::cout << variantNames[variant] << " check: " << differentPixels << " of " << width * height
+                  << " pixels differ from the " << variantNames[0] << " by more than " << tolerance << "/255, at most "
+                  << maxDifference << "/255, " << (variantMatch ? "match" : "MISMATCH") << std::endl;
+        match = match && variantMatch;
+    }
+
+    watercolorPlainShader = preshadedShader;
+    shadingConfig.useTextureArrays = useTextureArrays;
+    gnralConfig.useLightBake = useLightBake;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &framebuffer);
+    glDeleteTextures(1, &colorTexture);
+    glDeleteRenderbuffers(1, &depthRbo);
+    glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+    return match;
+}
+
 void drawFloor(){
     // camera parameters
     glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
@@ -514,7 +970,7 @@ void drawFloor(){
     glm::mat4 invTranspose = glm::inverse(glm::transpose(view * model));
     watercolorShader->setMat4("invTranspose", invTranspose);
     watercolorShader->setMat4("view", view);
-    floorModel->Draw(*watercolorShader);
+    drawModel(floorModel, model);
 }
 
 void drawCar(){
@@ -532,7 +988,7 @@ void drawCar(){
     glm::mat4 invTranspose = glm::inverse(glm::transpose(view * model));
     watercolorShader->setMat4("invTranspose", invTranspose);
     watercolorShader->setMat4("view", view);
-    carWheel->Draw(*watercolorShader);
+    drawModel(carWheel, model);
 
     // draw wheel
     model = glm::translate(glm::mat4(1.0f), glm::vec3(-.7432, .328, -1.296));
@@ -540,7 +996,7 @@ void drawCar(){
     invTranspose = glm::inverse(glm::transpose(view * model));
     watercolorShader->setMat4("invTranspose", invTranspose);
     watercolorShader->setMat4("view", view);
-    carWheel->Draw(*watercolorShader);
+    drawModel(carWheel, model);
 
     // draw wheel
     model = glm::rotate(glm::mat4(1.0f), glm::pi<float>(), glm::vec3(0.0, 1.0, 0.0));
@@ -549,7 +1005,7 @@ void drawCar(){
     invTranspose = glm::inverse(glm::transpose(view * model));
     watercolorShader->setMat4("invTranspose", invTranspose);
     watercolorShader->setMat4("view", view);
-    carWheel->Draw(*watercolorShader);
+    drawModel(carWheel, model);
 
     // draw wheel
     model = glm::rotate(glm::mat4(1.0f), glm::pi<float>(), glm::vec3(0.0, 1.0, 0.0));
@@ -558,7 +1014,7 @@ void drawCar(){
     invTranspose = glm::inverse(glm::transpose(view * model));
     watercolorShader->setMat4("invTranspose", invTranspose);
     watercolorShader->setMat4("view", view);
-    carWheel->Draw(*watercolorShader);
+    drawModel(carWheel, model);
 
     // draw the rest of the car
     model = glm::mat4(1.0f);
@@ -566,16 +1022,33 @@ void drawCar(){
     invTranspose = glm::inverse(glm::transpose(view * model));
     watercolorShader->setMat4("invTranspose", invTranspose);
     watercolorShader->setMat4("view", view);
-    carBody->Draw(*watercolorShader);
-    carInterior->Draw(*watercolorShader);
-    carPaint->Draw(*watercolorShader);
-    carLight->Draw(*watercolorShader);
+    drawModel(carBody, model);
+    drawModel(carInterior, model);
+    drawModel(carPaint, model);
+    drawModel(carLight, model);
+    // the blended windows stay out of the pre-pass depth, they are tested and written as without it
+    if (depthPass)
+        return;
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
     glEnable(GL_BLEND);
-    carWindow->Draw(*watercolorShader);
+    drawModel(carWindow, model);
     glDisable(GL_BLEND);
 
 }
 
+void drawModel(Model* model, const glm::mat4& transform) {
+    if (!depthPass && gnralConfig.useLightBake)
+        for (Mesh& mesh : model->meshes)
+            lightBake->prepare(mesh, transform, *watercolorShader);
+    if (depthPass)
+        model->DrawDepth();
+    else if (shadingConfig.useTextureArrays)
+        model->Draw(*watercolorShader, *materialAtlas);
+    else
+        model->Draw(*watercolorShader);
+}
+
 /////////////////////////////////
 // Based on prototypeC of MNPR //
 /////////////////////////////////
@@ -760,4 +1233,11 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
     // make sure the viewport matches the new window dimensions; note that width and
     // height will be significantly larger than specified on retina displays.
     glViewport(0, 0, width, height);
+    changes.invalidate(PASS_SCENE);
+}
+
+// glfw: the window contents were damaged (uncovered, restored), the last frame has to be drawn again
+void window_refresh_callback(GLFWwindow* window)
+{
+    changes.invalidate(PASS_SCENE);
 }
\ No newline at end of file
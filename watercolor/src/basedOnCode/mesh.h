@@ -41,6 +41,10 @@ public:
     vector<unsigned int> indices;
     vector<Texture> textures;
     unsigned int VAO;
+    // depth pre-pass layout, packed positions plus the normals the tremor displacement needs
+    unsigned int depthVAO;
+    // entry of the mesh material in the MaterialAtlas table, -1 if the model was loaded without an atlas
+    int materialIndex = -1;
 
     /*  Functions  */
     // constructor
@@ -83,18 +87,32 @@ public:
             glBindTexture(GL_TEXTURE_2D, textures[i].id);
         }
 
+        // always good practice to set everything back to defaults once configured.
+        glActiveTexture(GL_TEXTURE0);
+
         // draw mesh
+        DrawGeometry();
+    }
+
+    // draw the mesh without touching any texture state (the material atlas path binds its own pages)
+    void DrawGeometry()
+    {
         glBindVertexArray(VAO);
         glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
         glBindVertexArray(0);
+    }
 
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
+    // draw only the geometry for the depth pre-pass
+    void DrawDepth()
+    {
+        glBindVertexArray(depthVAO);
+        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+        glBindVertexArray(0);
     }
 
 private:
     /*  Render data  */
-    unsigned int VBO, EBO;
+    unsigned int VBO, EBO, positionVBO;
 
     /*  Functions    */
     // initializes all the buffer objects/arrays
@@ -134,6 +152,26 @@ private:
         glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
 
         glBindVertexArray(0);
+
+        // tightly packed positions and normals for the depth pre-pass (the tremor depends on n dot v), 24 of the 56
+        // bytes of a Vertex. Both stay floats so the displacement matches the colour pass bit for bit
+        vector<glm::vec3> depthVertices(vertices.size() * 2);
+        for (unsigned int i = 0; i < vertices.size(); i++) {
+            depthVertices[i * 2] = vertices[i].Position;
+            depthVertices[i * 2 + 1] = vertices[i].Normal;
+        }
+        glGenVertexArrays(1, &depthVAO);
+        glGenBuffers(1, &positionVBO);
+        glBindVertexArray(depthVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+        glBufferData(GL_ARRAY_BUFFER, depthVertices.size() * sizeof(glm::vec3), &depthVertices[0], GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec3), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec3), (void*)sizeof(glm::vec3));
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+        glBindVertexArray(0);
     }
 };
 #endif
\ No newline at end of file
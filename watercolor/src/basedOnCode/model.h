@@ -13,6 +13,7 @@
 
 #include <mesh.h>
 #include <shader.h>
+#include <materialAtlas.h>
 
 #include <string>
 #include <fstream>
@@ -32,10 +33,16 @@ public:
     vector<Mesh> meshes;
     string directory;
     bool gammaCorrection;
+    // if set, mesh materials are also registered in the atlas while loading
+    MaterialAtlas *atlas;
+    // with an atlas the per mesh textures are only uploaded by the first draw without it, the pages hold the same
+    // images and most runs never leave them
+    bool meshTexturesLoaded;
 
     /*  Functions   */
     // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    Model(string const &path, bool gamma = false, MaterialAtlas *atlas = nullptr)
+        : gammaCorrection(gamma), atlas(atlas), meshTexturesLoaded(atlas == nullptr)
     {
         loadModel(path);
     }
@@ -43,10 +50,43 @@ public:
     // draws the model, and thus all its meshes
     void Draw(Shader shader)
     {
+        LoadMeshTextures();
         for(unsigned int i = 0; i < meshes.size(); i++)
             meshes[i].Draw(shader);
     }
 
+    // draws the model reading the textures from the atlas pages, the shader must use the *Array.frag variant
+    void Draw(Shader &shader, MaterialAtlas &materialAtlas)
+    {
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            materialAtlas.use(shader, meshes[i].materialIndex);
+            meshes[i].DrawGeometry();
+        }
+    }
+
+    // draws the model into the depth buffer only, with a depth pre-pass shader
+    void DrawDepth()
+    {
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].DrawDepth();
+    }
+
+    // uploads the per mesh textures the loading left to the atlas, once
+    void LoadMeshTextures()
+    {
+        if(meshTexturesLoaded)
+            return;
+        for(unsigned int j = 0; j < textures_loaded.size(); j++)
+            textures_loaded[j].id = TextureFromFile(textures_loaded[j].path.c_str(), this->directory);
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            for(unsigned int t = 0; t < meshes[i].textures.size(); t++)
+                for(unsigned int j = 0; j < textures_loaded.size(); j++)
+                    if(meshes[i].textures[t].path == textures_loaded[j].path)
+                        meshes[i].textures[t].id = textures_loaded[j].id;
+        meshTexturesLoaded = true;
+    }
+
 private:
     /*  Functions   */
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
@@ -164,7 +204,26 @@ private:
         textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
 
         // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        Mesh result(vertices, indices, textures);
+        if(atlas)
+            result.materialIndex = registerMaterial(material);
+        return result;
+    }
+
+    // adds the first texture of every kind to the material atlas, the slot order matches AtlasSlot
+    int registerMaterial(aiMaterial *mat)
+    {
+        const aiTextureType types[ATLAS_SLOT_COUNT] = {aiTextureType_DIFFUSE, aiTextureType_HEIGHT, aiTextureType_AMBIENT, aiTextureType_SPECULAR};
+        string paths[ATLAS_SLOT_COUNT];
+        for(int slot = 0; slot < ATLAS_SLOT_COUNT; slot++)
+        {
+            if(mat->GetTextureCount(types[slot]) == 0)
+                continue;
+            aiString str;
+            mat->GetTexture(types[slot], 0, &str);
+            paths[slot] = directory + '/' + string(str.C_Str());
+        }
+        return atlas->addMaterial(paths);
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
@@ -190,7 +249,7 @@ private:
             if(!skip)
             {   // if texture hasn't been loaded already, load it
                 Texture texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
+                texture.id = atlas ? 0 : TextureFromFile(str.C_Str(), this->directory);
                 texture.type = typeName;
                 texture.path = str.C_Str();
                 textures.push_back(texture);
@@ -8,14 +8,17 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <vector>
 
 class Shader
 {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
+    // constructor generates the shader on the fly, defines ("#define X\n" lines) go right after the #version line.
+    // Transform feedback programs name the captured outputs (interleaved) and may leave out the fragment shader
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, const std::string& defines = "",
+           const std::vector<const char*>& feedbackVaryings = std::vector<const char*>())
     {
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
@@ -32,17 +35,20 @@ public:
         {
             // open files
             vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
             std::stringstream vShaderStream, fShaderStream;
             // read file's buffer contents into streams
             vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();
             // close file handlers
             vShaderFile.close();
-            fShaderFile.close();
             // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
+            vertexCode = addDefines(vShaderStream.str(), defines);
+            if(fragmentPath != nullptr)
+            {
+                fShaderFile.open(fragmentPath);
+                fShaderStream << fShaderFile.rdbuf();
+                fShaderFile.close();
+                fragmentCode = addDefines(fShaderStream.str(), defines);
+            }
             // if geometry shader path is present, also load a geometry shader
             if(geometryPath != nullptr)
             {
@@ -50,7 +56,7 @@ public:
                 std::stringstream gShaderStream;
                 gShaderStream << gShaderFile.rdbuf();
                 gShaderFile.close();
-                geometryCode = gShaderStream.str();
+                geometryCode = addDefines(gShaderStream.str(), defines);
             }
         }
         catch (std::ifstream::failure e)
@@ -67,10 +73,13 @@ public:
         glCompileShader(vertex);
         checkCompileErrors(vertex, "VERTEX");
         // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
+        if(fragmentPath != nullptr)
+        {
+            fragment = glCreateShader(GL_FRAGMENT_SHADER);
+            glShaderSource(fragment, 1, &fShaderCode, NULL);
+            glCompileShader(fragment);
+            checkCompileErrors(fragment, "FRAGMENT");
+        }
         // if geometry shader is given, compile geometry shader
         unsigned int geometry;
         if(geometryPath != nullptr)
@@ -84,14 +93,18 @@ public:
         // shader Program
         ID = glCreateProgram();
         glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
+        if(fragmentPath != nullptr)
+            glAttachShader(ID, fragment);
         if(geometryPath != nullptr)
             glAttachShader(ID, geometry);
+        if(!feedbackVaryings.empty())
+            glTransformFeedbackVaryings(ID, (GLsizei) feedbackVaryings.size(), &feedbackVaryings[0], GL_INTERLEAVED_ATTRIBS);
         glLinkProgram(ID);
         checkCompileErrors(ID, "PROGRAM");
         // delete the shaders as they're linked into our program now and no longer necessery
         glDeleteShader(vertex);
-        glDeleteShader(fragment);
+        if(fragmentPath != nullptr)
+            glDeleteShader(fragment);
         if(geometryPath != nullptr)
             glDeleteShader(geometry);
 
@@ -162,6 +175,18 @@ public:
     }
 
 private:
+    // inserts the defines after the #version line, which has to stay the first one
+    // ------------------------------------------------------------------------
+    static std::string addDefines(const std::string &code, const std::string &defines)
+    {
+        if (defines.empty())
+            return code;
+        size_t version = code.find("#version");
+        size_t lineEnd = version == std::string::npos ? std::string::npos : code.find('\n', version);
+        if (lineEnd == std::string::npos)
+            return defines + code;
+        return code.substr(0, lineEnd + 1) + defines + code.substr(lineEnd + 1);
+    }
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
@@ -0,0 +1,5 @@
+#version 330 core
+
+// depth only, the colour writes are masked during the pre-pass
+void main() {
+}
@@ -0,0 +1,45 @@
+#version 330 core
+layout (location = 0) in vec3 vertex;
+layout (location = 1) in vec3 normal;
+
+// depth pre-pass of shader.vert, the position math must stay identical to it (both use an invariant gl_Position)
+// so that the colour pass can test with GL_EQUAL
+invariant gl_Position;
+
+uniform vec4 inColor2;
+uniform mat4 view;
+uniform mat4 projection;
+uniform mat4 model;
+// preshader, see shader.vert
+#ifndef NO_PRESHADER
+uniform mat4 viewInv; // inverse(view)
+#else
+#define viewInv inverse(view)
+#endif
+
+// WATERCOLOR
+uniform float bleedOffset;
+uniform float tremorFront;
+uniform float tremorSpeed;
+uniform float tremorFreq;
+uniform float tremor;
+uniform float timer;
+uniform vec2 texel;
+
+void main() {
+    vec4 worldPos = model * vec4(vertex, 1.0);
+    vec3 posWorld = (vec4(worldPos.xyz,1) * view).xyz;
+    vec3 normalWorld = normalize((vec4(normal, 0.0) * view).xyz);
+    vec3 viewDir = normalize(viewInv[3].xyz - posWorld);
+    float nDotV = dot(normalWorld, viewDir);
+
+    // WATERCOLOR EFFECTS
+    vec3 newPos = worldPos.xyz;
+    newPos += normalWorld * clamp (inColor2.a - 0.7, 0.0, 1.0) * bleedOffset;
+
+    float tremorAngle = min(clamp(nDotV * 1.2, 0.0, 1.0), (1 - tremorFront));
+    vec4 pPos = vec4(newPos, 1) * projection;
+    vec4 tremorPos = pPos + vec4((sin(timer * (tremorSpeed * 100) + worldPos.xy * (tremorFreq * 10)) * tremor * texel).xy, 0, 0);
+
+    gl_Position = mix(tremorPos, pPos, tremorAngle);
+}
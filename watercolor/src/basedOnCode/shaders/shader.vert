@@ -4,18 +4,27 @@ layout (location = 1) in vec3 normal;
 layout (location = 2) in vec2 textCoord;
 layout (location = 3) in vec3 vTangent;
 layout (location = 4) in vec3 aBitangent;
+#ifndef LIGHT_BAKE
+// diffuse and dilute totals baked by LightBake (lightBake.h), read instead of calling calculateLight when
+// useBakedLights is set, only the specular is evaluated per vertex then
+layout (location = 5) in vec3 bakedLightColor;
+layout (location = 6) in vec3 bakedDilute;
+uniform bool useBakedLights;
+#endif
 
 struct L_OUT {
     vec3 lSpecular, lDilute, lColor;
 };
 
 
+// must match depth.vert, the colour pass tests against the pre-pass depth with GL_EQUAL
+invariant gl_Position;
+
 uniform vec4 inColor0, inColor1, inColor2, inColor3;
 uniform mat4 view;//world;
 uniform mat4 invTranspose;//worldInvTrans;
 uniform mat4 projection;//worldViewProj;
 uniform mat4 model;
-//uniform mat4 viewInv;
 // LIGHTS
 uniform bool l1enabled;
 uniform int l1type;
@@ -70,6 +79,23 @@ uniform vec2 texel;
 uniform float specular;
 uniform float specDiffusion;
 uniform float specTransparency;
+// PRESHADER, expressions of uniforms alone, evaluated once per frame on the cpu by setPreshaderUniforms in main.cpp
+// instead of for every vertex. NO_PRESHADER evaluates them here again, the benchmark compares both
+#ifndef NO_PRESHADER
+uniform mat4 viewInv;      // inverse(view)
+uniform vec3 mainLightDir; // normalize(-l1direction)
+uniform vec2 l1coneCos;    // cos(max(fallOff, coneAngle)), cos(coneAngle), the edges of the spot cone
+uniform vec2 l2coneCos;
+uniform vec2 l3coneCos;
+uniform float specPower;   // pow(2 - specDiffusion, 10)
+#else
+#define viewInv inverse(view)
+#define mainLightDir normalize(-l1direction)
+#define l1coneCos vec2(cos(max(l1fallOff, l1coneAngle)), cos(l1coneAngle))
+#define l2coneCos vec2(cos(max(l2fallOff, l2coneAngle)), cos(l2coneAngle))
+#define l3coneCos vec2(cos(max(l3fallOff, l3coneAngle)), cos(l3coneAngle))
+#define specPower pow((2 - specDiffusion), 10)
+#endif
 
 out vec4 vColor0, vColor1, vColor2;
 out vec4 vPreviousScreenPos;
@@ -89,12 +115,10 @@ out vec3 lightColorTotal;
 out vec3 lDiluteTotal;
 out float lShadeTotal;
 
-float getLightConeAngle(float coneAngle, float coneFallOff, vec3 lightVec, vec3 lightDir) {
-    if (coneFallOff< coneAngle)
-        coneFallOff = coneAngle;
+float getLightConeAngle(vec2 coneCos, vec3 lightVec, vec3 lightDir) {
     float lDotDir = dot(lightVec, lightDir);
-    float edge0 = cos(coneFallOff);
-    float edge1 = cos(coneAngle);
+    float edge0 = coneCos.x;
+    float edge1 = coneCos.y;
     // Hermite interpolation // smooth step function
     float cone = clamp((lDotDir - edge0) / (edge1 - edge0), 0.0f, 1.0f);
     cone = cone * cone * (3 - 2 * cone);
@@ -102,7 +126,7 @@ float getLightConeAngle(float coneAngle, float coneFallOff, vec3 lightVec, vec3
 }
 
 L_OUT calculateLight(bool lightEnable, int lightType, float lightAtten, vec3 lightPos, vec3 vertWorldPos,
-    vec3 lightColor, float lightIntensity, vec3 lightDir, float lightConeAngle, float lightFallOff, mat4 lightViewPrjMatrix,
+    vec3 lightColor, float lightIntensity, vec3 lightDir, vec2 lightConeCos, mat4 lightViewPrjMatrix,
     //bool lightShadowOn,
     vec3 normalWorld, vec3 viewDir, float depth, bool lightUseSpecular) {
 
@@ -151,7 +175,7 @@ L_OUT calculateLight(bool lightEnable, int lightType, float lightAtten, vec3 lig
             float rDotV = dot(reflect(nLightVec, normalWorld),-viewDir);
             float clamped = clamp(((1-specular)-rDotV)*200/5, 0.0f, 1.0f);// 5=> depth TODO find out where that value comes from
             float specularEdge = darkEdges * (clamped -1); // darkened edges mask
-            float specularColorFloat = (mix(specularEdge, 0.0f, specDiffusion) + 2 * clamp(((max(1.0f - specular, rDotV) - (1 - specular)) * pow((2 - specDiffusion), 10)),0.0f, 1.0f)) * (1 - specTransparency);
+            float specularColorFloat = (mix(specularEdge, 0.0f, specDiffusion) + 2 * clamp(((max(1.0f - specular, rDotV) - (1 - specular)) * specPower),0.0f, 1.0f)) * (1 - specTransparency);
             specularColor = vec3(specularColorFloat, specularColorFloat, specularColorFloat); // TODO verify
             specularColor *= clamp(dot(normalWorld, lightDir) * 2, 0.0f, 1.0f);
         }
@@ -167,7 +191,7 @@ L_OUT calculateLight(bool lightEnable, int lightType, float lightAtten, vec3 lig
 
         // spot light Cone Angle
         if (lightType == 2) {
-            float angle = getLightConeAngle(lightConeAngle, lightFallOff, nLightVec, lightDir);
+            float angle = getLightConeAngle(lightConeCos, nLightVec, lightDir);
             diffuseColor *= angle;
             specularColor *= angle;
         }
@@ -185,7 +209,6 @@ L_OUT calculateLight(bool lightEnable, int lightType, float lightAtten, vec3 lig
 
 void main() {
     vec4 worldPos = model * vec4(vertex, 1.0);//?
-    mat4 viewInv = inverse(view);
     vColor0 = inColor0;
     vColor1 = inColor1;
     vColor2 = inColor2;
@@ -203,7 +226,7 @@ void main() {
     viewDir = normalize(viewInv[3].xyz - posWorld);
     nDotV = dot(normalWorld, viewDir);
     // main light direction
-    lightDir = normalize(-l1direction);
+    lightDir = mainLightDir;
     //z-depth
     float depth = distance(posWorld, viewInv[3].xyz);
     //vec4 pos = vec4(worldPos.xyz, 1.0) * projection;
@@ -223,10 +246,30 @@ void main() {
 
     gl_Position = pos;
 
+#ifdef LIGHT_BAKE
+    // the same lighting as below without the specular, posWorld and normalWorld follow the view so it is in the key
+    L_OUT b1 = calculateLight(l1enabled, l1type, l1attenuationScale, l1pos, posWorld, l1color, l1intensity, l1direction, l1coneCos, l1matrix, normalWorld, viewDir, depth, false);
+    L_OUT b2 = calculateLight(l2enabled, l2type, l2attenuationScale, l2pos, posWorld, l2color, l2intensity, l2direction, l2coneCos, l2matrix, normalWorld, viewDir, depth, false);
+    L_OUT b3 = calculateLight(l3enabled, l3type, l3attenuationScale, l3pos, posWorld, l3color, l3intensity, l3direction, l3coneCos, l3matrix, normalWorld, viewDir, depth, false);
+    lightColorTotal = b1.lColor + b2.lColor + b3.lColor;
+    lDiluteTotal = b1.lDilute + b2.lDilute + b3.lDilute;
+    return;
+#else
+    if (useBakedLights) {
+        // only the first light has a specular, it also depends on the specular parameters that are not in the key
+        L_OUT s1 = calculateLight(l1enabled && l1UseSpecular, l1type, l1attenuationScale, l1pos, posWorld, l1color, l1intensity, l1direction, l1coneCos, l1matrix, normalWorld, viewDir, depth, true);
+        lSpecTotal = s1.lSpecular;
+        lightColorTotal = bakedLightColor;
+        lDiluteTotal = bakedDilute;
+        lShadeTotal = 1.0;
+        return;
+    }
+#endif
+
     //LIGHTS
-    L_OUT l1 = calculateLight(l1enabled, l1type, l1attenuationScale, l1pos, posWorld, l1color, l1intensity, l1direction, l1coneAngle, l1fallOff, l1matrix, normalWorld, viewDir, depth, l1UseSpecular);
-    L_OUT l2 = calculateLight(l2enabled, l2type, l2attenuationScale, l2pos, posWorld, l2color, l2intensity, l2direction, l2coneAngle, l3fallOff, l2matrix, normalWorld, viewDir, depth, false);
-    L_OUT l3 = calculateLight(l3enabled, l3type, l3attenuationScale, l3pos, posWorld, l3color, l3intensity, l3direction, l3coneAngle, l3fallOff, l3matrix, normalWorld, viewDir, depth, false);
+    L_OUT l1 = calculateLight(l1enabled, l1type, l1attenuationScale, l1pos, posWorld, l1color, l1intensity, l1direction, l1coneCos, l1matrix, normalWorld, viewDir, depth, l1UseSpecular);
+    L_OUT l2 = calculateLight(l2enabled, l2type, l2attenuationScale, l2pos, posWorld, l2color, l2intensity, l2direction, l2coneCos, l2matrix, normalWorld, viewDir, depth, false);
+    L_OUT l3 = calculateLight(l3enabled, l3type, l3attenuationScale, l3pos, posWorld, l3color, l3intensity, l3direction, l3coneCos, l3matrix, normalWorld, viewDir, depth, false);
 
     lSpecTotal = l1.lSpecular + l2.lSpecular + l3.lSpecular;
     lightColorTotal = l1.lColor + l2.lColor + l3.lColor;
@@ -8,6 +8,7 @@
 #include "shader.h"
 #include "camera.h"
 #include "model.h"
+#include "changeTracker.h"
 
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
@@ -21,6 +22,7 @@ void drawCrate();
 void drawRobot();
 void drawFloor();
 void drawGui();
+void watchChanges();
 
 // glfw and input functions
 // ------------------------
@@ -29,6 +31,7 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void key_input_callback(GLFWwindow* window, int button, int other, int action, int mods);
 void cursor_input_callback(GLFWwindow* window, double posX, double posY);
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
+void window_refresh_callback(GLFWwindow* window);
 
 // screen settings
 // ---------------
@@ -49,6 +52,9 @@ Model* floorModel;
 Model* crate;
 Model* robot;
 Camera camera(glm::vec3(0.0f, 1.6f, 5.0f));
+// the whole frame is one pass, there is no intermediate image to reuse
+const unsigned int PASS_SCENE = 1;
+ChangeTracker changes;
 
 // global variables used for control
 // ---------------------------------
@@ -89,6 +95,9 @@ struct Config {
     unsigned int minFilterSetting = GL_LINEAR_MIPMAP_LINEAR;
     unsigned int magFilterSetting = GL_LINEAR;
 
+    // only draw when something changed and sleep until the next event otherwise
+    bool redrawOnChange = true;
+
 } config;
 
 struct WatercolorConfig {
@@ -138,6 +147,7 @@ int main()
     glfwSetCursorPosCallback(window, cursor_input_callback);
     glfwSetKeyCallback(window, key_input_callback);
 	glfwSetScrollCallback(window, scroll_callback);
+    glfwSetWindowRefreshCallback(window, window_refresh_callback);
 
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED); 
 
@@ -187,6 +197,7 @@ int main()
     glClearColor( clearVec.x, clearVec.y, clearVec.z, 0.0f );
     glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT );
     // render loop
+    watchChanges();
     while (!glfwWindowShouldClose(window))
     {
         static float lastFrame = 0.0f;
@@ -196,6 +207,20 @@ int main()
 
         processInput(window);
 
+        // the deformations don't read the time (see shader.vert), a still camera gives a still image
+        if (!config.redrawOnChange)
+            changes.invalidate(PASS_SCENE);
+        if (changes.poll() == 0) {
+            // the last frame is still on the screen, nothing is drawn or swapped until an event comes in
+            glfwWaitEvents();
+            // the gui reacts to the mouse without changing any watched value
+            if (isPaused)
+                changes.invalidate(PASS_SCENE);
+            // the time spent waiting isn't camera movement time
+            lastFrame = (float)glfwGetTime();
+            continue;
+        }
+
         glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -282,6 +307,17 @@ void setCommonUniforms() {
 ///////////////////////////
 //    DRAW FUNCTIONS     //
 ///////////////////////////
+void watchChanges(){
+    // everything the frame reads that can change between frames, the config structs are plain values
+    changes.watch(camera.Position, PASS_SCENE);
+    changes.watch(camera.Front, PASS_SCENE);
+    changes.watch(camera.Up, PASS_SCENE);
+    changes.watch(camera.Zoom, PASS_SCENE);
+    changes.watch(config, PASS_SCENE);
+    changes.watch(watercolorConfig, PASS_SCENE);
+    changes.watch(isPaused, PASS_SCENE);
+}
+
 void drawGui(){
     // Start the Dear ImGui frame
     ImGui_ImplOpenGL3_NewFrame();
@@ -338,6 +374,9 @@ void drawGui(){
         ImGui::SliderFloat("uv scale", &config.uvScale, 1.0f, 100.0f);
         ImGui::Separator();
 
+        ImGui::Checkbox("Redraw on change", &config.redrawOnChange);
+        ImGui::Text("Redraw: %d frames drawn, %d waits for events", changes.drawnFrames, changes.skippedFrames);
+
         ImGui::Separator();
 
         ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
@@ -536,4 +575,11 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
     // make sure the viewport matches the new window dimensions; note that width and
     // height will be significantly larger than specified on retina displays.
     glViewport(0, 0, width, height);
+    changes.invalidate(PASS_SCENE);
+}
+
+// glfw: the window contents were damaged (uncovered, restored), the last frame has to be drawn again
+void window_refresh_callback(GLFWwindow* window)
+{
+    changes.invalidate(PASS_SCENE);
 }
\ No newline at end of file
@@ -0,0 +1,220 @@
+#ifndef IMPOSTOR_H
+#define IMPOSTOR_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "shader.h"
+#include "model.h"
+
+#include <vector>
+#include <functional>
+#include <cmath>
+#include <iostream>
+
+// must match impostor.vert
+const int IMPOSTOR_GRID = 8;         // views per side of the hemi-octahedron, the outer ones lie on the horizon
+const int IMPOSTOR_FRAME_SIZE = 128; // pixels per view
+const int IMPOSTOR_ATLAS_SIZE = IMPOSTOR_GRID * IMPOSTOR_FRAME_SIZE;
+// same layout as the g-buffer: albedo and specular mask, octahedral normal, pigment, substrate and edge controls
+const int IMPOSTOR_TARGETS = 5;
+
+// Octahedral impostor of a model. bake renders it from IMPOSTOR_GRID^2 directions of the upper hemisphere, spread by
+// a hemi-octahedral mapping, with an orthographic camera into atlases of the g-buffer attributes plus depth.
+// draw puts every instance on one camera facing quad, which blends the three views nearest to the view direction and
+// writes the g-buffer like the meshes do, so the deferred pass lights and stylizes it like any other surface.
+// All instances are a single instanced draw, thousands of them cost about as much as a particle system.
+//
+// usage:
+//   impostor.bake(boundsMin, boundsMax, drawModel);          // once, drawModel draws with the shader it gets
+//   impostor.draw(instances, projection, view, eye);         // in the geometry pass, xyz position, w heading
+class Impostor {
+public:
+    unsigned int textures[IMPOSTOR_TARGETS], depthTexture;
+    glm::vec3 center = glm::vec3(0.0f); // bounding sphere in model space
+    float radius = 1.0f;
+    // statistics
+    float bakeTime = 0.0f; // ms
+    int drawnInstances = 0;
+
+    Impostor()
+        : bakeShader("shaders/impostorBake.vert", "shaders/gBuffer.frag"),
+          drawShader("shaders/impostor.vert", "shaders/impostor.frag")
+    {
+        GLenum internalFormats[IMPOSTOR_TARGETS] = {GL_RGBA8, GL_RG16F, GL_RGBA8, GL_RGBA8, GL_RGBA8};
+        GLenum formats[IMPOSTOR_TARGETS] = {GL_RGBA, GL_RG, GL_RGBA, GL_RGBA, GL_RGBA};
+        glGenTextures(IMPOSTOR_TARGETS, textures);
+        for (int i = 0; i < IMPOSTOR_TARGETS; i++) {
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, internalFormats[i], IMPOSTOR_ATLAS_SIZE, IMPOSTOR_ATLAS_SIZE, 0, formats[i],
+                         GL_UNSIGNED_BYTE, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        }
+        // the depth doubles as coverage, the far plane means nothing was drawn
+        glGenTextures(1, &depthTexture);
+        glBindTexture(GL_TEXTURE_2D, depthTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, IMPOSTOR_ATLAS_SIZE, IMPOSTOR_ATLAS_SIZE, 0,
+                     GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        unsigned int attachments[IMPOSTOR_TARGETS];
+        for (int i = 0; i < IMPOSTOR_TARGETS; i++) {
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, textures[i], 0);
+            attachments[i] = GL_COLOR_ATTACHMENT0 + i;
+        }
+        glDrawBuffers(IMPOSTOR_TARGETS, attachments);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER:: Impostor atlas is not complete!" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        // a unit quad, the corners are placed in the vertex shader, and one position and heading per instance
+        const float corners[] = {-1.0f, -1.0f, 1.0f, -1.0f, -1.0f, 1.0f, 1.0f, 1.0f};
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &cornerVBO);
+        glGenBuffers(1, &instanceVBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, cornerVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), (void*)0);
+        glVertexAttribDivisor(1, 1);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        drawShader.use();
+        const char *samplers[IMPOSTOR_TARGETS] = {"impostorAlbedoSpec", "impostorNormal", "impostorPigmentCtrl",
+                                                  "impostorSubstrateCtrl", "impostorEdgeCtrl"};
+        for (int i = 0; i < IMPOSTOR_TARGETS; i++)
+            drawShader.setInt(samplers[i], i);
+        drawShader.setInt("impostorDepth", IMPOSTOR_TARGETS);
+    }
+
+    ~Impostor()
+    {
+        glDeleteTextures(IMPOSTOR_TARGETS, textures);
+        glDeleteTextures(1, &depthTexture);
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteBuffers(1, &cornerVBO);
+        glDeleteBuffers(1, &instanceVBO);
+        glDeleteVertexArrays(1, &VAO);
+    }
+
+    // grows the bounds by the corners of the mesh bounds of a model, transformed by its model matrix
+    static void growBounds(const Model &model, const glm::mat4 &transform, glm::vec3 &boundsMin, glm::vec3 &boundsMax)
+    {
+        for (const Mesh &mesh : model.meshes) {
+            for (int corner = 0; corner < 8; corner++) {
+                glm::vec3 offset((corner & 1) ? 1.0f : 0.0f, (corner & 2) ? 1.0f : 0.0f, (corner & 4) ? 1.0f : 0.0f);
+                glm::vec3 p = glm::vec3(transform * glm::vec4(mesh.positionOffset + offset * mesh.positionScale, 1.0f));
+                boundsMin = glm::min(boundsMin, p);
+                boundsMax = glm::max(boundsMax, p);
+            }
+        }
+    }
+
+    // renders every view of the model, drawModel sets the model matrices and material uniforms of the shader
+    void bake(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax, std::function<void(Shader&)> drawModel)
+    {
+        double start = glfwGetTime();
+        center = (boundsMin + boundsMax) * 0.5f;
+        radius = glm::length(boundsMax - boundsMin) * 0.5f;
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        GLboolean blend = glIsEnabled(GL_BLEND);
+        glDisable(GL_BLEND);
+        glEnable(GL_DEPTH_TEST);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, IMPOSTOR_ATLAS_SIZE, IMPOSTOR_ATLAS_SIZE);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        bakeShader.use();
+        for (int y = 0; y < IMPOSTOR_GRID; y++) {
+            for (int x = 0; x < IMPOSTOR_GRID; x++) {
+                glm::vec3 direction = frameDirection(x, y), right, up;
+                frameBasis(direction, right, up);
+                // orthographic over the bounding sphere, the depth runs from its front to its back
+                glm::mat4 view = glm::lookAt(center + direction * radius, center, up);
+                glm::mat4 projection = glm::ortho(-radius, radius, -radius, radius, 0.0f, 2.0f * radius);
+                glViewport(x * IMPOSTOR_FRAME_SIZE, y * IMPOSTOR_FRAME_SIZE, IMPOSTOR_FRAME_SIZE, IMPOSTOR_FRAME_SIZE);
+                bakeShader.use();
+                bakeShader.setMat4("bakeViewProjection", projection * view);
+                drawModel(bakeShader);
+            }
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        if (blend)
+            glEnable(GL_BLEND);
+        bakeTime = (float) (glfwGetTime() - start) * 1000.0f;
+        std::cout << "IMPOSTOR:: baked " << IMPOSTOR_GRID * IMPOSTOR_GRID << " views of " << IMPOSTOR_FRAME_SIZE << "x"
+                  << IMPOSTOR_FRAME_SIZE << " in " << bakeTime << " ms" << std::endl;
+    }
+
+    // projection and view as the meshes get them, eye is where the projection sees from
+    void draw(const std::vector<glm::vec4> &instances, const glm::mat4 &projection, const glm::mat4 &view,
+              const glm::vec3 &eye)
+    {
+        drawnInstances = (int) instances.size();
+        if (instances.empty())
+            return;
+        // orphaned every frame, the instances change with the camera
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(glm::vec4), NULL, GL_STREAM_DRAW);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(glm::vec4), &instances[0]);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        drawShader.use();
+        drawShader.setMat4("projection", projection);
+        drawShader.setMat4("view", view);
+        drawShader.setVec3("eyePosition", eye);
+        drawShader.setVec3("boundsCenter", center);
+        drawShader.setFloat("boundsRadius", radius);
+        for (int i = 0; i < IMPOSTOR_TARGETS; i++) {
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+        }
+        glActiveTexture(GL_TEXTURE0 + IMPOSTOR_TARGETS);
+        glBindTexture(GL_TEXTURE_2D, depthTexture);
+        glActiveTexture(GL_TEXTURE0);
+        glBindVertexArray(VAO);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei) instances.size());
+        glBindVertexArray(0);
+    }
+
+private:
+    unsigned int framebuffer, VAO, cornerVBO, instanceVBO;
+    Shader bakeShader, drawShader;
+
+    // same mapping as impostor.vert, the grid corners map to the horizon and the center looks from above
+    static glm::vec3 frameDirection(int x, int y)
+    {
+        glm::vec2 e = glm::vec2((float) x, (float) y) / (float) (IMPOSTOR_GRID - 1) * 2.0f - 1.0f;
+        glm::vec3 d((e.x - e.y) * 0.5f, 0.0f, (e.x + e.y) * 0.5f);
+        d.y = 1.0f - std::abs(d.x) - std::abs(d.z);
+        return glm::normalize(d);
+    }
+
+    static void frameBasis(const glm::vec3 &direction, glm::vec3 &right, glm::vec3 &up)
+    {
+        glm::vec3 reference = std::abs(direction.y) > 0.999f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        right = glm::normalize(glm::cross(reference, direction));
+        up = glm::cross(direction, right);
+    }
+};
+#endif
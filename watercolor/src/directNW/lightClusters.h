@@ -0,0 +1,221 @@
+#ifndef LIGHT_CLUSTERS_H
+#define LIGHT_CLUSTERS_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+
+#include "shader.h"
+#include "computeShader.h"
+
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+
+// cluster grid over the view frustum, tiles in x and y and exponential depth slices, must match the shaders
+const int CLUSTER_X = 16;
+const int CLUSTER_Y = 9;
+const int CLUSTER_Z = 24;
+const int CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+// every cluster stores its light count followed by up to CLUSTER_MAX_LIGHTS light indices
+const int CLUSTER_MAX_LIGHTS = 127;
+const int CLUSTER_STRIDE = CLUSTER_MAX_LIGHTS + 1;
+// texture units the deferred shader reads the light list and the clusters from
+const int CLUSTER_LIGHTS_UNIT = 3;
+const int CLUSTER_DATA_UNIT = 4;
+
+// one light as the shaders read it, four rgba32f texels (or one std430 struct in the compute pass)
+struct GpuLight {
+    glm::vec4 positionRange;  // xyz position, w range (<= 0 reaches everywhere)
+    glm::vec4 colorIntensity; // rgb color, a intensity
+    glm::vec4 directionCone;  // xyz direction, w cone angle
+    glm::vec4 params;         // x fall off, y attenuation scale, z type (2 spot, 3 point, 4 directional, 5 ambient), w specular
+};
+
+// Bins a light list into a 3D cluster grid so the lighting pass only loops over the lights that can reach a pixel.
+// The binning runs in a compute shader with GL 4.3 and on the cpu otherwise, both write the same buffers that
+// the deferred shader reads as buffer textures.
+//
+// usage:
+//   clusters.upload(lights);                        // every frame, uploads only when the list changed
+//   clusters.cull(clipToPosWorld, near, far);        // every frame
+//   clusters.bind(shader);                           // before the lighting pass
+class LightClusters {
+public:
+    bool gpu = false;
+    int lightCount = 0;
+    // statistics of the last cull, the cpu binning also reports the clusters that ran out of room
+    float cullTime = 0.0f; // ms on the cpu, dispatch only for the gpu binning
+    int maxClusterLights = 0;
+    int overflowingClusters = 0;
+
+    LightClusters()
+    {
+        glGenBuffers(1, &lightBuffer);
+        glGenTextures(1, &lightTexture);
+        glGenBuffers(1, &clusterBuffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, clusterBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, CLUSTER_COUNT * CLUSTER_STRIDE * sizeof(unsigned int), NULL, GL_DYNAMIC_DRAW);
+        glGenTextures(1, &clusterTexture);
+        glBindTexture(GL_TEXTURE_BUFFER, clusterTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_R32UI, clusterBuffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        upload(std::vector<GpuLight>());
+#ifdef GL_VERSION_4_3
+        gpu = GLAD_GL_VERSION_4_3;
+        if (gpu)
+            binning = new ComputeShader("shaders/lightCulling.comp");
+#endif
+        std::cout << "LIGHT CLUSTERS:: " << CLUSTER_X << "x" << CLUSTER_Y << "x" << CLUSTER_Z << " grid, binning on the "
+                  << (gpu ? "gpu" : "cpu") << std::endl;
+    }
+
+    ~LightClusters()
+    {
+#ifdef GL_VERSION_4_3
+        delete binning;
+#endif
+        glDeleteTextures(1, &lightTexture);
+        glDeleteTextures(1, &clusterTexture);
+        glDeleteBuffers(1, &lightBuffer);
+        glDeleteBuffers(1, &clusterBuffer);
+    }
+
+    // the buffer is only touched when the list changed, and only reallocated when it grew
+    void upload(const std::vector<GpuLight> &lights)
+    {
+        bool same = lightCapacity > 0 && lights.size() == this->lights.size() &&
+                    (lights.empty() || memcmp(&lights[0], &this->lights[0], lights.size() * sizeof(GpuLight)) == 0);
+        if (same)
+            return;
+        this->lights = lights;
+        lightCount = (int) lights.size();
+        glBindBuffer(GL_TEXTURE_BUFFER, lightBuffer);
+        if (lightCount > lightCapacity) {
+            // never empty, a zero sized buffer texture is incomplete
+            lightCapacity = std::max(lightCount, 1);
+            glBufferData(GL_TEXTURE_BUFFER, lightCapacity * sizeof(GpuLight), NULL, GL_DYNAMIC_DRAW);
+            glBindTexture(GL_TEXTURE_BUFFER, lightTexture);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, lightBuffer);
+            glBindTexture(GL_TEXTURE_BUFFER, 0);
+        }
+        if (lightCount > 0)
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, lightCount * sizeof(GpuLight), &lights[0]);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // clipToPosWorld brings clip coordinates to the space of the light positions, near and far set the slices
+    void cull(const glm::mat4 &clipToPosWorld, float zNear, float zFar)
+    {
+        double start = glfwGetTime();
+        this->zNear = zNear;
+        this->zFar = zFar;
+#ifdef GL_VERSION_4_3
+        if (gpu) {
+            binning->use();
+            binning->setMat4("clipToPosWorld", clipToPosWorld);
+            binning->setInt("lightCount", lightCount);
+            binning->setFloat("zNear", zNear);
+            binning->setFloat("zFar", zFar);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, lightBuffer);
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, clusterBuffer);
+            glDispatchCompute((CLUSTER_COUNT + 63) / 64, 1, 1);
+            // the lighting pass reads the result through a buffer texture
+            glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+            cullTime = (float) (glfwGetTime() - start) * 1000.0f;
+            return;
+        }
+#endif
+        cullCpu(clipToPosWorld);
+        cullTime = (float) (glfwGetTime() - start) * 1000.0f;
+    }
+
+    void bind(Shader &shader) const
+    {
+        shader.setInt("lightData", CLUSTER_LIGHTS_UNIT);
+        shader.setInt("clusterData", CLUSTER_DATA_UNIT);
+        shader.setFloat("zNear", zNear);
+        shader.setFloat("zFar", zFar);
+        glActiveTexture(GL_TEXTURE0 + CLUSTER_LIGHTS_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, lightTexture);
+        glActiveTexture(GL_TEXTURE0 + CLUSTER_DATA_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, clusterTexture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+private:
+    unsigned int lightBuffer, lightTexture;
+    unsigned int clusterBuffer, clusterTexture;
+#ifdef GL_VERSION_4_3
+    ComputeShader *binning = nullptr;
+#endif
+    std::vector<GpuLight> lights;
+    int lightCapacity = 0;
+    std::vector<unsigned int> clusterData;
+    float zNear = 0.1f, zFar = 100.0f;
+
+    // ndc depth where a slice starts, the slices are exponential in view distance
+    float sliceDepth(int slice) const
+    {
+        float distance = zNear * std::pow(zFar / zNear, (float) slice / CLUSTER_Z);
+        return ((zFar + zNear) - 2.0f * zFar * zNear / distance) / (zFar - zNear);
+    }
+
+    // same test as lightCulling.comp
+    void cullCpu(const glm::mat4 &clipToPosWorld)
+    {
+        clusterData.assign(CLUSTER_COUNT * CLUSTER_STRIDE, 0);
+        maxClusterLights = 0;
+        overflowingClusters = 0;
+        for (int z = 0; z < CLUSTER_Z; z++) {
+            float z0 = sliceDepth(z), z1 = sliceDepth(z + 1);
+            for (int y = 0; y < CLUSTER_Y; y++) {
+                for (int x = 0; x < CLUSTER_X; x++) {
+                    // bounds of the eight cluster corners
+                    glm::vec3 boundsMin(1e30f), boundsMax(-1e30f);
+                    for (int corner = 0; corner < 8; corner++) {
+                        glm::vec4 ndc((float) (x + (corner & 1)) / CLUSTER_X * 2.0f - 1.0f,
+                                      (float) (y + ((corner >> 1) & 1)) / CLUSTER_Y * 2.0f - 1.0f,
+                                      (corner & 4) ? z1 : z0, 1.0f);
+                        glm::vec4 p = clipToPosWorld * ndc;
+                        glm::vec3 position = glm::vec3(p) / p.w;
+                        boundsMin = glm::min(boundsMin, position);
+                        boundsMax = glm::max(boundsMax, position);
+                    }
+                    int cluster = (z * CLUSTER_Y + y) * CLUSTER_X + x;
+                    unsigned int *data = &clusterData[cluster * CLUSTER_STRIDE];
+                    int count = 0;
+                    for (int i = 0; i < lightCount; i++) {
+                        if (!reaches(lights[i], boundsMin, boundsMax))
+                            continue;
+                        if (count == CLUSTER_MAX_LIGHTS) {
+                            overflowingClusters++;
+                            break;
+                        }
+                        data[1 + count++] = (unsigned int) i;
+                    }
+                    data[0] = (unsigned int) count;
+                    maxClusterLights = std::max(maxClusterLights, count);
+                }
+            }
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, clusterBuffer);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, clusterData.size() * sizeof(unsigned int), &clusterData[0]);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    static bool reaches(const GpuLight &light, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax)
+    {
+        // directional and ambient lights and lights without a range are everywhere
+        float range = light.positionRange.w;
+        if (light.params.z >= 4.0f || range <= 0.0f)
+            return true;
+        glm::vec3 center(light.positionRange);
+        glm::vec3 closest = glm::clamp(center, boundsMin, boundsMax) - center;
+        return glm::dot(closest, closest) <= range * range;
+    }
+};
+#endif
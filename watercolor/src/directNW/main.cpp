@@ -3,9 +3,20 @@
 #include <iostream>
 
 #include <vector>
+#include <cstdlib>
+#include <cmath>
 #include "shader.h"
 #include "camera.h"
 #include "model.h"
+#include "lightClusters.h"
+#include "shadowMaps.h"
+#include "weightedOIT.h"
+#include "changeTracker.h"
+#include "shaderPermutations.h"
+#include "impostor.h"
+#include "lutBaker.h"
+#include "noiseBaker.h"
+#include "stylization.h"
 
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
@@ -19,9 +30,24 @@ struct LightOut {vec3 specular; vec3 lightColor; vec3 dilute; float shade;};
 // function declarations
 // ---------------------
 void setCommonUniforms();
+void setLightingUniforms();
+void updateLights();
+void generatePointLights(int count);
+void generateBackgroundCars(int count);
+void splitBackgroundCars();
+void drawBackgroundCars(bool opaque, bool transparent);
+void setGBuffer();
+void drawDeferred(bool geometryPass = true);
+void watchChanges();
+double nextTremorWait();
+void selectPermutations();
+void bakeLuts();
 void drawObjects();
-void drawCar();
+void drawCar(bool opaque = true, bool transparent = true, const glm::mat4& root = glm::mat4(1.0f));
+void drawShadowCasters(Shader& shader, bool dynamic);
+glm::mat4 wheelModel(int wheel);
 void drawGui();
+void drawStylizationGui();
 float getLightConeAngle(float coneAngle, float coneFallOff, glm::vec3 lightVec, glm::vec3 lightDir);
 LightOut calculateLight(int lightNo, vec3 worldVectorPosition, vec3 normalWorld, vec3 viewDir);
 vec2 calcVelocity(vec2 currentPos, vec2 prevPos, float zOverW);
@@ -33,15 +59,35 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void key_input_callback(GLFWwindow* window, int button, int other, int action, int mods);
 void cursor_input_callback(GLFWwindow* window, double posX, double posY);
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
+void window_refresh_callback(GLFWwindow* window);
 
 // screen settings
 // ---------------
 const unsigned int SCR_WIDTH = 1280;
 const unsigned int SCR_HEIGHT = 720;
 
+//vertex attributes for a quad that fills the entire screen in Normalized Device Coordinates.
+const float quadVertices[] = {
+        // positions   // texCoords
+        -1.0f,  1.0f,  0.0f, 1.0f,
+        -1.0f, -1.0f,  0.0f, 0.0f,
+        1.0f, -1.0f,  1.0f, 0.0f,
+
+        -1.0f,  1.0f,  0.0f, 1.0f,
+        1.0f, -1.0f,  1.0f, 0.0f,
+        1.0f,  1.0f,  1.0f, 1.0f
+};
+
 // global variables used for rendering
 // -----------------------------------
-Shader* watercolorShader;
+Shader* watercolorShader; // shader the draw functions use, one of the three below
+// the variants of the current config, picked from the permutations by selectPermutations every frame
+Shader* forwardShader;
+Shader* gBufferShader;
+Shader* deferredShader;
+ShaderPermutations* forwardPermutations;
+ShaderPermutations* gBufferPermutations;
+ShaderPermutations* deferredPermutations;
 Model* carPaint;
 Model* carBody;
 Model* carInterior;
@@ -51,8 +97,34 @@ Model* carWheel;
 Model* floorModel;
 Model* robotModel;
 Camera camera(glm::vec3(0.0f, 1.7f, 5.0f));
+// deferred path, the position is reconstructed from the depth
 unsigned int gBuffer;
-unsigned int gPosition, gNormal, gAlbedoSpec;
+unsigned int gDepth, gNormal, gAlbedoSpec;
+unsigned int gPigmentCtrl, gSubstrateCtrl, gEdgeCtrl; // MNPR control values
+unsigned int quadVAO;
+LightClusters* lightClusters; // light list of the deferred pass, binned per cluster
+ShadowMaps* shadowMaps; // shadows of the deferred pass
+// the dilute curve of the watercolor shaders, baked again when the dilute or the cangiante change
+Lut* diluteCurve;
+const int LUT_UNIT_DILUTE = 6;
+const float DILUTE_RANGE = 4.0f; // of the summed dilute of the lights, as in the shaders
+WeightedOIT* weightedOIT; // windows of the deferred pass, blended without sorting
+// the MNPR passes after the deferred lighting, reading the control targets of the g-buffer
+Stylization* stylization;
+WorkerPool* workers;
+NoiseBaker* noiseBaker;
+unsigned int substrateTexture; // paper height, tileable, owned by the noise baker
+Impostor* carImpostor; // the car baked from all sides, stands in for the small background cars
+std::vector<glm::vec4> backgroundCars; // xyz position, w heading
+// split every frame by their size on screen
+std::vector<glm::mat4> nearBackgroundCars;
+std::vector<glm::vec4> impostorInstances;
+int shadowLightIndex[SHADOW_MAX_LIGHTS]; // where the shadowed lights are in the light list
+unsigned int staticCastersVersion = 0; // bump whenever a static caster moves, it redraws the cached shadows
+// passes of a frame, the main loop runs the dirty ones and the ones reading their output
+const unsigned int PASS_LIGHTING = 1; // g-buffer to the screen, the windows and the gui, all of the forward path
+const unsigned int PASS_GEOMETRY = 2; // the opaque surfaces into the g-buffer
+ChangeTracker changes;
 
 // global variables used for control
 // ---------------------------------
@@ -74,12 +146,14 @@ struct LightConfig {
     float coneAngle = 0.46f;
     float fallOff = 0.7f;
     float attenuationScale = 0;
+    float range = 0; // the deferred pass culls lights past their range, 0 reaches everywhere
     bool shadowOn = true;
     bool specular = true;
     glm::mat4 matrix;
 }light1;
 LightConfig light2;
 LightConfig light3;
+std::vector<LightConfig> pointLights; // generated ones, besides the three lights of the gui
 
 // structure to hold watercolor direction info
 // -------------------------------------------
@@ -104,6 +178,11 @@ struct WatercolorConfig {
     // Paper color
     glm::vec3 paperColor = {1,1,1};
     float bleedOffset = 0.5;
+    // MNPR control values of the surfaces, written to the control targets of the g-buffer for the stylization
+    float pigmentDensity = 0.5f;
+    float granulation = 0.5f;
+    float edgeDarkening = 0.5f;
+    float substrateDistortion = 0.5f;
 
 } watercolorConfig;
 
@@ -136,6 +215,25 @@ struct GnralConfig {
     float atmRangeStart = 50.0f;
     float atmRangeEnd = 100.0f;
     vec2 texel = {1.0f / SCR_HEIGHT, 1.0f /SCR_WIDTH};
+    // light and stylize once per pixel from a g-buffer instead of for every drawn fragment
+    bool useDeferred = true;
+    bool useOIT = true; // weighted blended windows in the deferred path
+    int pointLightCount = 0;
+    // spinning wheels are dynamic shadow casters, the rest of the car is static
+    bool spinWheels = false;
+    // what the shadow casters read, and redrawing the static shadows every frame to compare the streams
+    VertexStream shadowStream = STREAM_QUANTIZED;
+    bool redrawStaticShadows = false;
+    // cars around the scene, the ones smaller than impostorPixels on screen are drawn as impostors
+    int backgroundCarCount = 0;
+    bool useImpostors = true;
+    float impostorPixels = 64.0f; // projected radius
+    // only run the passes whose inputs changed and sleep until the next event when none did
+    bool redrawOnChange = true;
+    // the tremor changes every frame, with redrawOnChange it is only redrawn this many times a second
+    float tremorRate = 12.0f;
+    // compile the material and shading switches into the shaders instead of branching on uniforms
+    bool usePermutations = true;
 
 }gnralConfig;
 
@@ -145,8 +243,6 @@ int main()
     // glfw: initialize and configure
     // ------------------------------
     glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
 #ifdef __APPLE__
@@ -155,7 +251,14 @@ int main()
 
     // glfw window creation
     // --------------------
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Watercolor Rendering", NULL, NULL);
+    // 4.3 bins the lights in a compute shader, 3.3 on the cpu
+    const int contextVersions[][2] = {{4, 3}, {3, 3}};
+    GLFWwindow* window = NULL;
+    for (int i = 0; i < 2 && window == NULL; i++) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, contextVersions[i][0]);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, contextVersions[i][1]);
+        window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Watercolor Rendering", NULL, NULL);
+    }
     if (window == NULL)
     {
         std::cout << "Failed to create GLFW window" << std::endl;
@@ -167,6 +270,7 @@ int main()
     glfwSetCursorPosCallback(window, cursor_input_callback);
     glfwSetKeyCallback(window, key_input_callback);
     glfwSetScrollCallback(window, scroll_callback);
+    glfwSetWindowRefreshCallback(window, window_refresh_callback);
 
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
@@ -180,7 +284,16 @@ int main()
 
     // load the shaders and the 3D models
     // ----------------------------------
-    watercolorShader = new Shader("shaders/watercolor.vert", "shaders/watercolor.frag");
+    forwardPermutations = new ShaderPermutations("shaders/watercolor.vert", "shaders/watercolor.frag");
+    gBufferPermutations = new ShaderPermutations("shaders/watercolor.vert", "shaders/gBuffer.frag");
+    deferredPermutations = new ShaderPermutations("shaders/screenQuad.vert", "shaders/deferredWatercolor.frag", [](Shader& shader) {
+        shader.use();
+        shader.setInt("gAlbedoSpec", 0);
+        shader.setInt("gNormal", 1);
+        shader.setInt("gDepth", 2);
+    });
+    selectPermutations();
+    watercolorShader = forwardShader;
     carPaint = new Model("car/Paint_LOD0.obj");
     carBody = new Model("car/Body_LOD0.obj");
     carLight = new Model("car/Light_LOD0.obj");
@@ -204,6 +317,45 @@ int main()
     glEnable(GL_DEPTH_TEST); // turn on z-buffer depth test
     glDepthFunc(GL_LESS); // draws fragments that are closer to the screen in NDC
 
+    setGBuffer();
+    lightClusters = new LightClusters();
+    shadowMaps = new ShadowMaps();
+    workers = new WorkerPool();
+    diluteCurve = new Lut(256, 1, GL_LINEAR, *workers);
+    bakeLuts();
+
+    // screen quad VAO
+    unsigned int quadVBO;
+    glGenVertexArrays(1, &quadVAO);
+    glGenBuffers(1, &quadVBO);
+    glBindVertexArray(quadVAO);
+    glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
+    glBindVertexArray(0);
+    weightedOIT = new WeightedOIT(SCR_WIDTH, SCR_HEIGHT, 0, gDepth, quadVAO, "shaders/screenQuad.vert");
+    stylization = new Stylization(SCR_WIDTH, SCR_HEIGHT, gDepth, quadVAO, "shaders/screenQuad.vert");
+    // generated once, read from the noise cache afterwards
+    noiseBaker = new NoiseBaker(*workers);
+    substrateTexture = noiseBaker->texture({NOISE_PERLIN, 512, false, 32, 4});
+
+    // the impostor is baked from the opaque parts, the windows would need their own transparency
+    glm::vec3 carMin(1e30f), carMax(-1e30f);
+    for (int wheel = 0; wheel < 4; wheel++)
+        Impostor::growBounds(*carWheel, wheelModel(wheel), carMin, carMax);
+    Model* carParts[4] = {carBody, carInterior, carPaint, carLight};
+    for (Model* part : carParts)
+        Impostor::growBounds(*part, glm::mat4(1.0f), carMin, carMax);
+    carImpostor = new Impostor();
+    carImpostor->bake(carMin, carMax, [](Shader& shader) {
+        watercolorShader = &shader;
+        setCommonUniforms();
+        drawCar(true, false);
+    });
+
     // Dear IMGUI init
     // ---------------
     IMGUI_CHECKVERSION();
@@ -215,13 +367,9 @@ int main()
     ImGui_ImplOpenGL3_Init("#version 330 core");
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    //watercolorShader->use();
-//    watercolorShader->setInt("gPosition", 0);
-//    watercolorShader->setInt("gNormal", 1);
-//    watercolorShader->setInt("gAlbedoSpec", 2);
-
     // render loop
     // -----------
+    watchChanges();
     while (!glfwWindowShouldClose(window))
     {
         static float lastFrame = 0.0f;
@@ -231,13 +379,44 @@ int main()
 
         processInput(window);
 
+        // the wheels move with the time and are drawn every frame while they spin, the tremor moves with the timer
+        // and is drawn tremorRate times a second, as often as it takes the eye to see it shake
+        if (!gnralConfig.redrawOnChange || gnralConfig.spinWheels)
+            changes.invalidate(PASS_GEOMETRY);
+        double tremorWait = nextTremorWait();
+        // the cached static shadows are thrown away every frame
+        if (gnralConfig.redrawStaticShadows)
+            changes.invalidate(PASS_LIGHTING);
+        unsigned int dirty = changes.poll();
+        if (dirty == 0) {
+            // the last frame is still on the screen, nothing is drawn or swapped until an event or the next tremor
+            if (tremorWait > 0.0)
+                glfwWaitEventsTimeout(tremorWait);
+            else
+                glfwWaitEvents();
+            // the gui reacts to the mouse without changing any watched value
+            if (isPaused)
+                changes.invalidate(PASS_LIGHTING);
+            // the time spent waiting isn't camera movement time
+            lastFrame = (float)glfwGetTime();
+            continue;
+        }
+
+        selectPermutations();
+        bakeLuts();
         glClearColor(0.3f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        watercolorShader->use();
-        setCommonUniforms();
-        //drawObjects();
-        drawCar();
+        if (gnralConfig.useDeferred) {
+            // light and stylization changes light the g-buffer of the last geometry pass again
+            drawDeferred((dirty & PASS_GEOMETRY) != 0);
+        } else {
+            watercolorShader = forwardShader;
+            watercolorShader->use();
+            setCommonUniforms();
+            //drawObjects();
+            drawCar();
+        }
 
         if (isPaused) {
             drawGui();
@@ -262,7 +441,16 @@ int main()
     delete carWheel;
     delete floorModel;
     //delete robotModel;
-    delete watercolorShader;
+    delete forwardPermutations;
+    delete gBufferPermutations;
+    delete deferredPermutations;
+    delete lightClusters;
+    delete shadowMaps;
+    delete weightedOIT;
+    delete stylization;
+    delete noiseBaker;
+    delete workers;
+    delete carImpostor;
 
     // glfw: terminate, clearing all previously allocated GLFW resources.
     // ------------------------------------------------------------------
@@ -271,6 +459,115 @@ int main()
 }
 
 
+void selectPermutations(){
+    // the switches of the config as constants, the uber shaders (empty defines) branch on the uniforms instead.
+    // The light count stays dynamic, the clusters pick the lights of every pixel, and oitPass changes within a frame
+    std::string materialDefines, forwardDefines, lightingDefines;
+    if (gnralConfig.usePermutations) {
+        materialDefines = ShaderPermutations::define("USE_NORMAL_MAPPING", shadingConfig.useNormalTexture)
+                        + ShaderPermutations::define("USE_SPECULAR_MAPPING", shadingConfig.useSpecularTexture)
+                        + ShaderPermutations::define("USE_COLOR_MAPPING", shadingConfig.useColorTexture)
+                        + ShaderPermutations::define("FLIP_U", shadingConfig.flipU)
+                        + ShaderPermutations::define("FLIP_V", shadingConfig.flipV);
+        // the g-buffer leaves the shading to the lighting pass
+        forwardDefines = materialDefines + ShaderPermutations::define("USE_OVERRIDE_SHADE", watercolorConfig.useOverrideShade);
+        lightingDefines = ShaderPermutations::define("USE_SHADOWS", shadingConfig.useShadows)
+                        + ShaderPermutations::define("USE_OVERRIDE_SHADE", watercolorConfig.useOverrideShade);
+    }
+    forwardShader = forwardPermutations->get(forwardDefines);
+    gBufferShader = gBufferPermutations->get(materialDefines);
+    deferredShader = deferredPermutations->get(lightingDefines);
+}
+
+void bakeLuts(){
+    // the key holds the only value the curve reads, it is baked again when that changed
+    float amount = std::max(0.0f, std::min(watercolorConfig.cangiante - watercolorConfig.dilute, 1.0f));
+    diluteCurve->bake("dilute " + std::to_string(amount), [amount](float u, float) {
+        float diluted = u * DILUTE_RANGE;
+        return glm::vec3(diluted + (std::pow(diluted, 2.2f) - diluted) * amount);
+    });
+    diluteCurve->bind(LUT_UNIT_DILUTE);
+}
+
+// dirties the scene when the tremor is due, returns the seconds until the next tremor frame, 0 when there is none
+double nextTremorWait(){
+    static double lastTremor = 0.0;
+    if (!gnralConfig.redrawOnChange || watercolorConfig.tremor == 0.0f)
+        return 0.0;
+    double now = glfwGetTime();
+    double period = 1.0 / std::max(gnralConfig.tremorRate, 1.0f);
+    if (now - lastTremor >= period) {
+        changes.invalidate(PASS_GEOMETRY);
+        lastTremor = now;
+    }
+    return period - (now - lastTremor);
+}
+
+void watchChanges(){
+    // what the g-buffer depends on, any of it also relights the frame
+    const unsigned int geometry = PASS_GEOMETRY | PASS_LIGHTING;
+    changes.watch(camera.Position, geometry);
+    changes.watch(camera.Front, geometry);
+    changes.watch(camera.Up, geometry);
+    changes.watch(camera.Zoom, geometry);
+    changes.watch(watercolorConfig.bleedOffset, geometry);
+    changes.watch(watercolorConfig.tremorFront, geometry);
+    changes.watch(watercolorConfig.tremorSpeed, geometry);
+    changes.watch(watercolorConfig.tremorFrequency, geometry);
+    changes.watch(watercolorConfig.pigmentDensity, geometry);
+    changes.watch(watercolorConfig.granulation, geometry);
+    changes.watch(watercolorConfig.edgeDarkening, geometry);
+    changes.watch(watercolorConfig.substrateDistortion, geometry);
+    changes.watch(shadingConfig.useColorTexture, geometry);
+    changes.watch(shadingConfig.colorTint, geometry);
+    changes.watch(shadingConfig.useNormalTexture, geometry);
+    changes.watch(shadingConfig.flipU, geometry);
+    changes.watch(shadingConfig.flipV, geometry);
+    changes.watch(shadingConfig.bumpDepth, geometry);
+    changes.watch(shadingConfig.useSpecularTexture, geometry);
+    changes.watch(gnralConfig.useDeferred, geometry);
+    changes.watch(gnralConfig.backgroundCarCount, geometry);
+    changes.watch(gnralConfig.useImpostors, geometry);
+    changes.watch(gnralConfig.impostorPixels, geometry);
+    changes.watch(gnralConfig.usePermutations, geometry);
+    // the lights and the stylization only read the g-buffer, the config structs are plain values
+    changes.watch(light1, PASS_LIGHTING);
+    changes.watch(light2, PASS_LIGHTING);
+    changes.watch(light3, PASS_LIGHTING);
+    changes.watch(watercolorConfig, PASS_LIGHTING);
+    changes.watch(shadingConfig, PASS_LIGHTING);
+    changes.watch(gnralConfig, PASS_LIGHTING);
+    changes.watch(shadowMaps->shadowDistance, PASS_LIGHTING);
+    changes.watch(stylization->settings, PASS_LIGHTING);
+    changes.watch(isPaused, PASS_LIGHTING);
+}
+
+void drawStylizationGui(){
+    Stylization::Settings& settings = stylization->settings;
+    ImGui::Text("Stylization (deferred only)");
+    ImGui::Checkbox("MNPR passes", &settings.enabled);
+    ImGui::Checkbox("Pigment density", &settings.pigmentDensity);
+    ImGui::SliderFloat("Density", &settings.density, 0, 3);
+    ImGui::Checkbox("Edge darkening", &settings.edgeDarkening);
+    ImGui::SliderFloat("Edge intensity", &settings.edgeIntensity, 0, 3);
+    ImGui::Checkbox("Granulation", &settings.granulation);
+    ImGui::SliderFloat("Granulation amount", &settings.granulationAmount, 0, 1);
+    ImGui::Checkbox("Substrate distortion", &settings.substrateDistortion);
+    ImGui::SliderFloat("Distortion", &settings.distortion, 0, 5);
+    // the control values the surfaces write into the g-buffer, the settings above scale them
+    ImGui::SliderFloat("Surface density", &watercolorConfig.pigmentDensity, 0, 1);
+    ImGui::SliderFloat("Surface granulation", &watercolorConfig.granulation, 0, 1);
+    ImGui::SliderFloat("Surface edges", &watercolorConfig.edgeDarkening, 0, 1);
+    ImGui::SliderFloat("Surface distortion", &watercolorConfig.substrateDistortion, 0, 1);
+    // the gpu time of every pass against its share of the budget
+    ImGui::SliderFloat("Budget (ms)", &settings.budget, 0.1f, 5.0f);
+    for (int pass = 0; pass < STYLIZE_PASSES; pass++)
+        ImGui::Text("  %s: %.3f ms, %.0f%% of the budget", Stylization::passName(pass), stylization->gpuTime[pass],
+                    stylization->gpuTime[pass] / settings.budget * 100.0f);
+    float total = stylization->totalTime();
+    ImGui::Text("  total: %.3f of %.3f ms%s", total, settings.budget, total > settings.budget ? ", over budget" : "");
+}
+
 void drawGui(){
     // Start the Dear ImGui frame
     ImGui_ImplOpenGL3_NewFrame();
@@ -320,6 +617,8 @@ void drawGui(){
                 ImGui::Text("Paper color");
                 ImGui::ColorEdit3("Paper color", (float*)&watercolorConfig.paperColor);
                 ImGui::SliderFloat("Bleed offset", &watercolorConfig.bleedOffset, 0, 1);
+                ImGui::Separator();
+                drawStylizationGui();
                 ImGui::EndGroup();
                 break;
             case 1:
@@ -363,6 +662,16 @@ void drawGui(){
                 ImGui::SliderFloat("attenuation scale", &light3.attenuationScale, 0, 1000);
                 ImGui::Checkbox("Shadow", &light3.shadowOn);
                 ImGui::EndGroup();
+                ImGui::Separator();
+                if (ImGui::SliderInt("Point lights", &gnralConfig.pointLightCount, 0, 1000))
+                    generatePointLights(gnralConfig.pointLightCount);
+                ImGui::Text("%d lights binned on the %s in %.3f ms", lightClusters->lightCount,
+                            lightClusters->gpu ? "gpu" : "cpu", lightClusters->cullTime);
+                if (!lightClusters->gpu)
+                    ImGui::Text("Most lights in a cluster: %d, %d clusters full", lightClusters->maxClusterLights,
+                                lightClusters->overflowingClusters);
+                if (ImGui::Checkbox("Spin wheels", &gnralConfig.spinWheels))
+                    staticCastersVersion++; // the wheels leave or join the static casters
                 break;
             case 2:
                 // SHADING
@@ -385,12 +694,38 @@ void drawGui(){
                 ImGui::SliderFloat("Specular transparency", &shadingConfig.specularTransparency, 0, 1);
                 ImGui::Separator();
                 ImGui::Checkbox("Use shadows", &shadingConfig.useShadows);
-                ImGui::SliderFloat("Shadow Depth Bias", &shadingConfig.shadowDepthBias, 0.0f, 10.0f);
+                ImGui::SliderFloat("Shadow Depth Bias", &shadingConfig.shadowDepthBias, 0.0f, 0.01f, "%.4f");
+                ImGui::SliderFloat("Shadow distance", &shadowMaps->shadowDistance, 5.0f, 100.0f);
+                ImGui::Text("Shadow layers drawn: %d static, %d dynamic in %.3f ms, gpu %.3f ms", shadowMaps->staticLayersDrawn,
+                            shadowMaps->dynamicLayersDrawn, shadowMaps->updateTime, shadowMaps->gpuTime);
+                ImGui::Combo("Shadow vertex stream", (int*)&gnralConfig.shadowStream,
+                             "Interleaved, 56 bytes\0Positions, 12 bytes\0Quantized, 8 bytes\0");
+                ImGui::Checkbox("Redraw static shadows", &gnralConfig.redrawStaticShadows);
                 ImGui::EndGroup();
                 break;
             case 3:
                 ImGui::BeginGroup();
                 ImGui::Checkbox("Use control", &gnralConfig.useControl);
+                ImGui::Checkbox("Deferred", &gnralConfig.useDeferred);
+                ImGui::Checkbox("Order independent transparency", &gnralConfig.useOIT);
+                ImGui::Checkbox("Redraw on change", &gnralConfig.redrawOnChange);
+                ImGui::SliderFloat("Tremor redraws per second", &gnralConfig.tremorRate, 1.0f, 60.0f);
+                ImGui::Text("  with redraw on change a tremor above 0 redraws at this rate, spinning wheels every frame");
+                ImGui::Checkbox("Shader permutations", &gnralConfig.usePermutations);
+                for (auto& variant : forwardPermutations->variants)
+                    ImGui::Text("  forward variant: %.1f ms%s", variant.second.buildTime, variant.second.fromDisk ? " from disk" : "");
+                for (auto& variant : gBufferPermutations->variants)
+                    ImGui::Text("  g-buffer variant: %.1f ms%s", variant.second.buildTime, variant.second.fromDisk ? " from disk" : "");
+                for (auto& variant : deferredPermutations->variants)
+                    ImGui::Text("  lighting variant: %.1f ms%s", variant.second.buildTime, variant.second.fromDisk ? " from disk" : "");
+                ImGui::Text("Redraw: %d frames drawn, %d waits for events", changes.drawnFrames, changes.skippedFrames);
+                ImGui::Separator();
+                if (ImGui::SliderInt("Background cars", &gnralConfig.backgroundCarCount, 0, 5000))
+                    generateBackgroundCars(gnralConfig.backgroundCarCount);
+                ImGui::Checkbox("Use impostors", &gnralConfig.useImpostors);
+                ImGui::SliderFloat("Impostor below pixels", &gnralConfig.impostorPixels, 4.0f, 512.0f);
+                ImGui::Text("%d meshes, %d impostors, baked in %.1f ms", (int) nearBackgroundCars.size(),
+                            carImpostor->drawnInstances, carImpostor->bakeTime);
                 ImGui::ColorEdit3("Atmosphere color", (float*)&gnralConfig.atmosphereColor);
                 ImGui::SliderFloat("Atm range start", &gnralConfig.atmRangeStart, 0.0f, 50000.0f);
                 ImGui::SliderFloat("Atm range end", &gnralConfig.atmRangeEnd, 0.0f, 50000.0f);
@@ -408,8 +743,10 @@ void drawGui(){
 
 
 void setCommonUniforms(){
+    // preshader, uniform only math of watercolor.vert done once per frame instead of per vertex
+    watercolorShader->setMat4("viewInv", glm::inverse(camera.GetViewMatrix()));
+    watercolorShader->setVec3("light1Dir", glm::normalize(light1.direction));
     // Watercolor in vertex
-    watercolorShader->setVec3("light1Dir", light1.direction);
     watercolorShader->setFloat("bleedOffset", watercolorConfig.bleedOffset);
     watercolorShader->setFloat("tremorFront", watercolorConfig.tremorFront);
     watercolorShader->setFloat("tremorSpeed", watercolorConfig.tremorSpeed);
@@ -439,6 +776,7 @@ void setCommonUniforms(){
     //WATERCOLOR
     watercolorShader->setFloat("dilute", watercolorConfig.dilute);
     watercolorShader->setFloat("cangiante", watercolorConfig.cangiante);
+    watercolorShader->setInt("diluteCurve", LUT_UNIT_DILUTE);
     watercolorShader->setVec3("paperColor", watercolorConfig.paperColor);
     watercolorShader->setFloat("highArea", watercolorConfig.highArea);
     watercolorShader->setFloat("highTransparency", watercolorConfig.highTransparency);
@@ -460,14 +798,274 @@ void setCommonUniforms(){
     watercolorShader->setFloat("bumpDepth", shadingConfig.bumpDepth);
     watercolorShader->setVec3("colorTint", shadingConfig.colorTint);
 
-    // CONTROL
-    watercolorShader->setVec3("inColor0", vec3{1});
-    watercolorShader->setVec3("inColor1", vec3{1});
-    watercolorShader->setVec3("inColor2", vec3{1});
-    watercolorShader->setVec3("inColor3", vec3{1});
+    // CONTROL, the vec4s of the MNPR targets: pigment (g granulation, b density), substrate (r distortion) and
+    // edge (r darkening, an alpha above 0.7 bleeds the geometry along the normal)
+    watercolorShader->setVec4("inColor0", 0.0f, watercolorConfig.granulation, watercolorConfig.pigmentDensity, 1.0f);
+    watercolorShader->setVec4("inColor1", watercolorConfig.substrateDistortion, 0.0f, 0.0f, 1.0f);
+    watercolorShader->setVec4("inColor2", watercolorConfig.edgeDarkening, 0.0f, 0.0f, 0.0f);
+    // the previous screen position, the velocity divides by it
+    watercolorShader->setVec4("inColor3", 1.0f, 1.0f, 1.0f, 1.0f);
+}
+
+void setLightingUniforms(){
+    // the per pixel lights of the deferred pass come from the clusters, the forward path gets them from calculateLight
+    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    glm::mat4 view = camera.GetViewMatrix();
+    // watercolor.vert multiplies with the transposed matrices, undo the projection the same way
+    deferredShader->setMat4("clipToPosWorld", glm::transpose(view) * glm::inverse(glm::transpose(projection)));
+    deferredShader->setVec3("cameraPosition", glm::vec3(glm::inverse(view)[3]));
+
+    lightClusters->bind(*deferredShader);
+    // SHADOWS
+    deferredShader->setMat4("clipToWorld", glm::inverse(glm::transpose(projection)));
+    deferredShader->setBool("useShadows", shadingConfig.useShadows);
+    deferredShader->setFloat("shadowDepthBias", shadingConfig.shadowDepthBias);
+    for (int i = 0; i < SHADOW_MAX_LIGHTS; i++)
+        deferredShader->setInt("shadowLight[" + std::to_string(i) + "]", shadowLightIndex[i]);
+    shadowMaps->bind(*deferredShader);
+    // SHADING
+    deferredShader->setFloat("specular", shadingConfig.specular);
+    deferredShader->setFloat("specDiffusion", shadingConfig.specularDiffusion);
+    deferredShader->setFloat("specPower", std::pow(2 - shadingConfig.specularDiffusion, 10.0f));
+    deferredShader->setFloat("specTransparency", shadingConfig.specularTransparency);
+    //WATERCOLOR
+    deferredShader->setFloat("diffuseFactor", watercolorConfig.diffuseFactor);
+    deferredShader->setFloat("diluteArea", watercolorConfig.diluteArea);
+    deferredShader->setFloat("shaderWrap", watercolorConfig.shadeWrap);
+    deferredShader->setFloat("dilute", watercolorConfig.dilute);
+    deferredShader->setFloat("cangiante", watercolorConfig.cangiante);
+    deferredShader->setInt("diluteCurve", LUT_UNIT_DILUTE);
+    deferredShader->setVec3("paperColor", watercolorConfig.paperColor);
+    deferredShader->setFloat("highArea", watercolorConfig.highArea);
+    deferredShader->setFloat("highTransparency", watercolorConfig.highTransparency);
+    deferredShader->setFloat("darkEdges", watercolorConfig.darkEdges);
+    deferredShader->setBool("useOverrideShade", watercolorConfig.useOverrideShade);
+    deferredShader->setVec3("shadeColor", watercolorConfig.shadeColor);
+    // gnral
+    deferredShader->setVec3("atmosphereColor", gnralConfig.atmosphereColor);
+    deferredShader->setFloat("rangeStart", gnralConfig.atmRangeStart);
+    deferredShader->setFloat("rangeEnd", gnralConfig.atmRangeEnd);
+}
+
+void updateLights(){
+    // everything that is enabled goes into the list, the clusters keep each pixel from looping over all of it
+    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    glm::mat4 view = camera.GetViewMatrix();
+    std::vector<GpuLight> lights;
+    std::vector<ShadowLight> shadowLights;
+    const LightConfig* guiLights[3] = {&light1, &light2, &light3};
+    for (int i = 0; i < SHADOW_MAX_LIGHTS; i++)
+        shadowLightIndex[i] = -1;
+    for (int i = 0; i < 3 + (int) pointLights.size(); i++) {
+        const LightConfig& light = i < 3 ? *guiLights[i] : pointLights[i - 3];
+        if (!light.enabled)
+            continue;
+        // the spot and directional lights of the gui cast shadows
+        if (i < 3 && shadingConfig.useShadows && light.shadowOn && (light.type == 2 || light.type == 4)) {
+            shadowLightIndex[shadowLights.size()] = (int) lights.size();
+            ShadowLight shadowLight = {light.type, light.position, light.direction, light.coneAngle, light.fallOff, light.range};
+            shadowLights.push_back(shadowLight);
+        }
+        GpuLight gpuLight;
+        gpuLight.positionRange = glm::vec4(light.position, light.range);
+        gpuLight.colorIntensity = glm::vec4(light.color, light.intensity);
+        gpuLight.directionCone = glm::vec4(light.direction, light.coneAngle);
+        // only the first light has a specular highlight, as in calculateLight
+        gpuLight.params = glm::vec4(light.fallOff, light.attenuationScale, (float) light.type, i == 0 && light.specular ? 1.0f : 0.0f);
+        lights.push_back(gpuLight);
+    }
+    lightClusters->upload(lights);
+    lightClusters->cull(glm::transpose(view) * glm::inverse(glm::transpose(projection)), 0.1f, 100.0f);
+    // the static casters are only redrawn when a light or the static geometry moved
+    if (gnralConfig.redrawStaticShadows)
+        staticCastersVersion++;
+    shadowMaps->update(shadowLights, glm::inverse(glm::transpose(projection)), 0.1f, 100.0f, staticCastersVersion,
+                       gnralConfig.spinWheels && !shadowLights.empty(), drawShadowCasters);
+}
+
+void generatePointLights(int count){
+    // small coloured point lights scattered around the car
+    srand(1);
+    pointLights.resize(count);
+    for (LightConfig& light : pointLights) {
+        float angle = (float) rand() / RAND_MAX * 2.0f * glm::pi<float>();
+        float radius = 1.0f + (float) rand() / RAND_MAX * 5.0f;
+        light.enabled = true;
+        light.type = 3;
+        light.position = {cos(angle) * radius, 0.2f + (float) rand() / RAND_MAX * 1.3f, sin(angle) * radius};
+        light.color = {(float) rand() / RAND_MAX, (float) rand() / RAND_MAX, (float) rand() / RAND_MAX};
+        light.intensity = 0.5f;
+        light.range = 1.0f + (float) rand() / RAND_MAX * 2.0f;
+    }
+}
+
+void generateBackgroundCars(int count){
+    // scattered over a ring around the car with random headings, fixed seed so the slider is repeatable
+    srand(2);
+    backgroundCars.resize(count);
+    for (glm::vec4& car : backgroundCars) {
+        float angle = (float) rand() / RAND_MAX * 2.0f * glm::pi<float>();
+        float radius = 10.0f + (float) rand() / RAND_MAX * 70.0f;
+        float heading = (float) rand() / RAND_MAX * 2.0f * glm::pi<float>();
+        car = glm::vec4(cos(angle) * radius, 0.0f, sin(angle) * radius, heading);
+    }
+}
+
+void splitBackgroundCars(){
+    // the size on screen decides between the meshes and the impostor, measured like watercolor.vert projects
+    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    glm::mat4 clip = glm::transpose(projection);
+    nearBackgroundCars.clear();
+    impostorInstances.clear();
+    for (const glm::vec4& car : backgroundCars) {
+        glm::mat4 root = glm::rotate(glm::translate(glm::mat4(1.0f), glm::vec3(car)), car.w, glm::vec3(0.0f, 1.0f, 0.0f));
+        glm::vec4 center = clip * root * glm::vec4(carImpostor->center, 1.0f);
+        // behind the eye is left to the clipping
+        float pixels = center.w > 0.0f ? carImpostor->radius * projection[1][1] / center.w * SCR_HEIGHT * 0.5f : 0.0f;
+        if (gnralConfig.useImpostors && pixels < gnralConfig.impostorPixels)
+            impostorInstances.push_back(car);
+        else
+            nearBackgroundCars.push_back(root);
+    }
+}
+
+void drawBackgroundCars(bool opaque, bool transparent){
+    for (const glm::mat4& root : nearBackgroundCars)
+        drawCar(opaque, transparent, root);
+    if (!opaque)
+        return;
+    // the rest in one instanced draw, the projection alone places the geometry so its eye is the point it sends to w = 0
+    glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
+    glm::vec4 eye = glm::inverse(glm::transpose(projection)) * glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+    carImpostor->draw(impostorInstances, projection, camera.GetViewMatrix(), glm::vec3(eye) / eye.w);
+}
+
+void setGBuffer(){
+    glGenFramebuffers(1, &gBuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+    // albedo and specular mask
+    glGenTextures(1, &gAlbedoSpec);
+    glBindTexture(GL_TEXTURE_2D, gAlbedoSpec);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gAlbedoSpec, 0);
+    // octahedral normal
+    glGenTextures(1, &gNormal);
+    glBindTexture(GL_TEXTURE_2D, gNormal);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RG, GL_FLOAT, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, gNormal, 0);
+    // MNPR control values
+    unsigned int* controls[3] = {&gPigmentCtrl, &gSubstrateCtrl, &gEdgeCtrl};
+    for (int i = 0; i < 3; i++) {
+        glGenTextures(1, controls[i]);
+        glBindTexture(GL_TEXTURE_2D, *controls[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2 + i, GL_TEXTURE_2D, *controls[i], 0);
+    }
+    unsigned int attachments[5] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2,
+                                   GL_COLOR_ATTACHMENT3, GL_COLOR_ATTACHMENT4};
+    glDrawBuffers(5, attachments);
+    // depth, same format as the default framebuffer so it can be blitted for the forward drawn windows
+    glGenTextures(1, &gDepth);
+    glBindTexture(GL_TEXTURE_2D, gDepth);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, SCR_WIDTH, SCR_HEIGHT, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, gDepth, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::FRAMEBUFFER:: G-buffer is not complete!" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void drawDeferred(bool geometryPass){
+    // geometry pass, the opaque surfaces write their attributes, nothing is lit yet
+    if (geometryPass) {
+        glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        watercolorShader = gBufferShader;
+        watercolorShader->use();
+        setCommonUniforms();
+        drawCar(true, false);
+        splitBackgroundCars();
+        drawBackgroundCars(true, false);
+    }
+
+    // lighting and stylization, once per pixel whatever the overdraw of the geometry pass. The MNPR passes read the
+    // lit image and the windows from the scene target
+    bool stylize = stylization->settings.enabled;
+    unsigned int sceneTarget = stylize ? stylization->sceneFramebuffer : 0;
+    updateLights();
+    glBindFramebuffer(GL_FRAMEBUFFER, sceneTarget);
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    if (stylize)
+        glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
+    glDisable(GL_DEPTH_TEST);
+    deferredShader->use();
+    setLightingUniforms();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, gAlbedoSpec);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, gNormal);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_2D, gDepth);
+    glActiveTexture(GL_TEXTURE0);
+    glBindVertexArray(quadVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    glBindVertexArray(0);
+    glEnable(GL_DEPTH_TEST);
+
+    // the blended windows can't live in the g-buffer, draw them forward against the depth of the geometry pass
+    watercolorShader = forwardShader;
+    if (gnralConfig.useOIT) {
+        // the transparency targets test against the g-buffer depth directly, so there is nothing to blit
+        watercolorShader->use();
+        setCommonUniforms();
+        watercolorShader->setBool("oitPass", true);
+        glDepthMask(GL_FALSE);
+        weightedOIT->target = sceneTarget;
+        weightedOIT->begin();
+        drawCar(false, true);
+        drawBackgroundCars(false, true);
+        weightedOIT->composite();
+        glDepthMask(GL_TRUE);
+        watercolorShader->setBool("oitPass", false);
+    } else if (stylize) {
+        // the scene target tests against the g-buffer depth itself, the windows mustn't write it, a frame that
+        // only relights reads it again
+        glDepthMask(GL_FALSE);
+        watercolorShader->use();
+        setCommonUniforms();
+        drawCar(false, true);
+        drawBackgroundCars(false, true);
+        glDepthMask(GL_TRUE);
+    } else {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, SCR_WIDTH, SCR_HEIGHT, 0, 0, SCR_WIDTH, SCR_HEIGHT, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        watercolorShader->use();
+        setCommonUniforms();
+        drawCar(false, true);
+        drawBackgroundCars(false, true);
+    }
+
+    if (stylize) {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        const unsigned int controls[3] = {gPigmentCtrl, gSubstrateCtrl, gEdgeCtrl};
+        // the near and far plane of the projection of drawCar
+        stylization->apply(controls, gDepth, substrateTexture, 0.1f, 100.0f);
+    }
 }
 
-void drawCar(){
+void drawCar(bool opaque, bool transparent, const glm::mat4& root){
     watercolorShader->use();
     // camera parameters
     glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
@@ -477,54 +1075,63 @@ void drawCar(){
     // set projection matrix uniform
     watercolorShader->setMat4("projection", projection);
 
-    // draw wheel
-    glm::mat4 model = glm::translate(glm::mat4(1.0f), glm::vec3(-.7432, .328, 1.39));
-    watercolorShader->setMat4("model", model);
-    glm::mat4 invTranspose = glm::inverse(glm::transpose(view * model));
-    watercolorShader->setMat4("invTranspose", invTranspose);
-    watercolorShader->setMat4("view", view);
-    carWheel->Draw(*watercolorShader);
-
-    // draw wheel
-    model = glm::translate(glm::mat4(1.0f), glm::vec3(-.7432, .328, -1.296));
-    watercolorShader->setMat4("model", model);
-    invTranspose = glm::inverse(glm::transpose(view * model));
-    watercolorShader->setMat4("invTranspose", invTranspose);
-    watercolorShader->setMat4("view", view);
-    carWheel->Draw(*watercolorShader);
+    // draw wheels, they are opaque
+    glm::mat4 model, invTranspose;
+    for (int wheel = 0; wheel < 4 && opaque; wheel++) {
+        model = root * wheelModel(wheel);
+        watercolorShader->setMat4("model", model);
+        invTranspose = glm::inverse(glm::transpose(view * model));
+        watercolorShader->setMat4("invTranspose", invTranspose);
+        watercolorShader->setMat4("view", view);
+        carWheel->Draw(*watercolorShader);
+    }
 
-    // draw wheel
-    model = glm::rotate(glm::mat4(1.0f), glm::pi<float>(), glm::vec3(0.0, 1.0, 0.0));
-    model = glm::translate(model, glm::vec3(-.7432, .328, 1.296));
+    // draw the rest of the car
+    model = root;
     watercolorShader->setMat4("model", model);
     invTranspose = glm::inverse(glm::transpose(view * model));
     watercolorShader->setMat4("invTranspose", invTranspose);
     watercolorShader->setMat4("view", view);
-    carWheel->Draw(*watercolorShader);
+    if (opaque) {
+        carBody->Draw(*watercolorShader);
+        carInterior->Draw(*watercolorShader);
+        carPaint->Draw(*watercolorShader);
+        carLight->Draw(*watercolorShader);
+    }
+    if (transparent) {
+        glEnable(GL_BLEND);
+        carWindow->Draw(*watercolorShader);
+        glDisable(GL_BLEND);
+    }
 
-    // draw wheel
-    model = glm::rotate(glm::mat4(1.0f), glm::pi<float>(), glm::vec3(0.0, 1.0, 0.0));
-    model = glm::translate(model, glm::vec3(-.7432, .328, -1.39));
-    watercolorShader->setMat4("model", model);
-    invTranspose = glm::inverse(glm::transpose(view * model));
-    watercolorShader->setMat4("invTranspose", invTranspose);
-    watercolorShader->setMat4("view", view);
-    carWheel->Draw(*watercolorShader);
+}
 
-    // draw the rest of the car
-    model = glm::mat4(1.0f);
-    watercolorShader->setMat4("model", model);
-    invTranspose = glm::inverse(glm::transpose(view * model));
-    watercolorShader->setMat4("invTranspose", invTranspose);
-    watercolorShader->setMat4("view", view);
-    carBody->Draw(*watercolorShader);
-    carInterior->Draw(*watercolorShader);
-    carPaint->Draw(*watercolorShader);
-    carLight->Draw(*watercolorShader);
-    glEnable(GL_BLEND);
-    carWindow->Draw(*watercolorShader);
-    glDisable(GL_BLEND);
+glm::mat4 wheelModel(int wheel){
+    const glm::vec3 offsets[4] = {{-.7432, .328, 1.39}, {-.7432, .328, -1.296}, {-.7432, .328, 1.296}, {-.7432, .328, -1.39}};
+    // the last two sit on the other side of the car
+    glm::mat4 model = wheel < 2 ? glm::mat4(1.0f) : glm::rotate(glm::mat4(1.0f), glm::pi<float>(), glm::vec3(0.0, 1.0, 0.0));
+    model = glm::translate(model, offsets[wheel]);
+    if (gnralConfig.spinWheels)
+        model = glm::rotate(model, (float)glfwGetTime() * 4.0f, glm::vec3(1.0, 0.0, 0.0));
+    return model;
+}
 
+void drawShadowCasters(Shader& shader, bool dynamic){
+    // the windows let the light through
+    bool wheelsDynamic = gnralConfig.spinWheels;
+    if (dynamic == wheelsDynamic) {
+        for (int wheel = 0; wheel < 4; wheel++) {
+            shader.setMat4("model", wheelModel(wheel));
+            carWheel->DrawPositions(shader, gnralConfig.shadowStream);
+        }
+    }
+    if (!dynamic) {
+        shader.setMat4("model", glm::mat4(1.0f));
+        carBody->DrawPositions(shader, gnralConfig.shadowStream);
+        carInterior->DrawPositions(shader, gnralConfig.shadowStream);
+        carPaint->DrawPositions(shader, gnralConfig.shadowStream);
+        carLight->DrawPositions(shader, gnralConfig.shadowStream);
+    }
 }
 
 void drawObjects(){
@@ -773,4 +1380,11 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height)
     // make sure the viewport matches the new window dimensions; note that width and
     // height will be significantly larger than specified on retina displays.
     glViewport(0, 0, width, height);
+    changes.invalidate(PASS_GEOMETRY | PASS_LIGHTING);
+}
+
+// glfw: the window contents were damaged (uncovered, restored), the last frame has to be presented again
+void window_refresh_callback(GLFWwindow* window)
+{
+    changes.invalidate(PASS_LIGHTING);
 }
\ No newline at end of file
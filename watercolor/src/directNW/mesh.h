@@ -28,6 +28,13 @@ struct Vertex {
     glm::vec3 Bitangent;
 };
 
+// vertex streams a position only pass (shadow maps, depth) can read, the interleaved one fetches the whole Vertex
+enum VertexStream {
+    STREAM_INTERLEAVED = 0, // 56 bytes per vertex
+    STREAM_POSITIONS,       // 12 bytes, packed float positions
+    STREAM_QUANTIZED        // 8 bytes, 16 bit positions relative to the bounds of the mesh
+};
+
 struct Texture {
     unsigned int id;
     string type;
@@ -41,6 +48,10 @@ public:
     vector<unsigned int> indices;
     vector<Texture> textures;
     unsigned int VAO;
+    // position only layouts, they share the index buffer with VAO
+    unsigned int positionVAO, quantizedVAO;
+    // quantized position = (position - positionOffset) / positionScale
+    glm::vec3 positionOffset, positionScale;
 
     /*  Functions  */
     // constructor
@@ -92,9 +103,20 @@ public:
         glActiveTexture(GL_TEXTURE0);
     }
 
+    // draws only the positions, the shader decodes them with positionOffset and positionScale
+    void DrawPositions(Shader &shader, VertexStream stream)
+    {
+        bool quantized = stream == STREAM_QUANTIZED;
+        shader.setVec3("positionOffset", quantized ? positionOffset : glm::vec3(0.0f));
+        shader.setVec3("positionScale", quantized ? positionScale : glm::vec3(1.0f));
+        glBindVertexArray(stream == STREAM_INTERLEAVED ? VAO : (quantized ? quantizedVAO : positionVAO));
+        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+        glBindVertexArray(0);
+    }
+
 private:
     /*  Render data  */
-    unsigned int VBO, EBO;
+    unsigned int VBO, EBO, positionVBO, quantizedVBO;
 
     /*  Functions    */
     // initializes all the buffer objects/arrays
@@ -134,6 +156,43 @@ private:
         glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
 
         glBindVertexArray(0);
+
+        // tightly packed positions for the position only passes
+        vector<glm::vec3> positions(vertices.size());
+        glm::vec3 boundsMin(1e30f), boundsMax(-1e30f);
+        for (unsigned int i = 0; i < vertices.size(); i++) {
+            positions[i] = vertices[i].Position;
+            boundsMin = glm::min(boundsMin, positions[i]);
+            boundsMax = glm::max(boundsMax, positions[i]);
+        }
+        glGenVertexArrays(1, &positionVAO);
+        glGenBuffers(1, &positionVBO);
+        glBindVertexArray(positionVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+        glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec3), &positions[0], GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (void*)0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBindVertexArray(0);
+
+        // the same positions in 16 bits per axis over the bounds, the fourth short keeps the vertices 4 byte aligned
+        positionOffset = boundsMin;
+        positionScale = glm::max(boundsMax - boundsMin, glm::vec3(1e-6f));
+        vector<unsigned short> quantized(vertices.size() * 4, 0);
+        for (unsigned int i = 0; i < vertices.size(); i++) {
+            glm::vec3 normalized = glm::clamp((positions[i] - positionOffset) / positionScale, 0.0f, 1.0f);
+            for (int axis = 0; axis < 3; axis++)
+                quantized[i * 4 + axis] = (unsigned short) (normalized[axis] * 65535.0f + 0.5f);
+        }
+        glGenVertexArrays(1, &quantizedVAO);
+        glGenBuffers(1, &quantizedVBO);
+        glBindVertexArray(quantizedVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, quantizedVBO);
+        glBufferData(GL_ARRAY_BUFFER, quantized.size() * sizeof(unsigned short), &quantized[0], GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, 4 * sizeof(unsigned short), (void*)0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBindVertexArray(0);
     }
 };
 #endif
\ No newline at end of file
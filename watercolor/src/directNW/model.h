@@ -47,6 +47,13 @@ public:
             meshes[i].Draw(shader);
     }
 
+    // draws the positions only, for the depth and shadow passes
+    void DrawPositions(Shader &shader, VertexStream stream)
+    {
+        for(unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].DrawPositions(shader, stream);
+    }
+
 private:
     /*  Functions   */
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
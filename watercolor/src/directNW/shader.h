@@ -13,9 +13,9 @@ class Shader
 {
 public:
     unsigned int ID;
-    // constructor generates the shader on the fly
+    // constructor generates the shader on the fly, defines ("#define X\n" lines) go right after the #version line
     // ------------------------------------------------------------------------
-    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
+    Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr, const std::string& defines = "")
     {
         // 1. retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
@@ -41,8 +41,8 @@ public:
             vShaderFile.close();
             fShaderFile.close();
             // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
+            vertexCode = addDefines(vShaderStream.str(), defines);
+            fragmentCode = addDefines(fShaderStream.str(), defines);
             // if geometry shader path is present, also load a geometry shader
             if(geometryPath != nullptr)
             {
@@ -50,7 +50,7 @@ public:
                 std::stringstream gShaderStream;
                 gShaderStream << gShaderFile.rdbuf();
                 gShaderFile.close();
-                geometryCode = gShaderStream.str();
+                geometryCode = addDefines(gShaderStream.str(), defines);
             }
         }
         catch (std::ifstream::failure e)
@@ -87,6 +87,11 @@ public:
         glAttachShader(ID, fragment);
         if(geometryPath != nullptr)
             glAttachShader(ID, geometry);
+#ifdef GL_VERSION_4_1
+        // lets ShaderPermutations keep the linked program on disk
+        if (GLAD_GL_VERSION_4_1)
+            glProgramParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+#endif
         glLinkProgram(ID);
         checkCompileErrors(ID, "PROGRAM");
         // delete the shaders as they're linked into our program now and no longer necessery
@@ -95,6 +100,11 @@ public:
         if(geometryPath != nullptr)
             glDeleteShader(geometry);
 
+    }
+    // wraps a program that is already linked, ShaderPermutations loads them from program binaries
+    // ------------------------------------------------------------------------
+    explicit Shader(unsigned int program) : ID(program)
+    {
     }
     // activate the shader
     // ------------------------------------------------------------------------
@@ -162,6 +172,18 @@ public:
     }
 
 private:
+    // inserts the defines after the #version line, which has to stay the first one
+    // ------------------------------------------------------------------------
+    static std::string addDefines(const std::string &code, const std::string &defines)
+    {
+        if (defines.empty())
+            return code;
+        size_t version = code.find("#version");
+        size_t lineEnd = version == std::string::npos ? std::string::npos : code.find('\n', version);
+        if (lineEnd == std::string::npos)
+            return defines + code;
+        return code.substr(0, lineEnd + 1) + defines + code.substr(lineEnd + 1);
+    }
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
     void checkCompileErrors(GLuint shader, std::string type)
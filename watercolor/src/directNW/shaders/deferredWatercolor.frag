@@ -0,0 +1,287 @@
+#version 330 core
+// lighting and watercolor stylization of the deferred path, evaluated once per pixel from the g-buffer
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+struct L_OUT {
+    vec3 lSpecular, lDilute, lColor;
+    float lShade;
+};
+
+// g-buffer
+uniform sampler2D gAlbedoSpec;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+// reconstructs the position the vertex shader calls posWorld from the depth
+uniform mat4 clipToPosWorld;
+uniform vec3 cameraPosition; // viewInv[3] of the vertex shader
+
+// LIGHTS, binned into clusters by lightClusters.h, four texels per light
+uniform samplerBuffer lightData;
+uniform usamplerBuffer clusterData; // per cluster the light count followed by the light indices
+uniform float zNear;
+uniform float zFar;
+const int CLUSTER_X = 16;
+const int CLUSTER_Y = 9;
+const int CLUSTER_Z = 24;
+const int CLUSTER_STRIDE = 128;
+// SHADOWS of up to three spot and directional lights, cascaded for the directional ones, see shadowMaps.h
+// constants in the variants of shaderPermutations.h, uniforms in the uber shader
+#ifndef USE_SHADOWS
+uniform bool useShadows;
+#define USE_SHADOWS useShadows
+#endif
+uniform float shadowDepthBias;
+uniform sampler2DArrayShadow shadowMaps;
+uniform mat4 shadowMatrices[9];
+uniform int shadowLight[3]; // index of the shadowed lights in the light list, -1 for none
+uniform vec3 cascadeEnds;   // view distance where every cascade ends
+uniform mat4 clipToWorld;   // the shadow maps are in world space, not in the one of posWorld
+const int SHADOW_CASCADES = 3;
+//shading
+uniform float specular;
+uniform float specDiffusion;
+uniform float specPower; // pow(2 - specDiffusion, 10), only depends on the uniform
+uniform float specTransparency;
+//WATERcoLor
+uniform float diffuseFactor;
+uniform float diluteArea;
+uniform float shaderWrap;
+uniform float dilute;
+uniform float cangiante;
+uniform vec3 paperColor;
+uniform float highArea;
+uniform float highTransparency;
+uniform float darkEdges;
+#ifndef USE_OVERRIDE_SHADE
+uniform bool useOverrideShade;
+#define USE_OVERRIDE_SHADE useOverrideShade
+#endif
+uniform vec3 shadeColor;
+uniform vec3 atmosphereColor;
+uniform float rangeStart;
+uniform float rangeEnd;
+// mix(x, pow(x, 2.2), clamp(cangiante - dilute, 0, 1)) for x in [0, DILUTE_RANGE], baked by bakeLuts in main.cpp
+uniform sampler2D diluteCurve;
+const float DILUTE_RANGE = 4.0;
+
+float lutCoord(float x, sampler2D lut) {
+    float size = float(textureSize(lut, 0).x);
+    return (clamp(x, 0.0, 1.0) * (size - 1.0) + 0.5) / size;
+}
+
+vec3 octahedralDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
+
+float getLightConeAngle(float coneAngle, float coneFallOff, vec3 lightVec, vec3 lightDir) {
+    if (coneFallOff< coneAngle)
+        coneFallOff = coneAngle;
+    float lDotDir = dot(lightVec, lightDir);
+    float edge0 = cos(coneFallOff);
+    float edge1 = cos(coneAngle);
+    // Hermite interpolation // smooth step function
+    float cone = clamp((lDotDir - edge0) / (edge1 - edge0), 0.0f, 1.0f);
+    cone = cone * cone * (3 - 2 * cone);
+    return cone;
+}
+
+// 1 lit, 0 in shadow, linear filtering of the depth comparison gives the hardware pcf in between
+float lightShadow(int slot, bool directional, vec3 worldPos, float viewDistance) {
+    int cascade = 0;
+    if (directional) {
+        if (viewDistance >= cascadeEnds.z)
+            return 1.0;
+        cascade = viewDistance < cascadeEnds.x ? 0 : (viewDistance < cascadeEnds.y ? 1 : 2);
+    }
+    int layer = slot * SHADOW_CASCADES + cascade;
+    vec4 position = shadowMatrices[layer] * vec4(worldPos, 1.0);
+    vec3 coords = position.xyz / position.w * 0.5 + 0.5;
+    if (coords.z > 1.0)
+        return 1.0;
+    return texture(shadowMaps, vec4(coords.xy, float(layer), coords.z - shadowDepthBias));
+}
+
+L_OUT calculateLight(bool lightEnable, int lightType, float lightAtten, vec3 lightPos, vec3 vertWorldPos,
+    vec3 lightColor, float lightIntensity, vec3 lightDir, float lightConeAngle, float lightFallOff,
+    vec3 normalWorld, vec3 viewDir, bool lightUseSpecular, float lightRange, float shadow) {
+
+    L_OUT L;
+    L.lSpecular = vec3(0.0);
+    L.lColor = vec3(0.0);
+    L.lDilute = vec3(0.0);
+    L.lShade = 0.0;
+
+    if(lightEnable){
+        //for Maya, flip the lightDir (weird)
+        lightDir = -lightDir;
+        //spot = 2, point = 3, directional = 4, ambient = 5,
+
+        //ambient light
+        //-> no diffuse, specular or shadow casting
+        if (lightType == 5){
+            L.lColor = lightColor * lightIntensity;
+            return L;
+        }
+
+        //directional light -> no position
+        bool isDirectionalLight = (lightType == 4);
+        vec3 lightVec = isDirectionalLight ? lightDir : lightPos - vertWorldPos;
+        vec3 nLightVec = normalize(lightVec); //normalized light vector
+
+        //diffuse
+        float nDotL = dot(normalWorld, nLightVec);
+
+        //Wrapped Lambert
+        float dotMask = clamp(nDotL, 0.0, 1.0);
+        float DF = mix(1,dotMask, diffuseFactor); //diffuse factor
+        float SW = mix(0,clamp(-nDotL, 0.0, 1.0), shaderWrap); //shade wrap
+        float CL = clamp(DF*(1-SW), 0.0, 1.0); //custom lambert
+        vec3 diffuseColor = lightColor * lightIntensity * CL; //diffuse reflectance (lambert)
+
+        //dilute area
+        float clampVal = clamp((dotMask + (diluteArea - 1)) / diluteArea, 0.0f, 1.0f);
+        vec3 diluted = vec3(clampVal, clampVal, clampVal);
+
+        //specular (Phong)
+        vec3 specularColor = vec3(0);
+        if(lightUseSpecular){
+            float rDotV = dot(reflect(nLightVec, normalWorld),-viewDir);
+            float clamped = clamp(((1-specular)-rDotV)*200/5, 0.0f, 1.0f);
+            float specularEdge = darkEdges * (clamped -1); // darkened edges mask
+            float specularColorFloat = (mix(specularEdge, 0.0f, specDiffusion) + 2 * clamp(((max(1.0f - specular, rDotV) - (1 - specular)) * specPower),0.0f, 1.0f)) * (1 - specTransparency);
+            specularColor = vec3(specularColorFloat);
+            specularColor *= clamp(dot(normalWorld, lightDir) * 2, 0.0f, 1.0f);
+        }
+
+        //attenuation
+        if (!isDirectionalLight){
+            bool enableAttenuation = lightAtten > 0.0001f;
+            float attenuation = mix(1.0, 1 / pow(length(lightVec), lightAtten), enableAttenuation);
+            diffuseColor *= attenuation;
+            specularColor *= attenuation;
+            // lights with a range fade out before it, the clusters don't list them past it
+            if (lightRange > 0.0) {
+                float window = clamp(1.0 - pow(length(lightVec) / lightRange, 4.0), 0.0, 1.0);
+                diffuseColor *= window * window;
+                specularColor *= window * window;
+            }
+        }
+
+        // spot light Cone Angle
+        if (lightType == 2) {
+            float angle = getLightConeAngle(lightConeAngle, lightFallOff, nLightVec, lightDir);
+            diffuseColor *= angle;
+            specularColor *= angle;
+        }
+
+        // shadows, the shaded part only keeps what the diffuse factor doesn't take away
+        if (shadow < 1.0) {
+            diffuseColor = mix(lightColor * lightIntensity * (1 - diffuseFactor), diffuseColor, shadow);
+            L.lShade = 1.0;
+        }
+        specularColor *= floor(shadow); //get rid of specular in the shade
+
+        L.lColor = diffuseColor;
+        L.lSpecular = specularColor;
+        L.lDilute = diluted;
+    }
+
+    return L;
+}
+
+void main()
+{
+    float fragDepth = texture(gDepth, TexCoords).r;
+    // nothing was drawn here, keep the clear color
+    if (fragDepth == 1.0)
+        discard;
+
+    vec4 albedoSpec = texture(gAlbedoSpec, TexCoords);
+    vec3 normalWorld = octahedralDecode(texture(gNormal, TexCoords).rg);
+    vec4 position = clipToPosWorld * vec4(TexCoords * 2.0 - 1.0, fragDepth * 2.0 - 1.0, 1.0);
+    vec3 posWorld = position.xyz / position.w;
+    vec3 viewDir = normalize(cameraPosition - posWorld);
+    float nDotV = dot(normalWorld, viewDir);
+    float depth = distance(posWorld, cameraPosition);
+    vec4 world = clipToWorld * vec4(TexCoords * 2.0 - 1.0, fragDepth * 2.0 - 1.0, 1.0);
+    vec3 worldPos = world.xyz / world.w;
+
+    ///// LIGHTS /////
+    // only the lights binned into the cluster of this pixel
+    float viewDistance = 2.0 * zFar * zNear / ((zFar + zNear) - (fragDepth * 2.0 - 1.0) * (zFar - zNear));
+    int slice = clamp(int(log(viewDistance / zNear) / log(zFar / zNear) * CLUSTER_Z), 0, CLUSTER_Z - 1);
+    ivec2 tile = min(ivec2(TexCoords * vec2(CLUSTER_X, CLUSTER_Y)), ivec2(CLUSTER_X - 1, CLUSTER_Y - 1));
+    int cluster = ((slice * CLUSTER_Y + tile.y) * CLUSTER_X + tile.x) * CLUSTER_STRIDE;
+    int count = int(texelFetch(clusterData, cluster).r);
+    vec3 lightTotal = vec3(0);
+    vec3 specTotal = vec3(0);
+    vec3 diluteTotal = vec3(0);
+    float shade = 0.0;
+    for (int i = 0; i < count; i++) {
+        int index = int(texelFetch(clusterData, cluster + 1 + i).r);
+        int light = index * 4;
+        vec4 positionRange = texelFetch(lightData, light);
+        vec4 colorIntensity = texelFetch(lightData, light + 1);
+        vec4 directionCone = texelFetch(lightData, light + 2);
+        vec4 params = texelFetch(lightData, light + 3);
+        float shadow = 1.0;
+        if (USE_SHADOWS) {
+            for (int slot = 0; slot < 3; slot++) {
+                if (shadowLight[slot] == index)
+                    shadow = lightShadow(slot, int(params.z) == 4, worldPos, viewDistance);
+            }
+        }
+        L_OUT L = calculateLight(true, int(params.z), params.y, positionRange.xyz, posWorld, colorIntensity.rgb,
+            colorIntensity.a, directionCone.xyz, directionCone.w, params.x, normalWorld, viewDir, params.w > 0.5,
+            positionRange.w, shadow);
+        lightTotal += L.lColor;
+        shade = max(shade, L.lShade);
+        specTotal += L.lSpecular;
+        diluteTotal += L.lDilute;
+    }
+
+    vec3 tex = albedoSpec.rgb;
+    float grayscale = 0.2989 * tex.r + 0.5870 * tex.g + 0.1140 * tex.b;
+
+    // the lights dilute all channels alike, one fetch of the curve. More lights than the table covers add up past
+    // its range, those pixels evaluate the curve
+    if (diluteTotal.r <= DILUTE_RANGE)
+        diluteTotal = vec3(texture(diluteCurve, vec2(lutCoord(diluteTotal.r / DILUTE_RANGE, diluteCurve), 0.5)).r);
+    else
+        diluteTotal = mix(diluteTotal, pow(diluteTotal, vec3(2.2)), clamp(-1 * dilute + cangiante, 0.0, 1.0));
+
+    vec3 highlight = vec3(0);
+    if (shade < 1.0) {
+        tex.rgb = tex.rgb + clamp(diluteTotal * cangiante, 0.0, 1.0);
+        tex.rgb = mix(tex.rgb, paperColor, diluteTotal * dilute);
+        if (highArea > 0) {
+            highlight = (max(vec3(1 - highArea), diluteTotal) - vec3(1 - highArea))*800/depth;
+            highlight = clamp(mix(-highlight*darkEdges, highlight, trunc(highlight)), 0.0, 1.0); //highlight darkened edges
+        }
+    }
+
+    vec3 watercolor = vec3(0);
+    if (USE_OVERRIDE_SHADE) {
+        vec3 c = mix(shadeColor, tex.rgb, clamp(lightTotal, 0.0, 1.0));
+        watercolor = c + (specTotal * albedoSpec.a) + highlight * (1 - highTransparency);
+    } else {
+        vec3 c = mix(shadeColor * grayscale, tex.rgb, clamp(lightTotal, 0.0, 1.0));
+        c = mix(vec3(1 - diffuseFactor), c, clamp(lightTotal, 0.0, 1.0));
+        watercolor = c + (specTotal * albedoSpec.a) + highlight * (1 - highTransparency);
+    }
+
+    vec3 wDarkenEdge = watercolor;
+    if (darkEdges > 0) {
+        float dEdges = clamp(nDotV * max(3, 20 / depth), 0.0, 1.0);
+        float darkenedEdges = mix(1, dEdges, darkEdges);
+        wDarkenEdge = mix(watercolor * darkenedEdges, watercolor, clamp(dilute, 0.0, 1.0) + 0.5);
+    }
+
+    vec3 pixel = mix(wDarkenEdge, atmosphereColor.rgb, clamp((depth - rangeStart)/rangeEnd, 0.0, 1.0));
+    FragColor = vec4(clamp(pixel, 0.0, 1.0), 1.0);
+}
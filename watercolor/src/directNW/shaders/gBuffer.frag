@@ -0,0 +1,84 @@
+#version 330 core
+// geometry pass of the deferred path, only the surface attributes are written, the lighting and the watercolor
+// stylization run once per pixel in deferredWatercolor.frag
+layout (location = 0) out vec4 gAlbedoSpec; // rgb albedo, a specular mask
+layout (location = 1) out vec2 gNormal;     // octahedral encoded normal
+// MNPR control values, the three rgb sets plus the abstraction set spread over the alpha channels
+layout (location = 2) out vec4 gPigmentCtrl;   // rgb pigment, a abstraction.r
+layout (location = 3) out vec4 gSubstrateCtrl; // rgb substrate, a abstraction.g
+layout (location = 4) out vec4 gEdgeCtrl;      // rgb edge, a abstraction.b
+
+// vertex output
+in vec4 vColor0, vColor1, vColor2;
+in vec3 normalWorld;
+in vec3 tangentWorld;
+in vec3 binormalWorld;
+in vec2 texCoordF;
+
+// the material switches, constants in the variants of shaderPermutations.h and uniforms in the uber shader
+#ifndef USE_NORMAL_MAPPING
+uniform bool useNormalMapping;
+#define USE_NORMAL_MAPPING useNormalMapping
+#endif
+#ifndef USE_SPECULAR_MAPPING
+uniform bool useSpecularMapping;
+#define USE_SPECULAR_MAPPING useSpecularMapping
+#endif
+#ifndef USE_COLOR_MAPPING
+uniform bool useColorMapping;
+#define USE_COLOR_MAPPING useColorMapping
+#endif
+// material textures
+uniform sampler2D texture_diffuse1;
+uniform sampler2D texture_specular1;
+uniform sampler2D texture_normal1;
+#ifndef FLIP_U
+uniform bool flipU;
+#define FLIP_U flipU
+#endif
+#ifndef FLIP_V
+uniform bool flipV;
+#define FLIP_V flipV
+#endif
+uniform float bumpDepth;
+uniform vec3 colorTint;
+
+vec2 octahedralEncode(vec3 n) {
+   n /= abs(n.x) + abs(n.y) + abs(n.z);
+   vec2 wrapped = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+   return n.z >= 0.0 ? n.xy : wrapped;
+}
+
+void main()
+{
+   vec3 normal = normalize(normalWorld);
+
+   // normal mapping
+   if (USE_NORMAL_MAPPING) {
+      mat3 local2WorldTranspose = mat3(tangentWorld, binormalWorld, normalWorld);
+      // fix normal range: rgb sampled value is in the range [0,1], but xyz normal vectors are in the range [-1,1]
+      vec3 normalMap = texture(texture_normal1, texCoordF).rgb * 2.0 - 1.0;
+      if (FLIP_U)
+         normalMap.r = -normalMap.r;
+      if (FLIP_V)
+         normalMap.g = -normalMap.g;
+      normalMap.rg *= bumpDepth;
+      normal = normalize(normalMap * local2WorldTranspose);
+   }
+
+   //specular mapping
+   float specularMask = 1.0;
+   if (USE_SPECULAR_MAPPING)
+      specularMask = dot(texture(texture_specular1, texCoordF).rgb, vec3(1.0 / 3.0));
+
+   // texture mapping
+   vec3 albedo = colorTint;
+   if (USE_COLOR_MAPPING)
+      albedo *= texture(texture_diffuse1, texCoordF).rgb;
+
+   gAlbedoSpec = vec4(albedo, specularMask);
+   gNormal = octahedralEncode(normal);
+   gPigmentCtrl = vec4(vColor0.rgb, vColor0.a);
+   gSubstrateCtrl = vec4(vColor1.rgb, vColor1.a);
+   gEdgeCtrl = vec4(vColor2.rgb, vColor2.a);
+}
@@ -0,0 +1,110 @@
+#version 330 core
+// writes the g-buffer from the baked views, blended with the weights of impostor.vert
+layout (location = 0) out vec4 gAlbedoSpec;
+layout (location = 1) out vec2 gNormal;
+layout (location = 2) out vec4 gPigmentCtrl;
+layout (location = 3) out vec4 gSubstrateCtrl;
+layout (location = 4) out vec4 gEdgeCtrl;
+
+#define IMPOSTOR_GRID 8        // must match impostor.h
+#define IMPOSTOR_FRAME_SIZE 128
+
+flat in ivec2 frame0, frame1, frame2;
+flat in vec3 frameWeights;
+flat in vec4 instanceData;
+in vec2 frameUV0, frameUV1, frameUV2;
+
+uniform sampler2D impostorAlbedoSpec;
+uniform sampler2D impostorNormal;
+uniform sampler2D impostorPigmentCtrl;
+uniform sampler2D impostorSubstrateCtrl;
+uniform sampler2D impostorEdgeCtrl;
+uniform sampler2D impostorDepth;
+
+uniform mat4 projection;
+uniform mat4 view;
+uniform vec3 boundsCenter;
+uniform float boundsRadius;
+
+vec2 octahedralEncode(vec3 n) {
+   n /= abs(n.x) + abs(n.y) + abs(n.z);
+   vec2 wrapped = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+   return n.z >= 0.0 ? n.xy : wrapped;
+}
+
+vec3 octahedralDecode(vec2 e) {
+   vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+   if (n.z < 0.0)
+      n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+   return normalize(n);
+}
+
+mat3 headingRotation(float heading) {
+   float c = cos(heading), s = sin(heading);
+   return mat3(c, 0.0, -s, 0.0, 1.0, 0.0, s, 0.0, c);
+}
+
+vec3 frameDirection(ivec2 frame) {
+   vec2 e = vec2(frame) / float(IMPOSTOR_GRID - 1) * 2.0 - 1.0;
+   vec3 d = vec3((e.x - e.y) * 0.5, 0.0, (e.x + e.y) * 0.5);
+   d.y = 1.0 - abs(d.x) - abs(d.z);
+   return normalize(d);
+}
+
+void frameBasis(vec3 direction, out vec3 right, out vec3 up) {
+   vec3 reference = abs(direction.y) > 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(0.0, 1.0, 0.0);
+   right = normalize(cross(reference, direction));
+   up = cross(direction, right);
+}
+
+// accumulated over the views
+vec4 albedoSpec, pigmentCtrl, substrateCtrl, edgeCtrl;
+vec3 normal, surface;
+float coverage;
+
+void addFrame(ivec2 frame, vec2 uv, float weight) {
+   if (weight <= 0.0 || any(lessThan(uv, vec2(0.0))) || any(greaterThan(uv, vec2(1.0))))
+      return;
+   // half a texel inside the view, the linear filter must not reach into the neighbours
+   vec2 texel = vec2(0.5 / IMPOSTOR_FRAME_SIZE);
+   vec2 atlasUV = (vec2(frame) + clamp(uv, texel, 1.0 - texel)) / float(IMPOSTOR_GRID);
+   float depth = texture(impostorDepth, atlasUV).r;
+   if (depth >= 1.0)
+      return;
+   // back onto the surface along the ray of the view, the depth spans the bounding sphere
+   vec3 direction = frameDirection(frame), right, up;
+   frameBasis(direction, right, up);
+   vec2 planar = (uv * 2.0 - 1.0) * boundsRadius;
+   surface += weight * (boundsCenter + right * planar.x + up * planar.y - direction * (depth * 2.0 - 1.0) * boundsRadius);
+   albedoSpec += weight * texture(impostorAlbedoSpec, atlasUV);
+   normal += weight * octahedralDecode(texture(impostorNormal, atlasUV).rg);
+   pigmentCtrl += weight * texture(impostorPigmentCtrl, atlasUV);
+   substrateCtrl += weight * texture(impostorSubstrateCtrl, atlasUV);
+   edgeCtrl += weight * texture(impostorEdgeCtrl, atlasUV);
+   coverage += weight;
+}
+
+void main()
+{
+   albedoSpec = pigmentCtrl = substrateCtrl = edgeCtrl = vec4(0.0);
+   normal = surface = vec3(0.0);
+   coverage = 0.0;
+   addFrame(frame0, frameUV0, frameWeights.x);
+   addFrame(frame1, frameUV1, frameWeights.y);
+   addFrame(frame2, frameUV2, frameWeights.z);
+   // the silhouette is where most of the blended views cover the pixel
+   if (coverage < 0.5)
+      discard;
+
+   mat3 rotation = headingRotation(instanceData.w);
+   vec3 normalWorld = rotation * normalize(normal);
+   vec3 surfaceWorld = instanceData.xyz + rotation * (surface / coverage);
+   // same spaces as watercolor.vert, the normal is multiplied with the view and the position with the projection
+   gNormal = octahedralEncode(normalize((vec4(normalWorld, 0.0) * view).xyz));
+   gAlbedoSpec = albedoSpec / coverage;
+   gPigmentCtrl = pigmentCtrl / coverage;
+   gSubstrateCtrl = substrateCtrl / coverage;
+   gEdgeCtrl = edgeCtrl / coverage;
+   vec4 clip = vec4(surfaceWorld, 1.0) * projection;
+   gl_FragDepth = clip.z / clip.w * 0.5 + 0.5;
+}
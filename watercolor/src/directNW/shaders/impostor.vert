@@ -0,0 +1,80 @@
+#version 330 core
+// camera facing quad of an impostor instance, picks the three baked views around the view direction
+layout (location = 0) in vec2 corner;   // -1 to 1
+layout (location = 1) in vec4 instance; // xyz position, w heading around y
+
+#define IMPOSTOR_GRID 8 // must match impostor.h
+
+uniform mat4 projection; // multiplied transposed, like watercolor.vert does
+uniform vec3 eyePosition;
+uniform vec3 boundsCenter; // bounding sphere of the baked model, in model space
+uniform float boundsRadius;
+
+flat out ivec2 frame0, frame1, frame2;
+flat out vec3 frameWeights;
+flat out vec4 instanceData;
+out vec2 frameUV0, frameUV1, frameUV2; // inside each view, 0 to 1 over the bounding sphere
+
+mat3 headingRotation(float heading) {
+    float c = cos(heading), s = sin(heading);
+    return mat3(c, 0.0, -s, 0.0, 1.0, 0.0, s, 0.0, c);
+}
+
+// hemi-octahedral mapping of the upper hemisphere to -1..1, the same as frameDirection in impostor.h
+vec2 hemiOctahedralEncode(vec3 d) {
+    d.y = max(d.y, 0.0);
+    d /= abs(d.x) + abs(d.y) + abs(d.z);
+    return vec2(d.x + d.z, d.z - d.x);
+}
+
+vec3 frameDirection(ivec2 frame) {
+    vec2 e = vec2(frame) / float(IMPOSTOR_GRID - 1) * 2.0 - 1.0;
+    vec3 d = vec3((e.x - e.y) * 0.5, 0.0, (e.x + e.y) * 0.5);
+    d.y = 1.0 - abs(d.x) - abs(d.z);
+    return normalize(d);
+}
+
+void frameBasis(vec3 direction, out vec3 right, out vec3 up) {
+    vec3 reference = abs(direction.y) > 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(0.0, 1.0, 0.0);
+    right = normalize(cross(reference, direction));
+    up = cross(direction, right);
+}
+
+// where the quad point lands in a view, orthographic along the view direction
+vec2 frameUV(ivec2 frame, vec3 p) {
+    vec3 right, up;
+    frameBasis(frameDirection(frame), right, up);
+    return vec2(dot(p, right), dot(p, up)) / boundsRadius * 0.5 + 0.5;
+}
+
+void main() {
+    mat3 rotation = headingRotation(instance.w);
+    vec3 centerWorld = instance.xyz + rotation * boundsCenter;
+    vec3 toEye = normalize(eyePosition - centerWorld);
+
+    // the quad faces the eye and covers the bounding sphere
+    vec3 right, up;
+    frameBasis(toEye, right, up);
+    vec3 cornerWorld = centerWorld + (right * corner.x + up * corner.y) * boundsRadius;
+    gl_Position = vec4(cornerWorld, 1.0) * projection;
+
+    // the three views around the view direction and their barycentric weights
+    vec3 toEyeModel = transpose(rotation) * toEye;
+    vec2 grid = (hemiOctahedralEncode(toEyeModel) * 0.5 + 0.5) * float(IMPOSTOR_GRID - 1);
+    vec2 base = clamp(floor(grid), 0.0, float(IMPOSTOR_GRID - 2));
+    vec2 f = clamp(grid - base, 0.0, 1.0);
+    ivec2 b = ivec2(base);
+    if (f.x + f.y < 1.0) {
+        frame0 = b; frame1 = b + ivec2(1, 0); frame2 = b + ivec2(0, 1);
+        frameWeights = vec3(1.0 - f.x - f.y, f.x, f.y);
+    } else {
+        frame0 = b + ivec2(1, 1); frame1 = b + ivec2(0, 1); frame2 = b + ivec2(1, 0);
+        frameWeights = vec3(f.x + f.y - 1.0, 1.0 - f.x, 1.0 - f.y);
+    }
+
+    vec3 p = transpose(rotation) * (cornerWorld - instance.xyz) - boundsCenter;
+    frameUV0 = frameUV(frame0, p);
+    frameUV1 = frameUV(frame1, p);
+    frameUV2 = frameUV(frame2, p);
+    instanceData = instance;
+}
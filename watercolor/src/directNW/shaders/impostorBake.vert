@@ -0,0 +1,28 @@
+#version 330 core
+// renders the views of an impostor into the atlas with gBuffer.frag, the "world" outputs are in model space here
+layout (location = 0) in vec3 vertex;
+layout (location = 1) in vec3 normal;
+layout (location = 2) in vec2 textCoord;
+layout (location = 3) in vec3 vTangent;
+
+uniform vec4 inColor0, inColor1, inColor2;
+uniform mat4 model;              // of the part inside the baked model, rotation and translation only
+uniform mat4 bakeViewProjection; // orthographic camera of the view
+
+out vec4 vColor0, vColor1, vColor2;
+out vec3 normalWorld;
+out vec3 tangentWorld;
+out vec3 binormalWorld;
+out vec2 texCoordF;
+
+void main() {
+    vColor0 = inColor0;
+    vColor1 = inColor1;
+    vColor2 = inColor2;
+    texCoordF = vec2(textCoord.x, 1.0 - textCoord.y);
+    mat3 rotation = mat3(model);
+    normalWorld = normalize(rotation * normal);
+    tangentWorld = normalize(rotation * vTangent);
+    binormalWorld = normalize(cross(normalWorld, tangentWorld));
+    gl_Position = bakeViewProjection * model * vec4(vertex, 1.0);
+}
@@ -0,0 +1,20 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+// weighted blended transparency targets, see weightedOIT.h
+uniform sampler2D accumTexture;  // rgb weighted premultiplied color, a revealage
+uniform sampler2D weightTexture; // r weighted coverage
+
+void main()
+{
+    vec4 accum = texture(accumTexture, TexCoords);
+    float revealage = accum.a;
+    // nothing transparent in front of the opaque surface
+    if (revealage >= 1.0)
+        discard;
+    float weight = texture(weightTexture, TexCoords).r;
+    vec3 average = accum.rgb / max(weight, 1e-5);
+    FragColor = vec4(average, 1.0 - revealage);
+}
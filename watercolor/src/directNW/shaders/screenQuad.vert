@@ -7,5 +7,5 @@ out vec2 TexCoords;
 void main()
 {
     TexCoords = aTexCoords;
-    gl_Position = vec4(aPos.xy, 0.0, 1.0);
-}
\ No newline at end of file
+    gl_Position = vec4(aPos.x, aPos.y, 0.0, 1.0);
+}
@@ -0,0 +1,14 @@
+#version 330 core
+// depth of the shadow casters as a light sees them, see shadowMaps.h
+layout (location = 0) in vec3 vertex; // quantized or not, see Mesh::DrawPositions
+
+uniform mat4 lightViewProjection;
+uniform mat4 model;
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+
+void main()
+{
+    vec3 position = positionOffset + positionScale * vertex;
+    gl_Position = lightViewProjection * model * vec4(position, 1.0);
+}
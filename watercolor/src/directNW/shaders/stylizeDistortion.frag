@@ -0,0 +1,25 @@
+#version 330 core
+// MNPR substrate distortion, see stylization.h. The image moves down the slopes of the substrate like the paint on
+// rough paper
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D colorTexture;
+uniform sampler2D substrateCtrl; // r distortion
+uniform sampler2D substrate;     // r height
+uniform vec2 substrateScale;     // a substrate texel per pixel
+uniform vec2 texelSize;
+uniform float distortion;        // pixels
+
+void main()
+{
+    vec2 uv = TexCoords * substrateScale;
+    vec2 step = 1.0 / vec2(textureSize(substrate, 0));
+    float height = texture(substrate, uv).r;
+    // the height changes by a few hundredths between texels, the steep slopes move the full distance
+    vec2 slope = vec2(texture(substrate, uv + vec2(step.x, 0.0)).r - height,
+                      texture(substrate, uv + vec2(0.0, step.y)).r - height) * 20.0;
+    float amount = texture(substrateCtrl, TexCoords).r * distortion;
+    FragColor = texture(colorTexture, TexCoords - clamp(slope, -1.0, 1.0) * amount * texelSize);
+}
@@ -0,0 +1,33 @@
+#version 330 core
+// one direction of the gaussian of the MNPR edge darkening, see stylization.h. Runs at half resolution, the first
+// pass turns the scene into luminance and linear depth, the second blurs the result of the first
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D source;
+uniform sampler2D depthTexture;
+uniform bool fromScene;
+uniform vec2 direction; // the step between the taps in texture coordinates
+uniform float zNear;
+uniform float zFar;
+
+const float WEIGHTS[5] = float[](0.2270270, 0.1945946, 0.1216216, 0.0540541, 0.0162162);
+
+vec2 lumaDepth(vec2 uv) {
+    if (!fromScene)
+        return texture(source, uv).rg;
+    float luma = dot(texture(source, uv).rgb, vec3(0.2989, 0.5870, 0.1140));
+    // view distance over the far plane, the background is 1
+    float depth = texture(depthTexture, uv).r * 2.0 - 1.0;
+    float linearDepth = 2.0 * zNear * zFar / (zFar + zNear - depth * (zFar - zNear)) / zFar;
+    return vec2(luma, linearDepth);
+}
+
+void main()
+{
+    vec2 sum = lumaDepth(TexCoords) * WEIGHTS[0];
+    for (int i = 1; i < 5; i++)
+        sum += (lumaDepth(TexCoords + direction * i) + lumaDepth(TexCoords - direction * i)) * WEIGHTS[i];
+    FragColor = vec4(sum, 0.0, 1.0);
+}
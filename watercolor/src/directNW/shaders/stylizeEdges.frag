@@ -0,0 +1,27 @@
+#version 330 core
+// MNPR edge darkening, see stylization.h. The difference of the pixel to its blurred surroundings finds the edges of
+// the colors and of the depth, where the pigment collects at the border of a wash
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D colorTexture;
+uniform sampler2D blurTexture; // luminance and linear depth, blurred at half resolution
+uniform sampler2D depthTexture;
+uniform sampler2D edgeCtrl;    // r intensity
+uniform float edgeIntensity;
+uniform float zNear;
+uniform float zFar;
+
+void main()
+{
+    vec4 color = texture(colorTexture, TexCoords);
+    vec2 blurred = texture(blurTexture, TexCoords).rg;
+    float luma = dot(color.rgb, vec3(0.2989, 0.5870, 0.1140));
+    float depth = texture(depthTexture, TexCoords).r * 2.0 - 1.0;
+    float linearDepth = 2.0 * zNear * zFar / (zFar + zNear - depth * (zFar - zNear)) / zFar;
+    // the depth differences are small fractions of the far plane
+    float edge = clamp(abs(luma - blurred.r) * 4.0 + abs(linearDepth - blurred.g) * 50.0, 0.0, 1.0);
+    float darkening = edge * texture(edgeCtrl, TexCoords).r * edgeIntensity * 3.0;
+    FragColor = vec4(pow(color.rgb, vec3(1.0 + darkening)), color.a);
+}
@@ -0,0 +1,19 @@
+#version 330 core
+// MNPR granulation, see stylization.h. The pigment settles in the valleys of the substrate and gets denser there
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D colorTexture;
+uniform sampler2D pigmentCtrl; // g granulation
+uniform sampler2D substrate;   // r height
+uniform vec2 substrateScale;   // a substrate texel per pixel
+uniform float granulation;
+
+void main()
+{
+    vec4 color = texture(colorTexture, TexCoords);
+    float height = texture(substrate, TexCoords * substrateScale).r;
+    float amount = texture(pigmentCtrl, TexCoords).g * granulation * (1.0 - height) * 2.0;
+    FragColor = vec4(pow(color.rgb, vec3(1.0 + amount)), color.a);
+}
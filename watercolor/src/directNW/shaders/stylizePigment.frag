@@ -0,0 +1,17 @@
+#version 330 core
+// MNPR pigment density, see stylization.h. The color darkens and saturates towards its square with the density,
+// white paper stays white
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D colorTexture;
+uniform sampler2D pigmentCtrl; // b density
+uniform float density;
+
+void main()
+{
+    vec4 color = texture(colorTexture, TexCoords);
+    float amount = texture(pigmentCtrl, TexCoords).b * density;
+    FragColor = vec4(pow(color.rgb, vec3(1.0 + amount)), color.a);
+}
@@ -15,29 +15,40 @@ in vec3 binormalWorld;
 in vec3 lightDir;
 in vec3 viewDir;
 in vec3 velocityDepth;
-in vec2 texture;
+in vec2 texCoordF;
 in float nDotV;
 
-out vec4 FragColor;
-out vec4 diffuseOut;
-out vec4 specularOut;
-out vec4 pigmentCtrlOut;
-out vec4 substrateCtrlOut;
-out vec4 edgeCtrlOut;
-out vec4 abstractionCtrlOut;
-out vec2 velocityOut;
+layout (location = 0) out vec4 FragColor;
+layout (location = 1) out vec4 OitWeight; // only bound in the transparency pass
+// the MNPR control values go to the g-buffer (gBuffer.frag), the stylization passes read them from there
 
+// the material switches, constants in the variants of shaderPermutations.h and uniforms in the uber shader
+#ifndef USE_NORMAL_MAPPING
 uniform bool useNormalMapping;
+#define USE_NORMAL_MAPPING useNormalMapping
+#endif
+#ifndef USE_SPECULAR_MAPPING
 uniform bool useSpecularMapping;
+#define USE_SPECULAR_MAPPING useSpecularMapping
+#endif
+#ifndef USE_COLOR_MAPPING
 uniform bool useColorMapping;
+#define USE_COLOR_MAPPING useColorMapping
+#endif
 // material textures
 uniform sampler2D texture_diffuse;
 uniform sampler2D texture_specular;
 uniform sampler2D texture_normal;
 uniform sampler2D texture_ambient;
 //uniform float normalMappingMix;
+#ifndef FLIP_U
 uniform bool flipU;
+#define FLIP_U flipU
+#endif
+#ifndef FLIP_V
 uniform bool flipV;
+#define FLIP_V flipV
+#endif
 uniform float bumpDepth;
 uniform vec3 colorTint;
 //lights
@@ -60,61 +71,66 @@ uniform vec3 paperColor;
 uniform float highArea;
 uniform float highTransparency;
 uniform float darkEdges;
+#ifndef USE_OVERRIDE_SHADE
 uniform bool useOverrideShade;
+#define USE_OVERRIDE_SHADE useOverrideShade
+#endif
 uniform vec3 shadeColor;
 uniform float diffuseFactor;
 uniform vec3 atmosphereColor;
 uniform float rangeStart;
 uniform float rangeEnd;
+// mix(x, pow(x, 2.2), clamp(cangiante - dilute, 0, 1)) for x in [0, DILUTE_RANGE], baked by bakeLuts in main.cpp
+uniform sampler2D diluteCurve;
+const float DILUTE_RANGE = 4.0;
+
+float lutCoord(float x, sampler2D lut) {
+    float size = float(textureSize(lut, 0).x);
+    return (clamp(x, 0.0, 1.0) * (size - 1.0) + 0.5) / size;
+}
+// the windows go to the weighted blended targets, see weightedOIT.h
+uniform bool oitPass;
 
 void main()
 {
    vec3 pixel = vec3(0);
    float transparency = 1.0f;
 
-   vec4 control1 = vec4(vColor0.rgb, transparency);
-   vec4 control2 = vec4(vColor1.rgb, transparency);
-   vec4 control3 = vec4(vColor2.rgb, transparency);
-   vec4 control4 = vec4(vColor0.a, vColor1.a, vColor2.a, transparency);
-
    vec3 nomrmalWorldFrag = normalize(normalWorld);
 
    // normal mapping
-   if (useNormalMapping) {
+   if (USE_NORMAL_MAPPING) {
       vec3 tangentWorldFrag = normalize(tangentWorld);
       vec3 binormalWorldFrag = normalize(binormalWorld);
 
       mat3 local2WorldTranspose = mat3(tangentWorld, binormalWorld, normalWorld);
       // retrieve texelfrom texture
       // fix normal range: rgb sampled value is in the range [0,1], but xyz normal vectors are in the range [-1,1]
-      vec3 normalMap = texture(texture_normal, texture).rgb * 2.0 - 1.0;
-      // mix the vertex normal and the normal map texture so we can visualize
-      // the difference with normal mapping
-      normalMap = normalize(mix(fs_in.Norm_tangent, N, normalMappingMix));
-      if (flipU){
+      vec3 normalMap = texture(texture_normal, texCoordF).rgb * 2.0 - 1.0;
+      if (FLIP_U){
          normalMap.r = -normalMap.r;
       }
-      if (flipV)
+      if (FLIP_V)
       {
-         normalMap.g = normalMap.g;
+         normalMap.g = -normalMap.g;
       }
       normalMap.rg *= bumpDepth;
-      vec3 normalWorldFrag = normalize(normalMap * local2WorldTranspose);
+      nomrmalWorldFrag = normalize(normalMap * local2WorldTranspose);
 //      normalMap = normalize(TBN * normalMap);
 //      gNormal = normalize(mix(normalize(Normal), normalMap, normalMappingMix));
    }
 
    //specular mapping
    vec4 specularMap = vec4(1.0);
-   if (useSpecularMapping) {
-      specularMap = texture(texture_specular, texture);
+   if (USE_SPECULAR_MAPPING) {
+      specularMap = texture(texture_specular, texCoordF);
    }
 
    // texture mapping
    vec3 tex = colorTint;
    float grayscale = 1.0;
-   if (useColorMapping) {
-      vec4 sampledPixel = texture(texture_diffuse, texture);
+   if (USE_COLOR_MAPPING) {
+      vec4 sampledPixel = texture(texture_diffuse, texCoordF);
       tex *= sampledPixel.rgb;
       transparency = sampledPixel.a;
       grayscale = 0.2989 * tex.r + 0.5870 * tex.g + 0.1140 * tex.b;
@@ -126,20 +142,25 @@ void main()
    vec3 diluteTotal = l1Dilute + l2Dilute + l3Dilute;
    float shade = l1Shade + l2Shade + l3Shade;
 
-   diluteTotal = mix(diluteTotal, pow(diluteTotal, vec3(2.2)), clamp(-1 * dilute + cangiante, 0.0, 1.0));
+   // the lights dilute all channels alike, one fetch of the curve. More lights than the table covers add up past
+   // its range, those pixels evaluate the curve
+   if (diluteTotal.r <= DILUTE_RANGE)
+       diluteTotal = vec3(texture(diluteCurve, vec2(lutCoord(diluteTotal.r / DILUTE_RANGE, diluteCurve), 0.5)).r);
+   else
+       diluteTotal = mix(diluteTotal, pow(diluteTotal, vec3(2.2)), clamp(-1 * dilute + cangiante, 0.0, 1.0));
 
    vec3 highlight = vec3(0);
    if (shade < 1.0) {
       tex.rgb = tex.rgb + clamp(diluteTotal * cangiante, 0.0, 1.0);
       tex.rgb = mix(tex.rgb, paperColor, diluteTotal * dilute);
       if (highArea > 0) {
-         highlight = (max(1 - highArea.xxx, diluteTotal) - (1- highArea.xxx))*800/velocityDepth.z;
+         highlight = (max(vec3(1 - highArea), diluteTotal) - vec3(1 - highArea))*800/velocityDepth.z;
          highlight = clamp(mix(-highlight*darkEdges, highlight, trunc(highlight)), 0.0, 1.0); //highlight darkened edges
       }
    }
 
    vec3 watercolor = vec3(0);
-   if (useOverrideShade) {
+   if (USE_OVERRIDE_SHADE) {
       vec3 c = mix(shadeColor, tex.rgb, clamp(lightTotal, 0.0, 1.0));
       watercolor = c + (specTotal * specularMap.rgb) + highlight * (1 - highTransparency);
    } else {
@@ -159,13 +180,14 @@ void main()
 
    vec3 controlledColor = wDarkenEdge;
 
-   vec2 velocity = velocityDepth.xy;
    pixel = mix(controlledColor, atmosphereColor.rgb, clamp((velocityDepth.z - rangeStart)/rangeEnd, 0.0, 1.0));
 
    FragColor = vec4(clamp(pixel, 0.0, 1.0), transparency);
-   pigmentCtrlOut = vec4(control1.xyz, 1);
-   substrateCtrlOut = vec4(control2.xyz, 1);
-   edgeCtrlOut = vec4(control3.xyz, 1);
-   abstractionCtrlOut = vec4(control4.xyz, 1);
-   velocityOut = velocity;
+   if (oitPass) {
+      // the weight falls off with the view distance, so nearer layers dominate the average
+      float viewDistance = 1.0 / gl_FragCoord.w;
+      float weight = transparency * clamp(10.0 / (1e-5 + pow(viewDistance / 5.0, 2.0) + pow(viewDistance / 200.0, 6.0)), 1e-2, 3e3);
+      FragColor = vec4(FragColor.rgb * transparency * weight, transparency);
+      OitWeight = vec4(transparency * weight);
+   }
 }
\ No newline at end of file
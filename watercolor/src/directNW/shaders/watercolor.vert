@@ -10,7 +10,7 @@ uniform mat4 view;//world;
 uniform mat4 invTranspose;//worldInvTrans;
 uniform mat4 projection;//worldViewProj;
 uniform mat4 model;
-//uniform mat4 viewInv;
+uniform mat4 viewInv; // inverse(view), evaluated once per frame on the cpu
 uniform vec3 light1Dir;
 uniform float bleedOffset;
 uniform float tremorFront;
@@ -30,17 +30,16 @@ out vec3 binormalWorld;
 out vec3 lightDir;
 out vec3 viewDir;
 out vec3 velocityDepth;
-out vec2 texture;
+out vec2 texCoordF;
 out float nDotV;
 
 void main() {
     vec4 worldPos = model * vec4(vertex, 1.0);//?
-    mat4 viewInv = inverse(view);
     vColor0 = inColor0;
     vColor1 = inColor1;
     vColor2 = inColor2;
     vPreviousScreenPos = inColor3;
-    texture = vec2(textCoord.x, 1.0 - textCoord.y);
+    texCoordF = vec2(textCoord.x, 1.0 - textCoord.y);
     posWorld = (vec4(worldPos.xyz,1) * view).xyz;
     normalWorld = normalize((vec4(normal, 0.0) * view).xyz);
     vec3 mul;// = vTangent * view;
@@ -53,7 +52,7 @@ void main() {
     viewDir = normalize(viewInv[3].xyz - posWorld);
     nDotV = dot(normalWorld, viewDir);
     // main light direction
-    lightDir = normalize(-light1Dir);
+    lightDir = -light1Dir; // normalized on the cpu
     //z-depth
     float depth = distance(posWorld, viewInv[3].xyz);
     //vec4 pos = vec4(worldPos.xyz, 1.0) * projection;
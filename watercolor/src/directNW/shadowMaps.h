@@ -0,0 +1,271 @@
+#ifndef SHADOW_MAPS_H
+#define SHADOW_MAPS_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "shader.h"
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+
+// must match the deferred shader
+const int SHADOW_MAX_LIGHTS = 3;
+const int SHADOW_CASCADES = 3;
+const int SHADOW_LAYERS = SHADOW_MAX_LIGHTS * SHADOW_CASCADES;
+const int SHADOW_SIZE = 2048;
+const int SHADOW_UNIT = 5;
+
+// what a shadow casting light needs, in world space
+struct ShadowLight {
+    int type;            // 2 spot, 4 directional
+    glm::vec3 position;
+    glm::vec3 direction; // the light travels along it
+    float coneAngle;
+    float fallOff;
+    float range;         // far plane of a spot light, <= 0 reaches everywhere
+};
+
+// Shadow maps of up to SHADOW_MAX_LIGHTS spot and directional lights, cascaded for the directional ones. Every layer
+// is a depth texture in an array sampled with hardware PCF.
+// The static casters are rendered into a cache that is only redrawn when the light matrix of the layer changes or the
+// static geometry moved (staticVersion). The dynamic casters are drawn on top of a copy of the cache every frame,
+// without any dynamic caster the cache is sampled directly and a static scene costs nothing after the first frame.
+//
+// usage:
+//   shadows.update(lights, clipToWorld, near, far, staticVersion, hasDynamic, drawCasters); // every frame
+//   shadows.bind(shader);                                                                  // before the lighting pass
+class ShadowMaps {
+public:
+    // statistics of the last update
+    int staticLayersDrawn = 0;
+    int dynamicLayersDrawn = 0;
+    float updateTime = 0.0f; // ms on the cpu
+    float gpuTime = 0.0f;    // ms, of an earlier update, read when its timer query is done
+    float shadowDistance = 30.0f; // the cascades cover the view up to here
+    // view distance where each cascade ends, the next one starts there and the first at zNear. splitCascades sets
+    // them from the practical split, the texel snapping of the light matrices doesn't move them
+    float cascadeEnds[SHADOW_CASCADES];
+
+    ShadowMaps()
+    {
+        staticMaps = createArray();
+        maps = createArray();
+        glGenFramebuffers(1, &framebuffer);
+        glGenFramebuffers(1, &copyFramebuffer);
+        glGenQueries(1, &timer);
+        for (int i = 0; i < SHADOW_LAYERS; i++)
+            cached[i] = false;
+        depthShader = new Shader("shaders/shadowDepth.vert", "shaders/shadowDepth.frag");
+    }
+
+    ~ShadowMaps()
+    {
+        delete depthShader;
+        glDeleteTextures(1, &staticMaps);
+        glDeleteTextures(1, &maps);
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteFramebuffers(1, &copyFramebuffer);
+        glDeleteQueries(1, &timer);
+    }
+
+    // drawCasters(shader, dynamic) draws the static or the dynamic casters with the model uniform of the shader set
+    void update(const std::vector<ShadowLight> &lights, const glm::mat4 &clipToWorld, float zNear, float zFar,
+                unsigned int staticVersion, bool hasDynamic, const std::function<void(Shader &, bool)> &drawCasters)
+    {
+        double start = glfwGetTime();
+        staticLayersDrawn = 0;
+        dynamicLayersDrawn = 0;
+        lightCount = std::min((int) lights.size(), SHADOW_MAX_LIGHTS);
+        dynamic = hasDynamic;
+        splitCascades(zNear, zFar);
+        // one measurement at a time, never waits for the result
+        if (timerPending) {
+            GLint available = 0;
+            glGetQueryObjectiv(timer, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available) {
+                GLuint64 elapsed = 0;
+                glGetQueryObjectui64v(timer, GL_QUERY_RESULT, &elapsed);
+                gpuTime = (float) elapsed / 1000000.0f;
+                timerPending = false;
+            }
+        }
+        bool measure = !timerPending;
+        if (measure)
+            glBeginQuery(GL_TIME_ELAPSED, timer);
+
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glViewport(0, 0, SHADOW_SIZE, SHADOW_SIZE);
+        depthShader->use();
+        // slope scaled bias while rendering, the constant one is applied by the lookup
+        glEnable(GL_POLYGON_OFFSET_FILL);
+        glPolygonOffset(2.0f, 4.0f);
+        for (int light = 0; light < lightCount; light++) {
+            int layers = lights[light].type == 4 ? SHADOW_CASCADES : 1;
+            for (int cascade = 0; cascade < layers; cascade++) {
+                int layer = light * SHADOW_CASCADES + cascade;
+                glm::mat4 matrix = lightMatrix(lights[light], cascade, clipToWorld, zNear, zFar);
+                bool valid = cached[layer] && cachedVersion[layer] == staticVersion &&
+                             memcmp(&cachedMatrix[layer], &matrix, sizeof(glm::mat4)) == 0;
+                if (!valid) {
+                    renderLayer(staticMaps, layer, matrix, false, drawCasters);
+                    cached[layer] = true;
+                    cachedVersion[layer] = staticVersion;
+                    cachedMatrix[layer] = matrix;
+                    staticLayersDrawn++;
+                }
+                matrices[layer] = matrix;
+                if (dynamic) {
+                    copyLayer(layer);
+                    renderLayer(maps, layer, matrix, true, drawCasters);
+                    dynamicLayersDrawn++;
+                }
+            }
+        }
+        glDisable(GL_POLYGON_OFFSET_FILL);
+        if (measure) {
+            glEndQuery(GL_TIME_ELAPSED);
+            timerPending = true;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        updateTime = (float) (glfwGetTime() - start) * 1000.0f;
+    }
+
+    void bind(Shader &shader) const
+    {
+        shader.setInt("shadowMaps", SHADOW_UNIT);
+        for (int i = 0; i < SHADOW_LAYERS; i++)
+            shader.setMat4("shadowMatrices[" + std::to_string(i) + "]", matrices[i]);
+        shader.setVec3("cascadeEnds", glm::vec3(cascadeEnds[0], cascadeEnds[1], cascadeEnds[2]));
+        glActiveTexture(GL_TEXTURE0 + SHADOW_UNIT);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, dynamic ? maps : staticMaps);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+private:
+    unsigned int staticMaps, maps;
+    unsigned int framebuffer, copyFramebuffer;
+    unsigned int timer;
+    bool timerPending = false;
+    Shader *depthShader;
+    int lightCount = 0;
+    bool dynamic = false;
+    glm::mat4 matrices[SHADOW_LAYERS];
+    // cache of the static layers
+    bool cached[SHADOW_LAYERS];
+    unsigned int cachedVersion[SHADOW_LAYERS];
+    glm::mat4 cachedMatrix[SHADOW_LAYERS];
+
+    static unsigned int createArray()
+    {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, SHADOW_SIZE, SHADOW_SIZE, SHADOW_LAYERS, 0,
+                     GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+        // linear filtering with the compare mode gives 2x2 pcf in hardware
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+        float border[] = {1.0f, 1.0f, 1.0f, 1.0f};
+        glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+        return texture;
+    }
+
+    // practical split scheme, a mix of uniform and logarithmic splits
+    void splitCascades(float zNear, float zFar)
+    {
+        float end = std::min(shadowDistance, zFar);
+        for (int i = 0; i < SHADOW_CASCADES; i++) {
+            float t = (float) (i + 1) / SHADOW_CASCADES;
+            float logarithmic = zNear * std::pow(end / zNear, t);
+            float uniform = zNear + (end - zNear) * t;
+            cascadeEnds[i] = 0.75f * logarithmic + 0.25f * uniform;
+        }
+    }
+
+    // ndc depth of a view distance, the inverse of what the deferred shader does with the depth
+    static float ndcDepth(float distance, float zNear, float zFar)
+    {
+        return ((zFar + zNear) - 2.0f * zFar * zNear / distance) / (zFar - zNear);
+    }
+
+    glm::mat4 lightMatrix(const ShadowLight &light, int cascade, const glm::mat4 &clipToWorld, float zNear, float zFar) const
+    {
+        glm::vec3 direction = glm::normalize(light.direction);
+        glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(1, 0, 0) : glm::vec3(0, 1, 0);
+        if (light.type != 4) {
+            float angle = std::max(light.coneAngle, light.fallOff);
+            float fov = glm::clamp(2.0f * angle, 0.1f, 3.0f);
+            glm::mat4 view = glm::lookAt(light.position, light.position + direction, up);
+            // without a range the spot light reaches everywhere, the default lights stand far from the car
+            return glm::perspective(fov, 1.0f, 0.5f, light.range > 0.0f ? light.range : 500.0f) * view;
+        }
+
+        // bound the slice of the view frustum of the cascade
+        float sliceNear = ndcDepth(cascade == 0 ? zNear : cascadeEnds[cascade - 1], zNear, zFar);
+        float sliceFar = ndcDepth(cascadeEnds[cascade], zNear, zFar);
+        glm::vec3 corners[8];
+        glm::vec3 center(0.0f);
+        for (int i = 0; i < 8; i++) {
+            glm::vec4 p = clipToWorld * glm::vec4((i & 1) ? 1.0f : -1.0f, (i & 2) ? 1.0f : -1.0f, (i & 4) ? sliceFar : sliceNear, 1.0f);
+            corners[i] = glm::vec3(p) / p.w;
+            center += corners[i] / 8.0f;
+        }
+        // a sphere around the slice keeps the size fixed while the camera turns, the casters in front of it are
+        // caught by pulling the near plane back
+        float radius = 0.0f;
+        for (int i = 0; i < 8; i++)
+            radius = std::max(radius, glm::length(corners[i] - center));
+        radius = std::ceil(radius * 16.0f) / 16.0f;
+        glm::mat4 view = glm::lookAt(center - direction * radius, center, up);
+        // snap the origin to whole texels, the depth included, so the matrix and with it the cached layers stay
+        // the same while the slice only moves a little; the far plane gets one texel for the depth snap
+        float texel = 2.0f * radius / SHADOW_SIZE;
+        glm::vec4 origin = view * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        glm::vec3 snap = glm::vec3(std::round(origin.x / texel) * texel, std::round(origin.y / texel) * texel,
+                                   std::round(origin.z / texel) * texel) - glm::vec3(origin);
+        view = glm::translate(glm::mat4(1.0f), snap) * view;
+        return glm::ortho(-radius, radius, -radius, radius, -50.0f, 2.0f * radius + texel) * view;
+    }
+
+    void renderLayer(unsigned int texture, int layer, const glm::mat4 &matrix, bool dynamic,
+                     const std::function<void(Shader &, bool)> &drawCasters)
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, layer);
+        glDrawBuffer(GL_NONE);
+        glReadBuffer(GL_NONE);
+        if (!dynamic)
+            glClear(GL_DEPTH_BUFFER_BIT);
+        depthShader->use();
+        depthShader->setMat4("lightViewProjection", matrix);
+        drawCasters(*depthShader, dynamic);
+    }
+
+    // the dynamic casters start from the cached static depth
+    void copyLayer(int layer)
+    {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, copyFramebuffer);
+        glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticMaps, 0, layer);
+        glReadBuffer(GL_NONE);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+        glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, maps, 0, layer);
+        glDrawBuffer(GL_NONE);
+        glBlitFramebuffer(0, 0, SHADOW_SIZE, SHADOW_SIZE, 0, 0, SHADOW_SIZE, SHADOW_SIZE, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+    }
+};
+#endif
@@ -0,0 +1,309 @@
+#ifndef STYLIZATION_H
+#define STYLIZATION_H
+
+#include <glad/glad.h>
+
+#include <shader.h>
+
+#include <iostream>
+
+enum StylizationPass {
+    STYLIZE_PIGMENT_DENSITY,
+    STYLIZE_EDGE_BLUR_X,
+    STYLIZE_EDGE_BLUR_Y,
+    STYLIZE_EDGE_DARKENING,
+    STYLIZE_GRANULATION,
+    STYLIZE_SUBSTRATE_DISTORTION,
+    STYLIZE_PASSES
+};
+
+// The image space half of MNPR watercolor (Montesdeoca et al.): full screen passes after the lighting that read the
+// control targets of the g-buffer, a control value of 0 (the background) leaves the pixel alone:
+//   pigment density       pigment.b, the color darkens towards its square, white paper stays white
+//   edge darkening        edge.r, a difference of gaussians of the luminance and the depth darkens the edges. The
+//                         gaussian is separable and runs at half resolution in two passes
+//   granulation           pigment.g, the pigment settles in the valleys of the substrate
+//   substrate distortion  substrate.r, the image is moved along the slope of the substrate
+// The lighting draws into sceneFramebuffer, which has the g-buffer depth for the forward drawn windows. The passes
+// ping-pong between two color targets and the last one writes the bound framebuffer of the caller. Every pass is
+// timed with a query read a few frames later.
+//
+// usage:
+//   glBindFramebuffer(GL_FRAMEBUFFER, stylization.sceneFramebuffer);
+//   ... lighting and windows ...
+//   stylization.apply(controls, depth, substrate, zNear, zFar);  // into framebuffer 0
+class Stylization {
+public:
+    // a POD so the change tracker can watch it
+    struct Settings {
+        bool enabled = true;
+        bool pigmentDensity = true;
+        bool edgeDarkening = true;
+        bool granulation = true;
+        bool substrateDistortion = true;
+        // times the control values
+        float density = 1.0f;
+        float edgeIntensity = 1.0f;
+        float granulationAmount = 0.5f;
+        float distortion = 1.0f; // pixels along the steepest slope of the substrate
+        float budget = 1.0f;     // gpu ms for all passes, the overlay shows the share of every pass
+    } settings;
+
+    unsigned int sceneFramebuffer;
+    float gpuTime[STYLIZE_PASSES]; // ms of the last measurement, 0 for the passes that didn't run
+    int width, height;
+
+    Stylization(int width, int height, unsigned int depthTexture, unsigned int quadVAO, const char* quadVertexPath)
+        : width(width), height(height), quadVAO(quadVAO),
+          pigmentShader(quadVertexPath, "shaders/stylizePigment.frag"),
+          blurShader(quadVertexPath, "shaders/stylizeEdgeBlur.frag"),
+          edgeShader(quadVertexPath, "shaders/stylizeEdges.frag"),
+          granulationShader(quadVertexPath, "shaders/stylizeGranulation.frag"),
+          distortionShader(quadVertexPath, "shaders/stylizeDistortion.frag")
+    {
+        for (int i = 0; i < 2; i++) {
+            colors[i] = createTarget(width, height, GL_RGBA8, GL_RGBA);
+            colorFramebuffers[i] = createFramebuffer(colors[i], 0);
+            // luminance and linear depth
+            blurs[i] = createTarget(width / 2, height / 2, GL_RG16F, GL_RG);
+            blurFramebuffers[i] = createFramebuffer(blurs[i], 0);
+        }
+        sceneFramebuffer = createFramebuffer(colors[0], depthTexture);
+        glGenQueries(STYLIZE_PASSES, timers);
+        for (int i = 0; i < STYLIZE_PASSES; i++) {
+            gpuTime[i] = 0.0f;
+            timerPending[i] = false;
+        }
+
+        // the samplers: the image on 0, the controls and the depth after it
+        pigmentShader.use();
+        pigmentShader.setInt("colorTexture", 0);
+        pigmentShader.setInt("pigmentCtrl", 1);
+        blurShader.use();
+        blurShader.setInt("source", 0);
+        blurShader.setInt("depthTexture", 1);
+        edgeShader.use();
+        edgeShader.setInt("colorTexture", 0);
+        edgeShader.setInt("blurTexture", 1);
+        edgeShader.setInt("depthTexture", 2);
+        edgeShader.setInt("edgeCtrl", 3);
+        granulationShader.use();
+        granulationShader.setInt("colorTexture", 0);
+        granulationShader.setInt("pigmentCtrl", 1);
+        granulationShader.setInt("substrate", 2);
+        distortionShader.use();
+        distortionShader.setInt("colorTexture", 0);
+        distortionShader.setInt("substrateCtrl", 1);
+        distortionShader.setInt("substrate", 2);
+    }
+
+    ~Stylization()
+    {
+        glDeleteFramebuffers(1, &sceneFramebuffer);
+        glDeleteFramebuffers(2, colorFramebuffers);
+        glDeleteFramebuffers(2, blurFramebuffers);
+        glDeleteTextures(2, colors);
+        glDeleteTextures(2, blurs);
+        glDeleteQueries(STYLIZE_PASSES, timers);
+    }
+
+    static const char* passName(int pass)
+    {
+        static const char* names[STYLIZE_PASSES] = {"pigment density", "edge blur x", "edge blur y", "edge darkening",
+                                                    "granulation", "substrate distortion"};
+        return names[pass];
+    }
+
+    // controls are the pigment, substrate and edge targets of the g-buffer, substrate a tileable height texture
+    void apply(const unsigned int controls[3], unsigned int depthTexture, unsigned int substrate, float zNear,
+               float zFar)
+    {
+        readTimers();
+        GLint target = 0, viewport[4];
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+        glDisable(GL_DEPTH_TEST);
+        glBindVertexArray(quadVAO);
+
+        bool enabled[STYLIZE_PASSES] = {settings.pigmentDensity, settings.edgeDarkening, settings.edgeDarkening,
+                                        settings.edgeDarkening, settings.granulation, settings.substrateDistortion};
+        int lastColorPass = -1;
+        for (int pass = 0; pass < STYLIZE_PASSES; pass++)
+            if (enabled[pass] && pass != STYLIZE_EDGE_BLUR_X && pass != STYLIZE_EDGE_BLUR_Y)
+                lastColorPass = pass;
+        glm::vec2 substrateScale = glm::vec2(width, height) / textureSize(substrate);
+
+        int current = 0; // the color target with the image so far
+        for (int pass = 0; pass < STYLIZE_PASSES; pass++) {
+            gpuTime[pass] = enabled[pass] ? gpuTime[pass] : 0.0f;
+            if (!enabled[pass])
+                continue;
+            bool measure = !timerPending[pass];
+            if (measure)
+                glBeginQuery(GL_TIME_ELAPSED, timers[pass]);
+            // the blurs write their own targets, the rest the next color target or the caller's framebuffer
+            if (pass == STYLIZE_EDGE_BLUR_X || pass == STYLIZE_EDGE_BLUR_Y) {
+                int blur = pass == STYLIZE_EDGE_BLUR_X ? 0 : 1;
+                glBindFramebuffer(GL_FRAMEBUFFER, blurFramebuffers[blur]);
+                glViewport(0, 0, width / 2, height / 2);
+            } else if (pass == lastColorPass) {
+                glBindFramebuffer(GL_FRAMEBUFFER, target);
+                glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+            } else {
+                glBindFramebuffer(GL_FRAMEBUFFER, colorFramebuffers[1 - current]);
+                glViewport(0, 0, width, height);
+            }
+
+            switch (pass) {
+                case STYLIZE_PIGMENT_DENSITY:
+                    pigmentShader.use();
+                    pigmentShader.setFloat("density", settings.density);
+                    bind(colors[current], controls[0], 0, 0);
+                    break;
+                case STYLIZE_EDGE_BLUR_X:
+                    // every other texel of the full resolution image
+                    blurShader.use();
+                    blurShader.setBool("fromScene", true);
+                    blurShader.setVec2("direction", glm::vec2(2.0f / width, 0.0f));
+                    blurShader.setFloat("zNear", zNear);
+                    blurShader.setFloat("zFar", zFar);
+                    bind(colors[current], depthTexture, 0, 0);
+                    break;
+                case STYLIZE_EDGE_BLUR_Y:
+                    blurShader.use();
+                    blurShader.setBool("fromScene", false);
+                    blurShader.setVec2("direction", glm::vec2(0.0f, 2.0f / height));
+                    bind(blurs[0], 0, 0, 0);
+                    break;
+                case STYLIZE_EDGE_DARKENING:
+                    edgeShader.use();
+                    edgeShader.setFloat("edgeIntensity", settings.edgeIntensity);
+                    edgeShader.setFloat("zNear", zNear);
+                    edgeShader.setFloat("zFar", zFar);
+                    bind(colors[current], blurs[1], depthTexture, controls[2]);
+                    break;
+                case STYLIZE_GRANULATION:
+                    granulationShader.use();
+                    granulationShader.setFloat("granulation", settings.granulationAmount);
+                    granulationShader.setVec2("substrateScale", substrateScale);
+                    bind(colors[current], controls[0], substrate, 0);
+                    break;
+                case STYLIZE_SUBSTRATE_DISTORTION:
+                    distortionShader.use();
+                    distortionShader.setFloat("distortion", settings.distortion);
+                    distortionShader.setVec2("substrateScale", substrateScale);
+                    distortionShader.setVec2("texelSize", glm::vec2(1.0f / width, 1.0f / height));
+                    bind(colors[current], controls[1], substrate, 0);
+                    break;
+            }
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+            if (pass != STYLIZE_EDGE_BLUR_X && pass != STYLIZE_EDGE_BLUR_Y)
+                current = 1 - current;
+            if (measure) {
+                glEndQuery(GL_TIME_ELAPSED);
+                timerPending[pass] = true;
+            }
+        }
+
+        // every pass is off, the lit image goes to the screen as it is
+        if (lastColorPass < 0) {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, colorFramebuffers[0]);
+            glBindFramebuffer(GL_DRAW_FRAMEBUFFER, target);
+            glBlitFramebuffer(0, 0, width, height, viewport[0], viewport[1], viewport[0] + viewport[2],
+                              viewport[1] + viewport[3], GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+        if (depthTest)
+            glEnable(GL_DEPTH_TEST);
+    }
+
+    float totalTime() const
+    {
+        float total = 0.0f;
+        for (int i = 0; i < STYLIZE_PASSES; i++)
+            total += gpuTime[i];
+        return total;
+    }
+
+private:
+    unsigned int quadVAO;
+    unsigned int colors[2], colorFramebuffers[2];
+    unsigned int blurs[2], blurFramebuffers[2];
+    unsigned int timers[STYLIZE_PASSES];
+    bool timerPending[STYLIZE_PASSES];
+    Shader pigmentShader, blurShader, edgeShader, granulationShader, distortionShader;
+
+    // one measurement per pass at a time, never waits for a result
+    void readTimers()
+    {
+        for (int i = 0; i < STYLIZE_PASSES; i++) {
+            if (!timerPending[i])
+                continue;
+            GLint available = 0;
+            glGetQueryObjectiv(timers[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue;
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(timers[i], GL_QUERY_RESULT, &elapsed);
+            gpuTime[i] = (float) elapsed / 1000000.0f;
+            timerPending[i] = false;
+        }
+    }
+
+    // the textures of units 0 to 3, 0 leaves a unit alone
+    static void bind(unsigned int unit0, unsigned int unit1, unsigned int unit2, unsigned int unit3)
+    {
+        unsigned int textures[4] = {unit0, unit1, unit2, unit3};
+        for (int i = 0; i < 4; i++) {
+            if (textures[i] == 0)
+                continue;
+            glActiveTexture(GL_TEXTURE0 + i);
+            glBindTexture(GL_TEXTURE_2D, textures[i]);
+        }
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    static glm::vec2 textureSize(unsigned int texture)
+    {
+        GLint size[2] = {1, 1};
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &size[0]);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &size[1]);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return glm::vec2(size[0], size[1]);
+    }
+
+    static unsigned int createTarget(int width, int height, GLenum internalFormat, GLenum format)
+    {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, NULL);
+        // the distortion and the half resolution blur read between the texels
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return texture;
+    }
+
+    static unsigned int createFramebuffer(unsigned int color, unsigned int depthTexture)
+    {
+        unsigned int framebuffer;
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+        if (depthTexture != 0)
+            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::STYLIZATION FRAMEBUFFER:: Framebuffer is not complete" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        return framebuffer;
+    }
+};
+#endif
@@ -0,0 +1,152 @@
+#ifndef WEIGHTEDOIT_H
+#define WEIGHTEDOIT_H
+
+#include <glad/glad.h>
+
+#include "shader.h"
+
+#include <iostream>
+
+// Weighted blended order independent transparency (McGuire and Bavoil 2013). The transparent surfaces are drawn
+// once, in any order, into two float targets that share the depth of the opaque pass:
+//   accumulation  rgba16f  rgb sum of the premultiplied colors times their weight, a product of (1 - alpha), the revealage
+//   weight        r16f     sum of the alphas times their weight
+// Both targets use the same separate blend function (add the rgb, multiply the alpha by 1 - alpha), so it needs no
+// per target blending and runs on GL 3.3. The composite pass divides out the weights and blends the average color
+// over the opaque image with the coverage 1 - revealage, its cost doesn't depend on how many layers were drawn.
+// The shaders write the targets when their oitPass uniform is set, see watercolor.frag.
+//
+// usage:
+//   oit.begin();                 // before the transparent draws, clears the targets the first time in a frame
+//   ... transparent draws with oitPass = true, depth test on and depth writes off ...
+//   oit.end();                   // back to the target framebuffer, can be followed by another begin
+//   oit.composite();             // once after all transparent draws, nothing happens if begin wasn't called
+class WeightedOIT {
+public:
+    unsigned int framebuffer, accumTexture, weightTexture;
+    // the framebuffer of the opaque pass, end() goes back to it and composite() blends into it
+    unsigned int target;
+
+    // target is the framebuffer the opaque pass draws into, depthTexture its depth attachment
+    WeightedOIT(int width, int height, unsigned int target, unsigned int depthTexture, unsigned int quadVAO,
+                const char *quadVertexPath)
+        : target(target), quadVAO(quadVAO), compositeShader(quadVertexPath, "shaders/oitComposite.frag")
+    {
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        accumTexture = createTarget(width, height, GL_RGBA16F, GL_RGBA);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumTexture, 0);
+        weightTexture = createTarget(width, height, GL_R16F, GL_RED);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, weightTexture, 0);
+        unsigned int attachments[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+        glDrawBuffers(2, attachments);
+        // the transparent surfaces are tested against the opaque ones, nothing is copied
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::OIT FRAMEBUFFER:: Framebuffer is not complete" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+
+        compositeShader.use();
+        compositeShader.setInt("accumTexture", 0);
+        compositeShader.setInt("weightTexture", 1);
+    }
+
+    ~WeightedOIT()
+    {
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteTextures(1, &accumTexture);
+        glDeleteTextures(1, &weightTexture);
+    }
+
+    void begin()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        if (!drawn) {
+            // no revealage is the neutral element of the product, no weight of the sums
+            const float accumClear[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+            const float weightClear[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+            glClearBufferfv(GL_COLOR, 0, accumClear);
+            glClearBufferfv(GL_COLOR, 1, weightClear);
+            drawn = true;
+        }
+        if (!active)
+            saveBlend();
+        active = true;
+        glEnable(GL_BLEND);
+        glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+    }
+
+    void end()
+    {
+        if (!active)
+            return;
+        active = false;
+        restoreBlend();
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+    }
+
+    // blends the resolved transparent layers over the target, the depth test is off for it
+    void composite()
+    {
+        end();
+        if (!drawn)
+            return;
+        drawn = false;
+        GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+        saveBlend();
+        glDisable(GL_DEPTH_TEST);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        compositeShader.use();
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, accumTexture);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, weightTexture);
+        glActiveTexture(GL_TEXTURE0);
+        glBindVertexArray(quadVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+        glBindVertexArray(0);
+        restoreBlend();
+        if (depthTest)
+            glEnable(GL_DEPTH_TEST);
+    }
+
+private:
+    unsigned int quadVAO;
+    Shader compositeShader;
+    bool drawn = false, active = false;
+    GLboolean blendEnabled = GL_FALSE;
+    GLint blendSrcRGB = GL_ONE, blendDstRGB = GL_ZERO, blendSrcAlpha = GL_ONE, blendDstAlpha = GL_ZERO;
+
+    static unsigned int createTarget(int width, int height, GLenum internalFormat, GLenum format)
+    {
+        unsigned int texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_HALF_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return texture;
+    }
+
+    // the rest of the frame keeps whatever blending it had set up
+    void saveBlend()
+    {
+        blendEnabled = glIsEnabled(GL_BLEND);
+        glGetIntegerv(GL_BLEND_SRC_RGB, &blendSrcRGB);
+        glGetIntegerv(GL_BLEND_DST_RGB, &blendDstRGB);
+        glGetIntegerv(GL_BLEND_SRC_ALPHA, &blendSrcAlpha);
+        glGetIntegerv(GL_BLEND_DST_ALPHA, &blendDstAlpha);
+    }
+
+    void restoreBlend()
+    {
+        glBlendFuncSeparate(blendSrcRGB, blendDstRGB, blendSrcAlpha, blendDstAlpha);
+        if (blendEnabled)
+            glEnable(GL_BLEND);
+        else
+            glDisable(GL_BLEND);
+    }
+};
+#endif